@@ -0,0 +1,54 @@
+#include "bench.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// The global allocation functions of the bench binary, counting the
+// allocations and their bytes for `Bench::Allocs`.
+
+static std::atomic<size_t> n_alloc{0};
+static std::atomic<size_t> n_alloc_bytes{0};
+
+Bench::Allocs Bench::Allocs::Now() {
+    return {n_alloc.load(std::memory_order_relaxed),
+            n_alloc_bytes.load(std::memory_order_relaxed)};
+}
+
+static void *counted_alloc(size_t size, size_t align) {
+    n_alloc.fetch_add(1, std::memory_order_relaxed);
+    n_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    const size_t n = (size + align - 1) / align * align;
+    void *p = align <= alignof(std::max_align_t)
+                  ? std::malloc(size == 0 ? 1 : size)
+                  : std::aligned_alloc(align, n);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new(size_t size) {
+    return counted_alloc(size, alignof(std::max_align_t));
+}
+void *operator new[](size_t size) {
+    return counted_alloc(size, alignof(std::max_align_t));
+}
+void *operator new(size_t size, std::align_val_t align) {
+    return counted_alloc(size, static_cast<size_t>(align));
+}
+void *operator new[](size_t size, std::align_val_t align) {
+    return counted_alloc(size, static_cast<size_t>(align));
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Minimal microbenchmark harness.
+//
+// A case is a function running `n` iterations of the measured operation. The
+// harness doubles `n` until a run lasts long enough to be timed reliably and
+// reports the time per iteration, the throughput if the case processes
+// bytes, and the heap allocations per iteration: their number and bytes, as
+// counted by the allocation functions of the bench binary. A case may add a
+// note of its own to its results, e.g. a compression ratio.
+//
+// A check verifies that optimized code agrees with its reference before
+// anything is timed; it returns an error message, empty on success.
+//
+// Example:
+//
+// ```
+// static Bench::Register reg("parser/get", kReq.size(), [](size_t n) {
+//     for (size_t i = 0; i < n; ++i) {
+//         Bench::DoNotOptimize(parse(kReq));
+//     }
+// });
+// ```
+namespace Bench {
+
+    // Keep `value` alive so the compiler cannot elide its computation.
+    template <typename T> inline void DoNotOptimize(const T &value) {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    // Heap allocations made by the program so far.
+    struct Allocs {
+        size_t count;
+        size_t bytes;
+
+        static Allocs Now();
+    };
+
+    struct Case {
+        std::string name;
+        size_t bytes; // bytes processed per iteration, 0 if not meaningful
+        std::function<void(size_t)> fn;
+        std::function<std::string()> note; // may be empty
+    };
+
+    inline std::vector<Case> &registry() {
+        static std::vector<Case> cases;
+        return cases;
+    }
+
+    struct Register {
+        Register(const std::string &name, size_t bytes,
+                 std::function<void(size_t)> fn,
+                 std::function<std::string()> note = {}) {
+            registry().push_back(
+                {name, bytes, std::move(fn), std::move(note)});
+        }
+    };
+
+    struct Check {
+        std::string name;
+        std::function<std::string()> fn;
+    };
+
+    inline std::vector<Check> &checks() {
+        static std::vector<Check> items;
+        return items;
+    }
+
+    struct RegisterCheck {
+        RegisterCheck(const std::string &name,
+                      std::function<std::string()> fn) {
+            checks().push_back({name, std::move(fn)});
+        }
+    };
+
+    // `str` as a JSON string.
+    inline std::string JsonString(std::string_view str) {
+        std::string out = "\"";
+        for (const char c : str) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char esc[8];
+                std::snprintf(esc, sizeof(esc), "\\u%04x", c);
+                out += esc;
+            } else {
+                out += c;
+            }
+        }
+        return out += '"';
+    }
+
+    // Run every registered check and case whose name contains `filter`.
+    // Return false, without timing anything, if a check fails.
+    // Results are printed as a table, or with `json` as one JSON object to
+    // compare between builds:
+    // {"checks": [{"name", "error"}...], "cases": [{"name", "iterations",
+    //  "ns_per_op", "mb_per_s", "allocs_per_op", "bytes_per_op",
+    //  "note"}...]}
+    inline bool RunAll(std::string_view filter, bool json = false) {
+        using Clock = std::chrono::steady_clock;
+        constexpr auto kMinTime = std::chrono::milliseconds(200);
+
+        const char *sep = "";
+        if (json) {
+            std::printf("{\n  \"checks\": [");
+        }
+        bool ok = true;
+        for (const Check &c : checks()) {
+            if (c.name.find(filter) == std::string::npos) {
+                continue;
+            }
+            const std::string err = c.fn();
+            if (json) {
+                std::printf("%s\n    {\"name\": %s, \"error\": %s}", sep,
+                            JsonString(c.name).c_str(),
+                            JsonString(err).c_str());
+                sep = ",";
+            } else {
+                std::printf("check %-34s %s\n", c.name.c_str(),
+                            err.empty() ? "ok" : err.c_str());
+            }
+            if (!err.empty()) {
+                ok = false;
+                break;
+            }
+        }
+        if (json) {
+            std::printf("\n  ],\n  \"cases\": [");
+        } else if (ok) {
+            std::printf("%-40s %12s %12s %10s %10s %10s\n", "case",
+                        "iterations", "ns/op", "MB/s", "allocs/op", "B/op");
+        }
+
+        sep = "";
+        for (const Case &c : registry()) {
+            if (!ok) {
+                break;
+            }
+            if (c.name.find(filter) == std::string::npos) {
+                continue;
+            }
+            c.fn(1); // warm up caches and lazily initialized state
+            size_t n = 1;
+            Clock::duration elapsed;
+            Allocs allocs;
+            for (;;) {
+                const Allocs before = Allocs::Now();
+                const auto beg = Clock::now();
+                c.fn(n);
+                elapsed = Clock::now() - beg;
+                const Allocs after = Allocs::Now();
+                allocs = {after.count - before.count,
+                          after.bytes - before.bytes};
+                if (elapsed >= kMinTime) {
+                    break;
+                }
+                n *= 2;
+            }
+            const double iters = static_cast<double>(n);
+            const double ns =
+                std::chrono::duration<double, std::nano>(elapsed).count();
+            const double ns_op = ns / iters;
+            const double mb_s =
+                c.bytes > 0 ? static_cast<double>(c.bytes) * 1e3 / ns_op : 0;
+            const double allocs_op = static_cast<double>(allocs.count) / iters;
+            const double bytes_op = static_cast<double>(allocs.bytes) / iters;
+            const std::string note = c.note ? c.note() : std::string();
+            if (json) {
+                std::printf("%s\n    {\"name\": %s, \"iterations\": %zu, "
+                            "\"ns_per_op\": %.2f, \"mb_per_s\": %.1f, "
+                            "\"allocs_per_op\": %.2f, "
+                            "\"bytes_per_op\": %.1f, \"note\": %s}",
+                            sep, JsonString(c.name).c_str(), n, ns_op, mb_s,
+                            allocs_op, bytes_op, JsonString(note).c_str());
+                sep = ",";
+            } else {
+                std::printf("%-40s %12zu %12.1f %10.1f %10.2f %10.1f  %s\n",
+                            c.name.c_str(), n, ns_op, mb_s, allocs_op,
+                            bytes_op, note.c_str());
+            }
+            std::fflush(stdout);
+        }
+        if (json) {
+            std::printf("\n  ]\n}\n");
+        }
+        return ok;
+    }
+
+} // namespace Bench
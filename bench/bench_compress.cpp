@@ -0,0 +1,186 @@
+#include "bench.hpp"
+#include "compress.hpp"
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+// Synthetic assets of about 64 KiB: a stylesheet, a script and a JSON
+// document, built from a small vocabulary as real ones are, so that they
+// compress about as well.
+namespace {
+
+    constexpr size_t kAssetSize = 64 * 1024;
+
+    constexpr std::array<const char *, 16> kWords = {
+        "button", "header", "content", "sidebar", "primary", "active",
+        "item",   "list",   "modal",   "footer",  "nav",     "card",
+        "user",   "title",  "input",   "toggle"};
+
+    // Deterministic pseudo-random numbers.
+    struct Rng {
+        uint32_t state = 12345;
+        uint32_t operator()(uint32_t n) {
+            state = state * 1664525u + 1013904223u;
+            return (state >> 8) % n;
+        }
+    };
+
+    std::string css() {
+        Rng rng;
+        std::string out;
+        char buf[256];
+        while (out.size() < kAssetSize) {
+            std::snprintf(buf, sizeof(buf),
+                          ".%s-%s-%u {\n  color: #%06x;\n  margin: %upx "
+                          "%upx;\n  padding: 0 %upx;\n  border-radius: "
+                          "%upx;\n}\n",
+                          kWords[rng(16)], kWords[rng(16)], rng(100),
+                          rng(0x1000000), rng(32), rng(32), rng(16), rng(8));
+            out += buf;
+        }
+        return out;
+    }
+
+    std::string js() {
+        Rng rng;
+        std::string out;
+        char buf[256];
+        while (out.size() < kAssetSize) {
+            const char *a = kWords[rng(16)];
+            const char *b = kWords[rng(16)];
+            std::snprintf(buf, sizeof(buf),
+                          "function update_%s_%s(el, state) {\n  if "
+                          "(state.%s > %u) {\n    el.classList.add('%s');\n  "
+                          "}\n  return render(el, state.%s);\n}\n",
+                          a, b, a, rng(1000), b, b);
+            out += buf;
+        }
+        return out;
+    }
+
+    std::string json() {
+        Rng rng;
+        std::string out = "[";
+        char buf[256];
+        for (uint32_t id = 0; out.size() < kAssetSize; ++id) {
+            std::snprintf(buf, sizeof(buf),
+                          "%s{\"id\":%u,\"name\":\"%s %s\",\"active\":%s,"
+                          "\"score\":%u,\"tags\":[\"%s\",\"%s\"]}",
+                          id > 0 ? "," : "", id, kWords[rng(16)],
+                          kWords[rng(16)], rng(2) ? "true" : "false",
+                          rng(10000), kWords[rng(16)], kWords[rng(16)]);
+            out += buf;
+        }
+        return out + "]";
+    }
+
+    enum class Asset { Css, Js, Json };
+
+    const std::string &asset(Asset kind) {
+        static const std::string kCss = css();
+        static const std::string kJs = js();
+        static const std::string kJson = json();
+        return kind == Asset::Css ? kCss : kind == Asset::Js ? kJs : kJson;
+    }
+
+} // namespace
+
+// Accept-Encoding values are parsed as browsers and proxies send them, and
+// what is encoded decodes back.
+static std::string check_codings() {
+    using Compress::bit;
+    using Compress::Coding;
+    const Compress::Codings all =
+        bit(Coding::Gzip) | bit(Coding::Deflate) | bit(Coding::Br);
+    const struct {
+        const char *accept;
+        Compress::Codings expected;
+    } cases[] = {
+        {"", 0},
+        {"gzip, deflate, br, zstd", all},
+        {"GZIP;q=1.0, identity; q=0.5, *;q=0", bit(Coding::Gzip)},
+        {"br;q=0, gzip;q=0.000, deflate;q=0.001", bit(Coding::Deflate)},
+        {"x-gzip", bit(Coding::Gzip)},
+        {"*", all},
+        {"br;q=0,*", bit(Coding::Gzip) | bit(Coding::Deflate)},
+        {"identity", 0},
+    };
+    for (const auto &c : cases) {
+        if (Compress::Accepted(c.accept) != c.expected) {
+            return std::string("wrong codings for \"") + c.accept + "\"";
+        }
+    }
+
+    for (const Coding coding : {Coding::Gzip, Coding::Deflate}) {
+        const std::string encoded = Compress::Encode(asset(Asset::Css), coding);
+        if (encoded.empty() || encoded.size() >= asset(Asset::Css).size()) {
+            return std::string(Compress::name(coding)) + " does not compress";
+        }
+        if (Compress::Decode(encoded, coding) != asset(Asset::Css)) {
+            return std::string(Compress::name(coding)) + " does not round-trip";
+        }
+    }
+    const std::string gzip = Compress::Encode("hello", Coding::Gzip);
+    if (gzip.size() < 2 || gzip[0] != '\x1f' || gzip[1] != '\x8b') {
+        return "gzip header missing";
+    }
+    return "";
+}
+
+static Bench::RegisterCheck check("compress/codings", check_codings);
+
+// Negotiating the coding of a request from a browser.
+static void bench_accept(size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        Bench::DoNotOptimize(Compress::Accepted("gzip, deflate, br, zstd"));
+    }
+}
+
+static Bench::Register reg_accept("compress/accept", 0, bench_accept);
+
+// Compressing an asset on its first request: its MB/s is the CPU cost, its
+// note the bytes saved on the wire by every later request.
+static std::function<void(size_t)> encode(Asset kind, Compress::Coding coding,
+                                          int level) {
+    return [=](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            Bench::DoNotOptimize(Compress::Encode(asset(kind), coding, level));
+        }
+    };
+}
+
+static std::function<std::string()> saved(Asset kind, Compress::Coding coding,
+                                          int level) {
+    return [=] {
+        const size_t raw = asset(kind).size();
+        const size_t wire = Compress::Encode(asset(kind), coding, level).size();
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "%zu -> %zu B, %.1f%% saved", raw,
+                      wire,
+                      100.0 * static_cast<double>(raw - wire) /
+                          static_cast<double>(raw));
+        return std::string(buf);
+    };
+}
+
+using Compress::Coding;
+static Bench::Register reg_gzip1("compress/gzip1_css", kAssetSize,
+                                 encode(Asset::Css, Coding::Gzip, 1),
+                                 saved(Asset::Css, Coding::Gzip, 1));
+static Bench::Register reg_gzip6("compress/gzip6_css", kAssetSize,
+                                 encode(Asset::Css, Coding::Gzip, 6),
+                                 saved(Asset::Css, Coding::Gzip, 6));
+static Bench::Register reg_gzip9("compress/gzip9_css", kAssetSize,
+                                 encode(Asset::Css, Coding::Gzip, 9),
+                                 saved(Asset::Css, Coding::Gzip, 9));
+static Bench::Register reg_deflate6("compress/deflate6_css", kAssetSize,
+                                    encode(Asset::Css, Coding::Deflate, 6),
+                                    saved(Asset::Css, Coding::Deflate, 6));
+static Bench::Register reg_gzip6_js("compress/gzip6_js", kAssetSize,
+                                    encode(Asset::Js, Coding::Gzip, 6),
+                                    saved(Asset::Js, Coding::Gzip, 6));
+static Bench::Register reg_gzip6_json("compress/gzip6_json", kAssetSize,
+                                      encode(Asset::Json, Coding::Gzip, 6),
+                                      saved(Asset::Json, Coding::Gzip, 6));
@@ -0,0 +1,125 @@
+#include "bench.hpp"
+#include "httpcond.hpp"
+#include "httpdate.hpp"
+#include <string>
+
+// Validators of a file of 1000 bytes modified at 784111777, i.e.
+// "Sun, 06 Nov 1994 08:49:37 GMT".
+static const HttpCond::Validators &validators() {
+    static const HttpCond::Validators v =
+        HttpCond::Make(timespec{784111777, 5}, 1000);
+    return v;
+}
+
+// Preconditions and ranges are answered as RFC 9110 has them.
+static std::string check_evaluate() {
+    using HttpCond::Outcome;
+    const HttpCond::Validators &v = validators();
+    if (v.etag != "\"2ebc98a1.5-3e8\"" ||
+        v.lines != "ETag: \"2ebc98a1.5-3e8\"\r\n"
+                   "Last-Modified: Sun, 06 Nov 1994 08:49:37 GMT\r\n") {
+        return "wrong validators: " + v.lines;
+    }
+    std::time_t t = 0;
+    if (!HttpDate::Parse("Sun, 06 Nov 1994 08:49:37 GMT", t) ||
+        t != 784111777 ||
+        HttpDate::Parse("Sunday, 06-Nov-94 08:49:37 GMT", t)) {
+        return "wrong date parsing";
+    }
+
+    const std::string etag = v.etag;
+    const struct {
+        const char *inm, *ims, *range, *if_range;
+        Outcome outcome;
+        size_t n, offset, length; // of the ranges, and of the last one
+    } cases[] = {
+        {"", "", "", "", Outcome::Full, 0, 0, 0},
+        {etag.c_str(), "", "", "", Outcome::NotModified, 0, 0, 0},
+        {"\"x\", W/\"2ebc98a1.5-3e8\"", "", "", "", Outcome::NotModified, 0, 0,
+         0},
+        {"*", "", "", "", Outcome::NotModified, 0, 0, 0},
+        // If-None-Match wins over If-Modified-Since
+        {"\"x\"", "Sun, 06 Nov 1994 08:49:37 GMT", "", "", Outcome::Full, 0, 0,
+         0},
+        {"", "Sun, 06 Nov 1994 08:49:37 GMT", "", "", Outcome::NotModified, 0,
+         0, 0},
+        {"", "Sun, 06 Nov 1994 08:49:36 GMT", "", "", Outcome::Full, 0, 0, 0},
+        {"", "yesterday", "", "", Outcome::Full, 0, 0, 0},
+        {"", "", "bytes=0-99", "", Outcome::Partial, 1, 0, 100},
+        {"", "", "bytes=900-", "", Outcome::Partial, 1, 900, 100},
+        {"", "", "bytes=-10", "", Outcome::Partial, 1, 990, 10},
+        {"", "", "bytes=-5000", "", Outcome::Partial, 1, 0, 1000},
+        {"", "", "bytes=990-99999999999999999999999", "", Outcome::Partial, 1,
+         990, 10},
+        {"", "", "Bytes=0-0, 5-9 ,1000-", "", Outcome::Partial, 2, 5, 5},
+        {"", "", "bytes=1000-", "", Outcome::Unsatisfiable, 0, 0, 0},
+        {"", "", "bytes=9-5", "", Outcome::Full, 0, 0, 0},
+        {"", "", "lines=0-5", "", Outcome::Full, 0, 0, 0},
+        {"", "", "bytes=0-1,2-3,4-5,6-7,8-9,10-11,12-13,14-15,16-17", "",
+         Outcome::Partial, 9, 16, 2},
+        {"", "", "bytes=0-99", etag.c_str(), Outcome::Partial, 1, 0, 100},
+        {"", "", "bytes=0-99", "\"x\"", Outcome::Full, 0, 0, 0},
+        {"", "", "bytes=0-99", "W/\"2ebc98a1.5-3e8\"", Outcome::Full, 0, 0, 0},
+        {"", "", "bytes=0-99", "Sun, 06 Nov 1994 08:49:37 GMT",
+         Outcome::Partial, 1, 0, 100},
+    };
+    HttpCond::Ranges ranges;
+    for (const auto &c : cases) {
+        const Outcome outcome = HttpCond::Evaluate(v, 1000, c.inm, c.ims,
+                                                   c.range, c.if_range, ranges);
+        if (outcome != c.outcome ||
+            (outcome == Outcome::Partial &&
+             (ranges.n != c.n || ranges.parts[c.n - 1].offset != c.offset ||
+              ranges.parts[c.n - 1].length != c.length))) {
+            return std::string("wrong answer to \"") + c.inm + "\" \"" +
+                   c.ims + "\" \"" + c.range + "\" \"" + c.if_range + "\"";
+        }
+    }
+    std::string many;
+    many.reserve(16 + HttpCond::kMaxRanges * 8);
+    many += "bytes=0-0";
+    for (size_t i = 1; i <= HttpCond::kMaxRanges; ++i) {
+        const std::string n = std::to_string(i);
+        many += ',';
+        many += n;
+        many += '-';
+        many += n;
+    }
+    if (HttpCond::ParseRanges(many, 1000, ranges) != Outcome::Full) {
+        return "too many ranges served";
+    }
+
+    std::string out;
+    HttpCond::AppendContentRange(out, {990, 10}, 1000);
+    HttpCond::AppendUnsatisfied(out, 1000);
+    if (out != "Content-Range: bytes 990-999/1000\r\n"
+               "Content-Range: bytes */1000\r\n") {
+        return "wrong Content-Range: " + out;
+    }
+    return "";
+}
+
+static Bench::RegisterCheck check("cond/evaluate", check_evaluate);
+
+// Revalidating a cached asset: a 304 or, tag changed, a 200.
+static void bench_revalidate(size_t n) {
+    HttpCond::Ranges ranges;
+    for (size_t i = 0; i < n; ++i) {
+        Bench::DoNotOptimize(HttpCond::Evaluate(
+            validators(), 1000, "\"2ebc98a1.5-3e8\"", "", "", "", ranges));
+    }
+}
+
+static Bench::Register reg_revalidate("cond/revalidate", 0, bench_revalidate);
+
+// Resuming a download, as browsers do.
+static void bench_range(size_t n) {
+    HttpCond::Ranges ranges;
+    for (size_t i = 0; i < n; ++i) {
+        Bench::DoNotOptimize(
+            HttpCond::Evaluate(validators(), 1000, "", "", "bytes=500-",
+                               "\"2ebc98a1.5-3e8\"", ranges));
+    }
+}
+
+static Bench::Register reg_range("cond/range", 0, bench_range);
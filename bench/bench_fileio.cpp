@@ -0,0 +1,87 @@
+#include "bench.hpp"
+#include "fileio.hpp"
+#include "utils.hpp"
+#include <asio.hpp>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Reads in flight at once in the check, past the completion queue of a ring
+// so that some wait for room, of a file not a whole number of pages long.
+static constexpr size_t kConcurrent = 1000;
+static constexpr size_t kCheckSize = 20011;
+
+// A file of `size` bytes that differ with their offset, so that a read put
+// at the wrong place shows.
+static std::filesystem::path pattern_file(size_t size) {
+    const std::filesystem::path path =
+        std::filesystem::temp_directory_path() /
+        ("fasterapi-bench-fileio-" + std::to_string(size));
+    std::string cont(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+        cont[i] = static_cast<char>('a' + i % 251 % 26);
+    }
+    std::ofstream(path, std::ios::binary) << cont;
+    return path;
+}
+
+static asio::awaitable<void> read_into(int fd, size_t size, std::string &out) {
+    out = co_await FileIo::Read(fd, size);
+}
+
+// Reads of `FileIo::Read`, through io_uring when the build and the kernel
+// allow it, give what pread(2) gives, many of them at once; a bad descriptor
+// gives nothing.
+static std::string check_read() {
+    const std::filesystem::path path = pattern_file(kCheckSize);
+    const Utils::Fd fd = Utils::open_file(path);
+    const std::string expected = Utils::read_fd(fd.get(), kCheckSize);
+    std::filesystem::remove(path);
+
+    asio::io_context ctx(1);
+    std::vector<std::string> got(kConcurrent);
+    std::string bad = "unread";
+    for (std::string &out : got) {
+        asio::co_spawn(ctx, read_into(fd.get(), kCheckSize, out),
+                       asio::detached);
+    }
+    asio::co_spawn(ctx, read_into(-1, kCheckSize, bad), asio::detached);
+    ctx.run();
+
+    if (expected.size() != kCheckSize) {
+        return "pread(2) read " + std::to_string(expected.size()) + " bytes";
+    }
+    for (const std::string &out : got) {
+        if (out != expected) {
+            return "read " + std::to_string(out.size()) +
+                   " bytes, not those of the file (" +
+                   std::string(FileIo::Backend()) + ")";
+        }
+    }
+    if (!bad.empty()) {
+        return "bad descriptor read " + std::to_string(bad.size()) + " bytes";
+    }
+    return "";
+}
+
+static asio::awaitable<void> read_n(int fd, size_t size, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        Bench::DoNotOptimize(co_await FileIo::Read(fd, size));
+    }
+}
+
+// One read at a time, each waited for, as a miss of the file cache is;
+// compare with utils/read_fd.
+template <size_t kSize> static void bench_read(size_t n) {
+    static const std::filesystem::path path = pattern_file(kSize);
+    const Utils::Fd fd = Utils::open_file(path);
+    asio::io_context ctx(1);
+    asio::co_spawn(ctx, read_n(fd.get(), kSize, n), asio::detached);
+    ctx.run();
+}
+
+static Bench::RegisterCheck check_read_("fileio/read", check_read);
+static Bench::Register reg_read_4k("fileio/read/4KiB", 4096, bench_read<4096>);
+static Bench::Register reg_read_256k("fileio/read/256KiB", 256 << 10,
+                                     bench_read<256 << 10>);
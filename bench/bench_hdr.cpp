@@ -0,0 +1,76 @@
+#include "bench.hpp"
+#include "httphdr.hpp"
+#include <array>
+#include <string>
+#include <string_view>
+
+// Conversions between the strings and enums of `HttpHdr` agree both ways.
+static std::string check_roundtrip() {
+    for (uint8_t i = 1; i < HttpHdr::kNMethod; ++i) {
+        const auto m = static_cast<HttpHdr::Method>(i);
+        if (HttpHdr::str2method(HttpHdr::method2str(m)) != m) {
+            return "method " + HttpHdr::method2str(m);
+        }
+    }
+    for (uint8_t i = 1; i < HttpHdr::kNVersion; ++i) {
+        const auto v = static_cast<HttpHdr::Version>(i);
+        if (HttpHdr::str2ver(HttpHdr::ver2str(v)) != v) {
+            return "version " + HttpHdr::ver2str(v);
+        }
+    }
+    for (uint8_t i = 1; i < HttpHdr::kNField; ++i) {
+        const auto f = static_cast<HttpHdr::Field>(i);
+        if (HttpHdr::str2field(HttpHdr::field2str(f)) != f) {
+            return "field " + HttpHdr::field2str(f);
+        }
+    }
+    if (HttpHdr::str2conn("keep-alive") != HttpHdr::Conn::KEEP_ALIVE ||
+        HttpHdr::str2conn("Close") != HttpHdr::Conn::CLOSE ||
+        HttpHdr::ext2conttype("/a/b.JS") !=
+            HttpHdr::ContType::TEXT_JAVASCRIPT ||
+        HttpHdr::ext2conttype("/a/b") !=
+            HttpHdr::ContType::APPLICATION_OCTET_STREAM) {
+        return "connection option or content type";
+    }
+    return "";
+}
+
+static Bench::RegisterCheck check_rt("hdr/roundtrip", check_roundtrip);
+
+// Cycle through `inputs`, converting each with `fn`.
+template <size_t N, typename Fn>
+static void bench_convert(size_t n, const std::array<std::string_view, N> &in,
+                          Fn fn) {
+    for (size_t i = 0; i < n; ++i) {
+        Bench::DoNotOptimize(fn(in[i % N]));
+    }
+}
+
+static constexpr std::array<std::string_view, 4> kMethods = {
+    "GET", "POST", "DELETE", "OPTIONS"};
+static constexpr std::array<std::string_view, 2> kVersions = {"HTTP/1.1",
+                                                              "HTTP/1.0"};
+static constexpr std::array<std::string_view, 3> kConns = {
+    "keep-alive", "close", "Upgrade"};
+static constexpr std::array<std::string_view, 4> kPaths = {
+    "/index.html", "/static/js/app.4f8e2c.js", "/img/logo.png",
+    "/downloads/archive.tar.gz"};
+
+static Bench::Register reg_method("hdr/str2method", 0, [](size_t n) {
+    bench_convert(n, kMethods, HttpHdr::str2method);
+});
+static Bench::Register reg_ver("hdr/str2ver", 0, [](size_t n) {
+    bench_convert(n, kVersions, HttpHdr::str2ver);
+});
+static Bench::Register reg_conn("hdr/str2conn", 0, [](size_t n) {
+    bench_convert(n, kConns, HttpHdr::str2conn);
+});
+static Bench::Register reg_ext("hdr/ext2conttype", 0, [](size_t n) {
+    bench_convert(n, kPaths, HttpHdr::ext2conttype);
+});
+static Bench::Register reg_status("hdr/status_line", 0, [](size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        Bench::DoNotOptimize(HttpHdr::status_line(
+            static_cast<HttpHdr::Status>(i % HttpHdr::kNStatus)));
+    }
+});
@@ -0,0 +1,203 @@
+#include "bench.hpp"
+#include "hpack.hpp"
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using Fields = std::vector<std::pair<std::string, std::string>>;
+
+static std::string hex(std::string_view bytes) {
+    std::string out;
+    char b[3];
+    for (const char c : bytes) {
+        std::snprintf(b, sizeof(b), "%02x", static_cast<unsigned char>(c));
+        out += b;
+    }
+    return out;
+}
+
+static std::string unhex(std::string_view str) {
+    std::string out;
+    for (size_t i = 0; i + 1 < str.size(); i += 2) {
+        out += static_cast<char>(std::stoi(std::string(str.substr(i, 2)),
+                                           nullptr, 16));
+    }
+    return out;
+}
+
+static bool decode(Hpack::Decoder &dec, std::string_view block, Fields &out) {
+    out.clear();
+    return dec.Decode(block,
+                      [&](std::string_view name, std::string_view value) {
+                          out.emplace_back(name, value);
+                      });
+}
+
+// Headers of a typical response to a browser.
+static const Fields kResponse = {
+    {"content-type", "text/html; charset=utf-8"},
+    {"content-length", "10240"},
+    {"etag", "\"65a1b2c3.0-2800\""},
+    {"last-modified", "Fri, 12 Jan 2024 10:20:30 GMT"},
+    {"cache-control", "public, max-age=3600"},
+    {"vary", "Accept-Encoding"},
+    {"content-encoding", "gzip"},
+    {"server", "FasterAPI"},
+};
+
+static void encode(Hpack::Encoder &enc, std::string &out) {
+    enc.Begin(out);
+    enc.Encode(out, ":status", "200");
+    for (const auto &[name, value] : kResponse) {
+        enc.Encode(out, name, value,
+                   name != "content-length" && name != "etag" &&
+                       name != "last-modified");
+    }
+}
+
+// The examples of RFC 7541, appendix C, and blocks of our encoder decode as
+// they should.
+static std::string check_codec() {
+    std::string out;
+    Hpack::HuffmanEncode(out, "www.example.com");
+    if (hex(out) != "f1e3c2e5f23a6ba0ab90f4ff" ||
+        Hpack::HuffmanSize("www.example.com") != 12) {
+        return "wrong Huffman code: " + hex(out);
+    }
+    std::string text;
+    if (!Hpack::HuffmanDecode(out, text) || text != "www.example.com") {
+        return "wrong Huffman decoding: " + text;
+    }
+    // padding longer than 7 bits, or not of ones
+    if (Hpack::HuffmanDecode(unhex("f1e3c2e5f23a6ba0ab90f4ffff"), text) ||
+        Hpack::HuffmanDecode(unhex("1e"), text)) {
+        return "malformed Huffman code decoded";
+    }
+
+    // C.4: requests with Huffman coding, sharing a dynamic table
+    Hpack::Decoder dec;
+    Fields fields;
+    const char *blocks[] = {
+        "828684418cf1e3c2e5f23a6ba0ab90f4ff",
+        "828684be5886a8eb10649cbf",
+        "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf",
+    };
+    const Fields want[] = {
+        {{":method", "GET"},
+         {":scheme", "http"},
+         {":path", "/"},
+         {":authority", "www.example.com"}},
+        {{":method", "GET"},
+         {":scheme", "http"},
+         {":path", "/"},
+         {":authority", "www.example.com"},
+         {"cache-control", "no-cache"}},
+        {{":method", "GET"},
+         {":scheme", "https"},
+         {":path", "/index.html"},
+         {":authority", "www.example.com"},
+         {"custom-key", "custom-value"}},
+    };
+    for (size_t i = 0; i < 3; ++i) {
+        if (!decode(dec, unhex(blocks[i]), fields) || fields != want[i]) {
+            return "wrong decoding of C.4." + std::to_string(i + 1);
+        }
+    }
+    // an index past the table, and a truncated integer
+    Hpack::Decoder bad;
+    if (decode(bad, unhex("c0"), fields) ||
+        decode(bad, unhex("3fff"), fields)) {
+        return "malformed block decoded";
+    }
+
+    // our responses round trip, the repeated fields shrinking to indices
+    Hpack::Encoder enc;
+    Hpack::Decoder peer;
+    Fields expected = {{":status", "200"}};
+    expected.insert(expected.end(), kResponse.begin(), kResponse.end());
+    size_t first = 0;
+    for (int i = 0; i < 3; ++i) {
+        out.clear();
+        encode(enc, out);
+        if (!decode(peer, out, fields) || fields != expected) {
+            return "response does not round trip";
+        }
+        if (i == 0) {
+            first = out.size();
+        } else if (out.size() * 2 > first) {
+            return "repeated response not compressed: " +
+                   std::to_string(out.size()) + " bytes";
+        }
+    }
+    // a smaller table is signalled, and the decoder follows it
+    enc.SetMaxTableSize(0);
+    out.clear();
+    encode(enc, out);
+    if (static_cast<unsigned char>(out[0]) != 0x20 ||
+        !decode(peer, out, fields) || fields != expected) {
+        return "table size update not signalled";
+    }
+    return "";
+}
+
+static Bench::RegisterCheck check("hpack/codec", check_codec);
+
+// Bytes of the second response block, after the first filled the table, as
+// against the HTTP/1 head.
+static std::string note_response() {
+    Hpack::Encoder enc;
+    std::string out;
+    encode(enc, out);
+    const size_t first = out.size();
+    out.clear();
+    encode(enc, out);
+    size_t plain = 17; // status line
+    for (const auto &[name, value] : kResponse) {
+        plain += name.size() + value.size() + 4;
+    }
+    return std::to_string(first) + " then " + std::to_string(out.size()) +
+           " bytes for " + std::to_string(plain) + " of HTTP/1";
+}
+
+// Encoding the head of a response once the table has its fields.
+static void bench_encode(size_t n) {
+    Hpack::Encoder enc;
+    std::string out;
+    for (size_t i = 0; i < n; ++i) {
+        out.clear();
+        encode(enc, out);
+        Bench::DoNotOptimize(out);
+    }
+}
+
+static Bench::Register reg_encode("hpack/encode", 0, bench_encode,
+                                  note_response);
+
+// Decoding the head of a request of a browser, its literals Huffman coded.
+static void bench_decode(size_t n) {
+    Hpack::Encoder enc;
+    std::string block;
+    enc.Begin(block);
+    enc.Encode(block, ":method", "GET");
+    enc.Encode(block, ":scheme", "http");
+    enc.Encode(block, ":path", "/static/app.js");
+    enc.Encode(block, ":authority", "example.com");
+    enc.Encode(block, "user-agent",
+               "Mozilla/5.0 (X11; Linux x86_64; rv:121.0) Gecko/20100101 "
+               "Firefox/121.0");
+    enc.Encode(block, "accept", "*/*");
+    enc.Encode(block, "accept-encoding", "gzip, deflate, br");
+    enc.Encode(block, "accept-language", "en-US,en;q=0.5");
+    Hpack::Decoder dec;
+    size_t size = 0;
+    for (size_t i = 0; i < n; ++i) {
+        dec.Decode(block, [&](std::string_view name, std::string_view value) {
+            size += name.size() + value.size();
+        });
+    }
+    Bench::DoNotOptimize(size);
+}
+
+static Bench::Register reg_decode("hpack/decode", 0, bench_decode);
@@ -0,0 +1,208 @@
+#include "bench.hpp"
+#include "http2.hpp"
+#include "httprsp_listener.hpp"
+#include <algorithm>
+#include <asio.hpp>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <string_view>
+
+// What came back on a stream.
+struct Answer {
+    std::string status;
+    std::string body;
+    bool ended = false;
+    bool refused = false;
+};
+
+// A client speaking h2c with prior knowledge.
+class Client {
+  public:
+    explicit Client(asio::ip::tcp::socket &socket) : socket_(socket) {}
+
+    // Queue the client preface with empty settings.
+    void Preface() {
+        out_ = Http2::kPreface;
+        Http2::AppendFrameHeader(out_, 0, Http2::Type::Settings, 0, 0);
+    }
+
+    // Queue a request head on stream `id`.
+    void Headers(uint32_t id, std::string_view method, std::string_view path,
+                 bool end_stream) {
+        block_.clear();
+        enc_.Begin(block_);
+        enc_.Encode(block_, ":method", method);
+        enc_.Encode(block_, ":scheme", "http");
+        enc_.Encode(block_, ":path", path);
+        enc_.Encode(block_, ":authority", "x");
+        Http2::AppendFrameHeader(
+            out_, block_.size(), Http2::Type::Headers,
+            Http2::kEndHeaders | (end_stream ? Http2::kEndStream : 0), id);
+        out_ += block_;
+    }
+
+    // Queue `size` bytes of body on stream `id` in frames of the default
+    // size.
+    void Data(uint32_t id, size_t size, bool end_stream) {
+        do {
+            const size_t n = std::min<size_t>(size, Http2::kDefaultFrameSize);
+            size -= n;
+            Http2::AppendFrameHeader(
+                out_, n, Http2::Type::Data,
+                size == 0 && end_stream ? Http2::kEndStream : 0, id);
+            out_.append(n, 'x');
+        } while (size > 0);
+    }
+
+    asio::awaitable<void> Flush() {
+        co_await asio::async_write(socket_, asio::buffer(out_),
+                                   asio::use_awaitable);
+        out_.clear();
+    }
+
+    // Read frames until stream `id` is answered in full or refused.
+    asio::awaitable<Answer> Await(uint32_t id) {
+        for (;;) {
+            const Answer &a = answers_[id];
+            if (a.ended || a.refused) {
+                co_return a;
+            }
+            while (in_.size() < Http2::kFrameHeaderSize ||
+                   in_.size() - Http2::kFrameHeaderSize <
+                       Http2::ParseFrameHeader(in_.data()).length) {
+                char tmp[16384];
+                in_.append(tmp, co_await socket_.async_read_some(
+                                    asio::buffer(tmp), asio::use_awaitable));
+            }
+            const Http2::FrameHeader fh = Http2::ParseFrameHeader(in_.data());
+            frame(fh, std::string_view(in_).substr(Http2::kFrameHeaderSize,
+                                                   fh.length));
+            in_.erase(0, Http2::kFrameHeaderSize + fh.length);
+        }
+    }
+
+  private:
+    void frame(const Http2::FrameHeader &fh, std::string_view payload) {
+        Answer &a = answers_[fh.stream];
+        switch (fh.type) {
+        case Http2::Type::Headers:
+            dec_.Decode(payload,
+                        [&a](std::string_view name, std::string_view value) {
+                            if (name == ":status") {
+                                a.status = value;
+                            }
+                        });
+            break;
+        case Http2::Type::Data:
+            a.body += payload;
+            break;
+        case Http2::Type::RstStream:
+            a.refused = payload.size() == 4 &&
+                        static_cast<uint8_t>(payload[3]) ==
+                            static_cast<uint8_t>(
+                                Http2::ErrorCode::RefusedStream);
+            return;
+        default:
+            return;
+        }
+        a.ended = a.ended || (fh.flags & Http2::kEndStream) != 0;
+    }
+
+    asio::ip::tcp::socket &socket_;
+    std::string out_;
+    std::string in_;
+    std::string block_;
+    Hpack::Encoder enc_;
+    Hpack::Decoder dec_;
+    std::map<uint32_t, Answer> answers_;
+};
+
+static constexpr size_t kMaxBody = 64 << 10;
+static constexpr size_t kPart = 40 << 10;
+
+// Two bodies in flight that pass the bound together: the second is
+// refused, the first answered, and once it is a third gets through.
+static asio::awaitable<void> client(uint16_t port, std::string &err) {
+    auto exor = co_await asio::this_coro::executor;
+    asio::ip::tcp::socket socket(exor);
+    co_await socket.async_connect(
+        {asio::ip::make_address("127.0.0.1"), port}, asio::use_awaitable);
+    Client c(socket);
+    c.Preface();
+    c.Headers(1, "GET", "/index.html", true);
+    c.Headers(3, "POST", "/size", false);
+    c.Data(3, kPart, false);
+    c.Headers(5, "POST", "/size", false);
+    c.Data(5, kPart, true);
+    co_await c.Flush();
+
+    const Answer index = co_await c.Await(1);
+    if (index.status != "200" || index.body != "<h1>hello</h1>") {
+        err = "GET answered " + index.status + ": " + index.body;
+        co_return;
+    }
+    if (!(co_await c.Await(5)).refused) {
+        err = "body over the bound of the connection not refused";
+        co_return;
+    }
+    c.Data(3, 0, true);
+    co_await c.Flush();
+    const Answer first = co_await c.Await(3);
+    if (first.status != "200" || first.body != std::to_string(kPart)) {
+        err = "first body answered " + first.status + ": " + first.body;
+        co_return;
+    }
+    c.Headers(7, "POST", "/size", false);
+    c.Data(7, kPart, true);
+    co_await c.Flush();
+    const Answer again = co_await c.Await(7);
+    if (again.status != "200" || again.body != std::to_string(kPart)) {
+        err = "body after release answered " + again.status + ": " +
+              again.body;
+    }
+}
+
+// Streams of one h2c connection are answered, and the request bodies they
+// hold at once are bounded.
+static std::string check_session() {
+    const std::filesystem::path root =
+        std::filesystem::temp_directory_path() / "fasterapi-bench-http2";
+    std::filesystem::create_directories(root);
+    std::ofstream(root / "index.html") << "<h1>hello</h1>";
+
+    HttpRoute::Router router;
+    router.Post("/size", [](const HttpReq::Message &req,
+                            const HttpRoute::Params &, HttpRsp::Message &rsp) {
+        rsp.body = std::to_string(req.body().size());
+    });
+    HttpRsp::Config cfg;
+    cfg.port = 0;
+    cfg.root = root.string();
+    cfg.max_body = kMaxBody;
+    HttpRsp::Listener listener(cfg, std::move(router));
+    // the session is left open when the check stops, and destroyed with
+    // `ctx`, before the wheel
+    TimeWheel::Wheel wheel;
+    asio::io_context ctx(1);
+
+    asio::ip::tcp::acceptor acceptor = listener.Open(ctx.get_executor());
+    const uint16_t port = acceptor.local_endpoint().port();
+    asio::co_spawn(ctx, listener.Start(std::move(acceptor), wheel),
+                   asio::detached);
+
+    std::string err;
+    asio::co_spawn(ctx, client(port, err),
+                   [&ctx, &err](std::exception_ptr e) {
+                       if (e && err.empty()) {
+                           err = "client failed";
+                       }
+                       ctx.stop();
+                   });
+    ctx.run();
+    std::filesystem::remove_all(root);
+    return err;
+}
+
+static Bench::RegisterCheck check_h2("http2/session", check_session);
@@ -0,0 +1,102 @@
+#include "bench.hpp"
+#include "log.hpp"
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// An access record of `GET /index.html` from 127.0.0.1:40000.
+static Log::Record access_record() {
+    Log::Record rec;
+    rec.set_peer({asio::ip::make_address("127.0.0.1"), 40000});
+    rec.method = HttpHdr::Method::GET;
+    rec.set_text("/index.html");
+    rec.status = 200;
+    rec.bytes = 1234;
+    rec.latency_ns = 56'000;
+    return rec;
+}
+
+// Lines of the file at `path`, which is removed.
+static std::vector<std::string> take_lines(const std::string &path) {
+    std::vector<std::string> lines;
+    {
+        std::ifstream in(path);
+        for (std::string line; std::getline(in, line);) {
+            lines.push_back(line);
+        }
+    }
+    std::filesystem::remove(path);
+    return lines;
+}
+
+// Records of several threads all reach the file, formatted; pushes to a full
+// ring are dropped and counted.
+static std::string check_log() {
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "fasterapi-bench-log")
+            .string();
+    std::filesystem::remove(path);
+
+    constexpr size_t kThreads = 4;
+    constexpr size_t kPerThread = 100;
+    {
+        Log::Logger log(path, -1, 1024);
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < kThreads; ++i) {
+            threads.emplace_back([&log] {
+                Log::Record rec = access_record();
+                for (size_t j = 0; j < kPerThread; ++j) {
+                    log.Push(rec);
+                }
+            });
+        }
+        for (std::thread &t : threads) {
+            t.join();
+        }
+        if (log.dropped() != 0) {
+            return "records dropped from a ring with room";
+        }
+    }
+    std::vector<std::string> lines = take_lines(path);
+    if (lines.size() != kThreads * kPerThread) {
+        return "records lost";
+    }
+    const std::string_view line = lines[0];
+    if (line.size() < 24 || line[10] != 'T' || line[23] != 'Z' ||
+        line.substr(24) !=
+            " 127.0.0.1:40000 \"GET /index.html\" 200 1234 56") {
+        return "access record misformatted: " + lines[0];
+    }
+
+    constexpr size_t kPushes = 10000;
+    uint64_t dropped = 0;
+    {
+        Log::Logger log(path, -1, 2);
+        Log::Record rec = access_record();
+        for (size_t i = 0; i < kPushes; ++i) {
+            log.Push(rec);
+        }
+        dropped = log.dropped();
+    }
+    lines = take_lines(path);
+    if (dropped == 0 || lines.size() + dropped != kPushes) {
+        return "drops of a full ring not counted";
+    }
+    return "";
+}
+
+static Bench::RegisterCheck check("log/records", check_log);
+
+// What logging costs the thread serving a response: stamping the record and
+// copying it into the ring.
+static void bench_push(size_t n) {
+    static Log::Logger log("/dev/null", -1, 1 << 16);
+    Log::Record rec = access_record();
+    for (size_t i = 0; i < n; ++i) {
+        Bench::DoNotOptimize(log.Push(rec));
+    }
+}
+
+static Bench::Register reg_push("log/push", 0, bench_push);
@@ -0,0 +1,139 @@
+#include "bench.hpp"
+#include "metrics.hpp"
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Metrics::Histogram;
+
+// Buckets tile the range without gaps, each within 1/16 of its values, and
+// quantiles fall in the bucket of the value they should be.
+static std::string check_histogram() {
+    for (size_t i = 0; i + 1 < Histogram::kNBucket; ++i) {
+        const uint64_t lo = Histogram::lower(i);
+        const uint64_t hi = Histogram::lower(i + 1) - 1;
+        if (Histogram::index(lo) != i || Histogram::index(hi) != i) {
+            return "bucket " + std::to_string(i) + " does not hold [" +
+                   std::to_string(lo) + ", " + std::to_string(hi) + "]";
+        }
+        if (lo >= 32 && (hi - lo + 1) * 16 > lo) {
+            return "bucket " + std::to_string(i) + " too wide";
+        }
+    }
+    if (Histogram::index(UINT64_MAX) != Histogram::kNBucket - 1) {
+        return "huge value not in the last bucket";
+    }
+
+    // 1..100000 ns once each
+    auto hist = std::make_unique<Histogram>();
+    for (uint64_t ns = 1; ns <= 100000; ++ns) {
+        hist->Record(ns);
+    }
+    auto dist = std::make_unique<Metrics::Distribution>();
+    dist->Add(*hist);
+    if (dist->count != 100000 || dist->sum != 100000ull * 100001 / 2) {
+        return "wrong count or sum";
+    }
+    for (const double q : {0.5, 0.9, 0.99, 0.999}) {
+        const double want = q * 100000;
+        const double got = static_cast<double>(dist->Quantile(q));
+        if (got < want * 15 / 16 || got > want * 17 / 16) {
+            return "quantile " + std::to_string(q) + ": " +
+                   std::to_string(got) + ", expected " + std::to_string(want);
+        }
+    }
+    return "";
+}
+
+static Bench::RegisterCheck check_hist("metrics/histogram", check_histogram);
+
+// What threads record concurrently is merged without loss, and rendered.
+static std::string check_threads() {
+    constexpr size_t kNThread = 4;
+    constexpr uint64_t kN = 100000;
+    Metrics::Registry registry;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < kNThread; ++t) {
+        threads.emplace_back([&registry] {
+            for (uint64_t i = 0; i < kN; ++i) {
+                Metrics::Recorder &rec = registry.local();
+                rec.Add(Metrics::Count::Requests);
+                rec.Add(Metrics::Count::BytesOut, 10);
+                rec.Respond(HttpHdr::Status::OK);
+                const Metrics::Clock::time_point t0{};
+                rec.Time(Metrics::Phase::Handle, t0,
+                         t0 + std::chrono::microseconds(i % 100));
+            }
+            registry.local().Fail(Metrics::Error::Write);
+        });
+    }
+    for (std::thread &t : threads) {
+        t.join();
+    }
+
+    const auto snap = std::make_unique<Metrics::Snapshot>(registry.Collect());
+    const uint64_t total = kNThread * kN;
+    if (snap->n_threads != kNThread ||
+        snap->counts[static_cast<uint8_t>(Metrics::Count::Requests)] !=
+            total ||
+        snap->counts[static_cast<uint8_t>(Metrics::Count::BytesOut)] !=
+            10 * total ||
+        snap->responses[static_cast<uint8_t>(HttpHdr::Status::OK)] != total ||
+        snap->errors[static_cast<uint8_t>(Metrics::Error::Write)] !=
+            kNThread ||
+        snap->phases[static_cast<uint8_t>(Metrics::Phase::Handle)].count !=
+            total) {
+        return "counts lost in the merge";
+    }
+
+    std::string text;
+    registry.Render(text);
+    const std::string lines[] = {
+        "fasterapi_requests_total " + std::to_string(total) + "\n",
+        "fasterapi_responses_total{code=\"200\"} " + std::to_string(total) +
+            "\n",
+        "fasterapi_errors_total{kind=\"write\"} 4\n",
+        // durations up to 10 us: 0..9 us, 10% of them
+        "fasterapi_request_duration_seconds_bucket{phase=\"handle\","
+        "le=\"1e-05\"} " +
+            std::to_string(total / 10) + "\n",
+        "fasterapi_request_duration_seconds_count{phase=\"handle\"} " +
+            std::to_string(total) + "\n",
+    };
+    for (const std::string &line : lines) {
+        if (text.find(line) == std::string::npos) {
+            return "missing from the rendering: " + line;
+        }
+    }
+    return "";
+}
+
+static Bench::RegisterCheck check_mt("metrics/threads", check_threads);
+
+// Recording a duration into a histogram.
+static void bench_record(size_t n) {
+    static Histogram hist;
+    for (size_t i = 0; i < n; ++i) {
+        hist.Record(i * 7919 % 100000);
+    }
+    Bench::DoNotOptimize(hist.sum());
+}
+
+// Recording what a session does per request: the thread's recorder, a
+// duration and two counters.
+static void bench_request(size_t n) {
+    static Metrics::Registry registry;
+    const Metrics::Clock::time_point t0{};
+    for (size_t i = 0; i < n; ++i) {
+        Metrics::Recorder &rec = registry.local();
+        rec.Time(Metrics::Phase::Parse, t0,
+                 t0 + std::chrono::nanoseconds(i * 7919 % 100000));
+        rec.Add(Metrics::Count::Requests);
+        rec.Respond(HttpHdr::Status::OK);
+    }
+}
+
+static Bench::Register reg_record("metrics/record", 0, bench_record);
+static Bench::Register reg_request("metrics/record_request", 0,
+                                   bench_request);
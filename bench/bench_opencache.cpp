@@ -0,0 +1,97 @@
+#include "bench.hpp"
+#include "opencache.hpp"
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+
+// A directory with "/index.html" and "/css/site.css", made once.
+static const std::string &temp_root() {
+    static const std::string root = [] {
+        const std::filesystem::path dir =
+            std::filesystem::temp_directory_path() / "fasterapi-bench-open";
+        std::filesystem::create_directories(dir / "css");
+        std::ofstream(dir / "index.html") << "<h1>hello</h1>";
+        std::ofstream(dir / "css" / "site.css") << "body {}";
+        return std::filesystem::canonical(dir).string();
+    }();
+    return root;
+}
+
+// Files and missing paths are cached until invalidated or expired.
+static std::string check_cache() {
+    const std::string &root = temp_root();
+    OpenCache::Cache cache(64, std::chrono::milliseconds(50));
+    cache.Enable();
+
+    const OpenCache::EntryPtr index = cache.Open("/", root);
+    if (!index->found() || index->size != 14 || index->file != "/index.html") {
+        return "index.html not opened";
+    }
+    if (cache.Get("/") != index) {
+        return "index.html not cached";
+    }
+    const OpenCache::EntryPtr missing = cache.Open("/nope/", root);
+    if (missing->found() || missing->file != "/nope/index.html" ||
+        cache.Get("/nope/") != missing) {
+        return "missing file not cached";
+    }
+    if (cache.Open("/../etc/passwd", root)->found()) {
+        return "path escaping the root opened";
+    }
+
+    cache.Open("/css/site.css", root);
+    cache.Invalidate("/index.html", false);
+    if (cache.Get("/") || !cache.Get("/css/site.css")) {
+        return "invalidated the wrong file";
+    }
+    cache.Invalidate("/nope", true);
+    if (cache.Get("/nope/")) {
+        return "missing file under a new directory still cached";
+    }
+    // a missing file under another spelling is dropped when it appears
+    const OpenCache::EntryPtr dotted = cache.Open("/css/../new.txt", root);
+    if (dotted->found() || dotted->file != "/new.txt") {
+        return "missing file not resolved: " + dotted->file;
+    }
+    cache.Invalidate("/new.txt", false);
+    if (cache.Get("/css/../new.txt")) {
+        return "missing file under another spelling still cached";
+    }
+    cache.Invalidate("/css", true);
+    if (cache.Get("/css/site.css")) {
+        return "file in an invalidated directory still cached";
+    }
+
+    cache.Open("/", root);
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    if (cache.Get("/")) {
+        return "expired entry returned";
+    }
+    return "";
+}
+
+static Bench::RegisterCheck check_open("opencache/entries", check_cache);
+
+// A hit: what spares resolving and opening a file.
+static void bench_hit(size_t n) {
+    static OpenCache::Cache cache(64, std::chrono::hours(1));
+    cache.Enable();
+    if (!cache.Get("/")) {
+        cache.Open("/", temp_root());
+    }
+    for (size_t i = 0; i < n; ++i) {
+        Bench::DoNotOptimize(cache.Get("/"));
+    }
+}
+
+// A miss: resolving the path, opening and checking the file.
+static void bench_open(size_t n) {
+    static OpenCache::Cache cache(64, std::chrono::hours(1));
+    for (size_t i = 0; i < n; ++i) {
+        Bench::DoNotOptimize(cache.Open("/css/site.css", temp_root()));
+    }
+}
+
+static Bench::Register reg_hit("opencache/hit", 0, bench_hit);
+static Bench::Register reg_open("opencache/open", 0, bench_open);
@@ -0,0 +1,124 @@
+#include "bench.hpp"
+#include "httprsp_listener.hpp"
+#include <asio.hpp>
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+// Requests to "/slow/<ms>" are answered by the upstream after <ms>
+// milliseconds; the first is answered, the second cut off by the upstream
+// read timeout. Both outlast the client's head timeout.
+static constexpr std::chrono::seconds kHeadTimeout{1};
+static constexpr std::chrono::seconds kReadTimeout{2};
+static constexpr char kAnswered[] = "1500";
+static constexpr char kTimedOut[] = "2500";
+
+// Read a request head, wait the milliseconds at the end of its path, and
+// answer.
+static asio::awaitable<void> upstream(asio::ip::tcp::socket socket) {
+    asio::streambuf buf;
+    asio::error_code ec;
+    co_await asio::async_read_until(
+        socket, buf, "\r\n\r\n", asio::redirect_error(asio::use_awaitable, ec));
+    if (ec) {
+        co_return;
+    }
+    const std::string_view head(
+        static_cast<const char *>(buf.data().data()), buf.size());
+    const size_t end = head.find(' ', 4);
+    const size_t slash = head.rfind('/', end);
+    const std::string ms(head.substr(slash + 1, end - slash - 1));
+
+    asio::steady_timer timer(socket.get_executor());
+    timer.expires_after(std::chrono::milliseconds(std::stoi(ms)));
+    co_await timer.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+    static constexpr std::string_view kRsp =
+        "HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\nslow";
+    co_await asio::async_write(socket, asio::buffer(kRsp),
+                               asio::redirect_error(asio::use_awaitable, ec));
+}
+
+static asio::awaitable<void> upstreams(asio::ip::tcp::acceptor &acceptor) {
+    for (;;) {
+        asio::ip::tcp::socket socket =
+            co_await acceptor.async_accept(asio::use_awaitable);
+        asio::co_spawn(acceptor.get_executor(), upstream(std::move(socket)),
+                       asio::detached);
+    }
+}
+
+static asio::awaitable<void> client(uint16_t port, std::string_view ms,
+                                    std::string &answer) {
+    auto exor = co_await asio::this_coro::executor;
+    asio::ip::tcp::socket socket(exor);
+    co_await socket.async_connect(
+        {asio::ip::make_address("127.0.0.1"), port}, asio::use_awaitable);
+    const std::string req = "GET /slow/" + std::string(ms) +
+                            " HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n";
+    co_await asio::async_write(socket, asio::buffer(req), asio::use_awaitable);
+    char tmp[4096];
+    asio::error_code ec;
+    while (!ec) {
+        answer.append(tmp, co_await socket.async_read_some(
+                               asio::buffer(tmp),
+                               asio::redirect_error(asio::use_awaitable, ec)));
+    }
+}
+
+// An upstream slower than the client's head timeout still gets its answer
+// through; one slower than the upstream read timeout gets a 504, not the
+// connection closed on the client.
+static std::string check_slow() {
+    // sessions left waiting when the check stops are destroyed with `ctx`,
+    // before the listener and the wheel they refer to
+    TimeWheel::Wheel wheel;
+    std::optional<HttpRsp::Listener> listener;
+    asio::io_context ctx(1);
+    asio::ip::tcp::acceptor up_acceptor(
+        ctx, {asio::ip::make_address("127.0.0.1"), 0});
+    asio::co_spawn(ctx, upstreams(up_acceptor), asio::detached);
+
+    HttpRsp::Config cfg;
+    cfg.port = 0;
+    cfg.root = std::filesystem::temp_directory_path().string();
+    cfg.head_timeout = kHeadTimeout;
+    cfg.upstream_read_timeout = kReadTimeout;
+    cfg.proxies.push_back(
+        {"/slow",
+         {"127.0.0.1:" + std::to_string(up_acceptor.local_endpoint().port())}});
+    listener.emplace(cfg);
+
+    asio::co_spawn(ctx, wheel.Run(), asio::detached);
+    asio::ip::tcp::acceptor acceptor = listener->Open(ctx.get_executor());
+    const uint16_t port = acceptor.local_endpoint().port();
+    asio::co_spawn(ctx, listener->Start(std::move(acceptor), wheel),
+                   asio::detached);
+
+    std::string answered;
+    std::string timed_out;
+    std::string err;
+    int n_left = 2;
+    auto done = [&ctx, &err, &n_left](std::exception_ptr e) {
+        if (e) {
+            err = "client failed";
+        }
+        if (--n_left == 0) {
+            ctx.stop();
+        }
+    };
+    asio::co_spawn(ctx, client(port, kAnswered, answered), done);
+    asio::co_spawn(ctx, client(port, kTimedOut, timed_out), done);
+    ctx.run();
+
+    if (err.empty() && (!answered.starts_with("HTTP/1.1 200") ||
+                        !answered.ends_with("\r\n\r\nslow"))) {
+        err = "slow upstream answered: " + answered.substr(0, 200);
+    }
+    if (err.empty() && !timed_out.starts_with("HTTP/1.1 504")) {
+        err = "timed out upstream answered: " + timed_out.substr(0, 200);
+    }
+    return err;
+}
+
+static Bench::RegisterCheck check_slow_("proxy/slow", check_slow);
@@ -0,0 +1,146 @@
+#include "bench.hpp"
+#include "httprsp_message.hpp"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// The date the server used before the cached Date header.
+static std::string legacy_timestamp() {
+    auto now =
+        std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    std::stringstream ss;
+    ss << std::ctime(&now);
+    std::string s = ss.str();
+    s.pop_back(); // Remove newline
+    return s;
+}
+
+// The serializer the server used before gathered writes: a chain of string
+// concatenations ending with a copy of the body.
+static std::string legacy_to_str(const HttpRsp::Message &rsp) {
+    HttpHdr::Version ver = HttpHdr::Version::HTTP_1_1;
+    return ver2str(ver) + " " + status2str(rsp.code) +
+           CRLF "Date: " + legacy_timestamp() +
+           CRLF "Content-Type: " + conttype2str(rsp.cont_type) +
+           CRLF "Content-Length: " + std::to_string(rsp.body.size()) +
+           CRLF "Connection: " + conn2str(rsp.conn) + CRLF2 + rsp.body;
+}
+
+static HttpRsp::Message make_response(size_t body_size) {
+    HttpRsp::Message rsp;
+    rsp.code = HttpHdr::Status::OK;
+    rsp.cont_type = HttpHdr::ContType::TEXT_HTML;
+    rsp.conn = HttpHdr::Conn::KEEP_ALIVE;
+    rsp.body.assign(body_size, 'x');
+    return rsp;
+}
+
+// Sorted header lines of a serialized response without its Date line,
+// followed by the body.
+static std::string normalize(const std::string &rsp) {
+    const size_t pos_body = rsp.find(CRLF2) + 4;
+    std::vector<std::string> lines;
+    for (size_t pos = 0; pos < pos_body - 2;) {
+        const size_t eol = rsp.find(CRLF, pos);
+        if (rsp.compare(pos, 5, "Date:") != 0) {
+            lines.push_back(rsp.substr(pos, eol - pos));
+        }
+        pos = eol + 2;
+    }
+    std::sort(lines.begin(), lines.end());
+    std::string out;
+    for (const std::string &line : lines) {
+        out += line + CRLF;
+    }
+    return out + rsp.substr(pos_body);
+}
+
+// The gathered buffers must carry the same response as the old serializer,
+// apart from the header order and the Date value.
+static std::string check_buffers() {
+    const HttpRsp::Message rsp = make_response(100);
+    std::string head;
+    std::string out;
+    for (const asio::const_buffer &b : rsp.ToBuffers(head)) {
+        out.append(static_cast<const char *>(b.data()), b.size());
+    }
+    if (normalize(out) != normalize(legacy_to_str(rsp))) {
+        return "gathered response differs from ToStr: " + head;
+    }
+    return "";
+}
+
+static Bench::RegisterCheck check_rsp("response/buffers", check_buffers);
+
+static void register_size(const std::string &suffix, size_t body_size) {
+    // messages own a file descriptor and cannot be copied
+    const auto rsp =
+        std::make_shared<const HttpRsp::Message>(make_response(body_size));
+    Bench::Register("response/legacy_to_str" + suffix, 0, [rsp](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            Bench::DoNotOptimize(legacy_to_str(*rsp));
+        }
+    });
+    Bench::Register("response/to_str" + suffix, 0, [rsp](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            Bench::DoNotOptimize(rsp->ToStr());
+        }
+    });
+    // As in a session: one head buffer reused for every response.
+    Bench::Register("response/to_buffers" + suffix, 0, [rsp](size_t n) {
+        std::string head;
+        for (size_t i = 0; i < n; ++i) {
+            Bench::DoNotOptimize(rsp->ToBuffers(head));
+        }
+    });
+}
+
+// IMF-fixdate formatting against known dates, including a leap day.
+static std::string check_date() {
+    static constexpr std::pair<std::time_t, std::string_view> kDates[] = {
+        {0, "Thu, 01 Jan 1970 00:00:00 GMT"},
+        {784111777, "Sun, 06 Nov 1994 08:49:37 GMT"},
+        {951782400, "Tue, 29 Feb 2000 00:00:00 GMT"},
+        {4102444799, "Thu, 31 Dec 2099 23:59:59 GMT"},
+    };
+    char out[HttpDate::kLen];
+    for (const auto &[t, date] : kDates) {
+        HttpDate::Format(t, out);
+        if (std::string_view(out, sizeof(out)) != date) {
+            return "expected " + std::string(date) + ", got " +
+                   std::string(out, sizeof(out));
+        }
+    }
+    const std::string_view line = HttpDate::Line();
+    if (!line.starts_with("Date: ") || !line.ends_with(" GMT\r\n")) {
+        return "bad header line: " + std::string(line);
+    }
+    return "";
+}
+
+static Bench::RegisterCheck check_dt("response/date", check_date);
+
+static void bench_legacy_date(size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        Bench::DoNotOptimize(legacy_timestamp());
+    }
+}
+
+static void bench_date(size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        Bench::DoNotOptimize(HttpDate::Line());
+    }
+}
+
+static Bench::Register reg_legacy_date("response/legacy_date", 0,
+                                       bench_legacy_date);
+static Bench::Register reg_date("response/date", 0, bench_date);
+
+static const bool kRegistered = [] {
+    register_size("/15B", 15);
+    register_size("/64KiB", 64 * 1024);
+    return true;
+}();
@@ -0,0 +1,168 @@
+#include "bench.hpp"
+#include "httproute.hpp"
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using HttpHdr::Method;
+
+// Handlers identified by the route they were registered for.
+static HttpRoute::Handler named(std::string name) {
+    return [name](const HttpReq::Message &, const HttpRoute::Params &,
+                  HttpRsp::Message &rsp) { rsp.body = name; };
+}
+
+// Name of the route matching `method` and `path`, followed by its
+// parameters, e.g. "user id=42"; "none" if none matches.
+static std::string match(const HttpRoute::Router &router, Method method,
+                         std::string_view path) {
+    HttpRoute::Params params;
+    const HttpRoute::Handler *handler = router.Match(method, path, params);
+    if (handler == nullptr) {
+        return "none";
+    }
+    HttpRsp::Message rsp;
+    (*handler)(HttpReq::Message(), params, rsp);
+    for (size_t i = 0; i < params.size(); ++i) {
+        rsp.body += ' ';
+        rsp.body += params.name(i);
+        rsp.body += '=';
+        rsp.body += params.value(i);
+    }
+    return rsp.body;
+}
+
+// Routes are matched by precedence, not by order, and yield their
+// parameters; a path matched with the wrong method falls through to the
+// next match, and is answered 405 if none has the method.
+static std::string check_match() {
+    HttpRoute::Router router;
+    router.Get("/*path", named("files"));
+    router.Get("/users/:id", named("user"));
+    router.Put("/users/:id", named("put_user"));
+    router.Get("/users/new", named("new_user"));
+    router.Get("/users/:id/posts/:post", named("post"));
+    router.Get("/static/*path", named("static"));
+    router.Get("/", named("home"));
+    router.Post("/users/", named("add_user"));
+    router.Compile();
+
+    const std::pair<std::string_view, std::string_view> cases[] = {
+        {"/", "home"},
+        {"/?q=1", "home"},
+        {"/users/new", "new_user"},
+        {"/users/42", "user id=42"},
+        {"/users/42?full=1", "user id=42"},
+        {"/users/new/posts/7", "post id=new post=7"},
+        {"/users/42/posts", "files path=/users/42/posts"},
+        {"/users", "files path=/users"},
+        {"/static/css/site.css", "static path=/css/site.css"},
+        {"/static/", "static path=/"},
+        {"/static", "files path=/static"},
+        // POST only: falls through to the wildcard
+        {"/users/", "files path=/users/"},
+        {"/index.html", "files path=/index.html"},
+        {"index.html", "none"},
+    };
+    for (const auto &[path, want] : cases) {
+        const std::string got = match(router, Method::GET, path);
+        if (got != want) {
+            return "GET " + std::string(path) + ": got " + got +
+                   ", expected " + std::string(want);
+        }
+    }
+    if (match(router, Method::PUT, "/users/7") != "put_user id=7" ||
+        match(router, Method::POST, "/users/") != "add_user" ||
+        match(router, Method::POST, "/users/7") != "none") {
+        return "method mismatch";
+    }
+    // HEAD is served by the GET route, falling through like GET
+    if (match(router, Method::HEAD, "/users/7") != "user id=7" ||
+        match(router, Method::HEAD, "/users/") != "files path=/users/") {
+        return "HEAD not served by the GET route";
+    }
+
+    HttpReq::Message req;
+    req.Feed("DELETE /users/7 HTTP/1.1\r\n\r\n");
+    req.Update();
+    HttpRsp::Message rsp;
+    rsp.Reset(req.conn);
+    router.Serve(req, rsp);
+    if (rsp.code != HttpHdr::Status::MethodNotAllowed ||
+        rsp.headers != "Allow: GET, PUT, HEAD\r\n") {
+        return "no 405 for DELETE /users/7";
+    }
+
+    try {
+        router.Get("/users/:name", named("dup"));
+        return "duplicate route accepted";
+    } catch (const std::invalid_argument &) {
+    }
+    try {
+        router.Get("/a/*rest/b", named("bad"));
+        return "wildcard in the middle accepted";
+    } catch (const std::invalid_argument &) {
+    }
+    return "";
+}
+
+static Bench::RegisterCheck check_route("route/match", check_match);
+
+// An API of 1000 routes: 200 resources, each with a collection, an item
+// and a sub-item route, over several methods.
+static const HttpRoute::Router &api_router() {
+    static const HttpRoute::Router router = [] {
+        HttpRoute::Router r;
+        const HttpRoute::Handler h = [](const HttpReq::Message &,
+                                        const HttpRoute::Params &,
+                                        HttpRsp::Message &) {};
+        for (int i = 0; i < 200; ++i) {
+            const std::string base = "/api/v1/resource" + std::to_string(i);
+            r.Get(base, h);
+            r.Post(base, h);
+            r.Get(base + "/:id", h);
+            r.Delete(base + "/:id", h);
+            r.Get(base + "/:id/items/:item", h);
+        }
+        r.Compile();
+        return r;
+    }();
+    return router;
+}
+
+// Request paths spread over the routes, and their methods.
+static std::vector<std::pair<Method, std::string>> api_paths(bool params) {
+    std::vector<std::pair<Method, std::string>> paths;
+    for (int i = 0; i < 1024; ++i) {
+        std::string path = "/api/v1/resource" + std::to_string(i * 7 % 200);
+        if (params) {
+            path += '/';
+            path += std::to_string(i);
+            if (i % 2 == 0) {
+                path += "/items/";
+                path += std::to_string(i * 3);
+            }
+        }
+        paths.emplace_back(i % 4 == 0 && !params ? Method::POST : Method::GET,
+                           std::move(path));
+    }
+    return paths;
+}
+
+static void bench_match(size_t n, bool params) {
+    const HttpRoute::Router &router = api_router();
+    static const std::array<std::vector<std::pair<Method, std::string>>, 2>
+        kPaths = {api_paths(false), api_paths(true)};
+    const auto &paths = kPaths[params];
+    HttpRoute::Params p;
+    for (size_t i = 0; i < n; ++i) {
+        const auto &[method, path] = paths[i % paths.size()];
+        Bench::DoNotOptimize(router.Match(method, path, p));
+    }
+}
+
+static Bench::Register reg_static("route/1k_routes_static", 0,
+                                  [](size_t n) { bench_match(n, false); });
+static Bench::Register reg_params("route/1k_routes_params", 0,
+                                  [](size_t n) { bench_match(n, true); });
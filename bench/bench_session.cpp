@@ -0,0 +1,337 @@
+#include "bench.hpp"
+#include "fswatch.hpp"
+#include "httpreq_body.hpp"
+#include "httprsp_listener.hpp"
+#include <asio.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+static constexpr char kReq[] = "GET /index.html HTTP/1.1\r\nHost: x\r\n\r\n";
+static constexpr size_t kNWarmUp = 100;
+static constexpr size_t kNReq = 1000;
+
+// Send `kNWarmUp + kNReq` keep-alive requests one at a time, and count the
+// allocations made by the client and the server during the last `kNReq`.
+static asio::awaitable<void> client(uint16_t port, size_t &allocs,
+                                    std::string &err) {
+    auto exor = co_await asio::this_coro::executor;
+    asio::ip::tcp::socket socket(exor);
+    co_await socket.async_connect(
+        {asio::ip::make_address("127.0.0.1"), port}, asio::use_awaitable);
+
+    std::array<char, 4096> buf;
+    size_t rsp_size = 0;
+    size_t before = 0;
+    for (size_t i = 0; i < kNWarmUp + kNReq; ++i) {
+        if (i == kNWarmUp) {
+            before = Bench::Allocs::Now().count;
+        }
+        co_await asio::async_write(
+            socket, asio::buffer(kReq, sizeof(kReq) - 1), asio::use_awaitable);
+        // responses differ only in the date, which has a fixed length
+        size_t n = 0;
+        do {
+            n += co_await socket.async_read_some(
+                asio::buffer(buf.data() + n, buf.size() - n),
+                asio::use_awaitable);
+        } while (rsp_size == 0 ? std::string_view(buf.data(), n).find(
+                                     "\r\n\r\n<h1>hello</h1>") ==
+                                     std::string_view::npos
+                               : n < rsp_size);
+        rsp_size = n;
+        if (!std::string_view(buf.data(), n).starts_with("HTTP/1.1 200 OK")) {
+            err = "unexpected response: " + std::string(buf.data(), n);
+            co_return;
+        }
+    }
+    allocs = Bench::Allocs::Now().count - before;
+}
+
+// Serving keep-alive requests of a cached file must not allocate at all.
+static std::string check_allocs() {
+    const std::filesystem::path root =
+        std::filesystem::temp_directory_path() / "fasterapi-bench-session";
+    std::filesystem::create_directories(root);
+    std::ofstream(root / "index.html") << "<h1>hello</h1>";
+
+    HttpRsp::Config cfg;
+    cfg.port = 0;
+    cfg.root = root.string();
+    HttpRsp::Listener listener(cfg);
+    asio::io_context ctx(1);
+    FsWatch::Watcher watcher(ctx.get_executor(), listener.root(),
+                             listener.log());
+    if (!watcher.Open()) {
+        return "inotify unavailable";
+    }
+    listener.Watch(watcher);
+
+    TimeWheel::Wheel wheel;
+    asio::ip::tcp::acceptor acceptor = listener.Open(ctx.get_executor());
+    const uint16_t port = acceptor.local_endpoint().port();
+    asio::co_spawn(ctx, listener.Start(std::move(acceptor), wheel),
+                   asio::detached);
+
+    size_t allocs = 0;
+    std::string err;
+    asio::co_spawn(ctx, client(port, allocs, err),
+                   [&ctx, &err](std::exception_ptr e) {
+                       if (e && err.empty()) {
+                           err = "client failed";
+                       }
+                       ctx.stop();
+                   });
+    ctx.run();
+    std::filesystem::remove_all(root);
+
+    if (err.empty() && allocs > 0) {
+        err = std::to_string(allocs) + " allocations in " +
+              std::to_string(kNReq) + " keep-alive requests";
+    }
+    return err;
+}
+
+static Bench::RegisterCheck check_session("session/allocs", check_allocs);
+
+static constexpr size_t kUploadSize = 64 << 20;
+
+// Read one response, with a body of `Content-Length` bytes, from `socket`
+// into `rsp`, keeping the bytes after it in `buf`.
+static asio::awaitable<void> read_response(asio::ip::tcp::socket &socket,
+                                           std::string &buf,
+                                           std::string &rsp) {
+    size_t end;
+    while ((end = buf.find(CRLF2)) == std::string::npos) {
+        char tmp[4096];
+        buf.append(tmp, co_await socket.async_read_some(asio::buffer(tmp),
+                                                        asio::use_awaitable));
+    }
+    const size_t pos = buf.find("Content-Length: ") + 16;
+    const size_t size = end + 4 + std::stoul(buf.substr(pos));
+    while (buf.size() < size) {
+        char tmp[4096];
+        buf.append(tmp, co_await socket.async_read_some(asio::buffer(tmp),
+                                                        asio::use_awaitable));
+    }
+    rsp = buf.substr(0, size);
+    buf.erase(0, size);
+}
+
+// Upload `kUploadSize` bytes with Content-Length, then chunked followed by
+// a pipelined request, then a small chunked body read whole, counting the
+// allocations made during the large uploads.
+static asio::awaitable<void> uploader(uint16_t port, size_t &allocs,
+                                      std::string &err) {
+    auto exor = co_await asio::this_coro::executor;
+    asio::ip::tcp::socket socket(exor);
+    co_await socket.async_connect(
+        {asio::ip::make_address("127.0.0.1"), port}, asio::use_awaitable);
+    const std::string block(1 << 20, 'x');
+    std::string buf;
+    std::string rsp;
+    const auto expect = [&rsp, &err](std::string_view body) {
+        if (err.empty() && !rsp.ends_with(CRLF2 + std::string(body))) {
+            err = "unexpected response: " + rsp.substr(0, 200);
+        }
+        return err.empty();
+    };
+
+    // warm up the connection's buffers
+    co_await asio::async_write(
+        socket,
+        asio::buffer(std::string_view("POST /upload HTTP/1.1\r\n"
+                                      "Content-Length: 1\r\n\r\nx")),
+        asio::use_awaitable);
+    co_await read_response(socket, buf, rsp);
+
+    const size_t before = Bench::Allocs::Now().count;
+    const std::string head = "POST /upload HTTP/1.1\r\nContent-Length: " +
+                             std::to_string(kUploadSize) + "\r\n\r\n";
+    co_await asio::async_write(socket, asio::buffer(head),
+                               asio::use_awaitable);
+    for (size_t n = 0; n < kUploadSize; n += block.size()) {
+        co_await asio::async_write(socket, asio::buffer(block),
+                                   asio::use_awaitable);
+    }
+    co_await read_response(socket, buf, rsp);
+    if (!expect(std::to_string(kUploadSize))) {
+        co_return;
+    }
+
+    co_await asio::async_write(
+        socket,
+        asio::buffer(std::string_view("POST /upload HTTP/1.1\r\n"
+                                      "Transfer-Encoding: chunked\r\n\r\n")),
+        asio::use_awaitable);
+    char size_line[32];
+    size_t n_sent = 0;
+    // chunks of varied sizes, split at odd places
+    for (size_t size = 1; n_sent + size <= kUploadSize; size = size * 3 + 1) {
+        size = std::min(size, block.size());
+        const int len =
+            std::snprintf(size_line, sizeof(size_line), "%zx;ext=1\r\n", size);
+        co_await asio::async_write(socket, asio::buffer(size_line, len),
+                                   asio::use_awaitable);
+        co_await asio::async_write(socket, asio::buffer(block.data(), size),
+                                   asio::use_awaitable);
+        co_await asio::async_write(socket, asio::buffer(CRLF, 2),
+                                   asio::use_awaitable);
+        n_sent += size;
+    }
+    co_await asio::async_write(
+        socket,
+        asio::buffer(std::string_view("0\r\nX-Trailer: 1\r\n\r\n"
+                                      "GET /index.html HTTP/1.1\r\n\r\n")),
+        asio::use_awaitable);
+    co_await read_response(socket, buf, rsp);
+    allocs = Bench::Allocs::Now().count - before;
+    if (!expect(std::to_string(n_sent))) {
+        co_return;
+    }
+    co_await read_response(socket, buf, rsp);
+    if (!expect("<h1>hello</h1>")) {
+        co_return;
+    }
+
+    // a chunked body read whole, after the client waits for 100 Continue
+    co_await asio::async_write(
+        socket,
+        asio::buffer(std::string_view("POST /size HTTP/1.1\r\n"
+                                      "Expect: 100-continue\r\n"
+                                      "Transfer-Encoding: chunked\r\n\r\n")),
+        asio::use_awaitable);
+    char tmp[64];
+    const size_t n = co_await socket.async_read_some(asio::buffer(tmp),
+                                                     asio::use_awaitable);
+    if (std::string_view(tmp, n) != HttpReq::kContinue) {
+        err = "no 100 Continue";
+        co_return;
+    }
+    co_await asio::async_write(
+        socket,
+        asio::buffer(std::string_view("3\r\nabc\r\n4\r\ndefg\r\n0\r\n\r\n")),
+        asio::use_awaitable);
+    co_await read_response(socket, buf, rsp);
+    expect("7");
+}
+
+// Uploads of any size go through the connection's fixed buffers: a large
+// body, chunked or not, is streamed without allocating.
+static std::string check_upload() {
+    const std::filesystem::path root =
+        std::filesystem::temp_directory_path() / "fasterapi-bench-upload";
+    std::filesystem::create_directories(root);
+    std::ofstream(root / "index.html") << "<h1>hello</h1>";
+
+    HttpRoute::Router router;
+    router.Stream(HttpHdr::Method::POST, "/upload",
+                  [](const HttpReq::Message &, const HttpRoute::Params &,
+                     HttpReq::BodyReader &body,
+                     HttpRsp::Message &rsp) -> asio::awaitable<void> {
+                      while (!(co_await body.Read()).empty()) {
+                      }
+                      rsp.body = std::to_string(body.size());
+                  });
+    router.Post("/size", [](const HttpReq::Message &req,
+                            const HttpRoute::Params &, HttpRsp::Message &rsp) {
+        rsp.body = std::to_string(req.body().size());
+    });
+    HttpRsp::Config cfg;
+    cfg.port = 0;
+    cfg.root = root.string();
+    HttpRsp::Listener listener(cfg, std::move(router));
+    asio::io_context ctx(1);
+
+    TimeWheel::Wheel wheel;
+    asio::ip::tcp::acceptor acceptor = listener.Open(ctx.get_executor());
+    const uint16_t port = acceptor.local_endpoint().port();
+    asio::co_spawn(ctx, listener.Start(std::move(acceptor), wheel),
+                   asio::detached);
+
+    size_t allocs = 0;
+    std::string err;
+    asio::co_spawn(ctx, uploader(port, allocs, err),
+                   [&ctx, &err](std::exception_ptr e) {
+                       if (e && err.empty()) {
+                           err = "client failed";
+                       }
+                       ctx.stop();
+                   });
+    ctx.run();
+    std::filesystem::remove_all(root);
+
+    // a few for the client's strings and the responses, none per read of
+    // the bodies: thousands of reads would make thousands of allocations
+    if (err.empty() && allocs > 64) {
+        err = std::to_string(allocs) + " allocations in two uploads of " +
+              std::to_string(kUploadSize) + " bytes";
+    }
+    return err;
+}
+
+static Bench::RegisterCheck check_upload_("session/upload", check_upload);
+
+// Send a request whose Content-Length makes its size, head and body, wrap
+// to 0, and read what comes back up to `kMaxAnswer` bytes.
+static constexpr size_t kMaxAnswer = 1 << 20;
+
+static asio::awaitable<void> wrapper(uint16_t port, std::string &answer) {
+    auto exor = co_await asio::this_coro::executor;
+    asio::ip::tcp::socket socket(exor);
+    co_await socket.async_connect(
+        {asio::ip::make_address("127.0.0.1"), port}, asio::use_awaitable);
+    const std::string_view prefix =
+        "GET /index.html HTTP/1.1\r\nContent-Length: ";
+    // the length has 20 digits
+    const size_t head_size = prefix.size() + 20 + 4;
+    const std::string req = std::string(prefix) +
+                            std::to_string(size_t{0} - head_size) + CRLF2;
+    co_await asio::async_write(socket, asio::buffer(req), asio::use_awaitable);
+    char tmp[4096];
+    asio::error_code ec;
+    while (!ec && answer.size() < kMaxAnswer) {
+        answer.append(tmp, co_await socket.async_read_some(
+                               asio::buffer(tmp),
+                               asio::redirect_error(asio::use_awaitable, ec)));
+    }
+}
+
+// A Content-Length that would overflow the size of the request is rejected
+// with a single 400 and the connection closed, not taken for an empty
+// request answered over and over.
+static std::string check_length() {
+    HttpRsp::Config cfg;
+    cfg.port = 0;
+    cfg.root = std::filesystem::temp_directory_path().string();
+    HttpRsp::Listener listener(cfg);
+    asio::io_context ctx(1);
+
+    TimeWheel::Wheel wheel;
+    asio::ip::tcp::acceptor acceptor = listener.Open(ctx.get_executor());
+    const uint16_t port = acceptor.local_endpoint().port();
+    asio::co_spawn(ctx, listener.Start(std::move(acceptor), wheel),
+                   asio::detached);
+
+    std::string answer;
+    std::string err;
+    asio::co_spawn(ctx, wrapper(port, answer),
+                   [&ctx, &err](std::exception_ptr e) {
+                       if (e) {
+                           err = "client failed";
+                       }
+                       ctx.stop();
+                   });
+    ctx.run();
+
+    if (err.empty() && (!answer.starts_with("HTTP/1.1 400") ||
+                        answer.find("HTTP/1.1", 1) != std::string::npos)) {
+        err = std::to_string(answer.size()) +
+              " bytes answered: " + answer.substr(0, 200);
+    }
+    return err;
+}
+
+static Bench::RegisterCheck check_length_("session/length", check_length);
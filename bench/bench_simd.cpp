@@ -0,0 +1,135 @@
+#include "bench.hpp"
+#include "simd.hpp"
+#include <random>
+#include <string>
+
+static constexpr Simd::Isa kIsas[] = {Simd::Isa::SSE42, Simd::Isa::AVX2,
+                                      Simd::Isa::AVX512BW, Simd::Isa::NEON};
+
+// Random bytes biased towards the characters the kernels look for, so that
+// matches land at every offset, including vector boundaries and tails.
+static std::string random_bytes(std::mt19937 &rng, size_t n) {
+    static constexpr char kAlphabet[] = "aZz@[`{\r\n:- \x80\xff";
+    std::uniform_int_distribution<size_t> pick(0, sizeof(kAlphabet) - 2);
+    std::string s(n, '\0');
+    for (char &c : s) {
+        c = kAlphabet[pick(rng)];
+    }
+    return s;
+}
+
+// Flip the case bit of some bytes; for non-letters (e.g. '@' and '`') this
+// must break equality.
+static std::string flip_case(std::mt19937 &rng, std::string s) {
+    for (char &c : s) {
+        if (rng() % 3 == 0) {
+            c ^= 0x20;
+        }
+    }
+    return s;
+}
+
+// Differential test: every vectorized kernel against the scalar reference.
+static std::string check_kernels() {
+    const Simd::Kernels &ref = *Simd::kernels(Simd::Isa::Scalar);
+    std::mt19937 rng(42);
+    for (Simd::Isa isa : kIsas) {
+        const Simd::Kernels *k = Simd::kernels(isa);
+        if (k == nullptr) {
+            continue;
+        }
+        const std::string name = Simd::isa2str(isa);
+        for (size_t n = 0; n <= 300; ++n) {
+            for (int round = 0; round < 20; ++round) {
+                const std::string s = random_bytes(rng, n);
+                if (k->find_byte(s.data(), n, ':') !=
+                    ref.find_byte(s.data(), n, ':')) {
+                    return name + ": find_byte mismatch, n=" +
+                           std::to_string(n);
+                }
+                if (k->find_crlf(s.data(), n) != ref.find_crlf(s.data(), n)) {
+                    return name + ": find_crlf mismatch, n=" +
+                           std::to_string(n);
+                }
+                if (k->find_crlf2(s.data(), n) !=
+                    ref.find_crlf2(s.data(), n)) {
+                    return name + ": find_crlf2 mismatch, n=" +
+                           std::to_string(n);
+                }
+                const std::string t = flip_case(rng, s);
+                if (k->iequals(s.data(), t.data(), n) !=
+                    ref.iequals(s.data(), t.data(), n)) {
+                    return name + ": iequals mismatch, n=" +
+                           std::to_string(n);
+                }
+                std::string u_k = s, u_ref = s;
+                k->toupper(u_k.data(), n);
+                ref.toupper(u_ref.data(), n);
+                if (u_k != u_ref) {
+                    return name + ": toupper mismatch, n=" +
+                           std::to_string(n);
+                }
+            }
+        }
+    }
+    return "";
+}
+
+static Bench::RegisterCheck check_simd("simd/differential", check_kernels);
+
+// A 4 KiB request head: long header lines, terminator at the end.
+static const std::string kHead = [] {
+    std::string s = "GET /index.html HTTP/1.1\r\n";
+    while (s.size() < 4096 - 64) {
+        s += "X-Forwarded-For: 203.0.113.195, 70.41.3.18, 150.172.238.178\r\n";
+    }
+    return s + "\r\n";
+}();
+
+static const std::string kName = "Access-Control-Allow-Credentials";
+static const std::string kNameFolded = "access-control-allow-credentials";
+
+static void register_isa(const std::string &prefix, const Simd::Kernels *k) {
+    Bench::Register(prefix + "/find_crlf2", kHead.size(), [k](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            Bench::DoNotOptimize(k->find_crlf2(kHead.data(), kHead.size()));
+        }
+    });
+    // Walk the head line by line, as the parser does.
+    Bench::Register(prefix + "/find_crlf_lines", kHead.size(), [k](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t pos = 0; pos < kHead.size();) {
+                pos += k->find_crlf(kHead.data() + pos, kHead.size() - pos) + 2;
+            }
+        }
+    });
+    const std::string_view line = std::string_view(kHead).substr(26, 61);
+    Bench::Register(prefix + "/find_colon", line.size(), [k, line](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            Bench::DoNotOptimize(k->find_byte(line.data(), line.size(), ':'));
+        }
+    });
+    Bench::Register(prefix + "/iequals_name", kName.size(), [k](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            Bench::DoNotOptimize(
+                k->iequals(kName.data(), kNameFolded.data(), kName.size()));
+        }
+    });
+    Bench::Register(prefix + "/toupper", kHead.size(), [k](size_t n) {
+        std::string s = kHead;
+        for (size_t i = 0; i < n; ++i) {
+            k->toupper(s.data(), s.size());
+            Bench::DoNotOptimize(s);
+        }
+    });
+}
+
+static const bool kRegistered = [] {
+    register_isa("simd/scalar", Simd::kernels(Simd::Isa::Scalar));
+    for (Simd::Isa isa : kIsas) {
+        if (const Simd::Kernels *k = Simd::kernels(isa)) {
+            register_isa(std::string("simd/") + Simd::isa2str(isa), k);
+        }
+    }
+    return true;
+}();
@@ -0,0 +1,115 @@
+#include "bench.hpp"
+#include "timewheel.hpp"
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using TimeWheel::Clock;
+using TimeWheel::kTick;
+
+namespace {
+    // A timer checking that it expires when due.
+    struct Probe {
+        TimeWheel::Timer timer;
+        uint64_t due = 0; // first tick it may expire at, 0 if disarmed
+    };
+
+    uint64_t now_tick = 0;
+    std::string error;
+
+    void on_expire(void *arg) {
+        Probe &p = *static_cast<Probe *>(arg);
+        if (error.empty() &&
+            (p.due == 0 || now_tick < p.due || now_tick > p.due + 2)) {
+            error = "timer due at tick " + std::to_string(p.due) +
+                    " expired at tick " + std::to_string(now_tick);
+        }
+        p.due = 0;
+    }
+} // namespace
+
+// Timers across both levels, re-armed and cancelled at random, must each
+// expire once, neither early nor more than two ticks late. Deadlines past
+// the wheel's range expire at its end.
+static std::string check_wheel() {
+    constexpr size_t kN = 20000;
+    constexpr uint64_t kRange = 64 * 256 - 256; // always within range
+    constexpr uint64_t kEnd = 2 * 64 * 256;
+    const Clock::time_point start{};
+    TimeWheel::Wheel wheel(start);
+    std::vector<Probe> probes(kN);
+    std::mt19937 rng(7);
+
+    error.clear();
+    for (Probe &p : probes) {
+        p.timer.fn = on_expire;
+        p.timer.arg = &p;
+    }
+    for (now_tick = 1; now_tick <= kEnd && error.empty(); ++now_tick) {
+        wheel.Advance(start + now_tick * kTick);
+        // arm, re-arm or cancel a few timers every tick
+        for (int i = 0; i < 8 && now_tick < kEnd / 2; ++i) {
+            Probe &p = probes[rng() % kN];
+            if (rng() % 8 == 0) {
+                wheel.Cancel(p.timer);
+                p.due = 0;
+                continue;
+            }
+            const uint64_t ticks = rng() % 2 ? rng() % 300 : rng() % kRange;
+            wheel.Set(p.timer, ticks * kTick);
+            p.due = now_tick + ticks;
+        }
+    }
+    if (!error.empty()) {
+        return error;
+    }
+    for (const Probe &p : probes) {
+        if (p.due != 0) {
+            return "timer due at tick " + std::to_string(p.due) +
+                   " never expired";
+        }
+    }
+    if (wheel.size() != 0) {
+        return std::to_string(wheel.size()) + " timers left armed";
+    }
+
+    // clamped to the end of the wheel's range
+    Probe far;
+    far.timer.fn = on_expire;
+    far.timer.arg = &far;
+    wheel.Set(far.timer, std::chrono::hours(24));
+    far.due = kEnd;
+    for (; far.due != 0 && now_tick < 2 * kEnd; ++now_tick) {
+        wheel.Advance(start + now_tick * kTick);
+    }
+    if (far.due != 0 || now_tick > kEnd + 64 * 256 + 1) {
+        return "clamped timer expired at tick " + std::to_string(now_tick);
+    }
+    return "";
+}
+
+static Bench::RegisterCheck check_tw("timewheel/expiry", check_wheel);
+
+// Re-arming the deadline of one of 100k connections, as a session does
+// several times per request.
+static void bench_rearm(size_t n) {
+    constexpr size_t kNConn = 100000;
+    static TimeWheel::Wheel wheel;
+    static const auto timers = [] {
+        auto t = std::make_unique<TimeWheel::Timer[]>(kNConn);
+        for (size_t i = 0; i < kNConn; ++i) {
+            t[i].fn = [](void *) {};
+            wheel.Set(t[i], std::chrono::seconds(60));
+        }
+        return t;
+    }();
+    for (size_t i = 0; i < n; ++i) {
+        wheel.Set(timers[(i * 7919) % kNConn],
+                  i % 2 == 0 ? std::chrono::seconds(10)
+                             : std::chrono::seconds(60));
+    }
+    Bench::DoNotOptimize(wheel.size());
+}
+
+static Bench::Register reg_rearm("timewheel/rearm", 0, bench_rearm);
@@ -0,0 +1,44 @@
+#include "bench.hpp"
+#include "utils.hpp"
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+// A file of `size` bytes in the temporary directory, written once.
+static std::filesystem::path temp_file(size_t size) {
+    const std::filesystem::path path =
+        std::filesystem::temp_directory_path() /
+        ("fasterapi-bench-" + std::to_string(size));
+    if (!std::filesystem::exists(path) ||
+        std::filesystem::file_size(path) != size) {
+        std::ofstream(path, std::ios::binary) << std::string(size, 'x');
+    }
+    return path;
+}
+
+// Reading a whole file through a stream, as `Utils::read_file` does.
+template <size_t kSize> static void bench_read_file(size_t n) {
+    static const std::filesystem::path path = temp_file(kSize);
+    for (size_t i = 0; i < n; ++i) {
+        Bench::DoNotOptimize(Utils::read_file(path));
+    }
+}
+
+// Opening a file and reading it with pread(2), as a miss of the file cache
+// does.
+template <size_t kSize> static void bench_read_fd(size_t n) {
+    static const std::filesystem::path path = temp_file(kSize);
+    for (size_t i = 0; i < n; ++i) {
+        const Utils::Fd fd = Utils::open_file(path);
+        Bench::DoNotOptimize(Utils::read_fd(fd.get(), kSize));
+    }
+}
+
+static Bench::Register reg_file_4k("utils/read_file/4KiB", 4096,
+                                   bench_read_file<4096>);
+static Bench::Register reg_fd_4k("utils/read_fd/4KiB", 4096,
+                                 bench_read_fd<4096>);
+static Bench::Register reg_file_256k("utils/read_file/256KiB", 256 << 10,
+                                     bench_read_file<(256 << 10)>);
+static Bench::Register reg_fd_256k("utils/read_fd/256KiB", 256 << 10,
+                                   bench_read_fd<(256 << 10)>);
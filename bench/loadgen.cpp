@@ -0,0 +1,489 @@
+#include "metrics.hpp"
+#include <algorithm>
+#include <asio.hpp>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <strings.h>
+#include <thread>
+#include <vector>
+
+// HTTP/1.1 load generator.
+//
+// Keep-alive connections are spread over threads, each running its own
+// io_context, and every connection keeps up to DEPTH requests in flight
+// (pipelining). In the default closed loop, a connection sends a request as
+// soon as one of its DEPTH slots is free, and latency runs from the write.
+// With a rate, the loop is open: requests fall due at fixed intervals
+// whatever the server does, and latency runs from when a request was due,
+// not from when a free slot let it out, so that a stalled server is charged
+// for all the requests it held up (coordinated omission, corrected as in
+// wrk2).
+//
+// Connections the server closes are not reopened; they are reported.
+
+using Clock = Metrics::Clock;
+
+// Bytes buffered per connection for response heads; bodies are skipped.
+static constexpr size_t kBufSize = 64 * 1024;
+
+// Time allowed to connect before the measurement starts.
+static constexpr std::chrono::milliseconds kConnectTime(200);
+
+namespace {
+
+    struct Options {
+        size_t n_conns = 64;
+        size_t n_threads = 2;
+        size_t depth = 1;
+        std::chrono::seconds duration{10};
+        double rate = 0; // requests/s of all connections; 0: closed loop
+        std::string method = "GET";
+        std::vector<std::string> headers;
+        std::string body;
+        std::string paths; // file of request paths, one per line
+        std::string host;
+        std::string port = "80";
+        std::string path = "/";
+    };
+
+    // What a thread measured; written by that thread only.
+    struct Stats {
+        Metrics::Histogram latency; // ns
+        uint64_t max_ns = 0;
+        uint64_t n_rsp = 0;
+        uint64_t n_non2xx = 0;
+        uint64_t n_bytes = 0;
+        uint64_t n_connect_err = 0;
+        uint64_t n_io_err = 0;
+        uint64_t n_closed = 0; // connections closed by the server
+    };
+
+    // The test: requests to send, and when.
+    struct Plan {
+        std::vector<std::string> reqs; // sent in turn
+        asio::ip::tcp::endpoint endpoint;
+        size_t depth;
+        Clock::duration interval; // between requests of a connection; 0:
+                                  // closed loop
+        Clock::time_point start;
+        Clock::time_point end;
+    };
+
+    struct Conn {
+        explicit Conn(asio::io_context &ctx, size_t depth)
+            : socket(ctx), wake(ctx), due(depth) {}
+
+        asio::ip::tcp::socket socket;
+        // the writer waits on it for a free slot; cancelled by the reader
+        asio::steady_timer wake;
+        // when the requests in flight fell due, oldest at `first`
+        std::vector<Clock::time_point> due;
+        size_t first = 0;
+        size_t n_inflight = 0;
+        bool done = false;
+    };
+
+} // namespace
+
+// Send requests on `conn` as slots free up, or as they fall due, from
+// `phase` after the start, until the end of the test.
+static asio::awaitable<void> write_loop(Conn &conn, const Plan &plan,
+                                        size_t next, Clock::duration phase) {
+    asio::steady_timer timer(conn.socket.get_executor());
+    Clock::time_point due = plan.start + phase;
+    try {
+        timer.expires_at(due);
+        co_await timer.async_wait(asio::use_awaitable);
+        for (;; due += plan.interval) {
+            if (plan.interval > Clock::duration::zero() && due > Clock::now()) {
+                timer.expires_at(due);
+                co_await timer.async_wait(asio::use_awaitable);
+            }
+            while (conn.n_inflight == plan.depth && !conn.done) {
+                asio::error_code ec;
+                conn.wake.expires_at(Clock::time_point::max());
+                co_await conn.wake.async_wait(
+                    asio::redirect_error(asio::use_awaitable, ec));
+            }
+            if (plan.interval == Clock::duration::zero()) {
+                due = Clock::now();
+            }
+            if (conn.done || due >= plan.end) {
+                co_return;
+            }
+            conn.due[(conn.first + conn.n_inflight) % plan.depth] = due;
+            ++conn.n_inflight;
+            const std::string &req = plan.reqs[next++ % plan.reqs.size()];
+            co_await asio::async_write(conn.socket, asio::buffer(req),
+                                       asio::use_awaitable);
+        }
+    } catch (const std::exception &) {
+        // the connection failed or the test ended; the reader reports it
+    }
+}
+
+// Length of `head` given by Content-Length, or -1 if there is none, and
+// whether the server closes the connection after it.
+static int64_t content_length(std::string_view head, bool &close) {
+    int64_t length = -1;
+    close = false;
+    for (size_t pos = head.find("\r\n"); pos != std::string_view::npos;) {
+        const size_t beg = pos + 2;
+        pos = head.find("\r\n", beg);
+        const std::string_view line =
+            head.substr(beg, pos == std::string_view::npos ? pos : pos - beg);
+        const size_t colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            continue;
+        }
+        const std::string_view name = line.substr(0, colon);
+        std::string_view value = line.substr(colon + 1);
+        value.remove_prefix(std::min(value.find_first_not_of(' '),
+                                     value.size()));
+        if (name.size() == 14 &&
+            ::strncasecmp(name.data(), "Content-Length", 14) == 0) {
+            std::from_chars(value.data(), value.data() + value.size(),
+                            length);
+        } else if (name.size() == 10 &&
+                   ::strncasecmp(name.data(), "Connection", 10) == 0) {
+            close = value.size() == 5 &&
+                    ::strncasecmp(value.data(), "close", 5) == 0;
+        }
+    }
+    return length;
+}
+
+// Read the responses of `conn`, recording the latency of those completed
+// during the test.
+static asio::awaitable<void> read_loop(Conn &conn, const Plan &plan,
+                                       Stats &stats) {
+    std::vector<char> buf(kBufSize);
+    size_t beg = 0;
+    size_t end = 0;
+    const auto read = [&]() -> asio::awaitable<void> {
+        if (end == buf.size()) {
+            if (beg == 0) {
+                throw std::length_error("response head too large");
+            }
+            std::memmove(buf.data(), buf.data() + beg, end - beg);
+            end -= beg;
+            beg = 0;
+        }
+        const size_t n = co_await conn.socket.async_read_some(
+            asio::buffer(buf.data() + end, buf.size() - end),
+            asio::use_awaitable);
+        end += n;
+        stats.n_bytes += n;
+    };
+
+    for (;;) {
+        size_t pos;
+        while ((pos = std::string_view(buf.data() + beg, end - beg)
+                          .find("\r\n\r\n")) == std::string_view::npos) {
+            co_await read();
+        }
+        const std::string_view head(buf.data() + beg, pos);
+        bool close = false;
+        const int64_t length = content_length(head, close);
+        if (length < 0 || !head.starts_with("HTTP/1.") || head.size() < 12) {
+            throw std::runtime_error("unsupported response");
+        }
+        const bool ok = head[9] == '2';
+        beg += pos + 4;
+
+        // skip the body
+        for (uint64_t left = static_cast<uint64_t>(length);;) {
+            const size_t n = static_cast<size_t>(
+                std::min<uint64_t>(left, end - beg));
+            beg += n;
+            left -= n;
+            if (left == 0) {
+                break;
+            }
+            beg = end = 0;
+            co_await read();
+        }
+
+        const Clock::time_point now = Clock::now();
+        if (now < plan.end && conn.n_inflight > 0) {
+            const uint64_t ns = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    now - conn.due[conn.first])
+                    .count());
+            stats.latency.Record(ns);
+            stats.max_ns = std::max(stats.max_ns, ns);
+            ++stats.n_rsp;
+            stats.n_non2xx += ok ? 0 : 1;
+        }
+        conn.first = (conn.first + 1) % plan.depth;
+        conn.n_inflight -= conn.n_inflight > 0 ? 1 : 0;
+        conn.wake.cancel();
+        if (close) {
+            ++stats.n_closed;
+            co_return;
+        }
+    }
+}
+
+static asio::awaitable<void> run_conn(Conn &conn, const Plan &plan,
+                                      Stats &stats, size_t index,
+                                      size_t n_conns) {
+    try {
+        co_await conn.socket.async_connect(plan.endpoint,
+                                           asio::use_awaitable);
+        conn.socket.set_option(asio::ip::tcp::no_delay(true));
+    } catch (const std::exception &) {
+        ++stats.n_connect_err;
+        co_return;
+    }
+
+    // spread the requests of the connections over the interval, and the
+    // request templates over the connections
+    const Clock::duration phase =
+        plan.interval * static_cast<Clock::rep>(index) /
+        static_cast<Clock::rep>(n_conns);
+    asio::co_spawn(conn.socket.get_executor(),
+                   write_loop(conn, plan, index, phase), asio::detached);
+    try {
+        co_await read_loop(conn, plan, stats);
+    } catch (const std::exception &) {
+        if (Clock::now() < plan.end) {
+            ++stats.n_io_err;
+        }
+    }
+    conn.done = true;
+    conn.wake.cancel();
+    asio::error_code ec;
+    conn.socket.close(ec);
+}
+
+// Run the connections `first`, `first + step`, ... on the calling thread
+// until the end of the test.
+static void run_thread(const Plan &plan, size_t first, size_t step,
+                       size_t n_conns, Stats &stats) {
+    asio::io_context ctx(1);
+    std::vector<std::unique_ptr<Conn>> conns;
+    for (size_t i = first; i < n_conns; i += step) {
+        conns.push_back(std::make_unique<Conn>(ctx, plan.depth));
+        asio::co_spawn(ctx, run_conn(*conns.back(), plan, stats, i, n_conns),
+                       asio::detached);
+    }
+    // at the end, responses still in flight are abandoned
+    asio::steady_timer stop(ctx);
+    stop.expires_at(plan.end);
+    stop.async_wait([&conns](const asio::error_code &) {
+        for (const auto &conn : conns) {
+            conn->done = true;
+            conn->wake.cancel();
+            asio::error_code ec;
+            conn->socket.close(ec);
+        }
+    });
+    ctx.run();
+}
+
+// A request for `path`, with the method, headers and body of `opts`.
+static std::string build_request(const Options &opts, std::string_view path) {
+    std::string req = opts.method + " " + std::string(path) +
+                      " HTTP/1.1\r\nHost: " + opts.host + ":" + opts.port +
+                      "\r\n";
+    for (const std::string &header : opts.headers) {
+        req += header;
+        req += "\r\n";
+    }
+    if (!opts.body.empty()) {
+        req += "Content-Length: " + std::to_string(opts.body.size()) + "\r\n";
+    }
+    req += "\r\n";
+    return req += opts.body;
+}
+
+// Split "http://HOST[:PORT][/PATH]" into `opts`; false if malformed.
+static bool parse_url(std::string_view url, Options &opts) {
+    if (!url.starts_with("http://")) {
+        return false;
+    }
+    url.remove_prefix(7);
+    const size_t slash = url.find('/');
+    std::string_view authority = url.substr(0, slash);
+    if (slash != std::string_view::npos) {
+        opts.path = url.substr(slash);
+    }
+    const size_t colon = authority.rfind(':');
+    if (colon != std::string_view::npos) {
+        opts.port = authority.substr(colon + 1);
+        authority = authority.substr(0, colon);
+    }
+    opts.host = authority;
+    return !opts.host.empty() && !opts.port.empty();
+}
+
+static void usage(const char *prog) {
+    std::cerr
+        << "Usage: " << prog
+        << " [-c CONNS] [-t THREADS] [-d SECONDS] [-p DEPTH] [-R RATE]\n"
+           "       [-m METHOD] [-H HEADER]... [-b BODY] [-f PATHS] URL\n"
+           "  -c CONNS     keep-alive connections (default 64)\n"
+           "  -t THREADS   threads, each with its share of connections "
+           "(default 2)\n"
+           "  -d SECONDS   duration of the test (default 10)\n"
+           "  -p DEPTH     requests in flight per connection (default 1)\n"
+           "  -R RATE      open loop at RATE requests/s in all, latency "
+           "corrected\n"
+           "               for coordinated omission (default: closed "
+           "loop)\n"
+           "  -m METHOD    request method (default GET)\n"
+           "  -H HEADER    extra request header, e.g. \"Accept: */*\"\n"
+           "  -b BODY      request body\n"
+           "  -f PATHS     file of request paths, one per line, sent in "
+           "turn\n"
+           "  URL          http://HOST[:PORT][/PATH]\n";
+}
+
+// Parse a positive decimal number into `out`; false if malformed.
+template <typename T> static bool parse_num(const char *str, T &out) {
+    const char *end = str + std::strlen(str);
+    const auto [ptr, ec] = std::from_chars(str, end, out);
+    return ec == std::errc() && ptr == end && out > 0;
+}
+
+int main(int argc, char *argv[]) {
+    Options opts;
+    std::string_view url;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        bool ok = true;
+        if (arg == "-c" && has_value) {
+            ok = parse_num(argv[++i], opts.n_conns);
+        } else if (arg == "-t" && has_value) {
+            ok = parse_num(argv[++i], opts.n_threads);
+        } else if (arg == "-p" && has_value) {
+            ok = parse_num(argv[++i], opts.depth);
+        } else if (arg == "-d" && has_value) {
+            size_t seconds = 0;
+            ok = parse_num(argv[++i], seconds);
+            opts.duration = std::chrono::seconds(seconds);
+        } else if (arg == "-R" && has_value) {
+            ok = parse_num(argv[++i], opts.rate);
+        } else if (arg == "-m" && has_value) {
+            opts.method = argv[++i];
+        } else if (arg == "-H" && has_value) {
+            opts.headers.emplace_back(argv[++i]);
+        } else if (arg == "-b" && has_value) {
+            opts.body = argv[++i];
+        } else if (arg == "-f" && has_value) {
+            opts.paths = argv[++i];
+        } else if (arg.starts_with('-') || !url.empty()) {
+            ok = false;
+        } else {
+            url = arg;
+        }
+        if (!ok) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!parse_url(url, opts)) {
+        usage(argv[0]);
+        return 1;
+    }
+    opts.n_threads = std::min(opts.n_threads, opts.n_conns);
+
+    Plan plan;
+    if (opts.paths.empty()) {
+        plan.reqs.push_back(build_request(opts, opts.path));
+    } else {
+        std::ifstream file(opts.paths);
+        for (std::string line; std::getline(file, line);) {
+            if (!line.empty()) {
+                plan.reqs.push_back(build_request(opts, line));
+            }
+        }
+        if (plan.reqs.empty()) {
+            std::cerr << "No paths in " << opts.paths << std::endl;
+            return 1;
+        }
+    }
+    try {
+        asio::io_context ctx;
+        asio::ip::tcp::resolver resolver(ctx);
+        plan.endpoint =
+            resolver.resolve(opts.host, opts.port)->endpoint();
+    } catch (const std::exception &e) {
+        std::cerr << "Cannot resolve " << opts.host << ": " << e.what()
+                  << std::endl;
+        return 1;
+    }
+    plan.depth = opts.depth;
+    plan.interval =
+        opts.rate > 0
+            ? std::chrono::duration_cast<Clock::duration>(
+                  std::chrono::duration<double>(
+                      static_cast<double>(opts.n_conns) / opts.rate))
+            : Clock::duration::zero();
+    plan.start = Clock::now() + kConnectTime;
+    plan.end = plan.start + opts.duration;
+
+    std::printf("%s %s for %llds, %zu connections on %zu threads, "
+                "depth %zu, %s\n",
+                opts.method.c_str(), std::string(url).c_str(),
+                static_cast<long long>(opts.duration.count()), opts.n_conns,
+                opts.n_threads, opts.depth,
+                opts.rate > 0 ? "open loop" : "closed loop");
+    std::vector<std::unique_ptr<Stats>> stats;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < opts.n_threads; ++t) {
+        stats.push_back(std::make_unique<Stats>());
+        threads.emplace_back(run_thread, std::cref(plan), t, opts.n_threads,
+                             opts.n_conns, std::ref(*stats.back()));
+    }
+    for (std::thread &t : threads) {
+        t.join();
+    }
+
+    Stats total;
+    const auto dist = std::make_unique<Metrics::Distribution>();
+    for (const auto &s : stats) {
+        dist->Add(s->latency);
+        total.max_ns = std::max(total.max_ns, s->max_ns);
+        total.n_rsp += s->n_rsp;
+        total.n_non2xx += s->n_non2xx;
+        total.n_bytes += s->n_bytes;
+        total.n_connect_err += s->n_connect_err;
+        total.n_io_err += s->n_io_err;
+        total.n_closed += s->n_closed;
+    }
+    const double secs = std::chrono::duration<double>(opts.duration).count();
+    std::printf("Requests:      %llu\n",
+                static_cast<unsigned long long>(total.n_rsp));
+    std::printf("Requests/sec:  %.1f\n",
+                static_cast<double>(total.n_rsp) / secs);
+    std::printf("Transfer/sec:  %.2f MB\n",
+                static_cast<double>(total.n_bytes) / secs / 1e6);
+    std::printf("Errors:        %llu connect, %llu read/write, %llu closed, "
+                "%llu non-2xx\n",
+                static_cast<unsigned long long>(total.n_connect_err),
+                static_cast<unsigned long long>(total.n_io_err),
+                static_cast<unsigned long long>(total.n_closed),
+                static_cast<unsigned long long>(total.n_non2xx));
+    std::printf("Latency (us):  ");
+    for (const auto &[label, q] :
+         {std::pair{"p50", 0.5}, {"p90", 0.9}, {"p99", 0.99},
+          {"p99.9", 0.999}, {"p99.99", 0.9999}}) {
+        // a quantile is the middle of its bucket, which may exceed the max
+        std::printf("%s %.1f  ", label,
+                    static_cast<double>(
+                        std::min(dist->Quantile(q), total.max_ns)) /
+                        1e3);
+    }
+    std::printf("max %.1f\n", static_cast<double>(total.max_ns) / 1e3);
+    return total.n_connect_err == opts.n_conns ? 1 : 0;
+}
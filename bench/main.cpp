@@ -0,0 +1,20 @@
+#include "bench.hpp"
+#include <string_view>
+
+// Usage: bench [--json] [FILTER]
+// Run the checks and benchmark cases whose name contains FILTER (all by
+// default), printing the results as a table, or as JSON with `--json`. Exit
+// with 1 if a check fails.
+int main(int argc, char *argv[]) {
+    bool json = false;
+    std::string_view filter;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (arg == "--json") {
+            json = true;
+        } else {
+            filter = arg;
+        }
+    }
+    return Bench::RunAll(filter, json) ? 0 : 1;
+}
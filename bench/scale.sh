@@ -0,0 +1,47 @@
+#!/bin/sh
+
+# Throughput of the server from 1 to N worker threads, in shared and sharded
+# mode, measured with bin/loadgen.
+#
+# Usage: bench/scale.sh [MAX_THREADS] [ROOT]
+#
+# The server is pinned to the first MAX_THREADS CPUs and the load generator
+# to the remaining ones, so that both do not compete for the same cores; the
+# machine needs more than MAX_THREADS CPUs for the numbers to mean anything.
+
+BIN=${BIN:-build/bin/FasterAPI}
+LOADGEN=${LOADGEN:-build/bin/loadgen}
+PORT=${PORT:-8080}
+CONNS=${CONNS:-256}
+DURATION=${DURATION:-10}
+DEPTH=${DEPTH:-1}
+MAX_THREADS=${1:-$(($(nproc) / 2))}
+ROOT=${2:-.}
+N_CPU=$(nproc)
+
+if [ "$MAX_THREADS" -lt 1 ] || [ "$MAX_THREADS" -ge "$N_CPU" ]; then
+    echo "MAX_THREADS must be between 1 and $((N_CPU - 1))"
+    exit 1
+fi
+
+printf "%-8s %8s %14s %10s\n" "mode" "threads" "requests/s" "p99 (us)"
+for mode in shared sharded; do
+    flag=""
+    [ "$mode" = "sharded" ] && flag="--sharded"
+    t=1
+    while [ "$t" -le "$MAX_THREADS" ]; do
+        taskset -c 0-$((MAX_THREADS - 1)) \
+            "$BIN" -p "$PORT" -t "$t" --pin $flag "$ROOT" >/dev/null 2>&1 &
+        pid=$!
+        sleep 0.5
+        out=$(taskset -c "$MAX_THREADS-$((N_CPU - 1))" \
+            "$LOADGEN" -t "$((N_CPU - MAX_THREADS))" -c "$CONNS" \
+            -d "$DURATION" -p "$DEPTH" "http://127.0.0.1:$PORT/")
+        rps=$(echo "$out" | awk '/Requests\/sec/ {print $2}')
+        p99=$(echo "$out" | awk '/Latency/ {print $8}')
+        kill "$pid"
+        wait "$pid" 2>/dev/null
+        printf "%-8s %8d %14s %10s\n" "$mode" "$t" "$rps" "$p99"
+        t=$((t * 2))
+    done
+done
@@ -0,0 +1,52 @@
+#!/bin/sh
+
+# Requests per second and system calls per request of one or more builds of
+# the server, e.g. before and after a change:
+#
+#   bench/syscalls.sh build-before/bin/FasterAPI build/bin/FasterAPI
+#
+# or against a build configured with -DFASTERAPI_IO_URING=ON, with PATHS a
+# file of request paths (see loadgen -f) under ROOT that add up to more than
+# the file cache holds, so that the requests read the files:
+#
+#   ROOT=www PATHS=paths.txt bench/syscalls.sh build/bin/FasterAPI \
+#       build-uring/bin/FasterAPI
+#
+# System calls are counted by perf(1) on the raw_syscalls:sys_enter
+# tracepoint of the server process while bin/loadgen runs, which needs
+# access to tracepoints (root or kernel.perf_event_paranoid <= -1).
+#
+# Usage: bench/syscalls.sh [BIN]... (default build/bin/FasterAPI)
+
+LOADGEN=${LOADGEN:-build/bin/loadgen}
+PORT=${PORT:-8080}
+THREADS=${THREADS:-2}
+CONNS=${CONNS:-64}
+DURATION=${DURATION:-10}
+DEPTH=${DEPTH:-1}
+URL_PATH=${URL_PATH:-/}
+ROOT=${ROOT:-.}
+PATHS=${PATHS:-}
+[ $# -eq 0 ] && set -- build/bin/FasterAPI
+
+printf "%-40s %14s %14s\n" "server" "requests/s" "syscalls/req"
+for bin in "$@"; do
+    "$bin" -p "$PORT" -t "$THREADS" "$ROOT" >/dev/null 2>&1 &
+    pid=$!
+    sleep 0.5
+    perf stat -x, -e raw_syscalls:sys_enter -p "$pid" -o /tmp/syscalls.$$ \
+        -- sleep "$DURATION" &
+    perf_pid=$!
+    out=$("$LOADGEN" -t "$THREADS" -c "$CONNS" -d "$DURATION" -p "$DEPTH" \
+        ${PATHS:+-f "$PATHS"} "http://127.0.0.1:$PORT$URL_PATH")
+    wait "$perf_pid"
+    kill "$pid"
+    wait "$pid" 2>/dev/null
+    n_req=$(echo "$out" | awk '/^Requests:/ {print $2}')
+    rps=$(echo "$out" | awk '/Requests\/sec/ {print $2}')
+    n_sys=$(awk -F, '/raw_syscalls/ {print $1}' /tmp/syscalls.$$)
+    rm -f /tmp/syscalls.$$
+    per_req=$(awk -v s="$n_sys" -v r="$n_req" \
+        'BEGIN { if (r > 0 && s != "") printf "%.2f", s / r; else print "-" }')
+    printf "%-40s %14s %14s\n" "$bin" "$rps" "$per_req"
+done
@@ -1,21 +1,18 @@
 #pragma once
 
+#include "simd.hpp"
+#include <cstring>
+#include <string_view>
+
 // HTTP header delimiter
 #define CRLF "\r\n"
 #define CRLF2 "\r\n\r\n"
 
-// Conditionally include the appropriate SIMD headers,
-// prototypes, and macro definitions based on the target
-#if defined(__aarch64__) || defined(__ARM_NEON)
-#include <arm_neon.h>
-void toupper_ascii_neon(char *str);
-#define TOUPPER_ASCII(str) toupper_ascii_neon(str)
-// TODO: the AVX2 detection is not working
-#elif defined(__AVX2__)
-#include <immintrin.h>
-void toupper_ascii_avx2(char *str);
-#define TOUPPER_ASCII(str) toupper_ascii_avx2(str)
-#else
-void toupper_ascii_scalar(char *str);
-#define TOUPPER_ASCII(str) toupper_ascii_scalar(str)
-#endif
+// Upper-case a NUL-terminated ASCII string in place with the SIMD kernel
+// selected at startup, see `simd.hpp`.
+#define TOUPPER_ASCII(str) Simd::toupper((str), std::strlen(str))
+
+// Case-insensitive comparison of two ASCII strings, e.g. header names.
+static inline bool iequals_ascii(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && Simd::iequals(a.data(), b.data(), a.size());
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "common.hpp"
+#include "httphdr.hpp"
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Content codings of responses (RFC 9110, section 8.4).
+//
+// A file of a compressible type is sent to a client accepting it either
+// from a precompressed sibling, "FILE.br" or "FILE.gz" next to "FILE", or
+// compressed with zlib on its first request, the result being cached. Brotli
+// is only served precompressed: compressing it well is too slow to do on the
+// fly, which is why it is worth doing ahead of time.
+namespace Compress {
+
+    enum class Coding : uint8_t {
+        Identity = 0,
+        Gzip,
+        Deflate,
+        Br,
+    };
+
+    inline constexpr uint8_t kNCoding = 4;
+
+    // Set of codings, a bit per coding.
+    using Codings = uint8_t;
+
+    constexpr Codings bit(Coding coding) {
+        return static_cast<Codings>(1u << static_cast<uint8_t>(coding));
+    }
+
+    namespace {
+        inline constexpr std::array<std::string_view, kNCoding> kArrName = {
+            "identity", "gzip", "deflate", "br"};
+        inline constexpr std::array<std::string_view, kNCoding>
+            kArrEncodingLine = {"", "Content-Encoding: gzip" CRLF,
+                                "Content-Encoding: deflate" CRLF,
+                                "Content-Encoding: br" CRLF};
+        // of the precompressed siblings; none for deflate
+        inline constexpr std::array<std::string_view, kNCoding> kArrSuffix = {
+            "", ".gz", "", ".br"};
+    } // namespace
+
+    // Header line telling caches that responses of compressible files
+    // depend on Accept-Encoding.
+    inline constexpr std::string_view kVaryLine =
+        "Vary: Accept-Encoding" CRLF;
+
+    // Compression level of zlib used by default, its own default: most of
+    // the gain of level 9 at a fraction of its time.
+    inline constexpr int kDefaultLevel = 6;
+
+    static inline std::string_view name(Coding coding) {
+        return kArrName.at(static_cast<uint8_t>(coding));
+    }
+
+    // "Content-Encoding: ...\r\n"; empty for identity.
+    static inline std::string_view encoding_line(Coding coding) {
+        return kArrEncodingLine.at(static_cast<uint8_t>(coding));
+    }
+
+    // Suffix of the precompressed sibling of a file, e.g. ".br"; empty if
+    // the coding has none.
+    static inline std::string_view suffix(Coding coding) {
+        return kArrSuffix.at(static_cast<uint8_t>(coding));
+    }
+
+    // Whether files of the type gain from compression: text, not formats
+    // compressed already such as images and archives.
+    static inline bool Compressible(HttpHdr::ContType cont_type) {
+        using HttpHdr::ContType;
+        switch (cont_type) {
+        case ContType::TEXT_PLAIN:
+        case ContType::TEXT_HTML:
+        case ContType::TEXT_CSS:
+        case ContType::TEXT_JAVASCRIPT:
+        case ContType::IMAGE_SVG:
+        case ContType::APPLICATION_JSON:
+        case ContType::APPLICATION_XML:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Codings other than identity accepted by a request with the
+    // Accept-Encoding value `accept`: those listed, or covered by "*", with
+    // a non-zero q-value.
+    Codings Accepted(std::string_view accept);
+
+    // Compress `data` as gzip or deflate (the zlib format, as HTTP means it)
+    // at the zlib level `level`; empty on failure.
+    std::string Encode(std::string_view data, Coding coding,
+                       int level = kDefaultLevel);
+
+    // Decompress `data` encoded by `Encode`; empty on failure.
+    std::string Decode(std::string_view data, Coding coding);
+
+} // namespace Compress
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "httpcond.hpp"
+#include "httphdr.hpp"
+#include <array>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace FileCache {
+
+    // An immutable cached file.
+    // Hits share it by reference count, so serving one copies nothing: the
+    // pre-serialized head and the body are written to the socket as they are.
+    struct Entry {
+        // status line, Content-Type and Content-Length, and Content-Encoding
+        // if the body is compressed
+        std::string head;
+        std::string body;
+        std::string file; // path relative to the root, e.g. "/index.html"
+        HttpHdr::ContType cont_type;
+        // of the file, or of the variant in a content coding the body is
+        HttpCond::Validators validators;
+    };
+
+    using EntryPtr = std::shared_ptr<const Entry>;
+
+    // Sharded, byte-bounded LRU cache of files keyed by request path.
+    //
+    // A key is hashed to one of `kNShard` shards, each an LRU list guarded by
+    // its own mutex, so concurrent hits on different paths rarely contend. A
+    // hit is a hash lookup and a list splice: no allocation, no syscall.
+    //
+    // Entries are dropped by `Invalidate` when the file changes on disk. The
+    // cache starts disabled and must be enabled once such invalidation is in
+    // place, otherwise it would serve stale files forever.
+    class Cache {
+      public:
+        inline static constexpr size_t kNShard = 16;
+
+        // `capacity`: bytes of all entries; `max_entry`: largest body cached
+        Cache(size_t capacity, size_t max_entry)
+            : shard_cap_(capacity / kNShard), max_entry_(max_entry),
+              gen_(0), enabled_(false) {}
+
+        bool enabled() const {
+            return enabled_.load(std::memory_order_relaxed);
+        }
+
+        void Enable() { enabled_.store(true, std::memory_order_relaxed); }
+
+        // Stop caching and drop every entry, for good if invalidation is
+        // no longer in place.
+        void Disable() {
+            enabled_.store(false, std::memory_order_relaxed);
+            Invalidate("", true);
+        }
+
+        size_t max_entry() const { return max_entry_; }
+
+        // Invalidation generation.
+        // Read it before reading a file from disk and pass it to `Put`, so an
+        // entry read before a concurrent invalidation is never inserted.
+        uint64_t generation() const {
+            return gen_.load(std::memory_order_acquire);
+        }
+
+        // Find the entry of a request path; nullptr on a miss.
+        EntryPtr Get(std::string_view path);
+
+        // Insert or replace the entry of a request path, evicting the least
+        // recently used entries of its shard to stay within capacity.
+        void Put(std::string_view path, EntryPtr entry, uint64_t gen);
+
+        // Drop the entries of the file `file` (relative to the root), or of
+        // every file below it if `is_dir`. An empty path drops everything.
+        void Invalidate(std::string_view file, bool is_dir);
+
+      private:
+        struct Node {
+            std::string key;
+            EntryPtr entry;
+            size_t size;
+        };
+
+        struct Shard {
+            std::mutex mtx;
+            std::list<Node> lru; // most recently used first
+            // keys are views of `Node::key`, which list nodes keep in place
+            std::unordered_map<std::string_view, std::list<Node>::iterator>
+                map;
+            size_t bytes = 0;
+        };
+
+        Shard &shard(std::string_view path) {
+            return shards_[std::hash<std::string_view>{}(path) % kNShard];
+        }
+
+        const size_t shard_cap_;
+        const size_t max_entry_;
+        std::atomic<uint64_t> gen_;
+        std::atomic<bool> enabled_;
+        std::array<Shard, kNShard> shards_;
+    };
+
+} // namespace FileCache
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <asio.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Blocking filesystem work kept off the I/O threads.
+//
+// `Pool` runs the work that cannot be done without blocking, e.g.
+// resolving a path or opening a file, on threads of its own while the
+// coroutine waiting for it is suspended, so that a slow disk stalls no
+// socket. It is bounded: past a number of jobs queued or running, new ones
+// are refused rather than queued without limit.
+//
+// Built with the FASTERAPI_IO_URING CMake option, the reads of files are
+// rather submitted to an io_uring of the I/O context (`Read`): the
+// submissions made while the context runs its ready handlers go to the
+// kernel in one io_uring_enter(2), and the coroutine is resumed by the
+// completion without a thread of the pool in between. The kernel is probed
+// once (too old, `kernel.io_uring_disabled`, a seccomp filter); if it
+// refuses io_uring, the reads stay on the pool.
+namespace FileIo {
+
+    // Whether files are read through io_uring: built with it, and the
+    // kernel allows it. Probed once.
+    bool Uring();
+
+    // Name of the I/O backend of the server, for the logs: "epoll" or
+    // "epoll + io_uring file reads".
+    std::string_view Backend();
+
+    // Read `size` bytes of the open file `fd` from its start through the
+    // io_uring of the calling coroutine's I/O context; empty on failure.
+    // Without io_uring, the read is a blocking pread(2) on the calling
+    // thread.
+    asio::awaitable<std::string> Read(int fd, size_t size);
+
+    // Threads for blocking filesystem work.
+    class Pool {
+      public:
+        // `n_threads` threads; at most `max_queue` jobs queued or running.
+        Pool(size_t n_threads, size_t max_queue)
+            : pool_(n_threads), max_queue_(max_queue) {}
+
+        Pool(const Pool &) = delete;
+        Pool &operator=(const Pool &) = delete;
+
+        // Run `fn` on a thread of the pool and return true once it is done,
+        // the calling coroutine resuming on its own executor; return false at
+        // once, without running it, if the pool is full.
+        template <typename Fn> asio::awaitable<bool> Run(Fn fn);
+
+        // Jobs queued or running.
+        size_t n_queued() const {
+            return n_queued_.load(std::memory_order_relaxed);
+        }
+        uint64_t n_done() const {
+            return n_done_.load(std::memory_order_relaxed);
+        }
+        uint64_t n_rejected() const {
+            return n_rejected_.load(std::memory_order_relaxed);
+        }
+
+      private:
+        asio::thread_pool pool_;
+        const size_t max_queue_;
+        std::atomic<size_t> n_queued_{0};
+        std::atomic<uint64_t> n_done_{0};
+        std::atomic<uint64_t> n_rejected_{0};
+    };
+
+    template <typename Fn> asio::awaitable<bool> Pool::Run(Fn fn) {
+        if (n_queued_.fetch_add(1, std::memory_order_relaxed) >= max_queue_) {
+            n_queued_.fetch_sub(1, std::memory_order_relaxed);
+            n_rejected_.fetch_add(1, std::memory_order_relaxed);
+            co_return false;
+        }
+        // `fn` lives in this frame, suspended until the job completes
+        co_await asio::async_initiate<decltype(asio::use_awaitable), void()>(
+            [this, &fn](auto handler) {
+                asio::post(pool_, [this, &fn,
+                                   handler = std::move(handler)]() mutable {
+                    fn();
+                    n_queued_.fetch_sub(1, std::memory_order_relaxed);
+                    n_done_.fetch_add(1, std::memory_order_relaxed);
+                    const auto exor = asio::get_associated_executor(handler);
+                    asio::dispatch(exor, std::move(handler));
+                });
+            },
+            asio::use_awaitable);
+        co_return true;
+    }
+
+} // namespace FileIo
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "log.hpp"
+#include <asio.hpp>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace FsWatch {
+
+    // Recursive inotify watch on a directory tree.
+    //
+    // Every change to a file or directory below the root (write, attribute
+    // change, creation, deletion, rename) is reported to the subscribers as a
+    // path relative to the root, starting with '/', e.g. "/css/site.css".
+    // Directories created later are watched as they appear. If the kernel
+    // drops events (queue overflow) or the root itself goes away, subscribers
+    // receive an empty path, meaning "anything may have changed". If part of
+    // the tree cannot be watched (a watch cannot be added, e.g. ENOSPC when
+    // fs.inotify.max_user_watches is exhausted, or the descriptor fails),
+    // the watcher is no longer `complete` and the lost subscribers are told
+    // once: changes may go unreported from then on.
+    //
+    // The inotify descriptor is read asynchronously by the `Run` coroutine,
+    // so no dedicated thread is needed. Failures go to the error log of
+    // `log`.
+    class Watcher {
+      public:
+        // `is_dir` tells whether the path is a directory, in which case
+        // everything below it is affected too.
+        using Callback =
+            std::function<void(std::string_view path, bool is_dir)>;
+
+        Watcher(const asio::any_io_executor &exor, const std::string &root,
+                Log::Logger &log)
+            : desc_(exor), root_(root), log_(log) {}
+
+        // Create the inotify instance and watch the tree.
+        // Return false if inotify is not available.
+        bool Open();
+
+        // Register a callback; must be called before `Run`.
+        void Subscribe(Callback cb) { subs_.push_back(std::move(cb)); }
+
+        // Register a callback for when the tree stops being watched whole;
+        // must be called before `Run`.
+        void SubscribeLost(std::function<void()> cb) {
+            lost_subs_.push_back(std::move(cb));
+        }
+
+        // Whether every directory of the tree is watched so far.
+        bool complete() const { return complete_; }
+
+        // Dispatch events until the descriptor is closed or fails.
+        asio::awaitable<void> Run();
+
+      private:
+        // Watch `rel` and every directory below it.
+        void add_tree(const std::string &rel);
+
+        void notify(std::string_view path, bool is_dir) const;
+
+        // Part of the tree is not watched: tell the lost subscribers once.
+        void lose();
+
+        asio::posix::stream_descriptor desc_;
+        const std::string root_;
+        Log::Logger &log_;
+        std::vector<Callback> subs_;
+        std::vector<std::function<void()>> lost_subs_;
+        bool complete_ = true;
+        // watch descriptor -> directory relative to the root ("" for root)
+        std::unordered_map<int, std::string> dirs_;
+    };
+
+} // namespace FsWatch
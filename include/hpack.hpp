@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+
+// HPACK, the header compression of HTTP/2 (RFC 7541).
+//
+// A field is sent as an index into the static table of common fields, or
+// into the dynamic table of fields sent before on the connection, or as a
+// literal, its name possibly indexed, which either side may add to its
+// dynamic table. Each direction of a connection has its own dynamic table:
+// the decoder's mirrors the peer's encoder, and ours, mirrored by the peer,
+// keeps the fields that repeat from response to response, such as
+// content-type and vary, so that they cost a byte or two each after the
+// first response.
+//
+// String literals may be Huffman coded with the static code of the RFC;
+// both directions support it, the encoder using it when it is shorter.
+namespace Hpack {
+
+    // Size of the dynamic tables by default (SETTINGS_HEADER_TABLE_SIZE), and
+    // the most either of ours takes.
+    inline constexpr size_t kDefaultTableSize = 4096;
+
+    // Number of entries of the static table.
+    inline constexpr size_t kNStatic = 61;
+
+    // Size a field takes in a dynamic table: its name and value, and 32
+    // bytes of overhead.
+    constexpr size_t entry_size(std::string_view name, std::string_view value) {
+        return name.size() + value.size() + 32;
+    }
+
+    // The static table followed by a dynamic table, as indexed by a header
+    // block: 1 to `kNStatic`, then the newest dynamic entry first.
+    class Table {
+      public:
+        explicit Table(size_t max_size) : max_size_(max_size) {}
+
+        size_t size() const { return size_; }
+        size_t max_size() const { return max_size_; }
+
+        // Resize the dynamic table, evicting the oldest entries as needed.
+        void SetMaxSize(size_t max_size);
+
+        // Add a field as the newest entry, evicting the oldest ones to make
+        // room; a field larger than the table empties it.
+        void Add(std::string_view name, std::string_view value);
+
+        // Field at `index`; false if there is none.
+        bool Get(size_t index, std::string_view &name,
+                 std::string_view &value) const;
+
+        // Index of the field `name`: `value`, 0 if there is none; `exact`
+        // tells whether the value matches too, else only the name does.
+        size_t Find(std::string_view name, std::string_view value,
+                    bool &exact) const;
+
+      private:
+        struct Entry {
+            std::string name;
+            std::string value;
+        };
+
+        void evict(size_t max_size);
+
+        std::deque<Entry> entries_; // newest first
+        size_t size_ = 0;
+        size_t max_size_;
+    };
+
+    // Decoder of the header blocks of a connection.
+    class Decoder {
+      public:
+        // `max_table`: the table size we announce, which the peer's size
+        // updates may not exceed.
+        explicit Decoder(size_t max_table = kDefaultTableSize)
+            : table_(max_table), max_table_(max_table) {}
+
+        // Decode `block`, calling `emit(name, value)` for each field in
+        // order; the views are valid during the call. False if the block is
+        // malformed, a connection error of type COMPRESSION_ERROR, as the
+        // table may then be out of step with the peer's.
+        template <typename Emit>
+        bool Decode(std::string_view block, Emit &&emit) {
+            bool fields = false;
+            while (!block.empty()) {
+                std::string_view name;
+                std::string_view value;
+                switch (next(block, name, value)) {
+                case Step::Field:
+                    fields = true;
+                    emit(name, value);
+                    break;
+                case Step::Update:
+                    // size updates only come first
+                    if (fields) {
+                        return false;
+                    }
+                    break;
+                case Step::Error:
+                    return false;
+                }
+            }
+            return true;
+        }
+
+      private:
+        enum class Step { Field, Update, Error };
+
+        // Decode the next representation of `block` and drop it from the
+        // block.
+        Step next(std::string_view &block, std::string_view &name,
+                  std::string_view &value);
+
+        // Decode a string literal into `buf` if Huffman coded, else view it
+        // in place.
+        static bool string(std::string_view &block, std::string &buf,
+                           std::string_view &out);
+
+        Table table_;
+        const size_t max_table_;
+        std::string name_buf_;
+        std::string value_buf_;
+    };
+
+    // Encoder of the header blocks of a connection.
+    class Encoder {
+      public:
+        Encoder() : table_(kDefaultTableSize) {}
+
+        // Apply the peer's SETTINGS_HEADER_TABLE_SIZE; the table is signalled
+        // at the start of the next block.
+        void SetMaxTableSize(size_t size);
+
+        // Start a block in `out`.
+        void Begin(std::string &out);
+
+        // Append the field `name`: `value` to the block in `out`; `name` is
+        // lower case. A field that is not indexed, e.g. one whose value
+        // changes with every response, is not added to the dynamic table.
+        void Encode(std::string &out, std::string_view name,
+                    std::string_view value, bool indexed = true);
+
+      private:
+        Table table_;
+        // smallest size the table was set to since the last block, and the
+        // size it ends at, to signal; SIZE_MAX if unchanged
+        size_t min_update_ = SIZE_MAX;
+        size_t update_ = SIZE_MAX;
+    };
+
+    // Append `str` to `out` in the Huffman code.
+    void HuffmanEncode(std::string &out, std::string_view str);
+
+    // Length of `str` in the Huffman code.
+    size_t HuffmanSize(std::string_view str);
+
+    // Decode `in`, in the Huffman code, appending to `out`; false if it is
+    // malformed.
+    bool HuffmanDecode(std::string_view in, std::string &out);
+
+} // namespace Hpack
@@ -0,0 +1,270 @@
+#pragma once
+
+#include "fileio.hpp"
+#include "hpack.hpp"
+#include "httpreq_message.hpp"
+#include "httprsp_message.hpp"
+#include "metrics.hpp"
+#include "timewheel.hpp"
+#include <asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// HTTP/2 over cleartext TCP, "h2c" (RFC 9113).
+//
+// A connection turns to HTTP/2 either from its first bytes, the client
+// preface sent by a client knowing the server speaks it ("prior
+// knowledge"), or by an HTTP/1.1 request asking to `Upgrade: h2c`, which is
+// then answered as stream 1. Either way the listener hands the socket over
+// to a `Session` for the rest of the connection.
+//
+// Requests arrive on streams, multiplexed over the connection: each request
+// is rebuilt into an HTTP/1 head, parsed into an `HttpReq::Message` of its
+// own, and answered by the routes as any other, its handler running
+// concurrently with those of the other streams. The session runs on a strand,
+// so that its coroutines never run at the same time, even when several
+// threads run the I/O context. Responses go out as HPACK-coded HEADERS and
+// as DATA frames within the flow control windows of the peer; a writer
+// coroutine gathers the frames all streams queued since its last write into
+// the next one, so that many small responses cost few system calls.
+//
+// What a client can make the server do is bounded: the reader stops reading
+// while the frames queued are past a limit, so that replies to PING or
+// SETTINGS the client does not read cannot pile up, and streams are refused
+// while as many handlers run as streams may be open, counting those of
+// streams reset by the client, which run to their end. The request bodies
+// held for all streams at once are bounded as one HTTP/1 request's is: a
+// stream whose DATA would pass that is refused, for the client to send
+// again once others are answered.
+namespace Http2 {
+
+    // Client connection preface.
+    inline constexpr std::string_view kPreface =
+        "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+    // Its part an HTTP/1 parser takes for a complete request head.
+    inline constexpr size_t kPrefaceHead = 18;
+    static_assert(kPreface.substr(kPrefaceHead) == "SM\r\n\r\n");
+
+    inline constexpr size_t kFrameHeaderSize = 9;
+    // Initial flow control window and frame size, unless set otherwise.
+    inline constexpr uint32_t kDefaultWindow = 65535;
+    inline constexpr uint32_t kMaxWindow = 0x7fffffff;
+    inline constexpr uint32_t kDefaultFrameSize = 16384;
+    inline constexpr uint32_t kMaxFrameSize = (1 << 24) - 1;
+
+    enum class Type : uint8_t {
+        Data = 0,
+        Headers,
+        Priority,
+        RstStream,
+        Settings,
+        PushPromise,
+        Ping,
+        GoAway,
+        WindowUpdate,
+        Continuation,
+    };
+
+    // Flags of frames, by the types having them.
+    inline constexpr uint8_t kEndStream = 0x1;  // DATA, HEADERS
+    inline constexpr uint8_t kAck = 0x1;        // SETTINGS, PING
+    inline constexpr uint8_t kEndHeaders = 0x4; // HEADERS, CONTINUATION
+    inline constexpr uint8_t kPadded = 0x8;     // DATA, HEADERS
+    inline constexpr uint8_t kPriority = 0x20;  // HEADERS
+
+    enum class ErrorCode : uint32_t {
+        NoError = 0,
+        ProtocolError,
+        InternalError,
+        FlowControlError,
+        SettingsTimeout,
+        StreamClosed,
+        FrameSizeError,
+        RefusedStream,
+        Cancel,
+        CompressionError,
+        ConnectError,
+        EnhanceYourCalm,
+    };
+
+    enum class Setting : uint16_t {
+        HeaderTableSize = 1,
+        EnablePush,
+        MaxConcurrentStreams,
+        InitialWindowSize,
+        MaxFrameSize,
+        MaxHeaderListSize,
+    };
+
+    struct FrameHeader {
+        uint32_t length;
+        Type type;
+        uint8_t flags;
+        uint32_t stream;
+    };
+
+    // Parse the 9 bytes of a frame header at `p`.
+    FrameHeader ParseFrameHeader(const char *p);
+
+    // Append a frame header to `out`.
+    void AppendFrameHeader(std::string &out, size_t length, Type type,
+                           uint8_t flags, uint32_t stream);
+
+    // Settings of the peer that bear on what the server sends.
+    struct Settings {
+        uint32_t header_table_size = Hpack::kDefaultTableSize;
+        uint32_t initial_window = kDefaultWindow;
+        uint32_t max_frame_size = kDefaultFrameSize;
+    };
+
+    // Apply the parameters of a SETTINGS payload to `settings`; other than
+    // `NoError` if one is invalid, a connection error.
+    ErrorCode ApplySettings(std::string_view payload, Settings &settings);
+
+    // Whether `req` asks to upgrade its connection to h2c: an HTTP/1.1
+    // request without a body, with "h2c" among its Upgrade tokens and with
+    // HTTP2-Settings.
+    bool Upgrades(const HttpReq::Message &req);
+
+    // Decode `in`, in base64url as HTTP2-Settings has it, padded or not,
+    // into `out`; false if it is malformed.
+    bool DecodeBase64Url(std::string_view in, std::string &out);
+
+    struct Options {
+        // most bytes of a request body, more being answered 413, and of the
+        // bodies held for all streams of the connection
+        size_t max_body;
+        // most streams open, or handlers running, at once, more being
+        // refused
+        uint32_t max_streams;
+        std::chrono::seconds idle_timeout;
+        std::chrono::seconds write_timeout;
+    };
+
+    // What the session asks of the server.
+    struct Hooks {
+        // Answer `req`, whose body has been read whole, in `rsp`.
+        std::function<asio::awaitable<void>(const HttpReq::Message &req,
+                                            HttpRsp::Message &rsp)>
+            serve;
+        // `rsp` to `req`, begun at `start`, was sent in full, `bytes` of it,
+        // or its stream ended before.
+        std::function<void(const HttpReq::Message &req,
+                           const HttpRsp::Message &rsp, uint64_t bytes,
+                           Metrics::Clock::time_point start)>
+            done;
+    };
+
+    // An HTTP/2 connection, from the client preface on.
+    class Session {
+      public:
+        // The session reads and writes `socket` with the deadline `timer`,
+        // reads large files on `pool`, and records its traffic in `metrics`.
+        Session(asio::ip::tcp::socket &socket, TimeWheel::Wheel &wheel,
+                TimeWheel::Timer &timer, FileIo::Pool &pool,
+                Metrics::Registry &metrics, const Options &opts, Hooks hooks);
+
+        Session(const Session &) = delete;
+        Session &operator=(const Session &) = delete;
+
+        // Serve the connection until either side ends it, and every stream
+        // with it. `buffered`: the bytes read already, from the preface on.
+        // `upgrade`: the head of the HTTP/1.1 request that upgraded the
+        // connection, if any; it is answered "101 Switching Protocols"
+        // first, then as stream 1.
+        // Must run on a strand of its own.
+        asio::awaitable<void> Run(std::string_view buffered,
+                                  std::string_view upgrade = {});
+
+      private:
+        struct Stream;
+        using StreamPtr = std::shared_ptr<Stream>;
+
+        // Handle a frame; other than `NoError` on a connection error.
+        ErrorCode frame(const FrameHeader &fh, std::string_view payload);
+        ErrorCode on_headers(const FrameHeader &fh, std::string_view payload);
+        ErrorCode on_data(const FrameHeader &fh, std::string_view payload);
+        ErrorCode on_window_update(const FrameHeader &fh,
+                                   std::string_view payload);
+        ErrorCode on_settings(const FrameHeader &fh, std::string_view payload);
+        // Decode the header block of `block_`, whole.
+        ErrorCode end_headers();
+
+        // Open the stream `id`, new, of the request head `head`.
+        StreamPtr open(uint32_t id, std::string_view head);
+        // The request of `s` is in: check its length and answer it.
+        void end_request(const StreamPtr &s);
+        // Answer `s` once its request is in, on a coroutine of its own.
+        void start(const StreamPtr &s);
+        asio::awaitable<void> respond(StreamPtr s);
+        // Send the response of `s` within the flow control windows.
+        asio::awaitable<uint64_t> send(Stream &s);
+
+        // Queue RST_STREAM for `s` and forget it.
+        void reset(Stream &s, ErrorCode code);
+        void reset(uint32_t id, ErrorCode code);
+        // The response of `s` was sent in full.
+        void close_local(Stream &s);
+        // The body of `s` is no longer needed: stop counting it.
+        void release(Stream &s);
+        void queue_window_update(uint32_t id, uint32_t increment);
+        void queue_goaway(ErrorCode code);
+
+        // Write what is queued in `out_`, as long as the session runs.
+        asio::awaitable<void> writer();
+
+        // Signals: a waiter waits on a timer that never expires, and is woken
+        // by cancelling it. Waiters check their condition again.
+        static asio::awaitable<void> wait(asio::steady_timer &signal);
+        static void notify(asio::steady_timer &signal) { signal.cancel(); }
+
+        asio::ip::tcp::socket &socket_;
+        TimeWheel::Wheel &wheel_;
+        TimeWheel::Timer &timer_;
+        FileIo::Pool &pool_;
+        Metrics::Registry &metrics_;
+        const Options opts_;
+        const Hooks hooks_;
+        asio::any_io_executor strand_;
+
+        Settings peer_;
+        Hpack::Decoder decoder_;
+        Hpack::Encoder encoder_;
+        std::unordered_map<uint32_t, StreamPtr> streams_;
+        uint32_t last_stream_ = 0;
+        // flow control windows of the connection
+        int64_t send_window_ = kDefaultWindow;
+        int64_t recv_window_;
+        // bytes of request bodies held by the streams
+        size_t buffered_ = 0;
+        // header block being received, and its stream and flags
+        std::string block_;
+        uint32_t block_stream_ = 0;
+        uint8_t block_flags_ = 0;
+        // scratch space for a request head being rebuilt, its fields, and
+        // the header block of a response
+        std::string buf_;
+        std::string fields_;
+        std::string name_;
+        std::string out_block_;
+
+        // frames queued, and those being written
+        std::string out_;
+        std::string writing_buf_;
+        bool writing_ = false;
+        // the session is ending: streams stop sending
+        bool closing_ = false;
+        bool writer_done_ = false;
+        size_t n_tasks_ = 0; // stream coroutines running
+        asio::steady_timer wake_writer_;
+        asio::steady_timer drained_;   // a write completed
+        asio::steady_timer window_;    // flow control windows grew
+        asio::steady_timer tasks_;     // a coroutine ended
+    };
+
+} // namespace Http2
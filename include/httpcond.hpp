@@ -0,0 +1,115 @@
+#pragma once
+
+#include "common.hpp"
+#include "httphdr.hpp"
+#include <array>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
+
+// Conditional and range requests (RFC 9110, sections 13 and 14).
+//
+// A file answered carries validators made from its metadata when it was
+// opened: an entity tag from its modification time and size, as nginx makes
+// them, and the modification time as Last-Modified. A client holding a copy
+// sends them back in If-None-Match or If-Modified-Since and gets a 304
+// without a body if the file did not change. A client resuming a download
+// sends Range, guarded by If-Range, and gets the parts it lacks in a 206:
+// a part of a cached file is a slice of its entry, a part of a large file
+// is sent with sendfile(2) from its offset, so nothing else is read.
+namespace HttpCond {
+
+    // Validators of a representation of a file.
+    struct Validators {
+        std::string etag; // quoted, e.g. "\"65f1a2b3.1f-2d\""
+        std::time_t mtime = 0;
+        // "ETag: ...\r\nLast-Modified: ...\r\n", for the head
+        std::string lines;
+    };
+
+    // Part of a representation, `length` bytes from `offset`.
+    struct Range {
+        size_t offset;
+        size_t length;
+    };
+
+    // Most ranges answered; a request asking for more is answered in full,
+    // not spread over as many parts.
+    inline constexpr size_t kMaxRanges = 16;
+
+    // Most bytes of a large file read into a multipart answer; more are
+    // answered in full, streamed instead.
+    inline constexpr size_t kMaxPartsRead = 1 << 20;
+
+    struct Ranges {
+        std::array<Range, kMaxRanges> parts;
+        size_t n = 0;
+    };
+
+    // Boundary of the parts of a multipart/byteranges body.
+    inline constexpr std::string_view kBoundary =
+        "FASTERAPI_3d6b6a416f9b5fa1";
+    // the last parameter of the Content-Type line of such a body
+    static_assert([] {
+        constexpr std::string_view line =
+            HttpHdr::conttype_line(HttpHdr::ContType::MULTIPART_BYTERANGES);
+        return line.substr(line.size() - kBoundary.size() - 2,
+                           kBoundary.size()) == kBoundary;
+    }());
+
+    // Answer to a request given its preconditions and Range.
+    enum class Outcome : uint8_t {
+        Full = 0,      // 200 as usual
+        NotModified,   // 304, the client's copy is current
+        Partial,       // 206 with the ranges found
+        Unsatisfiable, // 416, no range within the representation
+    };
+
+    // Validators of a file modified at `mtime`, `size` bytes long.
+    Validators Make(const timespec &mtime, size_t size);
+
+    // Validators of the variant of a file in the content coding `coding`,
+    // e.g. "gzip": the same but for a tag of its own, as it has other bytes.
+    Validators Variant(const Validators &file, std::string_view coding);
+
+    // Whether the If-None-Match value `tags` matches `etag`: "*", or a tag
+    // listed, compared weakly.
+    bool NoneMatch(std::string_view tags, std::string_view etag);
+
+    // Whether the If-Range value `cond`, an entity tag compared strongly or a
+    // date, still designates the representation of `v`.
+    bool IfRange(std::string_view cond, const Validators &v);
+
+    // Parse the Range value `spec` against a representation of `size`
+    // bytes into `ranges`. Ranges past the end are dropped, ranges running
+    // past it are cut short. `Full` if the value is invalid or asks for more
+    // than `kMaxRanges` ranges, for it is then ignored.
+    Outcome ParseRanges(std::string_view spec, size_t size, Ranges &ranges);
+
+    // Decide the answer to a GET of the representation of `v`, `size` bytes
+    // long, from the values of its If-None-Match, If-Modified-Since, Range
+    // and If-Range fields, empty when absent (section 13.2.2). `ranges` is
+    // filled for `Partial`.
+    Outcome Evaluate(const Validators &v, size_t size,
+                     std::string_view if_none_match,
+                     std::string_view if_modified_since,
+                     std::string_view range, std::string_view if_range,
+                     Ranges &ranges);
+
+    // Append "Content-Range: bytes FIRST-LAST/SIZE\r\n" to `out`.
+    void AppendContentRange(std::string &out, Range range, size_t size);
+
+    // Append "Content-Range: bytes */SIZE\r\n" to `out`, for a 416.
+    void AppendUnsatisfied(std::string &out, size_t size);
+
+    // Append a part of a multipart/byteranges body, `data` being `range` of
+    // a representation of `size` bytes with the Content-Type line
+    // `type_line`.
+    void AppendPart(std::string &out, std::string_view type_line, Range range,
+                    size_t size, std::string_view data);
+
+    // Append the delimiter closing a multipart/byteranges body.
+    void AppendClose(std::string &out);
+
+} // namespace HttpCond
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <asio.hpp>
+#include <ctime>
+#include <string_view>
+
+// Cached value of the Date response header.
+//
+// Every response carries the current date in IMF-fixdate format (RFC 9110),
+// e.g. "Sun, 06 Nov 1994 08:49:37 GMT", which only changes once a second.
+// `Run` formats it once per second into the next slot of a ring and publishes
+// the slot with an atomic store; requests read it with one atomic load, no
+// lock and no formatting.
+//
+// A slot is rewritten only after the ring has wrapped around, i.e. `kNSlot`
+// seconds later, so a reader still copying an older date is never torn
+// unless it stalls that long mid-copy.
+namespace HttpDate {
+
+    inline constexpr size_t kNSlot = 64;
+
+    // Length of an IMF-fixdate.
+    inline constexpr size_t kLen = 29;
+
+    // Format `t` as an IMF-fixdate into `out`, which holds `kLen` chars.
+    // Independent of the locale and the time zone.
+    void Format(std::time_t t, char *out);
+
+    // Parse an IMF-fixdate into `t`; false if `date` is not one. The
+    // obsolete formats RFC 9110 still asks recipients to accept are not:
+    // dates parsed are validators, which clients echo as they were sent.
+    bool Parse(std::string_view date, std::time_t &t);
+
+    // Format the current time into the next slot and publish it.
+    void Refresh();
+
+    // The complete header line, "Date: <IMF-fixdate>\r\n", as of the last
+    // refresh. Remains valid for about `kNSlot` seconds.
+    std::string_view Line();
+
+    // Refresh the date at every turn of the second, forever.
+    asio::awaitable<void> Run();
+
+} // namespace HttpDate
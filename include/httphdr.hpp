@@ -1,7 +1,10 @@
 #pragma once
 
+#include "common.hpp"
 #include <array>
 #include <string>
+#include <string_view>
+#include <utility>
 
 namespace HttpHdr {
 
@@ -17,6 +20,14 @@ namespace HttpHdr {
         NotFound,
         BadRequest,
         OK,
+        ServiceUnavailable,
+        MethodNotAllowed,
+        PayloadTooLarge,
+        PartialContent,
+        NotModified,
+        RangeNotSatisfiable,
+        BadGateway,
+        GatewayTimeout,
     };
 
     enum class ContType : uint8_t {
@@ -34,6 +45,9 @@ namespace HttpHdr {
         APPLICATION_XML,
         APPLICATION_ZIP,
         APPLICATION_PDF,
+        APPLICATION_OCTET_STREAM,
+        // of a 206 with several ranges, see `HttpCond`
+        MULTIPART_BYTERANGES,
     };
 
     enum class Method : uint8_t {
@@ -52,6 +66,32 @@ namespace HttpHdr {
         KEEP_ALIVE,
     };
 
+    // Request header fields the server knows of, looked up by name in O(1).
+    enum class Field : uint8_t {
+        UNKNOWN = 0,
+        HOST,
+        CONTENT_LENGTH,
+        CONTENT_TYPE,
+        CONNECTION,
+        TRANSFER_ENCODING,
+        EXPECT,
+        ACCEPT,
+        ACCEPT_ENCODING,
+        RANGE,
+        IF_RANGE,
+        IF_NONE_MATCH,
+        IF_MODIFIED_SINCE,
+        UPGRADE,
+        HTTP2_SETTINGS,
+        USER_AGENT,
+        COOKIE,
+        AUTHORIZATION,
+        CACHE_CONTROL,
+        REFERER,
+        ORIGIN,
+        X_FORWARDED_FOR,
+    };
+
     namespace {
         inline static constexpr char kDEFAULT[] = "UNKNOWN";
 
@@ -59,76 +99,254 @@ namespace HttpHdr {
         inline static constexpr std::array<const char *, kNVersion>
             kArrVersionStr = {kDEFAULT, "HTTP/1.0", "HTTP/1.1", "HTTP/2"};
 
-        inline static constexpr uint8_t kNStatus = 4;
+        inline static constexpr uint8_t kNStatus = 12;
         inline static constexpr std::array<uint16_t, kNStatus> kArrStatusCode =
-            {500, 404, 400, 200};
+            {500, 404, 400, 200, 503, 405, 413, 206, 304, 416, 502, 504};
         // can have lower case text as this is for response only
         inline static constexpr std::array<const char *, kNStatus>
             kArrStatusStr = {"500 Internal Server Error", "404 Not Found",
-                             "400 Bad Request", "200 OK"};
+                             "400 Bad Request", "200 OK",
+                             "503 Service Unavailable",
+                             "405 Method Not Allowed",
+                             "413 Content Too Large",
+                             "206 Partial Content", "304 Not Modified",
+                             "416 Range Not Satisfiable",
+                             "502 Bad Gateway", "504 Gateway Timeout"};
 
         inline static constexpr uint8_t kNMethod = 8;
         inline static constexpr std::array<const char *, kNMethod>
             kArrMethodStr = {kDEFAULT, "GET",  "POST",    "PUT",
                              "DELETE", "HEAD", "OPTIONS", "PATCH"};
 
-        inline static constexpr uint8_t kNConn = 3;
+        inline static constexpr uint8_t kNConn = 2;
         inline static constexpr std::array<const char *, kNConn> kArrConnStr = {
-            kDEFAULT, "KEEP-ALIVE", "CLOSE"};
+            "CLOSE", "KEEP-ALIVE"};
 
-        inline static constexpr uint8_t kNContentType = 14;
+        inline static constexpr uint8_t kNContentType = 16;
         inline static constexpr std::array<const char *, kNContentType>
             kArrContentTypeStr = {
                 kDEFAULT,          "TEXT/PLAIN",       "TEXT/HTML",
                 "TEXT/CSS",        "TEXT/JAVASCRIPT",  "IMAGE/JPEG",
                 "IMAGE/PNG",       "IMAGE/GIF",        "IMAGE/SVG+XML",
                 "IMAGE/X-ICON",    "APPLICATION/JSON", "APPLICATION/XML",
-                "APPLICATION/ZIP", "APPLICATION/PDF"};
+                "APPLICATION/ZIP", "APPLICATION/PDF",
+                "APPLICATION/OCTET-STREAM", "MULTIPART/BYTERANGES"};
+
+        // Complete response head lines, precomputed so that serializing a
+        // head is a few appends of constant fragments; indexed like the
+        // string tables above.
+        inline static constexpr std::array<std::string_view, kNStatus>
+            kArrStatusLine = {"HTTP/1.1 500 Internal Server Error\r\n",
+                              "HTTP/1.1 404 Not Found\r\n",
+                              "HTTP/1.1 400 Bad Request\r\n",
+                              "HTTP/1.1 200 OK\r\n",
+                              "HTTP/1.1 503 Service Unavailable\r\n",
+                              "HTTP/1.1 405 Method Not Allowed\r\n",
+                              "HTTP/1.1 413 Content Too Large\r\n",
+                              "HTTP/1.1 206 Partial Content\r\n",
+                              "HTTP/1.1 304 Not Modified\r\n",
+                              "HTTP/1.1 416 Range Not Satisfiable\r\n",
+                              "HTTP/1.1 502 Bad Gateway\r\n",
+                              "HTTP/1.1 504 Gateway Timeout\r\n"};
+
+        inline static constexpr std::array<std::string_view, kNContentType>
+            kArrContentTypeLine = {
+                "Content-Type: UNKNOWN\r\n",
+                "Content-Type: TEXT/PLAIN\r\n",
+                "Content-Type: TEXT/HTML\r\n",
+                "Content-Type: TEXT/CSS\r\n",
+                "Content-Type: TEXT/JAVASCRIPT\r\n",
+                "Content-Type: IMAGE/JPEG\r\n",
+                "Content-Type: IMAGE/PNG\r\n",
+                "Content-Type: IMAGE/GIF\r\n",
+                "Content-Type: IMAGE/SVG+XML\r\n",
+                "Content-Type: IMAGE/X-ICON\r\n",
+                "Content-Type: APPLICATION/JSON\r\n",
+                "Content-Type: APPLICATION/XML\r\n",
+                "Content-Type: APPLICATION/ZIP\r\n",
+                "Content-Type: APPLICATION/PDF\r\n",
+                "Content-Type: APPLICATION/OCTET-STREAM\r\n",
+                "Content-Type: MULTIPART/BYTERANGES; "
+                "boundary=FASTERAPI_3d6b6a416f9b5fa1\r\n"};
+
+        // the last header line, terminating the head
+        inline static constexpr std::array<std::string_view, kNConn>
+            kArrConnLine = {"Connection: CLOSE\r\n\r\n",
+                            "Connection: KEEP-ALIVE\r\n\r\n"};
+
+        inline static constexpr uint8_t kNField = 22;
+        inline static constexpr std::array<const char *, kNField>
+            kArrFieldStr = {kDEFAULT,
+                            "Host",
+                            "Content-Length",
+                            "Content-Type",
+                            "Connection",
+                            "Transfer-Encoding",
+                            "Expect",
+                            "Accept",
+                            "Accept-Encoding",
+                            "Range",
+                            "If-Range",
+                            "If-None-Match",
+                            "If-Modified-Since",
+                            "Upgrade",
+                            "HTTP2-Settings",
+                            "User-Agent",
+                            "Cookie",
+                            "Authorization",
+                            "Cache-Control",
+                            "Referer",
+                            "Origin",
+                            "X-Forwarded-For"};
+
+        // Perfect hash table of the names of a string table, built at
+        // compile time: a name is hashed from its length and its first and
+        // last bytes, case folded, so that finding it costs one probe and one
+        // comparison. Entry 0 of the table, UNKNOWN, is not a name; a table
+        // with colliding names does not compile, and calls for other `seed`
+        // and `mul`.
+        template <size_t NKey, size_t NSlot> class NameTable {
+          public:
+            constexpr NameTable(const std::array<const char *, NKey> &names,
+                                size_t seed, size_t mul)
+                : seed_(seed), mul_(mul) {
+                for (size_t i = 1; i < NKey; ++i) {
+                    names_[i] = names[i];
+                    uint8_t &slot = slots_[hash(names_[i])];
+                    if (slot != 0) {
+                        throw "colliding names";
+                    }
+                    slot = static_cast<uint8_t>(i);
+                }
+            }
+
+            // Index of `name` in the table, 0 if it is not there.
+            template <bool kIgnoreCase>
+            uint8_t find(std::string_view name) const {
+                if (name.empty()) {
+                    return 0;
+                }
+                const uint8_t i = slots_[hash(name)];
+                const bool equal = kIgnoreCase ? iequals_ascii(names_[i], name)
+                                               : names_[i] == name;
+                return i != 0 && equal ? i : 0;
+            }
+
+          private:
+            constexpr size_t hash(std::string_view name) const {
+                const auto fold = [](char c) {
+                    return static_cast<size_t>(static_cast<unsigned char>(c) |
+                                               0x20);
+                };
+                return (name.size() * seed_ + fold(name.front()) * mul_ +
+                        fold(name.back())) %
+                       NSlot;
+            }
+
+            std::array<std::string_view, NKey> names_{};
+            std::array<uint8_t, NSlot> slots_{};
+            size_t seed_;
+            size_t mul_;
+        };
+
+        inline static constexpr NameTable<kNVersion, 4> kVersionTable{
+            kArrVersionStr, 2, 1};
+        inline static constexpr NameTable<kNMethod, 16> kMethodTable{
+            kArrMethodStr, 1, 1};
+        // without CLOSE, entry 0: any token but keep-alive; telling close
+        // from other options is left to the caller
+        inline static constexpr NameTable<kNConn, 2> kConnTable{kArrConnStr,
+                                                                1, 1};
+        inline static constexpr NameTable<kNField, 64> kFieldTable{
+            kArrFieldStr, 14, 2};
+
+        inline static constexpr uint8_t kNExt = 16;
+        inline static constexpr std::array<std::pair<const char *, ContType>,
+                                           kNExt>
+            kArrExtContType = {{
+                {"html", ContType::TEXT_HTML},
+                {"htm", ContType::TEXT_HTML},
+                {"txt", ContType::TEXT_PLAIN},
+                {"css", ContType::TEXT_CSS},
+                {"js", ContType::TEXT_JAVASCRIPT},
+                {"mjs", ContType::TEXT_JAVASCRIPT},
+                {"jpg", ContType::IMAGE_JPEG},
+                {"jpeg", ContType::IMAGE_JPEG},
+                {"png", ContType::IMAGE_PNG},
+                {"gif", ContType::IMAGE_GIF},
+                {"svg", ContType::IMAGE_SVG},
+                {"ico", ContType::IMAGE_ICON},
+                {"json", ContType::APPLICATION_JSON},
+                {"xml", ContType::APPLICATION_XML},
+                {"zip", ContType::APPLICATION_ZIP},
+                {"pdf", ContType::APPLICATION_PDF},
+            }};
 
     } // namespace
 
     static inline const std::string ver2str(Version version) {
         return kArrVersionStr.at(static_cast<uint8_t>(version));
     }
-    static inline Version str2ver(const std::string &protocol) {
-        for (uint8_t i = 0; i < kNVersion; ++i) {
-            if (kArrVersionStr[i] == protocol) {
-                return static_cast<Version>(i);
-            }
-        }
-        return Version::UNKNOWN;
+    static inline Version str2ver(std::string_view protocol) {
+        return static_cast<Version>(kVersionTable.find<false>(protocol));
     }
 
     static inline const std::string status2str(Status status) {
         return kArrStatusStr.at(static_cast<uint8_t>(status));
     }
 
+    static inline std::string_view status_line(Status status) {
+        return kArrStatusLine.at(static_cast<uint8_t>(status));
+    }
+
     static inline const std::string method2str(const Method &method) {
         return kArrMethodStr.at(static_cast<uint8_t>(method));
     }
-    static inline Method str2method(const std::string &method) {
-        for (uint8_t i = 0; i < kNMethod; ++i) {
-            if (kArrMethodStr[i] == method) {
-                return static_cast<Method>(i);
-            }
-        }
-        return Method::UNKNOWN;
+    // Methods are case-sensitive (RFC 9110).
+    static inline Method str2method(std::string_view method) {
+        return static_cast<Method>(kMethodTable.find<false>(method));
     }
 
     static inline const std::string conn2str(const Conn &conn) {
         return kArrConnStr.at(static_cast<uint8_t>(conn));
     }
-    static inline Conn str2conn(const std::string &conn) {
-        for (uint8_t i = 0; i < kNConn; ++i) {
-            if (kArrConnStr[i] == conn) {
-                return static_cast<Conn>(i);
-            }
-        }
-        return Conn::CLOSE;
+    static inline std::string_view conn_line(Conn conn) {
+        return kArrConnLine.at(static_cast<uint8_t>(conn));
+    }
+    // Connection options are case-insensitive tokens (RFC 9110); KEEP_ALIVE
+    // for `keep-alive`, CLOSE for any other one option.
+    static inline Conn str2conn(std::string_view conn) {
+        return static_cast<Conn>(kConnTable.find<true>(conn));
+    }
+
+    static inline const std::string field2str(Field field) {
+        return kArrFieldStr.at(static_cast<uint8_t>(field));
+    }
+    // Field names are case-insensitive (RFC 9110).
+    static inline Field str2field(std::string_view name) {
+        return static_cast<Field>(kFieldTable.find<true>(name));
     }
 
     static inline const std::string conttype2str(ContType cont_type) {
         return kArrContentTypeStr.at(static_cast<uint8_t>(cont_type));
     }
 
+    static constexpr std::string_view conttype_line(ContType cont_type) {
+        return kArrContentTypeLine.at(static_cast<uint8_t>(cont_type));
+    }
+
+    // Guess the content type of a file from its extension.
+    static inline ContType ext2conttype(std::string_view path) {
+        const size_t pos = path.rfind('.');
+        if (pos != std::string_view::npos) {
+            const std::string_view ext = path.substr(pos + 1);
+            for (const auto &[e, cont_type] : kArrExtContType) {
+                if (iequals_ascii(e, ext)) {
+                    return cont_type;
+                }
+            }
+        }
+        return ContType::APPLICATION_OCTET_STREAM;
+    }
+
 } // namespace HttpHdr
@@ -0,0 +1,243 @@
+#pragma once
+
+#include "common.hpp"
+#include "httpreq_message.hpp"
+#include "timewheel.hpp"
+#include <algorithm>
+#include <asio.hpp>
+#include <cctype>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace HttpReq {
+
+    // Interim response asking a client that sent `Expect: 100-continue` for
+    // the body.
+    inline constexpr std::string_view kContinue =
+        "HTTP/1.1 100 Continue" CRLF2;
+
+    // Whether the client waits for `kContinue` before sending the body.
+    static inline bool expects_continue(const Message &req) {
+        return req.version == HttpHdr::Version::HTTP_1_1 &&
+               iequals_ascii(req.get(HttpHdr::Field::EXPECT), "100-continue");
+    }
+
+    // Incremental decoder of the chunked transfer coding (RFC 9112, 7.1).
+    //
+    // Like `Parser`, it never copies: the data of the chunks is returned as
+    // views into the input, however the input was split across reads, and
+    // the state between calls is a handful of counters. Chunk extensions and
+    // trailer fields are skipped.
+    class ChunkedDecoder {
+      public:
+        enum class Result : uint8_t {
+            Data = 0, // `out` holds the next piece of data
+            Partial,  // the input is used up; decode more
+            Done,     // the body ended; the input holds the bytes after it
+            Error,    // malformed
+        };
+
+        // Longest chunk size line, extensions included, and most bytes of
+        // trailer fields.
+        inline static constexpr size_t kMaxLine = 4096;
+        inline static constexpr size_t kMaxTrailer = 16 * 1024;
+
+        // Decode from the front of `in`, dropping what was decoded from it.
+        inline Result Decode(std::string_view &in, std::string_view &out);
+
+      private:
+        enum class State : uint8_t {
+            Size = 0, // chunk size digits
+            Ext,      // chunk extensions, up to the end of the line
+            SizeLF,   // LF ending the size line
+            Data,
+            DataCR, // CRLF ending the data
+            DataLF,
+            Trailer, // trailer fields, up to an empty line
+            Done,
+        };
+
+        uint64_t size_ = 0; // size of the chunk, then bytes of it left
+        size_t n_digits_ = 0;
+        size_t n_line_ = 0;    // bytes of the current line
+        size_t n_trailer_ = 0; // bytes of the trailer fields
+        State state_ = State::Size;
+    };
+
+    inline ChunkedDecoder::Result
+    ChunkedDecoder::Decode(std::string_view &in, std::string_view &out) {
+        while (state_ != State::Done) {
+            if (in.empty()) {
+                return Result::Partial;
+            }
+            if (state_ == State::Data) {
+                const size_t n = static_cast<size_t>(
+                    std::min<uint64_t>(size_, in.size()));
+                out = in.substr(0, n);
+                in.remove_prefix(n);
+                size_ -= n;
+                if (size_ == 0) {
+                    state_ = State::DataCR;
+                }
+                return Result::Data;
+            }
+
+            const char c = in.front();
+            in.remove_prefix(1);
+            bool line_end = false;
+            switch (state_) {
+            case State::Size:
+                if (std::isxdigit(static_cast<unsigned char>(c))) {
+                    // more than 16 digits would overflow
+                    if (++n_digits_ > 16) {
+                        return Result::Error;
+                    }
+                    const int d = c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+                    size_ = size_ * 16 + static_cast<uint64_t>(d);
+                } else if (n_digits_ == 0) {
+                    return Result::Error;
+                } else if (c == ';' || c == ' ' || c == '\t') {
+                    state_ = State::Ext;
+                } else if (c == '\r') {
+                    state_ = State::SizeLF;
+                } else if (c == '\n') {
+                    line_end = true;
+                } else {
+                    return Result::Error;
+                }
+                break;
+            case State::Ext:
+                if (c == '\r') {
+                    state_ = State::SizeLF;
+                } else if (c == '\n') {
+                    line_end = true;
+                } else if (++n_line_ > kMaxLine) {
+                    return Result::Error;
+                }
+                break;
+            case State::SizeLF:
+                if (c != '\n') {
+                    return Result::Error;
+                }
+                line_end = true;
+                break;
+            case State::DataCR:
+                if (c == '\r') {
+                    state_ = State::DataLF;
+                    break;
+                }
+                [[fallthrough]]; // a bare LF is tolerated
+            case State::DataLF:
+                if (c != '\n') {
+                    return Result::Error;
+                }
+                size_ = 0;
+                n_digits_ = n_line_ = 0;
+                state_ = State::Size;
+                break;
+            case State::Trailer:
+                if (c == '\n') {
+                    if (n_line_ == 0) {
+                        state_ = State::Done;
+                    }
+                    n_line_ = 0;
+                } else if (c != '\r') {
+                    ++n_line_;
+                    if (++n_trailer_ > kMaxTrailer) {
+                        return Result::Error;
+                    }
+                }
+                break;
+            default:
+                break;
+            }
+
+            // end of the size line: the last chunk has size 0
+            if (line_end) {
+                n_line_ = 0;
+                state_ = size_ == 0 ? State::Trailer : State::Data;
+            }
+        }
+        return Result::Done;
+    }
+
+    // Body of a request, read piece by piece as it arrives.
+    //
+    // Bytes already received with the head are returned first, in place; the
+    // rest is read from the connection into a buffer of fixed size, so a
+    // body of any size goes through in constant memory. A chunked body is
+    // decoded on the way. Every read from the connection is bounded by a
+    // deadline, and answers `Expect: 100-continue` first.
+    class BodyReader {
+      public:
+        // `buffered` holds the bytes received after the head of `req`; `buf`
+        // is the buffer of the connection for the rest.
+        BodyReader(asio::ip::tcp::socket &socket, const Message &req,
+                   std::string_view buffered, std::span<char> buf,
+                   TimeWheel::Wheel &wheel, TimeWheel::Timer &timer,
+                   TimeWheel::Clock::duration timeout)
+            : socket_(socket), buf_(buf), buffered_(buffered),
+              in_(buffered), wheel_(wheel), timer_(timer), timeout_(timeout),
+              remaining_(req.length), chunked_(req.chunked),
+              continue_(expects_continue(req)) {}
+
+        // A body received whole already, e.g. over HTTP/2; it is returned
+        // in one piece and nothing is read from `socket`.
+        BodyReader(asio::ip::tcp::socket &socket, std::string_view body,
+                   TimeWheel::Wheel &wheel, TimeWheel::Timer &timer)
+            : socket_(socket), buffered_(body), in_(body), wheel_(wheel),
+              timer_(timer), timeout_(), remaining_(body.size()),
+              chunked_(false), continue_(false) {}
+
+        // Next piece of the body, valid until the next call; empty once the
+        // body is complete, or malformed. Throw `std::system_error` if the
+        // connection fails.
+        asio::awaitable<std::string_view> Read();
+
+        // The whole body was read.
+        bool done() const { return done_; }
+        bool malformed() const { return malformed_; }
+
+        // Wheel of the deadlines of the connection, for work done on its
+        // behalf.
+        TimeWheel::Wheel &wheel() const { return wheel_; }
+
+        // Bytes of the body read so far, decoded.
+        uint64_t size() const { return size_; }
+
+        // Bytes read from the connection so far, not counting `buffered`.
+        uint64_t n_read() const { return n_read_; }
+
+        // Bytes of `buffered` used.
+        size_t n_buffered() const {
+            return in_buffered_ ? buffered_.size() - in_.size()
+                                : buffered_.size();
+        }
+
+        // Bytes read from the connection past the end of the body: the
+        // beginning of the next request.
+        std::string_view leftover() const {
+            return in_buffered_ ? std::string_view() : in_;
+        }
+
+      private:
+        asio::ip::tcp::socket &socket_;
+        const std::span<char> buf_;
+        const std::string_view buffered_;
+        std::string_view in_; // input not decoded yet
+        TimeWheel::Wheel &wheel_;
+        TimeWheel::Timer &timer_;
+        const TimeWheel::Clock::duration timeout_;
+        ChunkedDecoder decoder_;
+        uint64_t remaining_; // of a body of known length
+        uint64_t size_ = 0;
+        uint64_t n_read_ = 0;
+        const bool chunked_;
+        bool continue_;
+        bool in_buffered_ = true; // `in_` is a part of `buffered_`
+        bool done_ = false;
+        bool malformed_ = false;
+    };
+
+} // namespace HttpReq
@@ -2,65 +2,78 @@
 
 #include "common.hpp"
 #include "httphdr.hpp"
+#include "httpreq_parser.hpp"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <limits>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 
 namespace HttpReq {
 
     // Struct to hold HTTP request message
+    //
+    // The message does not own any bytes: path, body and header values are
+    // views into the connection's read buffer, produced by the incremental
+    // `Parser`. They stay valid until the buffer is consumed for the next
+    // request.
     struct Message {
-
-      private:
-        inline static const std::string kK_PATH = "PATH";
-        inline static const std::string kK_BODY = "BODY";
-        inline static const std::string kK_LENGTH = "CONTENT-LENGTH";
-        inline static const std::string kK_CONN = "CONNECTION";
-
-      public:
-        std::unordered_map<std::string, std::string> kv;
+        Parser head;
+        // Length of the body, unless it is chunked.
         size_t length;
+        bool chunked = false;
         HttpHdr::Method method;
         HttpHdr::Version version;
         HttpHdr::Conn conn;
 
         // Constructor
-        // TODO:
-        // - remove initialization of `conn` can increase the IO capacity of the
-        //   server. It is not safe and we don't know why.
-        // - consider: change `Message` to a class
         Message()
-            : kv({
-                  std::pair<std::string, std::string>{kK_PATH, ""},
-                  std::pair<std::string, std::string>{kK_BODY, ""},
-              }),
-              length(0), method(HttpHdr::Method::UNKNOWN),
-              version(HttpHdr::Version::UNKNOWN) {}
-
-        // Get a value by a specified key (read-only)
-        const std::string &get(const std::string &key) const {
-            auto it = kv.find(key);
-            if (it == kv.end()) {
-                throw std::out_of_range("Key not found: " + key);
+            : length(0), method(HttpHdr::Method::UNKNOWN),
+              version(HttpHdr::Version::UNKNOWN), conn(HttpHdr::Conn::CLOSE) {
+            fields_.fill(0);
+        }
+
+        // Value of a known header field, the first one if repeated; empty
+        // if the request has none.
+        std::string_view get(HttpHdr::Field field) const {
+            const uint8_t i = fields_[static_cast<uint8_t>(field)];
+            return i != 0 ? head.value(i - 1) : std::string_view();
+        }
+
+        bool has(HttpHdr::Field field) const {
+            return fields_[static_cast<uint8_t>(field)] != 0;
+        }
+
+        // Value of a header field by its case-insensitive name; empty if the
+        // request has none.
+        std::string_view get(std::string_view name) const {
+            const HttpHdr::Field field = HttpHdr::str2field(name);
+            if (field != HttpHdr::Field::UNKNOWN) {
+                return get(field);
+            }
+            for (uint8_t k = 0; k < n_others_; ++k) {
+                if (iequals_ascii(head.name(others_[k]), name)) {
+                    return head.value(others_[k]);
+                }
             }
-            return it->second;
+            return {};
         }
 
-        // Set a value by a specified key
-        void set(const std::string &key, const std::string &value) {
-            kv[key] = value;
+        std::string_view host() const { return get(HttpHdr::Field::HOST); }
+        std::string_view content_type() const {
+            return get(HttpHdr::Field::CONTENT_TYPE);
         }
+        std::string_view range() const { return get(HttpHdr::Field::RANGE); }
 
         // Const accessor for path value (read-only)
-        const std::string &path() const { return kv.at(kK_PATH); }
-
-        // Setter (or non-const accessor) to modify the path value
-        void set_path(const std::string &new_path) { kv[kK_PATH] = new_path; }
+        std::string_view path() const { return head.target(); }
 
-        // Const accessor for "BODY" value (read-only)
-        const std::string &body() const { return kv.at("BODY"); }
+        // Const accessor for body value (read-only)
+        std::string_view body() const { return body_; }
 
-        // Setter (or non-const accessor) to modify the "BODY" value
-        void set_body(const std::string &new_body) { kv["BODY"] = new_body; }
+        // Point the body to the bytes following the head
+        void set_body(std::string_view new_body) { body_ = new_body; }
 
         // Other attributes
         // Get the length of unread data (body).
@@ -71,121 +84,117 @@ namespace HttpReq {
 
         bool keep_alive() const { return conn == HttpHdr::Conn::KEEP_ALIVE; }
 
+        // Size of the whole request (head and body) in the read buffer; of
+        // the head alone if the body is chunked
+        size_t size() const { return head.size() + length; }
+
         void Print() const;
 
-        inline void Update(const std::string &req_str);
+        // Feed the bytes received so far to the head parser, see
+        // `Parser::Feed`.
+        Parser::Result Feed(std::string_view buf) { return head.Feed(buf); }
+
+        // Prepare the message for the next request on the connection.
+        void Reset() {
+            head.Reset();
+            body_ = {};
+            length = 0;
+            chunked = false;
+            method = HttpHdr::Method::UNKNOWN;
+            version = HttpHdr::Version::UNKNOWN;
+            conn = HttpHdr::Conn::CLOSE;
+            fields_.fill(0);
+            n_others_ = 0;
+        }
+
+        inline bool Update();
 
         inline const std::string ToStr() const;
 
       private:
-        inline void update_reqline(const std::string &, const size_t &);
-
-        inline void update_kv(const std::string &, const size_t &);
+        std::string_view body_;
+        // Header fields by the parser's index: 1 + the index of the first
+        // field of each known name (0 if absent), then the indices of the
+        // fields of other names. Indices rather than views stay valid when
+        // the read buffer moves.
+        std::array<uint8_t, HttpHdr::kNField> fields_;
+        std::array<uint8_t, Parser::kMaxFields> others_;
+        uint8_t n_others_ = 0;
     };
 
-    // Function to update the request line.
-    // NOTE: will NOT set default values if not found
-    inline void Message::update_reqline(const std::string &req_str,
-                                        const size_t &pos_end) {
-        // Split request line by spaces
-        std::size_t pos_dlm_1 = req_str.find(' ');
-        std::size_t pos_dlm_2 = req_str.find(' ', pos_dlm_1 + 1);
-        if (pos_dlm_1 != std::string::npos && pos_dlm_2 != std::string::npos) {
-            method = HttpHdr::str2method(req_str.substr(0, pos_dlm_1));
-            version = HttpHdr::str2ver(req_str.substr(pos_dlm_2 + 1, pos_end));
-            set_path(req_str.substr(pos_dlm_1 + 1, pos_dlm_2 - pos_dlm_1 - 1));
-        }
-    }
-
-    // Parse the request string and update the header key-value pairs.
-    // NOTE: will NOT set default values if not found
-    //
-    // Example:
-    //
-    // ```
-    // GET / HTTP/1.1\r\n
-    // HOST: EXAMPLE.COM\r\n
-    // USER-AGENT: MYAGENT/1.0\r\n
-    // CONTENT-LENGTH: 13\r\n
-    // ```
-    //
-    // Each record is separated by EOL (CRLF), and the key-value pair is
-    // separated by a colon. The key is case-insensitive.
-    //
-    // - `pos_beg` will indicate the starting position of the key-value pairs.
-    // - two indices will be used in the loop to indicate the current starting
-    //   position and the end of a record (`pos_cur` and `pos_eol`).
-    inline void Message::update_kv(const std::string &req_str,
-                                   const size_t &pos_beg) {
-        std::size_t pos_cur = pos_beg;
-        std::size_t pos_eol = pos_beg;
-        std::string key, val;
-        for (;;) {
-            pos_eol = req_str.find(CRLF, pos_cur);
-            // break updating loop if no more EOL is found
-            if (pos_eol == std::string::npos) {
-                break;
+    // Update the message from a completed head; nothing is copied.
+    // Return false if a header value is invalid.
+    // NOTE:
+    // - Connection is a comma-separated list of options (RFC 9112 9.3):
+    //   HTTP/1.1 connections are persistent unless `close` is listed,
+    //   HTTP/1.0 ones only if `keep-alive` is and `close` is not. Other
+    //   options, e.g. `Upgrade` or `TE`, leave the persistence as it is.
+    // - Repeated Content-Length fields must agree (RFC 9112); one so large
+    //   that `size()` would overflow is invalid.
+    // - The only transfer coding supported is chunked, alone; it may not come
+    //   with Content-Length, as the two disagreeing is how requests are
+    //   smuggled past proxies.
+    inline bool Message::Update() {
+        method = HttpHdr::str2method(head.method());
+        version = HttpHdr::str2ver(head.version());
+        conn = version == HttpHdr::Version::HTTP_1_1 ? HttpHdr::Conn::KEEP_ALIVE
+                                                      : HttpHdr::Conn::CLOSE;
+        bool close = false;
+
+        for (size_t i = 0; i < head.n_fields(); ++i) {
+            const HttpHdr::Field field = HttpHdr::str2field(head.name(i));
+            if (field == HttpHdr::Field::UNKNOWN) {
+                others_[n_others_++] = static_cast<uint8_t>(i);
+                continue;
             }
-            // Find the separator between header name and value
-            std::size_t pos_dlm = req_str.find(':', pos_cur);
-            if (pos_dlm != std::string::npos) {
-                key = req_str.substr(pos_cur, pos_dlm - pos_cur);
-                val = req_str.substr(pos_dlm + 2, pos_eol - pos_dlm - 2);
-                set(key, val);
+            uint8_t &slot = fields_[static_cast<uint8_t>(field)];
+            const bool repeated = slot != 0;
+            if (!repeated) {
+                slot = static_cast<uint8_t>(i + 1);
             }
-            // start from the next line
-            pos_cur = pos_eol + 2;
-        }
 
-        // fill length and connection
-        try {
-            const std::string len_str = get(kK_LENGTH);
-            length = std::stoi(len_str);
-            kv.erase(kK_LENGTH);
-        } catch (const std::out_of_range &e) {
-            // ignore
-        }
-        try {
-            const std::string conn_str = get(kK_CONN);
-            conn = HttpHdr::str2conn(conn_str);
-            kv.erase(kK_CONN);
-        } catch (const std::out_of_range &e) {
-            // ignore
-        }
-    }
-
-    // Parse the request string and update the message
-    // NOTE:
-    // - will NOT set default values if not found
-    // - Favor updating the existing request message instead of creating a new
-    //   one
-    inline void Message::Update(const std::string &req_str) {
-        // Split header and body; raise error if no trailing two CRLFs
-        size_t pos_body = req_str.find(CRLF2); // position of start of body
-        if (pos_body == std::string::npos) {
-            throw std::invalid_argument("Invalid request string");
-            exit(1);
-        }
-
-        size_t pos_kv;
-        // TODO: the current parser `parse_line_req` requires the input ends
-        // with CRLF. Make it more robust.
-        std::string reqhdr_str = req_str.substr(0, pos_body + 2);
-        TOUPPER_ASCII(reqhdr_str.data());
-        // set body if exists
-        if (pos_body + 4 < req_str.size()) {
-            set_body(req_str.substr(pos_body + 4));
+            const std::string_view val = head.value(i);
+            if (field == HttpHdr::Field::CONTENT_LENGTH) {
+                const char *val_end = val.data() + val.size();
+                size_t n = 0;
+                auto [end, ec] = std::from_chars(val.data(), val_end, n);
+                // the size of the request, head and body, must not wrap
+                if (ec != std::errc() || end != val_end ||
+                    n > std::numeric_limits<size_t>::max() - head.size() ||
+                    (repeated && n != length)) {
+                    return false;
+                }
+                length = n;
+            } else if (field == HttpHdr::Field::CONNECTION) {
+                for (std::string_view rest = val; !rest.empty();) {
+                    const size_t comma = std::min(rest.find(','), rest.size());
+                    std::string_view opt = rest.substr(0, comma);
+                    rest.remove_prefix(std::min(comma + 1, rest.size()));
+                    while (!opt.empty() &&
+                           (opt.front() == ' ' || opt.front() == '\t')) {
+                        opt.remove_prefix(1);
+                    }
+                    while (!opt.empty() &&
+                           (opt.back() == ' ' || opt.back() == '\t')) {
+                        opt.remove_suffix(1);
+                    }
+                    if (HttpHdr::str2conn(opt) == HttpHdr::Conn::KEEP_ALIVE) {
+                        conn = HttpHdr::Conn::KEEP_ALIVE;
+                    } else if (iequals_ascii(opt, "close")) {
+                        close = true;
+                    }
+                }
+            } else if (field == HttpHdr::Field::TRANSFER_ENCODING) {
+                if (repeated || !iequals_ascii(val, "chunked")) {
+                    return false;
+                }
+                chunked = true;
+            }
         }
-
-        // Parse the method, path, and version
-        pos_kv = reqhdr_str.find(CRLF); // position of end of KV pairs
-        if (pos_kv != std::string::npos) {
-            update_reqline(reqhdr_str.substr(0, pos_kv), pos_kv);
+        if (close) {
+            conn = HttpHdr::Conn::CLOSE;
         }
-
-        // Parse the headers
-        std::size_t pos_beg = pos_kv + 2;
-        update_kv(reqhdr_str, pos_beg);
+        return !(chunked && has(HttpHdr::Field::CONTENT_LENGTH));
     }
 
     // Convert the message to a string
@@ -193,7 +202,8 @@ namespace HttpReq {
         return "Method: " + HttpHdr::method2str(method) +
                "; Protocol: " + HttpHdr::ver2str(version) +
                "; Connection: " + HttpHdr::conn2str(conn) +
-               "; Length: " + std::to_string(length) + "; Body:\n" + body();
+               "; Length: " + std::to_string(length) + "; Body:\n" +
+               std::string(body());
     }
 
 } // namespace HttpReq
@@ -0,0 +1,209 @@
+#pragma once
+
+#include "simd.hpp"
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace HttpReq {
+
+    // Incremental, zero-copy parser for the HTTP/1.x request head (request
+    // line and header fields).
+    //
+    // The parser never owns or copies bytes. It works directly on the
+    // connection's read buffer and records every token as an offset relative
+    // to the first byte of the request. Offsets (rather than pointers) keep
+    // the state valid when the buffer is compacted or grown between reads, so
+    // `Feed` can resume at the line where the previous call stopped instead of
+    // rescanning the head from the start.
+    //
+    // Example:
+    //
+    // ```
+    // HttpReq::Parser p;
+    // while (p.Feed(buf) == HttpReq::Parser::Result::Partial) {
+    //     // read more bytes into `buf`
+    // }
+    // std::string_view path = p.target();
+    // ```
+    class Parser {
+      public:
+        enum class Result : uint8_t {
+            Partial = 0, // the head is incomplete; feed more bytes
+            Complete,    // the head is complete; `size()` bytes are parsed
+            Error,       // malformed or oversized head
+        };
+
+        // A slice of the request as an offset from its first byte.
+        struct Span {
+            uint32_t pos;
+            uint32_t len;
+        };
+
+        struct Field {
+            Span name;
+            Span value;
+        };
+
+        inline static constexpr size_t kMaxFields = 64;
+        inline static constexpr size_t kMaxHeadSize = 16 * 1024;
+
+        Parser() { Reset(); }
+
+        // Continue parsing with the bytes received so far.
+        // `buf` must begin at the first byte of the request and contain every
+        // byte passed to the previous call (it may have moved in memory).
+        inline Result Feed(std::string_view buf);
+
+        // Prepare the parser for the next request on the connection.
+        void Reset() {
+            base_ = nullptr;
+            method_ = target_ = version_ = Span{0, 0};
+            line_ = scan_ = 0;
+            n_fields_ = 0;
+            state_ = State::ReqLine;
+        }
+
+        bool done() const { return state_ == State::Done; }
+
+        // Size of the parsed head in bytes, including the trailing empty line.
+        // Only meaningful once `Feed` returned `Result::Complete`.
+        size_t size() const { return line_; }
+
+        // The views below point into the buffer last passed to `Feed` and are
+        // valid as long as that buffer is neither modified nor moved.
+        std::string_view method() const { return view(method_); }
+        std::string_view target() const { return view(target_); }
+        std::string_view version() const { return view(version_); }
+
+        size_t n_fields() const { return n_fields_; }
+        std::string_view name(size_t i) const { return view(fields_[i].name); }
+        std::string_view value(size_t i) const {
+            return view(fields_[i].value);
+        }
+
+      private:
+        enum class State : uint8_t {
+            ReqLine = 0,
+            Fields,
+            Done,
+        };
+
+        std::string_view view(const Span &s) const {
+            return {base_ + s.pos, s.len};
+        }
+
+        inline bool parse_reqline(const size_t &, const size_t &);
+
+        inline bool parse_field(const size_t &, const size_t &);
+
+        const char *base_;
+        Span method_;
+        Span target_;
+        Span version_;
+        std::array<Field, kMaxFields> fields_;
+        uint32_t line_; // start of the first line not parsed yet
+        uint32_t scan_; // bytes of that line already searched for LF
+        uint8_t n_fields_;
+        State state_;
+    };
+
+    // Parse the request line `METHOD SP TARGET SP VERSION` spanning
+    // [pos_beg, pos_end), the line terminator excluded.
+    inline bool Parser::parse_reqline(const size_t &pos_beg,
+                                      const size_t &pos_end) {
+        const char *beg = base_ + pos_beg;
+        const char *end = base_ + pos_end;
+        const char *sp_1 = beg + Simd::find_byte(beg, end - beg, ' ');
+        if (sp_1 == end) {
+            return false;
+        }
+        const char *sp_2 =
+            sp_1 + 1 + Simd::find_byte(sp_1 + 1, end - sp_1 - 1, ' ');
+        if (sp_2 == end || sp_1 == beg || sp_2 == sp_1 + 1 ||
+            sp_2 + 1 == end) {
+            return false;
+        }
+        method_ = {static_cast<uint32_t>(pos_beg),
+                   static_cast<uint32_t>(sp_1 - beg)};
+        target_ = {static_cast<uint32_t>(sp_1 + 1 - base_),
+                   static_cast<uint32_t>(sp_2 - sp_1 - 1)};
+        version_ = {static_cast<uint32_t>(sp_2 + 1 - base_),
+                    static_cast<uint32_t>(end - sp_2 - 1)};
+        return true;
+    }
+
+    // Parse a header field `NAME ":" OWS VALUE OWS` spanning
+    // [pos_beg, pos_end), the line terminator excluded.
+    // Obsolete line folding and whitespace before the colon are rejected as
+    // required by RFC 9112.
+    inline bool Parser::parse_field(const size_t &pos_beg,
+                                    const size_t &pos_end) {
+        const char *beg = base_ + pos_beg;
+        const char *end = base_ + pos_end;
+        if (n_fields_ == kMaxFields || *beg == ' ' || *beg == '\t') {
+            return false;
+        }
+        const char *colon = beg + Simd::find_byte(beg, end - beg, ':');
+        if (colon == end || colon == beg || colon[-1] == ' ' ||
+            colon[-1] == '\t') {
+            return false;
+        }
+        const char *val_beg = colon + 1;
+        while (val_beg < end && (*val_beg == ' ' || *val_beg == '\t')) {
+            ++val_beg;
+        }
+        const char *val_end = end;
+        while (val_end > val_beg &&
+               (val_end[-1] == ' ' || val_end[-1] == '\t')) {
+            --val_end;
+        }
+        fields_[n_fields_++] = {
+            {static_cast<uint32_t>(pos_beg),
+             static_cast<uint32_t>(colon - beg)},
+            {static_cast<uint32_t>(val_beg - base_),
+             static_cast<uint32_t>(val_end - val_beg)},
+        };
+        return true;
+    }
+
+    // Each line is located with a single forward scan for LF that resumes at
+    // `scan_`, so bytes already seen by a previous call are not searched
+    // again. A bare LF is tolerated as a line terminator.
+    inline Parser::Result Parser::Feed(std::string_view buf) {
+        base_ = buf.data();
+        while (state_ != State::Done) {
+            const size_t pos_lf =
+                scan_ +
+                Simd::find_byte(buf.data() + scan_, buf.size() - scan_, '\n');
+            if (pos_lf == buf.size()) {
+                scan_ = static_cast<uint32_t>(buf.size());
+                return scan_ > kMaxHeadSize ? Result::Error : Result::Partial;
+            }
+            const size_t pos_end = pos_lf > line_ && buf[pos_lf - 1] == '\r'
+                                       ? pos_lf - 1
+                                       : pos_lf;
+
+            if (state_ == State::ReqLine) {
+                // empty lines preceding the request line are ignored
+                if (pos_end != line_) {
+                    if (!parse_reqline(line_, pos_end)) {
+                        return Result::Error;
+                    }
+                    state_ = State::Fields;
+                }
+            } else if (pos_end == line_) {
+                state_ = State::Done;
+            } else if (!parse_field(line_, pos_end)) {
+                return Result::Error;
+            }
+
+            line_ = scan_ = static_cast<uint32_t>(pos_lf + 1);
+            if (line_ > kMaxHeadSize) {
+                return Result::Error;
+            }
+        }
+        return Result::Complete;
+    }
+
+} // namespace HttpReq
@@ -0,0 +1,214 @@
+#pragma once
+
+#include "httphdr.hpp"
+#include "httpreq_body.hpp"
+#include "httpreq_message.hpp"
+#include "httprsp_message.hpp"
+#include <array>
+#include <asio.hpp>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Dispatch of requests to handlers by method and path.
+//
+// A route is a method and a pattern of '/'-separated segments:
+// - a static segment matches itself, e.g. `/users/new`;
+// - `:name` matches any non-empty segment, e.g. `/users/:id`;
+// - `*name`, last, matches the rest of the path from its '/', which makes a
+//   prefix route: `/static/*path` matches `/static/css/site.css` with `path`
+//   = `/css/site.css`, and `/static/` with `path` = `/`.
+// Static segments win over parameters, and parameters over wildcards,
+// whatever the order the routes were added in; a path whose best match has
+// no route of the method falls through to the next, e.g. a wildcard, and is
+// answered 405 only if none has. A GET route answers HEAD too, unless a HEAD
+// route of its own is added. The query string is not part of the path
+// matched.
+//
+// Routes are added at startup, then `Compile` lays the trie of segments out
+// in flat arrays: the children of a node are contiguous and sorted by the
+// hash of their label, found by binary search over the hashes, and all
+// labels share one string, read only to confirm a hash match. Matching walks
+// those arrays, records parameters as views into the path, and allocates
+// nothing. A compiled router is read-only and may be used by any number of
+// threads.
+namespace HttpRoute {
+
+    // Most parameters (`:name` and `*name` segments) in a pattern.
+    inline constexpr size_t kMaxParams = 8;
+
+    // Parameters of a matched route, in the order of the pattern; names
+    // refer to the router, values to the request path.
+    class Params {
+      public:
+        size_t size() const { return n_; }
+        std::string_view name(size_t i) const { return names_[i]; }
+        std::string_view value(size_t i) const { return values_[i]; }
+
+        // Value of the parameter `name`; empty if there is none.
+        std::string_view get(std::string_view name) const {
+            for (size_t i = 0; i < n_; ++i) {
+                if (names_[i] == name) {
+                    return values_[i];
+                }
+            }
+            return {};
+        }
+
+      private:
+        friend class Router;
+        std::array<std::string_view, kMaxParams> names_;
+        std::array<std::string_view, kMaxParams> values_;
+        size_t n_ = 0;
+    };
+
+    // Fill in `rsp` for `req`, whose body has been read whole. The response
+    // comes prepared as an empty 200 text/plain response with the request's
+    // persistence; a handler may set `conn` to CLOSE to close the connection
+    // after it.
+    // Handlers run on the I/O threads: they must not block.
+    using Handler = std::function<void(const HttpReq::Message &req,
+                                       const Params &params,
+                                       HttpRsp::Message &rsp)>;
+
+    // Like `Handler`, for a request whose body is read piece by piece from
+    // `body` as it arrives, e.g. an upload of any size. If the handler
+    // returns before reading the whole body, the connection is closed after
+    // the response.
+    using StreamHandler = std::function<asio::awaitable<void>(
+        const HttpReq::Message &req, const Params &params,
+        HttpReq::BodyReader &body, HttpRsp::Message &rsp)>;
+
+    // Like `Handler`, for a handler that waits on I/O of its own, e.g.
+    // reading a file, without blocking the I/O thread. The request and
+    // `params` stay valid until it returns.
+    using AsyncHandler = std::function<asio::awaitable<void>(
+        const HttpReq::Message &req, const Params &params,
+        HttpRsp::Message &rsp)>;
+
+    // The handler of a route, and the names of its parameters.
+    struct Route {
+        Handler handler;      // set if the route takes the body whole
+        StreamHandler stream; // set if it streams the body
+        AsyncHandler async;   // set if it takes the body whole and waits
+        std::vector<std::string> names;
+    };
+
+    class Router {
+      public:
+        // Add a route. Throw `std::invalid_argument` if the pattern is
+        // malformed or the route exists already.
+        void Add(HttpHdr::Method method, std::string_view pattern,
+                 Handler handler);
+
+        void Get(std::string_view pattern, Handler handler) {
+            Add(HttpHdr::Method::GET, pattern, std::move(handler));
+        }
+        void Post(std::string_view pattern, Handler handler) {
+            Add(HttpHdr::Method::POST, pattern, std::move(handler));
+        }
+        void Put(std::string_view pattern, Handler handler) {
+            Add(HttpHdr::Method::PUT, pattern, std::move(handler));
+        }
+        void Delete(std::string_view pattern, Handler handler) {
+            Add(HttpHdr::Method::DELETE, pattern, std::move(handler));
+        }
+
+        // Add a route streaming the request body; see `Add`.
+        void Stream(HttpHdr::Method method, std::string_view pattern,
+                    StreamHandler handler);
+
+        // Add a route with an asynchronous handler; see `Add`.
+        void Async(HttpHdr::Method method, std::string_view pattern,
+                   AsyncHandler handler);
+
+        // Build the dispatch table from the routes added so far; required
+        // before matching, and again after adding routes.
+        void Compile();
+
+        // Handler of the route matching `method` and `path`, filling in
+        // `params`; null if there is none, or if its handler streams the
+        // body or is asynchronous.
+        const Handler *Match(HttpHdr::Method method, std::string_view path,
+                             Params &params) const;
+
+        // Route of `req`, filling in `params`. If there is none, `rsp` is
+        // set to answer 404 if no route matches its path, 405 if none
+        // matches its method, and null is returned.
+        const Route *Find(const HttpReq::Message &req, Params &params,
+                          HttpRsp::Message &rsp) const;
+
+        // Answer `req`, whose body has been read whole, with the handler of
+        // its route; see `Find`. Streaming and asynchronous routes answer
+        // 500.
+        void Serve(const HttpReq::Message &req, HttpRsp::Message &rsp) const;
+
+        // Number of routes.
+        size_t size() const { return routes_.size(); }
+
+      private:
+        inline static constexpr uint32_t kNone = UINT32_MAX;
+
+        using MethodRoutes = std::array<uint32_t, HttpHdr::kNMethod>;
+
+        // A node of the trie as routes are added.
+        struct Draft {
+            std::map<std::string, std::unique_ptr<Draft>, std::less<>>
+                statics;
+            std::unique_ptr<Draft> param;
+            std::unique_ptr<Draft> wild;
+            std::unique_ptr<MethodRoutes> routes; // set if a route ends here
+        };
+
+        // A node of the compiled trie; indices into `nodes_`, `labels_` and
+        // `ends_`.
+        struct Node {
+            uint32_t hash = 0; // of the label
+            uint32_t label = 0;
+            uint32_t label_len = 0;
+            uint32_t first = 0; // first static child
+            uint32_t n_static = 0;
+            uint32_t param = kNone;
+            uint32_t wild = kNone;
+            uint32_t end = kNone; // routes ending at this node
+        };
+
+        // Routes ending at a node.
+        struct End {
+            MethodRoutes routes; // index in `routes_` by method
+            std::string allow;   // Allow header line for a 405
+        };
+
+        // Add `route` for `method` and `pattern`; see `Add`.
+        void add(HttpHdr::Method method, std::string_view pattern,
+                 Route route);
+
+        // Walk the trie from node `i` for `rest`, a suffix of the path
+        // beginning with '/' or empty. Return the index in `ends_` of the
+        // node matched with a route of `method`; the first node matched
+        // without one is left in `other`, if still `kNone`.
+        uint32_t find(uint32_t i, std::string_view rest, uint8_t method,
+                      Params &params, uint32_t &other) const;
+
+        // Look the path up; return the index in `ends_` of its node with a
+        // route of `method`, else of the first node matched, for a 405.
+        uint32_t lookup(std::string_view path, HttpHdr::Method method,
+                        Params &params) const;
+
+        // Route of `method` ending at `ends_[end]`, naming `params` after
+        // its pattern; null if there is none.
+        const Route *route(uint32_t end, HttpHdr::Method method,
+                           Params &params) const;
+
+        std::unique_ptr<Draft> draft_;
+        std::vector<Route> routes_;
+        std::vector<Node> nodes_;
+        std::string labels_;
+        std::vector<End> ends_;
+    };
+
+} // namespace HttpRoute
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace HttpRsp {
+
+    // How worker threads share the work.
+    enum class Mode : uint8_t {
+        // One io_context and one acceptor shared by all threads; a
+        // connection may be served by any thread.
+        Shared = 0,
+        // One io_context and one SO_REUSEPORT acceptor per thread; the kernel
+        // spreads connections over the acceptors and a connection stays on
+        // its thread from accept to close.
+        Sharded,
+    };
+
+    // How a proxy route spreads its requests over its upstream servers.
+    enum class Balance : uint8_t {
+        // in turn
+        RoundRobin = 0,
+        // to the one with the fewest requests in flight, from all threads
+        LeastOutstanding,
+    };
+
+    // A path prefix whose requests are forwarded to upstream servers.
+    struct ProxyRoute {
+        // e.g. "/api"; requests keep it in their path upstream
+        std::string prefix;
+        // "host:port" of each server, resolved at startup
+        std::vector<std::string> upstreams;
+        Balance balance = Balance::RoundRobin;
+    };
+
+    // Server settings; the defaults suit a small static site.
+    struct Config {
+        // The port on which the server listens for incoming connections.
+        uint16_t port = 8080;
+        // Number of threads running the I/O context.
+        uint16_t n_thread = 4;
+        Mode mode = Mode::Shared;
+        // Pin worker thread i to the i-th CPU the process may run on.
+        bool pin_cpu = false;
+        // Most connections served at once; further clients are answered
+        // 503 and disconnected right away.
+        size_t max_conns = 10000;
+        // Connection deadlines: waiting for a request on an idle
+        // connection, receiving a request head once it has begun, receiving
+        // a body, and sending a response (for a streamed file: without
+        // progress). The connection is closed when one passes.
+        std::chrono::seconds idle_timeout{60};
+        std::chrono::seconds head_timeout{10};
+        std::chrono::seconds body_timeout{30};
+        std::chrono::seconds write_timeout{30};
+        // Directory of the files served.
+        std::string root = ".";
+        // URL prefix the files are served under, e.g. "/static"; they make
+        // a GET route matched after all others with the same prefix. Empty
+        // to serve no files.
+        std::string files_prefix = "/";
+        // Path of the built-in endpoint exposing the server's metrics in the
+        // Prometheus text format; empty for none.
+        std::string metrics_path = "/metrics";
+
+        // Static file cache: total bytes of all entries, and the largest file
+        // cached. Larger files are read from disk on every request.
+        size_t cache_bytes = 64 << 20;
+        size_t cache_max_file = 1 << 20;
+
+        // Largest request body read whole for a handler; larger ones are
+        // answered 413. Streaming routes take bodies of any size, read
+        // through a buffer of `body_buffer` bytes per connection.
+        size_t max_body = 1 << 20;
+        size_t body_buffer = 64 << 10;
+
+        // Most streams of an HTTP/2 connection open at once; the client is
+        // told, and further streams are refused.
+        uint32_t h2_max_streams = 100;
+
+        // Reverse proxy routes, matched before the files. Each thread keeps
+        // up to `upstream_max_idle` idle connections per upstream server,
+        // for `upstream_idle_timeout` at most. Connecting, and then waiting
+        // for each read or write of a server, time out as set, answering
+        // 504.
+        std::vector<ProxyRoute> proxies;
+        std::chrono::seconds upstream_connect_timeout{5};
+        std::chrono::seconds upstream_read_timeout{30};
+        std::chrono::seconds upstream_idle_timeout{30};
+        size_t upstream_max_idle = 16;
+
+        // Content codings of files of text types, for the clients accepting
+        // them: a precompressed sibling "FILE.br" or "FILE.gz" is sent if
+        // there is one; otherwise files of `compress_min` bytes or more, up
+        // to `cache_max_file`, are compressed with zlib at `gzip_level` (0
+        // for never) on their first request. Either is kept in a cache of
+        // `compress_cache_bytes`, which, like the file cache, needs inotify.
+        size_t compress_min = 256;
+        int gzip_level = 6;
+        size_t compress_cache_bytes = 16 << 20;
+
+        // Open file cache: most files kept open with their metadata, or
+        // known not to exist, and how long an entry is trusted at most;
+        // changes seen by inotify drop entries at once.
+        size_t open_cache_entries = 1024;
+        std::chrono::seconds open_cache_ttl{60};
+
+        // Threads doing the blocking filesystem work of files not in the
+        // cache (resolving the path, opening and reading the file), and most
+        // such files being served at once; requests over that are answered
+        // 503.
+        size_t file_threads = 4;
+        size_t file_queue = 1024;
+
+        // Files of at least this size are not read into memory: the head is
+        // written, then the body is streamed from the page cache with
+        // sendfile(2), so memory per download stays constant.
+        size_t sendfile_min = 1 << 20;
+
+        // File the responses are logged to, appended to; empty for no access
+        // log. Errors go to stderr. Records wait in a ring of `log_ring`
+        // entries per thread for the writer thread of the log; those pushed
+        // to a full ring are dropped and counted.
+        std::string access_log;
+        size_t log_ring = 4096;
+    };
+
+} // namespace HttpRsp
@@ -1,28 +1,166 @@
 #pragma once
 
+#include "compress.hpp"
+#include "filecache.hpp"
+#include "fileio.hpp"
+#include "fswatch.hpp"
+#include "httprsp_config.hpp"
+#include "httproute.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "opencache.hpp"
+#include "proxy.hpp"
+#include "timewheel.hpp"
+#include "utils.hpp"
 #include <asio.hpp>
+#include <atomic>
+#include <chrono>
 #include <stdint.h>
 
 namespace HttpRsp {
 
+    // Counters of the accept loops, shared by all acceptors.
+    struct AcceptStats {
+        std::atomic<uint64_t> accepted{0};
+        // clients answered 503: over `Config::max_conns` or out of
+        // descriptors
+        std::atomic<uint64_t> rejected{0};
+        // accept loop paused because the process ran out of descriptors
+        std::atomic<uint64_t> paused{0};
+    };
+
     class Listener {
       public:
-        // Constructor to initialize the Listener object with the specified
-        // IO context and port.
-        Listener(const uint16_t port, const std::string &root_dir)
-            : port_(port), root_(root_dir) {}
+        // Constructor to initialize the Listener object with the server
+        // settings and the routes of the application. The routes serving
+        // the metrics and the files, if any, are added to `router`, which is
+        // then compiled.
+        explicit Listener(const Config &cfg, HttpRoute::Router router = {});
+
+        // Open an acceptor listening on the port.
+        // In sharded mode, it is opened with SO_REUSEPORT so that every
+        // shard can have its own acceptor on the same port.
+        asio::ip::tcp::acceptor Open(const asio::any_io_executor &exor) const;
+
+        // Accept connections and serve each of them on the acceptor's
+        // executor, with deadlines tracked by `wheel`.
+        // Clients over the connection limit are answered 503 and
+        // disconnected. When the process runs out of descriptors, accepting
+        // pauses with exponential backoff, and a reserved descriptor is used
+        // to turn pending clients away with a 503 instead of leaving them
+        // hanging in the backlog.
+        asio::awaitable<void> Start(asio::ip::tcp::acceptor acceptor,
+                                    TimeWheel::Wheel &wheel);
+
+        // Invalidate cached files as they change on disk, and enable the
+        // file caches, which are off until then. They stay off, or are
+        // turned off, while the watcher does not cover the whole root.
+        void Watch(FsWatch::Watcher &watcher);
+
+        const std::string &root() const { return root_; }
+
+        const AcceptStats &stats() const { return stats_; }
+
+        // Number of connections being served.
+        size_t n_conns() const {
+            return n_conns_.load(std::memory_order_relaxed);
+        }
+
+        const Metrics::Registry &metrics() const { return metrics_; }
 
-        // Start listening for incoming connections on the specified port.
-        asio::awaitable<void> Start();
+        Log::Logger &log() { return log_; }
+
+        // Append the metrics of the server, those of the requests, of the
+        // connections and of the upstream servers, to `out` in the
+        // Prometheus text format.
+        void RenderMetrics(std::string &out) const;
 
       private:
         // The port on which the server listens for incoming connections.
         const uint16_t port_;
+        const bool reuse_port_;
+        // Canonical directory of the files served.
         const std::string root_;
+        // Files of at least this size are streamed with sendfile(2).
+        const size_t sendfile_min_;
+        // Files smaller than this are not compressed; nor at all at level 0.
+        const size_t compress_min_;
+        const int gzip_level_;
+        const size_t max_body_;
+        const size_t body_buffer_;
+        const size_t max_conns_;
+        const uint32_t h2_max_streams_;
+        std::atomic<size_t> n_conns_;
+        const std::chrono::seconds idle_timeout_;
+        const std::chrono::seconds head_timeout_;
+        const std::chrono::seconds body_timeout_;
+        const std::chrono::seconds write_timeout_;
+        AcceptStats stats_;
+        Metrics::Registry metrics_;
+        // Access log, if enabled, and errors.
+        Log::Logger log_;
+        // Files served recently, shared by all connections.
+        FileCache::Cache cache_;
+        // Variants of these in content codings, by the codings accepted.
+        FileCache::Cache zcache_;
+        // Files opened recently, and paths found to have no file.
+        OpenCache::Cache open_cache_;
+        // Threads serving the files not in the cache.
+        FileIo::Pool file_pool_;
+        // Upstream servers of the proxy routes, and their connections.
+        Proxy::Forwarder proxy_;
+        // Handlers of requests, read-only once the listener is constructed.
+        HttpRoute::Router router_;
 
       private:
-        // Handle a single client connection.
-        asio::awaitable<void> session(asio::ip::tcp::socket socket);
+        // Answer `req`, in `rsp`, with the file at `path`, relative to the
+        // root, in a content coding accepted if it has one worth it, and as
+        // its conditions and range ask.
+        asio::awaitable<void> serve_file(const HttpReq::Message &req,
+                                         std::string_view path,
+                                         HttpRsp::Message &rsp);
+
+        // Answer `rsp` with the file at `path` as it is, not in the cache;
+        // false if it was answered 503, the file pool full.
+        asio::awaitable<bool> open_file(std::string_view path,
+                                        HttpRsp::Message &rsp);
+
+        // Whether the file answered at `path`, too large to be compressed,
+        // may have a precompressed sibling in one of `accepted`.
+        bool may_have_sibling(std::string_view path,
+                              Compress::Codings accepted);
+
+        // Replace the file answered in `rsp` with its variant in one of
+        // `accepted`, found or made; blocking. `gen`: of `zcache_`, taken
+        // before the file was read.
+        void encode_file(std::string_view path, Compress::Codings accepted,
+                         uint64_t gen, HttpRsp::Message &rsp);
+
+        // Handle a single client connection, from `peer`.
+        asio::awaitable<void> session(asio::ip::tcp::socket socket,
+                                      asio::ip::tcp::endpoint peer,
+                                      TimeWheel::Wheel &wheel);
+
+        // Serve the rest of the connection of `session` over HTTP/2, see
+        // `Http2::Session::Run` for `buffered` and `upgrade`.
+        asio::awaitable<void> session_h2(asio::ip::tcp::socket &socket,
+                                         const asio::ip::tcp::endpoint &peer,
+                                         TimeWheel::Wheel &wheel,
+                                         TimeWheel::Timer &timer,
+                                         std::string_view buffered,
+                                         std::string_view upgrade);
+
+        // Answer `req`, of an HTTP/2 stream of the connection `socket`, in
+        // `rsp`.
+        asio::awaitable<void> serve_h2(const HttpReq::Message &req,
+                                       HttpRsp::Message &rsp,
+                                       asio::ip::tcp::socket &socket,
+                                       TimeWheel::Wheel &wheel,
+                                       TimeWheel::Timer &timer);
+
+        // Accept pending clients with the reserved descriptor `spare` and
+        // answer them 503, while the process is out of descriptors.
+        void shed(asio::ip::tcp::acceptor &acceptor, Utils::Fd &spare);
     };
 
 } // namespace HttpRsp
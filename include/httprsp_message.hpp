@@ -1,14 +1,67 @@
 #pragma once
 
+#include "compress.hpp"
+#include "filecache.hpp"
+#include "httpcond.hpp"
+#include "httpdate.hpp"
 #include "httphdr.hpp"
 #include "httpreq_message.hpp"
+#include "opencache.hpp"
 #include "utils.hpp"
+#include <array>
 #include <asio.hpp>
+#include <charconv>
+#include <memory>
+#include <string_view>
 
 namespace HttpRsp {
 
+    // A file being served by the steps of `Message::ServFile`.
+    struct PendingFile {
+        OpenCache::EntryPtr open;
+        // of the file cache, taken before the file was looked up so that a
+        // concurrent change is not cached
+        uint64_t gen = 0;
+    };
+
+    // Response relayed from elsewhere, e.g. an upstream server, its body
+    // read piece by piece while it is sent; see `Proxy`.
+    struct Relay {
+        virtual ~Relay() = default;
+
+        // Next piece of the body, valid until the next call; empty once the
+        // body is complete, or if it could not be read.
+        virtual asio::awaitable<std::string_view> Read() = 0;
+
+        // The whole body was read.
+        virtual bool done() const = 0;
+
+        // Status line and header fields, each ending with CRLF: the head of
+        // the response but for the connection fields.
+        std::string head;
+        uint16_t status = 0;
+        // The body is sent in the chunked transfer coding, as `head` tells.
+        bool chunked = false;
+    };
+
     struct Message {
         std::string body;
+        // Extra header lines, each ending with CRLF, e.g. "Allow: GET\r\n".
+        std::string headers;
+        // Cached file sent instead of `body` when set; shared, never copied.
+        FileCache::EntryPtr file;
+        // Large file streamed with sendfile(2) after the head when set,
+        // instead of `body`; `fd_size` bytes from `fd_offset`, which is 0
+        // but for a range. Shared with the open file cache.
+        std::shared_ptr<const Utils::Fd> fd;
+        size_t fd_size = 0;
+        size_t fd_offset = 0;
+        // Validators of the file answered, shared with its cache entry;
+        // their lines go out in the head.
+        std::shared_ptr<const HttpCond::Validators> validators;
+        // Relayed response sent instead of all the above when set; `code`
+        // is its status, or OK if it has none of ours.
+        std::shared_ptr<Relay> relay;
         HttpHdr::Conn conn;
         HttpHdr::Status code;
         HttpHdr::ContType cont_type;
@@ -19,41 +72,323 @@ namespace HttpRsp {
               code(HttpHdr::Status::InternalServerError),
               cont_type(HttpHdr::ContType::TEXT_PLAIN) {}
 
+        // Append the status line, Content-Type and Content-Length of a
+        // response to `head`; the part of the head that does not change
+        // between requests.
+        static void AppendHead(std::string &head, HttpHdr::Status code,
+                               HttpHdr::ContType cont_type, size_t length) {
+            char digits[20];
+            const char *end =
+                std::to_chars(digits, digits + sizeof(digits), length).ptr;
+            head += HttpHdr::status_line(code);
+            head += HttpHdr::conttype_line(cont_type);
+            head += "Content-Length: ";
+            head.append(digits, static_cast<size_t>(end - digits));
+            head += CRLF;
+        }
+
+        static const std::string Head(HttpHdr::Status code,
+                                      HttpHdr::ContType cont_type,
+                                      size_t length) {
+            std::string head;
+            AppendHead(head, code, cont_type, length);
+            return head;
+        }
+
+        // Prepare the message for a new response: empty, 200, text/plain.
+        // Buffers keep their capacity.
+        void Reset(HttpHdr::Conn persistence) {
+            body.clear();
+            headers.clear();
+            file.reset();
+            fd.reset();
+            fd_size = 0;
+            fd_offset = 0;
+            validators.reset();
+            relay.reset();
+            conn = persistence;
+            code = HttpHdr::Status::OK;
+            cont_type = HttpHdr::ContType::TEXT_PLAIN;
+        }
+
+        // Turn the message into a plain-text error response.
+        void Error(HttpHdr::Status status) {
+            code = status;
+            body = status2str(status);
+            headers.clear();
+            cont_type = HttpHdr::ContType::TEXT_PLAIN;
+            file.reset();
+            fd.reset();
+            validators.reset();
+            relay.reset();
+        }
+
         // Serialize the response message to a string.
         const std::string ToStr() const {
-            HttpHdr::Version ver = HttpHdr::Version::HTTP_1_1;
-            return ver2str(ver) + " " + status2str(code) +
-                   CRLF "Date: " + Utils::timestamp() +
-                   CRLF "Content-Type: " + conttype2str(cont_type) +
-                   CRLF "Content-Length: " + std::to_string(body.size()) +
-                   CRLF "Connection: " + conn2str(conn) + CRLF2 + body;
+            std::string head;
+            const asio::const_buffer content = ToBuffers(head)[1];
+            return head.append(static_cast<const char *>(content.data()),
+                               content.size());
+        }
+
+        // Serialize the head into `head` and return the buffers to write
+        // with one gathered write: the head, then the body, which is
+        // referenced rather than copied. The head is assembled from
+        // precomputed fragments; `head` is meant to be reused across
+        // responses so that its capacity is allocated only once.
+        // The body buffer is empty if the body is to be streamed from `fd`
+        // or `relay`.
+        std::array<asio::const_buffer, 2> ToBuffers(std::string &head) const {
+            head.clear();
+            if (relay) {
+                head += relay->head;
+                head += headers;
+                head += HttpHdr::conn_line(conn);
+                return {asio::buffer(head), asio::const_buffer()};
+            }
+            if (code == HttpHdr::Status::NotModified) {
+                // no body, nor fields describing one
+                head += HttpHdr::status_line(code);
+            } else if (file) {
+                head += file->head;
+            } else {
+                AppendHead(head, code, cont_type, fd ? fd_size : body.size());
+            }
+            if (validators) {
+                head += validators->lines;
+            }
+            head += headers;
+            head += HttpDate::Line();
+            head += HttpHdr::conn_line(conn);
+            return {asio::buffer(head), file ? asio::buffer(file->body)
+                                        : fd ? asio::const_buffer()
+                                             : asio::buffer(body)};
         }
 
-        // Serve the file at the given path.
+        // Serve the file at `path`, relative to `root` and beginning with
+        // '/'.
         // Favor updating the existing response message over creating a new
         // one.
-        inline void ServFile(const HttpReq::Message &req,
-                             const std::string &root) {
+        // Files up to the cache's entry limit are kept in `cache`; a hit is
+        // served without touching the filesystem. Other files are opened
+        // through `open_cache`, which keeps them open; files of
+        // `sendfile_min` bytes or more are left in `fd` for the caller to
+        // stream.
+        inline void ServFile(std::string_view path, const std::string &root,
+                             FileCache::Cache &cache,
+                             OpenCache::Cache &open_cache,
+                             size_t sendfile_min) {
+            if (CachedFile(path, cache)) {
+                return;
+            }
+            PendingFile pending{open_cache.Get(path), cache.generation()};
+            if (!pending.open) {
+                pending.open = open_cache.Open(path, root);
+            }
+            if (!OpenFile(pending, sendfile_min)) {
+                FillFile(path, cache, pending,
+                         Utils::read_fd(pending.open->fd.get(),
+                                        pending.open->size));
+            }
+        }
 
-            conn = req.conn == HttpHdr::Conn::KEEP_ALIVE
-                       ? HttpHdr::Conn::KEEP_ALIVE
-                       : HttpHdr::Conn::CLOSE;
+        // `ServFile` in steps, for a caller doing the blocking ones in its
+        // own way.
+        // 1. Serve the file from `cache`; false on a miss.
+        inline bool CachedFile(std::string_view path,
+                               FileCache::Cache &cache) {
+            fd.reset();
+            if (!(file = cache.Get(path))) {
+                return false;
+            }
+            code = HttpHdr::Status::OK;
+            cont_type = file->cont_type;
+            validators = std::shared_ptr<const HttpCond::Validators>(
+                file, &file->validators);
+            if (Compress::Compressible(cont_type)) {
+                headers += Compress::kVaryLine;
+            }
+            return true;
+        }
 
-            if (req.method != HttpHdr::Method::GET) {
-                code = HttpHdr::Status::BadRequest;
-                body = "You are in the wrong place!";
+        // 2. Answer with the file of `pending.open`, found in or added to
+        // the open file cache. Return false if it is to be read whole, then
+        // passed to `FillFile`.
+        inline bool OpenFile(const PendingFile &pending, size_t sendfile_min) {
+            file.reset();
+            fd.reset();
+            const OpenCache::Entry &open = *pending.open;
+            if (!open.found() || open.size == 0) {
+                Error(HttpHdr::Status::NotFound);
+                return true;
+            }
+
+            code = HttpHdr::Status::OK;
+            cont_type = open.cont_type;
+            validators = std::shared_ptr<const HttpCond::Validators>(
+                pending.open, &open.validators);
+            if (Compress::Compressible(cont_type)) {
+                headers += Compress::kVaryLine;
+            }
+            if (open.size >= sendfile_min) {
+                // shares the descriptor of the entry
+                fd = std::shared_ptr<const Utils::Fd>(pending.open, &open.fd);
+                fd_size = open.size;
+                return true;
             }
+            return false;
+        }
 
-            const std::string cont = Utils::read_file(req.path(), root);
+        // 3. Answer with `cont`, the content of the file of `OpenFile`,
+        // empty if it could not be read.
+        inline void FillFile(std::string_view path, FileCache::Cache &cache,
+                             const PendingFile &pending, std::string cont) {
             if (cont.empty()) {
-                code = HttpHdr::Status::NotFound;
-                body = "404 Not Found";
-                cont_type = HttpHdr::ContType::TEXT_PLAIN;
-            } else {
-                code = HttpHdr::Status::OK;
-                body = cont;
-                cont_type = HttpHdr::ContType::TEXT_HTML;
+                Error(HttpHdr::Status::NotFound);
+                return;
+            }
+            if (!cache.enabled() || cont.size() > cache.max_entry()) {
+                body = std::move(cont);
+                return;
+            }
+            auto entry = std::make_shared<FileCache::Entry>(FileCache::Entry{
+                Head(code, cont_type, cont.size()), std::move(cont),
+                pending.open->file, cont_type, pending.open->validators});
+            cache.Put(path, entry, pending.gen);
+            file = std::move(entry);
+        }
+
+        // Steps replacing the file found by the above with a variant in a
+        // content coding, see `Compress`.
+        // Answer with the precompressed file `sibling`, in `coding`,
+        // streamed from its descriptor.
+        inline void SiblingFile(const OpenCache::EntryPtr &sibling,
+                                Compress::Coding coding) {
+            file.reset();
+            body.clear();
+            fd = std::shared_ptr<const Utils::Fd>(sibling, &sibling->fd);
+            fd_size = sibling->size;
+            validators = std::make_shared<const HttpCond::Validators>(
+                HttpCond::Variant(*validators, Compress::name(coding)));
+            headers += Compress::encoding_line(coding);
+        }
+
+        // Answer with `cont`, the content of the file `name` in `coding`,
+        // and keep it in `cache` under `key`; `gen` as for `FillFile`.
+        inline void FillEncoded(std::string_view key, FileCache::Cache &cache,
+                                uint64_t gen, Compress::Coding coding,
+                                const std::string &name, std::string cont) {
+            std::string head;
+            AppendHead(head, code, cont_type, cont.size());
+            head += Compress::encoding_line(coding);
+            auto entry = std::make_shared<FileCache::Entry>(FileCache::Entry{
+                std::move(head), std::move(cont), name, cont_type,
+                HttpCond::Variant(*validators, Compress::name(coding))});
+            cache.Put(key, entry, gen);
+            file = std::move(entry);
+            validators = std::shared_ptr<const HttpCond::Validators>(
+                file, &file->validators);
+            fd.reset();
+            body.clear();
+        }
+
+        // Last step, after the above: answer a conditional GET or a GET of
+        // ranges of the file found, `req`, from the file's validators, with
+        // 304, 206 or 416; `ranges` is scratch space.
+        // A range of `body` or of a cached file is cut out of it, a range of
+        // `fd` is left to stream from its offset. Return false if the parts
+        // of a multipart answer are to be read from `fd` by `FillParts`.
+        inline bool Conditional(const HttpReq::Message &req,
+                                HttpCond::Ranges &ranges) {
+            using HttpHdr::Field;
+            if (code != HttpHdr::Status::OK || !validators) {
+                return true;
+            }
+            const size_t size = file ? file->body.size()
+                                : fd ? fd_size
+                                     : body.size();
+            switch (HttpCond::Evaluate(*validators, size,
+                                       req.get(Field::IF_NONE_MATCH),
+                                       req.get(Field::IF_MODIFIED_SINCE),
+                                       req.range(), req.get(Field::IF_RANGE),
+                                       ranges)) {
+            case HttpCond::Outcome::Full:
+                return true;
+            case HttpCond::Outcome::NotModified:
+                code = HttpHdr::Status::NotModified;
+                file.reset();
+                fd.reset();
+                body.clear();
+                return true;
+            case HttpCond::Outcome::Unsatisfiable:
+                Error(HttpHdr::Status::RangeNotSatisfiable);
+                HttpCond::AppendUnsatisfied(headers, size);
+                return true;
+            case HttpCond::Outcome::Partial:
+                break;
+            }
+
+            if (ranges.n == 1) {
+                const HttpCond::Range range = ranges.parts[0];
+                code = HttpHdr::Status::PartialContent;
+                HttpCond::AppendContentRange(headers, range, size);
+                if (fd) {
+                    fd_offset = range.offset;
+                    fd_size = range.length;
+                } else if (file) {
+                    body.assign(file->body, range.offset, range.length);
+                    file.reset();
+                } else {
+                    body.erase(0, range.offset);
+                    body.resize(range.length);
+                }
+                return true;
+            }
+            if (fd) {
+                size_t n_read = 0;
+                for (size_t i = 0; i < ranges.n; ++i) {
+                    n_read += ranges.parts[i].length;
+                }
+                // too much to read into memory: the whole file, streamed
+                return n_read > HttpCond::kMaxPartsRead;
+            }
+            std::string parts;
+            const std::string_view cont = file ? file->body : body;
+            for (size_t i = 0; i < ranges.n; ++i) {
+                const HttpCond::Range range = ranges.parts[i];
+                HttpCond::AppendPart(
+                    parts, HttpHdr::conttype_line(cont_type), range, size,
+                    cont.substr(range.offset, range.length));
+            }
+            HttpCond::AppendClose(parts);
+            body = std::move(parts);
+            file.reset();
+            code = HttpHdr::Status::PartialContent;
+            cont_type = HttpHdr::ContType::MULTIPART_BYTERANGES;
+            return true;
+        }
+
+        // Answer with the `ranges` of `fd` found by `Conditional`, read into
+        // a multipart body. Blocking.
+        inline void FillParts(const HttpCond::Ranges &ranges) {
+            std::string parts;
+            for (size_t i = 0; i < ranges.n; ++i) {
+                const HttpCond::Range range = ranges.parts[i];
+                const std::string cont =
+                    Utils::read_fd(fd->get(), range.length,
+                                   static_cast<off_t>(range.offset));
+                if (cont.empty()) {
+                    Error(HttpHdr::Status::InternalServerError);
+                    return;
+                }
+                HttpCond::AppendPart(parts, HttpHdr::conttype_line(cont_type),
+                                     range, fd_size, cont);
             }
+            HttpCond::AppendClose(parts);
+            body = std::move(parts);
+            fd.reset();
+            code = HttpHdr::Status::PartialContent;
+            cont_type = HttpHdr::ContType::MULTIPART_BYTERANGES;
         }
     };
 
@@ -1,24 +1,80 @@
 #pragma once
 
+#include "fileio.hpp"
+#include "fswatch.hpp"
+#include "httpdate.hpp"
+#include "httprsp_config.hpp"
 #include "httprsp_listener.hpp"
+#include "httproute.hpp"
+#include "timewheel.hpp"
 #include <asio.hpp>
 #include <iostream>
+#include <memory>
+#include <pthread.h>
+#include <sched.h>
 #include <stdint.h>
+#include <vector>
 
 namespace HttpRsp {
 
-    // Start the server (begin listening for incoming connections).
-    static inline void Run(uint16_t port, uint16_t n_thread,
-                           const std::string &root_dir) {
-        HttpRsp::Listener listener = Listener(port, root_dir);
+    // Pin the calling thread to the `i`-th CPU the process may run on,
+    // wrapping around if there are fewer CPUs than threads.
+    static inline void pin_thread(size_t i) {
+        cpu_set_t allowed;
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 ||
+            CPU_COUNT(&allowed) == 0) {
+            return;
+        }
+        size_t k = i % static_cast<size_t>(CPU_COUNT(&allowed));
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed) && k-- == 0) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cpu, &set);
+                pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+                return;
+            }
+        }
+    }
+
+    // Start the server (begin listening for incoming connections), serving
+    // the routes of `router` and the files under `cfg.root`.
+    static inline void Run(const Config &cfg, HttpRoute::Router router = {}) {
+        HttpRsp::Listener listener(cfg, std::move(router));
+
+        // Shared mode: a single I/O context run by every thread.
+        // Sharded mode: one I/O context per thread, each with its own
+        // acceptor, so that the contexts share no scheduler lock and a
+        // connection never migrates between threads. The concurrency hint
+        // tells each context how many threads will run it.
+        const bool sharded = cfg.mode == Mode::Sharded;
+        const size_t n_ctx = sharded ? cfg.n_thread : 1;
+        std::vector<std::unique_ptr<asio::io_context>> ctxs;
+        for (size_t i = 0; i < n_ctx; ++i) {
+            ctxs.push_back(
+                std::make_unique<asio::io_context>(sharded ? 1 : cfg.n_thread));
+        }
 
-        asio::io_context ctx;
+        // Connection deadlines, one wheel per I/O context.
+        std::vector<std::unique_ptr<TimeWheel::Wheel>> wheels;
+        for (size_t i = 0; i < n_ctx; ++i) {
+            wheels.push_back(std::make_unique<TimeWheel::Wheel>());
+        }
+
+        // Watch the served directory so that cached files are invalidated
+        // as they change.
+        FsWatch::Watcher watcher(ctxs[0]->get_executor(), listener.root(),
+                                 listener.log());
 
         // Work Guard: Prevents the io_context from running out of work and
         // concluding too early. This is critical in a multi-threaded server
         // to keep the io_context active even if it's temporarily out of
         // work.
-        auto work_guard = asio::make_work_guard(ctx);
+        std::vector<asio::executor_work_guard<asio::io_context::executor_type>>
+            work_guards;
+        for (const auto &ctx : ctxs) {
+            work_guards.push_back(asio::make_work_guard(*ctx));
+        }
 
         // Thread pool to manage multiple worker threads.
         // The number of threads can be determined based on the hardware
@@ -30,13 +86,37 @@ namespace HttpRsp {
 
         try {
 
-            // Launch the listener coroutine. This function is responsible for
-            // accepting incoming connections and spawning a new coroutine for
-            // each connection using asio::co_spawn.
-            asio::co_spawn(ctx, listener.Start(), asio::detached);
+            if (watcher.Open()) {
+                listener.Watch(watcher);
+                asio::co_spawn(*ctxs[0], watcher.Run(), asio::detached);
+            } else {
+                listener.log().Error("inotify unavailable: file cache "
+                                     "disabled");
+            }
+
+            // Keep the cached Date header current.
+            asio::co_spawn(*ctxs[0], HttpDate::Run(), asio::detached);
+
+            // Launch the listener coroutines and their timing wheels, one per
+            // I/O context. The listeners are responsible for accepting
+            // incoming connections and spawning a new coroutine for each
+            // connection using asio::co_spawn.
+            for (size_t i = 0; i < n_ctx; ++i) {
+                asio::io_context &ctx = *ctxs[i];
+                TimeWheel::Wheel &wheel = *wheels[i];
+                asio::co_spawn(ctx, wheel.Run(), asio::detached);
+                asio::ip::tcp::acceptor acceptor =
+                    listener.Open(ctx.get_executor());
+                asio::co_spawn(ctx, listener.Start(std::move(acceptor), wheel),
+                               asio::detached);
+            }
+            std::cout << "Server listening on port " << cfg.port << " ("
+                      << (sharded ? "sharded" : "shared") << ", "
+                      << cfg.n_thread << " threads, " << FileIo::Backend()
+                      << ")" << std::endl;
 
-            for (int i = 0; i < n_thread; i++) {
-                // Each thread runs the io_context. The run() function will
+            for (int i = 0; i < cfg.n_thread; i++) {
+                // Each thread runs an io_context. The run() function will
                 // block until all work has finished, including asynchronous
                 // tasks initiated by active connections and handlers.
                 //
@@ -49,7 +129,13 @@ namespace HttpRsp {
                 // posting work to it, respect its non-thread-safe
                 // characteristics. This is typically achieved by using
                 // `strand` objects to serialize access to the io_context.
-                threads.emplace_back([&ctx]() { ctx.run(); });
+                asio::io_context &ctx = *ctxs[i % n_ctx];
+                threads.emplace_back([&ctx, i, pin = cfg.pin_cpu]() {
+                    if (pin) {
+                        pin_thread(static_cast<size_t>(i));
+                    }
+                    ctx.run();
+                });
             }
 
             // Join all threads to the main thread. This ensures that the main
@@ -61,7 +147,7 @@ namespace HttpRsp {
         } catch (std::system_error &e) {
             // Exception handling: Any exceptions thrown within the server will
             // be caught here and logged to stderr.
-            std::cerr << "Server Exception: " << e.what() << std::endl;
+            listener.log().Error("Server exception", e.code());
         }
     }
 
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "httphdr.hpp"
+#include "metrics.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <array>
+#include <asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Access and error logs written off the I/O threads.
+//
+// A thread logs by copying a fixed-size binary record into a ring of its
+// own, which only it writes and only the writer thread of the logger reads:
+// a push is a copy and two atomic accesses, with no lock, no allocation and
+// no system call. The writer thread formats what the rings hold and writes
+// it out in batches. A push to a full ring drops the record and counts it
+// rather than waiting, so that a flood of errors never slows the server
+// down.
+namespace Log {
+
+    enum class Kind : uint8_t {
+        Access = 0,
+        Error,
+    };
+
+    // Longest request path or error message logged; longer ones are
+    // truncated.
+    inline constexpr size_t kTextSize = 192;
+
+    // What is logged of a response or an error.
+    struct Record {
+        int64_t time_ns = 0;    // since the epoch, set on push
+        uint64_t latency_ns = 0; // from the first byte of the request
+        uint64_t bytes = 0;      // of the response
+        // error of an error record, if any
+        const asio::error_category *category = nullptr;
+        int code = 0;
+        std::array<uint8_t, 16> addr{}; // of the peer; IPv4 is mapped
+        uint16_t port = 0;              // of the peer; 0 if unknown
+        uint16_t status = 0;            // HTTP code of an access
+        HttpHdr::Method method = HttpHdr::Method::UNKNOWN;
+        Kind kind = Kind::Access;
+        uint8_t n_text = 0;
+        char text[kTextSize]; // path of an access, message of an error
+
+        void set_peer(const asio::ip::tcp::endpoint &peer);
+        void set_text(std::string_view str) {
+            n_text = static_cast<uint8_t>(std::min(str.size(), kTextSize));
+            std::copy_n(str.data(), n_text, text);
+        }
+    };
+
+    // Single-producer, single-consumer ring of records.
+    class alignas(Metrics::kCacheLine) Ring {
+      public:
+        // `size`: a power of two
+        explicit Ring(size_t size)
+            : records_(std::make_unique<Record[]>(size)), mask_(size - 1) {}
+
+        // Producer: append `rec`; false, and counted, if the ring is full.
+        bool Push(const Record &rec) {
+            const uint64_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail - head_.load(std::memory_order_acquire) > mask_) {
+                Metrics::bump(dropped_, 1);
+                return false;
+            }
+            records_[tail & mask_] = rec;
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer: take the oldest record into `rec`; false if empty.
+        bool Pop(Record &rec) {
+            const uint64_t head = head_.load(std::memory_order_relaxed);
+            if (head == tail_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            rec = records_[head & mask_];
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        uint64_t dropped() const {
+            return dropped_.load(std::memory_order_relaxed);
+        }
+
+      private:
+        const std::unique_ptr<Record[]> records_;
+        const uint64_t mask_;
+        // written by the producer
+        alignas(Metrics::kCacheLine) std::atomic<uint64_t> tail_{0};
+        std::atomic<uint64_t> dropped_{0};
+        // written by the consumer
+        alignas(Metrics::kCacheLine) std::atomic<uint64_t> head_{0};
+    };
+
+    // The rings of the threads logging, and the thread writing them out.
+    class Logger {
+      public:
+        // Access records go to the file `access_path`, appended to, if not
+        // empty; errors to `error_fd`, not closed. Each thread gets a ring of
+        // `ring_size` records, rounded up to a power of two.
+        Logger(const std::string &access_path, int error_fd,
+               size_t ring_size);
+
+        // Write out what is left and stop the writer thread.
+        ~Logger();
+
+        Logger(const Logger &) = delete;
+        Logger &operator=(const Logger &) = delete;
+
+        // Whether access records are written, not to fill them in vain.
+        bool access() const { return static_cast<bool>(access_fd_); }
+
+        // Log `rec`, stamped with the time; false if it was dropped.
+        bool Push(Record &rec) {
+            rec.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::system_clock::now()
+                                  .time_since_epoch())
+                              .count();
+            return local().Push(rec);
+        }
+
+        // Log an error: `what`, the message of `ec` if set, and the peer if
+        // known.
+        void Error(std::string_view what, const asio::error_code &ec = {},
+                   const asio::ip::tcp::endpoint *peer = nullptr);
+
+        // Records dropped, the rings full.
+        uint64_t dropped() const;
+
+      private:
+        // Ring of the calling thread, created on its first call; see
+        // `Metrics::Registry::local`.
+        Ring &local() {
+            struct Cached {
+                uint64_t id = 0;
+                Ring *ring = nullptr;
+            };
+            thread_local Cached cached;
+            if (cached.id != id_) {
+                cached = {id_, &attach()};
+            }
+            return *cached.ring;
+        }
+
+        Ring &attach();
+
+        // Writer thread: drain the rings until stopped.
+        void run();
+
+        // Format `rec` at the end of `out`.
+        static void format(const Record &rec, std::string &out);
+
+        const uint64_t id_;
+        const size_t ring_size_;
+        Utils::Fd access_fd_;
+        const int error_fd_;
+        mutable std::mutex mtx_;
+        std::vector<std::unique_ptr<Ring>> rings_;
+        std::atomic<bool> stop_{false};
+        std::thread writer_;
+    };
+
+} // namespace Log
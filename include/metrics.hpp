@@ -0,0 +1,218 @@
+#pragma once
+
+#include "httphdr.hpp"
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Latency histograms and counters of the server, exposed in the Prometheus
+// text format.
+//
+// Every thread records into its own `Recorder`, which no other thread
+// writes: an update is a relaxed load, an add and a relaxed store, with no
+// lock and no atomic read-modify-write, and each recorder is allocated on
+// cache lines of its own so that threads never write the same line. A
+// scrape merges the recorders of all threads on demand; it may see a request
+// counted in one metric and not yet in another, as with any live process.
+namespace Metrics {
+
+    using Clock = std::chrono::steady_clock;
+
+    // Phases of a request, timed separately.
+    enum class Phase : uint8_t {
+        Read = 0, // from the first bytes of the head to the last, and a body
+                  // read before the handler runs
+        Parse,    // parsing the head and finding the route
+        Handle,   // running the handler, reading a streamed body
+        Write,    // writing a batch of pipelined responses
+        File,     // blocking filesystem work of a request, queued and run on
+                  // the file pool; part of handling it
+    };
+
+    // Counters of traffic.
+    enum class Count : uint8_t {
+        Requests = 0,
+        Reused, // requests after the first of their connection
+        BytesIn,
+        BytesOut,
+        Http2, // connections turned to HTTP/2
+    };
+
+    // Errors, by kind.
+    enum class Error : uint8_t {
+        Malformed = 0, // request answered 400 by the server
+        TooLarge,      // body over the limit, answered 413
+        Read,          // connection failed while reading, e.g. reset
+        Write,         // connection failed while writing
+    };
+
+    inline constexpr size_t kNPhase = 5;
+    inline constexpr size_t kNCount = 5;
+    inline constexpr size_t kNError = 4;
+
+    // Recorders are cache-line aligned.
+    inline constexpr size_t kCacheLine = 64;
+
+    // Add `n` to a counter written by one thread only.
+    static inline void bump(std::atomic<uint64_t> &counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n,
+                      std::memory_order_relaxed);
+    }
+
+    // Log-linear histogram of durations in nanoseconds, in the manner of
+    // HdrHistogram: one bucket per value below 32 ns, then 16 buckets per
+    // power of two, so that a value is known within 1/16 of it. Values of
+    // 2^40 ns (18 minutes) and more fall in the last bucket.
+    // Written by one thread; read by any.
+    class Histogram {
+      public:
+        inline static constexpr size_t kNBucket = 16 * 37;
+        inline static constexpr uint64_t kMax = (uint64_t{1} << 40) - 1;
+
+        // Bucket of `ns`.
+        static size_t index(uint64_t ns) {
+            ns = ns < kMax ? ns : kMax;
+            const int shift = std::bit_width(ns) - 5;
+            if (shift <= 0) {
+                return static_cast<size_t>(ns);
+            }
+            return 16 * static_cast<size_t>(shift) +
+                   static_cast<size_t>(ns >> shift);
+        }
+
+        // Smallest value of bucket `i`; the bucket ends where `i + 1`
+        // begins.
+        static uint64_t lower(size_t i) {
+            const size_t shift = i < 32 ? 0 : i / 16 - 1;
+            return static_cast<uint64_t>(i - 16 * shift) << shift;
+        }
+
+        void Record(uint64_t ns) {
+            bump(buckets_[index(ns)], 1);
+            bump(sum_, ns);
+        }
+
+        uint64_t bucket(size_t i) const {
+            return buckets_[i].load(std::memory_order_relaxed);
+        }
+        uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+
+      private:
+        std::array<std::atomic<uint64_t>, kNBucket> buckets_{};
+        std::atomic<uint64_t> sum_{0};
+    };
+
+    // Histograms merged, read at leisure.
+    struct Distribution {
+        std::array<uint64_t, Histogram::kNBucket> buckets{};
+        uint64_t count = 0;
+        uint64_t sum = 0; // ns
+
+        void Add(const Histogram &hist);
+
+        // Value below which a fraction `q` of the values fall, to within
+        // the precision of the buckets; 0 if empty.
+        uint64_t Quantile(double q) const;
+    };
+
+    // What a thread records, on cache lines of its own.
+    struct alignas(kCacheLine) Recorder {
+        std::array<Histogram, kNPhase> phases;
+        std::array<std::atomic<uint64_t>, kNCount> counts{};
+        std::array<std::atomic<uint64_t>, HttpHdr::kNStatus> responses{};
+        std::array<std::atomic<uint64_t>, kNError> errors{};
+
+        void Time(Phase phase, Clock::time_point from, Clock::time_point to) {
+            phases[static_cast<uint8_t>(phase)].Record(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(to - from)
+                    .count()));
+        }
+        void Add(Count count, uint64_t n = 1) {
+            bump(counts[static_cast<uint8_t>(count)], n);
+        }
+        void Respond(HttpHdr::Status status) {
+            bump(responses[static_cast<uint8_t>(status)], 1);
+        }
+        void Fail(Error error) { bump(errors[static_cast<uint8_t>(error)], 1); }
+    };
+
+    // Recorders of all threads, merged.
+    struct Snapshot {
+        std::array<Distribution, kNPhase> phases;
+        std::array<uint64_t, kNCount> counts{};
+        std::array<uint64_t, HttpHdr::kNStatus> responses{};
+        std::array<uint64_t, kNError> errors{};
+        size_t n_threads = 0;
+    };
+
+    // The recorders of the threads using a set of metrics.
+    class Registry {
+      public:
+        Registry();
+
+        Registry(const Registry &) = delete;
+        Registry &operator=(const Registry &) = delete;
+
+        // Recorder of the calling thread, created on its first call. A
+        // coroutine must call this again after resuming, as it may have
+        // moved to another thread.
+        Recorder &local() {
+            struct Cached {
+                uint64_t id = 0;
+                Recorder *recorder = nullptr;
+            };
+            thread_local Cached cached;
+            if (cached.id != id_) {
+                cached = {id_, &attach()};
+            }
+            return *cached.recorder;
+        }
+
+        Snapshot Collect() const;
+
+        // Append the metrics, prefixed with "fasterapi_", to `out`.
+        void Render(std::string &out) const;
+
+      private:
+        // Find or create the recorder of the calling thread.
+        Recorder &attach();
+
+        // Distinguishes registries for the cache in `local`, as one may be
+        // allocated where another was freed.
+        const uint64_t id_;
+        mutable std::mutex mtx_;
+        std::vector<std::pair<std::thread::id, std::unique_ptr<Recorder>>>
+            recorders_;
+    };
+
+    // Append a single-valued metric to `out`; `type` is "counter" or
+    // "gauge".
+    void Append(std::string &out, std::string_view name, std::string_view type,
+                std::string_view help, uint64_t value);
+
+    // Append the HELP and TYPE lines of a metric to `out`, to be followed by
+    // its samples.
+    void AppendHeader(std::string &out, std::string_view name,
+                      std::string_view type, std::string_view help);
+
+    // Append the sample `name{label="value"} n` to `out`.
+    void AppendSample(std::string &out, std::string_view name,
+                      std::string_view label, std::string_view value,
+                      uint64_t n);
+
+    // Append the samples of `dist`, in seconds, as those of the histogram
+    // `name` labeled `label="value"`, to `out`.
+    void AppendHistogram(std::string &out, std::string_view name,
+                         std::string_view label, std::string_view value,
+                         const Distribution &dist);
+
+} // namespace Metrics
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "httpcond.hpp"
+#include "httphdr.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <unordered_map>
+
+namespace OpenCache {
+
+    using Clock = std::chrono::steady_clock;
+
+    // What a request path resolves to: an open file and its metadata, or
+    // nothing (a 404).
+    // Requests share it by reference count; the descriptor is closed when
+    // the entry is dropped and the last of them is done with it.
+    struct Entry {
+        Utils::Fd fd; // invalid if there is no such file
+        // path relative to the root, e.g. "/index.html"; for a missing file,
+        // the path it would have, see `Utils::resolve_missing`
+        std::string file;
+        size_t size = 0;
+        timespec mtime{};
+        ino_t inode = 0;
+        HttpHdr::ContType cont_type = HttpHdr::ContType::TEXT_PLAIN;
+        HttpCond::Validators validators; // made from `mtime` and `size`
+        Clock::time_point expires;
+
+        bool found() const { return static_cast<bool>(fd); }
+    };
+
+    using EntryPtr = std::shared_ptr<const Entry>;
+
+    // Sharded, bounded LRU cache of open files keyed by request path, in the
+    // manner of nginx's open_file_cache.
+    //
+    // A hit spares resolving the path (`std::filesystem::canonical`, which
+    // takes an lstat(2) per component), checking the file and opening it:
+    // the request gets a descriptor ready to read or to sendfile(2), or
+    // learns that there is no such file. Shards are guarded by their own
+    // mutex, as in `FileCache::Cache`.
+    //
+    // Entries are dropped by `Invalidate` as files change, and in any case
+    // `ttl` after they were opened, which bounds how long a change inotify
+    // cannot attribute to a path (e.g. through a symbolic link) goes
+    // unnoticed. The cache starts disabled, see `FileCache::Cache`.
+    class Cache {
+      public:
+        inline static constexpr size_t kNShard = 16;
+
+        // `max_entries`: most entries, hence descriptors, held open
+        Cache(size_t max_entries, Clock::duration ttl)
+            : shard_cap_(std::max<size_t>(max_entries / kNShard, 1)),
+              ttl_(ttl), gen_(0), enabled_(false) {}
+
+        bool enabled() const {
+            return enabled_.load(std::memory_order_relaxed);
+        }
+
+        void Enable() { enabled_.store(true, std::memory_order_relaxed); }
+
+        // Stop caching and drop every entry, for good if invalidation is
+        // no longer in place.
+        void Disable() {
+            enabled_.store(false, std::memory_order_relaxed);
+            Invalidate("", true);
+        }
+
+        // Entry of a request path; nullptr on a miss or if it expired.
+        EntryPtr Get(std::string_view path);
+
+        // Resolve a request path under `root`, which must be canonical, and
+        // open the file, caching the result; see `Utils::resolve`.
+        // Blocking: for the file pool.
+        EntryPtr Open(std::string_view path, const std::string &root);
+
+        // Drop the entries of the file `file` (relative to the root), or of
+        // every file below it if `is_dir`. An empty path drops everything.
+        void Invalidate(std::string_view file, bool is_dir);
+
+      private:
+        struct Node {
+            std::string key;
+            EntryPtr entry;
+        };
+
+        struct Shard {
+            std::mutex mtx;
+            std::list<Node> lru; // most recently used first
+            // keys are views of `Node::key`, which list nodes keep in place
+            std::unordered_map<std::string_view, std::list<Node>::iterator>
+                map;
+        };
+
+        Shard &shard(std::string_view path) {
+            return shards_[std::hash<std::string_view>{}(path) % kNShard];
+        }
+
+        // Insert or replace the entry of a request path unless the cache
+        // was invalidated since generation `gen`.
+        void put(std::string_view path, EntryPtr entry, uint64_t gen);
+
+        const size_t shard_cap_;
+        const Clock::duration ttl_;
+        std::atomic<uint64_t> gen_;
+        std::atomic<bool> enabled_;
+        std::array<Shard, kNShard> shards_;
+    };
+
+} // namespace OpenCache
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "httpreq_body.hpp"
+#include "httpreq_message.hpp"
+#include "httprsp_config.hpp"
+#include "httprsp_message.hpp"
+#include "metrics.hpp"
+#include "utils.hpp"
+#include <array>
+#include <asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Reverse proxy: requests under a path prefix are forwarded to upstream
+// HTTP/1.1 servers.
+//
+// A request goes out as its head arrived, less the hop-by-hop fields, its
+// body streamed from the client through the buffer of the connection; the
+// response comes back as a `HttpRsp::Relay`, its head parsed and its body
+// read into a fixed buffer while the client is sent the previous piece, so
+// neither body is ever held whole. A body of unknown length is re-chunked
+// for HTTP/1.1 clients.
+//
+// Connections to the servers are kept alive and reused: each thread keeps a
+// stack of idle ones per server, the most recent on top so that the pool
+// shrinks to what the load needs, without a lock as no other thread touches
+// it. They are kept as bare descriptors, tied to no I/O context, and checked
+// for a close by the server before reuse; a request without a body that
+// fails on a reused connection before any response is tried once more on a
+// new one. Connecting, reading and writing have deadlines in the timing
+// wheel of the client's connection.
+namespace Proxy {
+
+    struct Options {
+        std::chrono::seconds connect_timeout;
+        std::chrono::seconds read_timeout;
+        std::chrono::seconds idle_timeout;
+        // most idle connections per server and thread
+        size_t max_idle;
+        // bytes read from a server at once, and most of a response head
+        size_t buffer;
+    };
+
+    class Forwarder {
+      public:
+        explicit Forwarder(const Options &opts);
+        ~Forwarder();
+
+        Forwarder(const Forwarder &) = delete;
+        Forwarder &operator=(const Forwarder &) = delete;
+
+        // Add a route to `upstreams`, "host:port" each, and return its
+        // index. The names are resolved now; throw `std::invalid_argument`
+        // if one is malformed or `upstreams` is empty, `std::system_error`
+        // if one does not resolve. Not to be called once serving.
+        size_t Add(const std::vector<std::string> &upstreams,
+                   HttpRsp::Balance balance);
+
+        // Forward `req`, whose body is read from `body`, to a server of
+        // route `route` and answer `rsp` with its response, to relay, or
+        // with 502 (the server failed) or 504 (it timed out).
+        asio::awaitable<void> Forward(size_t route,
+                                      const HttpReq::Message &req,
+                                      HttpReq::BodyReader &body,
+                                      HttpRsp::Message &rsp);
+
+        // Append the metrics of the servers, by server, to `out`.
+        void Render(std::string &out) const;
+
+      private:
+        class Exchange;
+
+        struct Upstream {
+            std::string name; // as configured
+            std::vector<asio::ip::tcp::endpoint> endpoints;
+            // requests in flight, from all threads
+            std::atomic<int64_t> outstanding{0};
+        };
+
+        struct Route {
+            std::vector<size_t> upstreams;
+            HttpRsp::Balance balance;
+        };
+
+        // An idle connection.
+        struct Idle {
+            Utils::Fd fd;
+            bool v6 = false;
+            Metrics::Clock::time_point since;
+        };
+
+        // Counters of a server.
+        enum class Count : uint8_t {
+            Requests = 0,
+            Reused,   // requests sent on an idle connection
+            Connects, // connections opened
+            Failures, // connection failed or response malformed: answered
+                      // 502, or the body cut short
+            Timeouts, // answered 504, or the body cut short
+        };
+        inline static constexpr size_t kNCount = 5;
+
+        // What a thread records of a server, on cache lines of its own.
+        struct alignas(Metrics::kCacheLine) Stats {
+            // from picking the server to its response head
+            Metrics::Histogram latency;
+            std::array<std::atomic<uint64_t>, kNCount> counts{};
+
+            void Add(Count count) {
+                Metrics::bump(counts[static_cast<uint8_t>(count)], 1);
+            }
+        };
+
+        // State of a thread: its idle connections and stats per server, and
+        // where its round robin is per route.
+        struct Local {
+            std::vector<std::vector<Idle>> idle;
+            std::vector<Stats> stats;
+            std::vector<size_t> next;
+
+            Local(size_t n_upstreams, size_t n_routes)
+                : idle(n_upstreams), stats(n_upstreams), next(n_routes, 0) {}
+        };
+
+        // State of the calling thread, created on its first call; see
+        // `Metrics::Registry::local`.
+        Local &local() {
+            struct Cached {
+                uint64_t id = 0;
+                Local *local = nullptr;
+            };
+            thread_local Cached cached;
+            if (cached.id != id_) {
+                cached = {id_, &attach()};
+            }
+            return *cached.local;
+        }
+        Local &attach();
+
+        // Server of `route` for the next request.
+        size_t pick(size_t route, Local &local);
+
+        // An idle connection to `upstream` still open, if any.
+        bool checkout(size_t upstream, Local &local, Idle &idle);
+        void checkin(size_t upstream, Idle idle);
+
+        const Options opts_;
+        const uint64_t id_;
+        std::vector<std::unique_ptr<Upstream>> upstreams_;
+        std::vector<Route> routes_;
+        mutable std::mutex mtx_;
+        std::vector<std::pair<std::thread::id, std::unique_ptr<Local>>>
+            locals_;
+    };
+
+} // namespace Proxy
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Runtime-dispatched SIMD kernels for scanning HTTP header bytes.
+//
+// Every kernel has a scalar reference implementation and vectorized variants
+// for SSE4.2, AVX2 and AVX-512BW on x86-64 and NEON on AArch64. Each variant
+// lives in its own translation unit compiled for its instruction set, and the
+// widest one the CPU supports is selected once, on first use, from CPUID. A
+// single binary therefore runs AVX2 or AVX-512 kernels without being built
+// with `-mavx2`.
+namespace Simd {
+
+    enum class Isa : uint8_t {
+        Scalar = 0,
+        SSE42,
+        AVX2,
+        AVX512BW,
+        NEON,
+    };
+
+    struct Kernels {
+        Isa isa;
+        // Position of the first `c` in [s, s + n), or n if not found.
+        size_t (*find_byte)(const char *s, size_t n, char c);
+        // Position of the first CRLF in [s, s + n), or n if not found.
+        size_t (*find_crlf)(const char *s, size_t n);
+        // Position of the first CRLF CRLF in [s, s + n), or n if not found.
+        size_t (*find_crlf2)(const char *s, size_t n);
+        // ASCII case-insensitive equality of [a, a + n) and [b, b + n).
+        bool (*iequals)(const char *a, const char *b, size_t n);
+        // Upper-case the ASCII letters of [s, s + n) in place.
+        void (*toupper)(char *s, size_t n);
+    };
+
+    // Kernels of the widest instruction set supported by the CPU.
+    const Kernels &kernels();
+
+    // Kernels of a specific instruction set, or nullptr if they are not
+    // compiled for this target or not supported by the CPU.
+    const Kernels *kernels(Isa isa);
+
+    const char *isa2str(Isa isa);
+
+    inline size_t find_byte(const char *s, size_t n, char c) {
+        return kernels().find_byte(s, n, c);
+    }
+
+    inline size_t find_crlf(const char *s, size_t n) {
+        return kernels().find_crlf(s, n);
+    }
+
+    inline size_t find_crlf2(const char *s, size_t n) {
+        return kernels().find_crlf2(s, n);
+    }
+
+    inline bool iequals(const char *a, const char *b, size_t n) {
+        return kernels().iequals(a, b, n);
+    }
+
+    inline void toupper(char *s, size_t n) { kernels().toupper(s, n); }
+
+} // namespace Simd
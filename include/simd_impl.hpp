@@ -0,0 +1,184 @@
+#pragma once
+
+// Building blocks shared by the per-instruction-set kernel translation units.
+// Only `src/simd*.cpp` include this header.
+//
+// Everything below is in an anonymous namespace on purpose: each translation
+// unit is compiled for a different instruction set, and internal linkage keeps
+// the linker from merging, say, an AVX2 instantiation into the SSE4.2 one.
+
+#include "simd.hpp"
+
+namespace Simd {
+
+    extern const Kernels kScalarKernels;
+    extern const Kernels kSSE42Kernels;
+    extern const Kernels kAVX2Kernels;
+    extern const Kernels kAVX512BWKernels;
+    extern const Kernels kNEONKernels;
+
+    namespace {
+
+        inline bool is_lower(char c) { return c >= 'a' && c <= 'z'; }
+
+        inline bool iequals_char(char a, char b) {
+            return a == b || ((a | 0x20) == (b | 0x20) && is_lower(a | 0x20));
+        }
+
+        // Kernels generic over a vector traits type `V` providing:
+        //
+        // - `kWidth`: bytes per vector
+        // - `kShift`: log2 of the mask bits per byte
+        // - `Vec load(const char *)` and `void store(char *, Vec)`
+        // - `uint64_t eq(Vec, char)`: mask of the bytes equal to a character
+        // - `bool ieq(Vec, Vec)`: case-insensitive equality of all bytes
+        // - `Vec upper(Vec)`: upper-cased letters
+        //
+        // Bytes left over after the last full vector go through the scalar
+        // code, which is also the reference implementation. Instruction sets
+        // with masked memory access may instead provide
+        //
+        // - `Vec load_n(const char *, size_t n)`: load n < kWidth bytes and
+        //   zero the others
+        // - `void store_n(char *, Vec, size_t n)`: store n < kWidth bytes
+        //
+        // and finish with one partial vector.
+        template <typename V>
+        concept Masked = requires(char *p, typename V::Vec v) {
+            V::load_n(p, size_t{0});
+            V::store_n(p, v, size_t{0});
+        };
+
+        // Mask of the first n bytes of a vector
+        template <typename V> uint64_t first_n(size_t n) {
+            return n * (1u << V::kShift) >= 64
+                       ? ~uint64_t{0}
+                       : (uint64_t{1} << (n << V::kShift)) - 1;
+        }
+
+        template <typename V>
+        size_t find_byte(const char *s, size_t n, char c) {
+            size_t i = 0;
+            for (; i + V::kWidth <= n; i += V::kWidth) {
+                const uint64_t m = V::eq(V::load(s + i), c);
+                if (m != 0) {
+                    return i + (__builtin_ctzll(m) >> V::kShift);
+                }
+            }
+            if constexpr (Masked<V>) {
+                const uint64_t m =
+                    V::eq(V::load_n(s + i, n - i), c) & first_n<V>(n - i);
+                return m != 0 ? i + (__builtin_ctzll(m) >> V::kShift) : n;
+            }
+            for (; i < n; ++i) {
+                if (s[i] == c) {
+                    return i;
+                }
+            }
+            return n;
+        }
+
+        template <typename V> size_t find_crlf(const char *s, size_t n) {
+            size_t i = 0;
+            for (; i + V::kWidth + 1 <= n; i += V::kWidth) {
+                const uint64_t m = V::eq(V::load(s + i), '\r') &
+                                   V::eq(V::load(s + i + 1), '\n');
+                if (m != 0) {
+                    return i + (__builtin_ctzll(m) >> V::kShift);
+                }
+            }
+            if constexpr (Masked<V>) {
+                if (i + 1 >= n) {
+                    return n;
+                }
+                const size_t r = n - i;
+                const uint64_t m = V::eq(V::load_n(s + i, r), '\r') &
+                                   V::eq(V::load_n(s + i + 1, r - 1), '\n') &
+                                   first_n<V>(r - 1);
+                return m != 0 ? i + (__builtin_ctzll(m) >> V::kShift) : n;
+            }
+            for (; i + 1 < n; ++i) {
+                if (s[i] == '\r' && s[i + 1] == '\n') {
+                    return i;
+                }
+            }
+            return n;
+        }
+
+        template <typename V> size_t find_crlf2(const char *s, size_t n) {
+            size_t i = 0;
+            for (; i + V::kWidth + 3 <= n; i += V::kWidth) {
+                const uint64_t m = V::eq(V::load(s + i), '\r') &
+                                   V::eq(V::load(s + i + 1), '\n') &
+                                   V::eq(V::load(s + i + 2), '\r') &
+                                   V::eq(V::load(s + i + 3), '\n');
+                if (m != 0) {
+                    return i + (__builtin_ctzll(m) >> V::kShift);
+                }
+            }
+            if constexpr (Masked<V>) {
+                if (i + 3 >= n) {
+                    return n;
+                }
+                const size_t r = n - i;
+                const uint64_t m = V::eq(V::load_n(s + i, r), '\r') &
+                                   V::eq(V::load_n(s + i + 1, r - 1), '\n') &
+                                   V::eq(V::load_n(s + i + 2, r - 2), '\r') &
+                                   V::eq(V::load_n(s + i + 3, r - 3), '\n') &
+                                   first_n<V>(r - 3);
+                return m != 0 ? i + (__builtin_ctzll(m) >> V::kShift) : n;
+            }
+            for (; i + 3 < n; ++i) {
+                if (s[i] == '\r' && s[i + 1] == '\n' && s[i + 2] == '\r' &&
+                    s[i + 3] == '\n') {
+                    return i;
+                }
+            }
+            return n;
+        }
+
+        template <typename V>
+        bool iequals(const char *a, const char *b, size_t n) {
+            size_t i = 0;
+            for (; i + V::kWidth <= n; i += V::kWidth) {
+                if (!V::ieq(V::load(a + i), V::load(b + i))) {
+                    return false;
+                }
+            }
+            if constexpr (Masked<V>) {
+                // bytes past the end load as zero on both sides and match
+                return V::ieq(V::load_n(a + i, n - i), V::load_n(b + i, n - i));
+            }
+            for (; i < n; ++i) {
+                if (!iequals_char(a[i], b[i])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        template <typename V> void toupper(char *s, size_t n) {
+            size_t i = 0;
+            for (; i + V::kWidth <= n; i += V::kWidth) {
+                V::store(s + i, V::upper(V::load(s + i)));
+            }
+            if constexpr (Masked<V>) {
+                V::store_n(s + i, V::upper(V::load_n(s + i, n - i)), n - i);
+                return;
+            }
+            for (; i < n; ++i) {
+                if (is_lower(s[i])) {
+                    s[i] -= 0x20;
+                }
+            }
+        }
+
+        // Kernel table of the instruction set described by `V`.
+        template <typename V> constexpr Kernels make_kernels(Isa isa) {
+            return {isa,           &find_byte<V>, &find_crlf<V>,
+                    &find_crlf2<V>, &iequals<V>,  &toupper<V>};
+        }
+
+    } // namespace
+
+} // namespace Simd
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+// Hierarchical timing wheel for connection deadlines.
+//
+// Connections re-arm their deadline several times per request (reading the
+// head, the body, writing, waiting for the next request); with a timer per
+// connection every re-arm would be an O(log n) operation on asio's timer
+// heap. Here a deadline is an intrusive list node dropped into the slot of
+// its expiry tick: arming, re-arming and cancelling are O(1), need no
+// allocation, and the wheel itself is a fixed 320 slots however many
+// connections it tracks.
+//
+// Level 0 has one slot per tick for the next 256 ticks; level 1 has one slot
+// per 256 ticks for the next 64 * 256 ticks, and its slots are cascaded down
+// into level 0 as time reaches them. With 100 ms ticks, deadlines are exact
+// to a tick up to 25.6 s and may reach 27 minutes; longer ones are clamped.
+//
+// The wheel is driven by the `Run` coroutine, which wakes up once per tick.
+// A wheel may be shared by the threads running an io_context (shared mode);
+// a mutex, uncontended when a single thread uses it, guards the slots.
+namespace TimeWheel {
+
+    using Clock = std::chrono::steady_clock;
+
+    inline constexpr Clock::duration kTick = std::chrono::milliseconds(100);
+
+    // A deadline, embedded in the object it belongs to.
+    // On expiry `fn(arg)` is called on the thread running the wheel, with
+    // the wheel locked: it must be quick and must not use the wheel.
+    struct Timer {
+        void (*fn)(void *arg) = nullptr;
+        void *arg = nullptr;
+
+        bool armed() const { return pprev != nullptr; }
+
+      private:
+        friend class Wheel;
+        Timer *next = nullptr;
+        Timer **pprev = nullptr; // link pointing to this timer when armed
+        uint64_t expiry = 0;     // tick
+    };
+
+    class Wheel {
+      public:
+        explicit Wheel(Clock::time_point start = Clock::now())
+            : start_(start) {}
+
+        Wheel(const Wheel &) = delete;
+        Wheel &operator=(const Wheel &) = delete;
+
+        // Arm `timer` to expire `timeout` from now, re-arming it if it is
+        // armed already.
+        void Set(Timer &timer, Clock::duration timeout);
+
+        // Disarm `timer`; nothing happens if it is not armed.
+        // Once this returns, the timer's function is not running and will
+        // not run.
+        void Cancel(Timer &timer);
+
+        // Number of armed timers.
+        size_t size() const {
+            std::lock_guard<std::mutex> lock(mtx_);
+            return size_;
+        }
+
+        // Expire the timers due by `now`.
+        void Advance(Clock::time_point now);
+
+        // Expire timers as time passes, forever.
+        asio::awaitable<void> Run();
+
+      private:
+        inline static constexpr size_t kNSlot0 = 256;
+        inline static constexpr size_t kNSlot1 = 64;
+
+        void link(Timer &timer);
+        static void unlink(Timer &timer);
+        // Advance by one tick, expiring the timers due.
+        void tick();
+
+        const Clock::time_point start_;
+        mutable std::mutex mtx_;
+        uint64_t now_ = 0; // ticks since `start_` processed so far
+        size_t size_ = 0;
+        std::array<Timer *, kNSlot0> level0_{};
+        std::array<Timer *, kNSlot1> level1_{};
+    };
+
+} // namespace TimeWheel
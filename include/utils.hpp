@@ -1,26 +1,131 @@
 #pragma once
 
-#include <chrono>
+#include <cerrno>
+#include <fcntl.h>
+#include <filesystem>
 #include <fstream>
 #include <string>
+#include <string_view>
+#include <unistd.h>
+#include <utility>
 
 namespace Utils {
-    static inline const std::string read_file(const std::string &path,
-                                              const std::string &root) {
-        std::filesystem::path full_path;
 
-        try {
-            full_path = std::filesystem::canonical(
-                root + (path.back() == '/' ? path + "index.html" : path));
-        } catch (const std::exception &e) {
-            return "";
+    // Owned file descriptor, closed on destruction.
+    class Fd {
+      public:
+        Fd() = default;
+        explicit Fd(int fd) : fd_(fd) {}
+        Fd(Fd &&other) noexcept : fd_(std::exchange(other.fd_, -1)) {}
+        Fd &operator=(Fd &&other) noexcept {
+            if (this != &other) {
+                reset(std::exchange(other.fd_, -1));
+            }
+            return *this;
         }
+        ~Fd() { reset(); }
 
-        if (!std::filesystem::exists(full_path) ||
-            !std::filesystem::is_regular_file(full_path)) {
-            return "";
+        int get() const { return fd_; }
+        explicit operator bool() const { return fd_ >= 0; }
+
+        // Give up the descriptor, left open.
+        int release() { return std::exchange(fd_, -1); }
+
+        void reset(int fd = -1) {
+            if (fd_ >= 0) {
+                ::close(fd_);
+            }
+            fd_ = fd;
         }
 
+      private:
+        int fd_ = -1;
+    };
+
+    // Open a file read-only; the descriptor is invalid on failure.
+    static inline Fd open_file(const std::filesystem::path &path) {
+        return Fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    }
+
+    // Resolve a request path to a regular file under `root`, which must be
+    // canonical; "index.html" is appended to directory paths.
+    // Return an empty path if there is no such file or the path escapes the
+    // root (e.g. "/../etc/passwd").
+    static inline std::filesystem::path resolve(std::string_view path,
+                                                const std::string &root) {
+        std::string rel_path = root;
+        rel_path += path;
+        if (path.empty() || path.back() == '/') {
+            rel_path += "index.html";
+        }
+
+        std::error_code ec;
+        std::filesystem::path full_path =
+            std::filesystem::canonical(rel_path, ec);
+        if (ec) {
+            return {};
+        }
+
+        const std::string &full = full_path.native();
+        const size_t n_root =
+            root.back() == '/' ? root.size() - 1 : root.size();
+        if (full.size() <= n_root || full.compare(0, n_root, root, 0, n_root) ||
+            full[n_root] != '/') {
+            return {};
+        }
+
+        if (!std::filesystem::is_regular_file(full_path, ec)) {
+            return {};
+        }
+        return full_path;
+    }
+
+    // Path a request path would resolve to if its file existed, relative to
+    // `root` as by `relative`: the part that exists is resolved, the rest
+    // normalized, and "index.html" appended to directory paths. If it
+    // escapes the root, the request path normalized.
+    static inline std::string resolve_missing(std::string_view path,
+                                              const std::string &root) {
+        std::string rel_path = root;
+        rel_path += path;
+        if (path.empty() || path.back() == '/') {
+            rel_path += "index.html";
+        }
+
+        std::error_code ec;
+        const std::filesystem::path full_path =
+            std::filesystem::weakly_canonical(rel_path, ec);
+        const std::string &full = full_path.native();
+        const size_t n_root =
+            root.back() == '/' ? root.size() - 1 : root.size();
+        if (ec || full.size() <= n_root ||
+            full.compare(0, n_root, root, 0, n_root) || full[n_root] != '/') {
+            return std::filesystem::path(rel_path.substr(n_root))
+                .lexically_normal()
+                .native();
+        }
+        return full.substr(n_root);
+    }
+
+    // Path of a file resolved by `resolve` relative to `root`, starting with
+    // '/', e.g. "/css/site.css".
+    static inline std::string_view
+    relative(const std::filesystem::path &full_path, const std::string &root) {
+        const size_t n_root =
+            root.back() == '/' ? root.size() - 1 : root.size();
+        return std::string_view(full_path.native()).substr(n_root);
+    }
+
+    // Canonical form of a directory, or the directory itself if it cannot be
+    // resolved.
+    static inline std::string canonical_dir(const std::string &dir) {
+        std::error_code ec;
+        const std::filesystem::path path = std::filesystem::canonical(dir, ec);
+        return ec ? dir : path.native();
+    }
+
+    static inline const std::string
+    read_file(const std::filesystem::path &full_path) {
         std::ifstream file(full_path, std::ios::binary | std::ios::ate);
         if (!file)
             return "";
@@ -32,14 +137,27 @@ namespace Utils {
         return content;
     }
 
-    static inline std::string timestamp() {
-        auto now = std::chrono::system_clock::to_time_t(
-            std::chrono::system_clock::now());
-        std::stringstream ss;
-        ss << std::ctime(&now);
-        std::string s = ss.str();
-        s.pop_back(); // Remove newline
-        return s;
+    // Read `size` bytes of an open file from `offset`; empty on failure.
+    static inline std::string read_fd(int fd, size_t size, off_t offset = 0) {
+        std::string content(size, '\0');
+        for (size_t pos = 0; pos < size;) {
+            const ssize_t n = ::pread(fd, &content[pos], size - pos,
+                                      offset + static_cast<off_t>(pos));
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                return "";
+            }
+            pos += static_cast<size_t>(n);
+        }
+        return content;
+    }
+
+    static inline const std::string read_file(std::string_view path,
+                                              const std::string &root) {
+        const std::filesystem::path full_path = resolve(path, root);
+        return full_path.empty() ? "" : read_file(full_path);
     }
 
 } // namespace Utils
@@ -0,0 +1,122 @@
+#include "compress.hpp"
+#include <zlib.h>
+
+// Window bits of zlib selecting the format: zlib's own header for deflate,
+// a gzip header above 16.
+static int window_bits(Compress::Coding coding) {
+    return coding == Compress::Coding::Gzip ? MAX_WBITS + 16 : MAX_WBITS;
+}
+
+static std::string_view trim(std::string_view str) {
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) {
+        str.remove_prefix(1);
+    }
+    while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) {
+        str.remove_suffix(1);
+    }
+    return str;
+}
+
+// Whether the parameters of a coding, e.g. " q=0.5", leave it acceptable:
+// only a q-value of zero ("0", "0.0", "0.00", "0.000") refuses it.
+static bool acceptable(std::string_view params) {
+    while (!params.empty()) {
+        const size_t semi = params.find(';');
+        const std::string_view param = trim(params.substr(0, semi));
+        params = semi == std::string_view::npos ? std::string_view()
+                                                : params.substr(semi + 1);
+        if (param.size() < 2 || (param[0] != 'q' && param[0] != 'Q') ||
+            param[1] != '=') {
+            continue;
+        }
+        const std::string_view q = trim(param.substr(2));
+        return !q.starts_with('0') ||
+               q.find_first_not_of("0.") != std::string_view::npos;
+    }
+    return true;
+}
+
+Compress::Codings Compress::Accepted(std::string_view accept) {
+    Codings listed = 0;
+    Codings accepted = 0;
+    bool any = false;
+    while (!accept.empty()) {
+        const size_t comma = accept.find(',');
+        std::string_view item = accept.substr(0, comma);
+        accept = comma == std::string_view::npos ? std::string_view()
+                                                 : accept.substr(comma + 1);
+        const size_t semi = item.find(';');
+        const std::string_view token = trim(item.substr(0, semi));
+        const bool ok = semi == std::string_view::npos ||
+                        acceptable(item.substr(semi + 1));
+        if (token == "*") {
+            any = ok;
+            continue;
+        }
+        Codings coding = 0;
+        if (iequals_ascii(token, "gzip") || iequals_ascii(token, "x-gzip")) {
+            coding = bit(Coding::Gzip);
+        } else if (iequals_ascii(token, "deflate")) {
+            coding = bit(Coding::Deflate);
+        } else if (iequals_ascii(token, "br")) {
+            coding = bit(Coding::Br);
+        }
+        listed |= coding;
+        if (ok) {
+            accepted |= coding;
+        }
+    }
+    if (any) {
+        accepted |= static_cast<Codings>(
+            (bit(Coding::Gzip) | bit(Coding::Deflate) | bit(Coding::Br)) &
+            ~listed);
+    }
+    return accepted;
+}
+
+std::string Compress::Encode(std::string_view data, Coding coding,
+                             int level) {
+    z_stream zs{};
+    if (deflateInit2(&zs, level, Z_DEFLATED, window_bits(coding), 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return {};
+    }
+    std::string out(deflateBound(&zs, static_cast<uLong>(data.size())), '\0');
+    zs.next_in =
+        reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    zs.avail_in = static_cast<uInt>(data.size());
+    zs.next_out = reinterpret_cast<Bytef *>(out.data());
+    zs.avail_out = static_cast<uInt>(out.size());
+    const int ret = deflate(&zs, Z_FINISH);
+    const size_t n_out = zs.total_out;
+    deflateEnd(&zs);
+    if (ret != Z_STREAM_END) {
+        return {};
+    }
+    out.resize(n_out);
+    return out;
+}
+
+std::string Compress::Decode(std::string_view data, Coding coding) {
+    z_stream zs{};
+    if (inflateInit2(&zs, window_bits(coding)) != Z_OK) {
+        return {};
+    }
+    std::string out;
+    char buf[16 * 1024];
+    zs.next_in =
+        reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    zs.avail_in = static_cast<uInt>(data.size());
+    int ret = Z_OK;
+    while (ret == Z_OK) {
+        zs.next_out = reinterpret_cast<Bytef *>(buf);
+        zs.avail_out = sizeof(buf);
+        ret = inflate(&zs, Z_NO_FLUSH);
+        out.append(buf, sizeof(buf) - zs.avail_out);
+    }
+    inflateEnd(&zs);
+    if (ret != Z_STREAM_END) {
+        return {};
+    }
+    return out;
+}
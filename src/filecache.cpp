@@ -0,0 +1,78 @@
+#include "filecache.hpp"
+
+FileCache::EntryPtr FileCache::Cache::Get(std::string_view path) {
+    if (!enabled()) {
+        return nullptr;
+    }
+    Shard &sh = shard(path);
+    std::lock_guard<std::mutex> lock(sh.mtx);
+    const auto it = sh.map.find(path);
+    if (it == sh.map.end()) {
+        return nullptr;
+    }
+    sh.lru.splice(sh.lru.begin(), sh.lru, it->second);
+    return it->second->entry;
+}
+
+void FileCache::Cache::Put(std::string_view path, EntryPtr entry,
+                           uint64_t gen) {
+    const size_t size = path.size() + entry->head.size() +
+                        entry->body.size() + entry->file.size() +
+                        sizeof(Node) + sizeof(Entry);
+    if (!enabled() || size > shard_cap_) {
+        return;
+    }
+    Shard &sh = shard(path);
+    std::lock_guard<std::mutex> lock(sh.mtx);
+    // the file was invalidated while being read
+    if (gen != gen_.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    const auto it = sh.map.find(path);
+    if (it != sh.map.end()) {
+        sh.bytes -= it->second->size;
+        it->second->entry = std::move(entry);
+        it->second->size = size;
+        sh.lru.splice(sh.lru.begin(), sh.lru, it->second);
+    } else {
+        sh.lru.push_front({std::string(path), std::move(entry), size});
+        sh.map.emplace(sh.lru.front().key, sh.lru.begin());
+    }
+    sh.bytes += size;
+
+    while (sh.bytes > shard_cap_) {
+        const Node &lru = sh.lru.back();
+        sh.bytes -= lru.size;
+        sh.map.erase(lru.key);
+        sh.lru.pop_back();
+    }
+}
+
+// Several request paths may resolve to the same file ("/" and
+// "/index.html"), so every shard is scanned for entries of that file. Files
+// change rarely compared to how often they are served, and the cache holds
+// at most a few thousand entries, so the scan is cheap.
+void FileCache::Cache::Invalidate(std::string_view file, bool is_dir) {
+    // bump first: a concurrent `Put` either sees the new generation and
+    // gives up, or has already inserted its entry, which the scan removes
+    gen_.fetch_add(1, std::memory_order_acq_rel);
+
+    for (Shard &sh : shards_) {
+        std::lock_guard<std::mutex> lock(sh.mtx);
+        for (auto it = sh.lru.begin(); it != sh.lru.end();) {
+            const std::string_view f = it->entry->file;
+            const bool hit =
+                file.empty() || f == file ||
+                (is_dir && f.size() > file.size() && f.starts_with(file) &&
+                 f[file.size()] == '/');
+            if (hit) {
+                sh.bytes -= it->size;
+                sh.map.erase(it->key);
+                it = sh.lru.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
@@ -0,0 +1,406 @@
+#include "fileio.hpp"
+#include "utils.hpp"
+
+#if defined(FASTERAPI_IO_URING)
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <linux/io_uring.h>
+#include <mutex>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// Submission queue entries of a ring; the completion queue has twice as
+// many, and no more reads than that are in flight at once.
+static constexpr unsigned kEntries = 256;
+// Largest read submitted at once; longer files are read in several.
+static constexpr size_t kMaxRead = size_t{1} << 30;
+
+static int uring_setup(unsigned entries, io_uring_params *params) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                       unsigned flags) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit,
+                                      min_complete, flags, nullptr, 0));
+}
+
+static int uring_register(int fd, unsigned opcode, void *arg,
+                          unsigned n_args) {
+    return static_cast<int>(
+        ::syscall(__NR_io_uring_register, fd, opcode, arg, n_args));
+}
+
+// Whether the kernel sets up a ring and reads files through it.
+static bool probe() {
+    io_uring_params params{};
+    const int fd = uring_setup(1, &params);
+    if (fd < 0) {
+        return false;
+    }
+    constexpr unsigned n_ops = 256;
+    std::vector<char> buf(sizeof(io_uring_probe) +
+                          n_ops * sizeof(io_uring_probe_op));
+    auto *ops = reinterpret_cast<io_uring_probe *>(buf.data());
+    const bool ok =
+        uring_register(fd, IORING_REGISTER_PROBE, ops, n_ops) == 0 &&
+        ops->last_op >= IORING_OP_READ &&
+        (ops->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) != 0;
+    ::close(fd);
+    return ok;
+}
+
+namespace FileIo {
+
+    // A read in flight: its completion resumes the coroutine waiting for it.
+    struct Op {
+        virtual ~Op() = default;
+        // Complete with `res`, the bytes read or -errno, and delete this.
+        virtual void complete(int res) = 0;
+
+        int fd = -1;
+        char *buf = nullptr;
+        unsigned len = 0;
+        uint64_t offset = 0;
+    };
+
+    template <typename Handler> struct ReadOp final : Op {
+        explicit ReadOp(Handler h) : handler(std::move(h)) {}
+
+        void complete(int res) override {
+            Handler h = std::move(handler);
+            delete this;
+            const auto exor = asio::get_associated_executor(h);
+            asio::dispatch(exor,
+                           [h = std::move(h), res]() mutable { h(res); });
+        }
+
+        Handler handler;
+    };
+
+    // The io_uring of an I/O context. The reads queued while the context
+    // runs its ready handlers are submitted together by one flush posted
+    // behind them; their completions are signalled on an eventfd that the
+    // context awaits only while reads are in flight, so that an idle ring
+    // keeps no work on it.
+    class Ring : public asio::execution_context::service {
+      public:
+        static inline asio::execution_context::id id;
+
+        explicit Ring(asio::io_context &io)
+            : asio::execution_context::service(io), io_(io), wait_(io) {
+            setup();
+        }
+
+        ~Ring() override { unmap(); }
+
+        // Whether the ring could be set up.
+        bool ok() const { return fd_ >= 0; }
+
+        // Read `len` bytes of `fd` from `offset` into `buf`; completes with
+        // the bytes read or -errno.
+        template <typename Token>
+        auto Read(int fd, char *buf, unsigned len, uint64_t offset,
+                  Token &&token) {
+            return asio::async_initiate<Token, void(int)>(
+                [this, fd, buf, len, offset](auto handler) {
+                    auto *op =
+                        new ReadOp<decltype(handler)>(std::move(handler));
+                    op->fd = fd;
+                    op->buf = buf;
+                    op->len = len;
+                    op->offset = offset;
+                    push(op);
+                },
+                token);
+        }
+
+      private:
+        void setup() {
+            io_uring_params params{};
+            fd_ = uring_setup(kEntries, &params);
+            if (fd_ < 0) {
+                return;
+            }
+            sq_entries_ = params.sq_entries;
+            cq_entries_ = params.cq_entries;
+            sq_size_ = params.sq_off.array + sq_entries_ * sizeof(unsigned);
+            cq_size_ = params.cq_off.cqes + cq_entries_ * sizeof(io_uring_cqe);
+            const bool single = (params.features & IORING_FEAT_SINGLE_MMAP);
+            if (single) {
+                sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+            }
+            sq_ = map(sq_size_, IORING_OFF_SQ_RING);
+            cq_ = single ? sq_ : map(cq_size_, IORING_OFF_CQ_RING);
+            sqes_ = static_cast<io_uring_sqe *>(
+                map(sq_entries_ * sizeof(io_uring_sqe), IORING_OFF_SQES));
+            int efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (!sq_ || !cq_ || !sqes_ || efd < 0 ||
+                uring_register(fd_, IORING_REGISTER_EVENTFD, &efd, 1) != 0) {
+                if (efd >= 0) {
+                    ::close(efd);
+                }
+                unmap();
+                return;
+            }
+            wait_.assign(efd);
+            efd_ = efd;
+
+            char *sq = static_cast<char *>(sq_);
+            char *cq = static_cast<char *>(cq_);
+            sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+            sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+            sq_mask_ =
+                *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+            sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+            cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+            cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+            cq_mask_ =
+                *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+            cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        }
+
+        void *map(size_t size, off_t what) {
+            void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, fd_, what);
+            return p == MAP_FAILED ? nullptr : p;
+        }
+
+        void unmap() {
+            if (fd_ < 0) {
+                return;
+            }
+            if (sqes_) {
+                ::munmap(sqes_, sq_entries_ * sizeof(io_uring_sqe));
+            }
+            if (cq_ && cq_ != sq_) {
+                ::munmap(cq_, cq_size_);
+            }
+            if (sq_) {
+                ::munmap(sq_, sq_size_);
+            }
+            ::close(fd_);
+            fd_ = -1;
+        }
+
+        // The reads still in the kernel write to the frames of coroutines
+        // about to be destroyed: wait for them first.
+        void shutdown() override {
+            std::lock_guard<std::mutex> lock(mtx_);
+            std::vector<std::pair<Op *, int>> done;
+            while (ok() && in_flight_ > 0) {
+                const int n = uring_enter(fd_, unsent_, 1,
+                                          IORING_ENTER_GETEVENTS);
+                if (n < 0 && errno != EINTR) {
+                    break;
+                }
+                unsent_ -= std::min<unsigned>(unsent_, std::max(n, 0));
+                harvest(done);
+            }
+            for (auto [op, res] : done) {
+                delete op;
+            }
+            for (Op *op : waiting_) {
+                delete op;
+            }
+            waiting_.clear();
+        }
+
+        void push(Op *op) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            waiting_.push_back(op);
+            if (!flush_posted_) {
+                flush_posted_ = true;
+                asio::post(io_, [this] { flush(); });
+            }
+        }
+
+        void flush() {
+            std::lock_guard<std::mutex> lock(mtx_);
+            flush_posted_ = false;
+            submit();
+        }
+
+        // Move the waiting reads to the submission queue, as many as the
+        // completion queue has room for, hand them to the kernel in one
+        // call and await their completions. Called with `mtx_` held.
+        void submit() {
+            while (!waiting_.empty() && in_flight_ < cq_entries_) {
+                const unsigned tail = *sq_tail_;
+                if (tail - std::atomic_ref<unsigned>(*sq_head_).load(
+                               std::memory_order_acquire) == sq_entries_) {
+                    break;
+                }
+                Op *op = waiting_.front();
+                waiting_.pop_front();
+                const unsigned idx = tail & sq_mask_;
+                io_uring_sqe &sqe = sqes_[idx];
+                std::memset(&sqe, 0, sizeof(sqe));
+                sqe.opcode = IORING_OP_READ;
+                sqe.fd = op->fd;
+                sqe.addr = reinterpret_cast<uintptr_t>(op->buf);
+                sqe.len = op->len;
+                sqe.off = op->offset;
+                sqe.user_data = reinterpret_cast<uintptr_t>(op);
+                sq_array_[idx] = idx;
+                std::atomic_ref<unsigned>(*sq_tail_).store(
+                    tail + 1, std::memory_order_release);
+                ++in_flight_;
+                ++unsent_;
+            }
+            while (unsent_ > 0) {
+                const int n = uring_enter(fd_, unsent_, 0, 0);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    // out of resources for now: try again later
+                    if (!flush_posted_) {
+                        flush_posted_ = true;
+                        asio::post(io_, [this] { flush(); });
+                    }
+                    break;
+                }
+                unsent_ -= static_cast<unsigned>(n);
+            }
+            if (!armed_ && in_flight_ > unsent_) {
+                armed_ = true;
+                wait_.async_wait(
+                    asio::posix::descriptor_base::wait_read,
+                    [this](const asio::error_code &ec) { reap(ec); });
+            }
+        }
+
+        // Take the completions off the queue. Called with `mtx_` held.
+        void harvest(std::vector<std::pair<Op *, int>> &done) {
+            unsigned head = *cq_head_;
+            const unsigned tail = std::atomic_ref<unsigned>(*cq_tail_).load(
+                std::memory_order_acquire);
+            for (; head != tail; ++head) {
+                const io_uring_cqe &cqe = cqes_[head & cq_mask_];
+                done.emplace_back(reinterpret_cast<Op *>(cqe.user_data),
+                                  cqe.res);
+                --in_flight_;
+            }
+            std::atomic_ref<unsigned>(*cq_head_).store(
+                head, std::memory_order_release);
+        }
+
+        void reap(const asio::error_code &ec) {
+            if (ec) {
+                return;
+            }
+            uint64_t n;
+            [[maybe_unused]] const ssize_t r = ::read(efd_, &n, sizeof(n));
+            std::vector<std::pair<Op *, int>> done;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                armed_ = false;
+                harvest(done);
+                submit();
+            }
+            for (auto [op, res] : done) {
+                op->complete(res);
+            }
+        }
+
+        asio::io_context &io_;
+        asio::posix::stream_descriptor wait_;
+        int fd_ = -1;
+        int efd_ = -1;
+
+        void *sq_ = nullptr;
+        void *cq_ = nullptr;
+        size_t sq_size_ = 0;
+        size_t cq_size_ = 0;
+        unsigned sq_entries_ = 0;
+        unsigned cq_entries_ = 0;
+        unsigned *sq_head_ = nullptr;
+        unsigned *sq_tail_ = nullptr;
+        unsigned *sq_array_ = nullptr;
+        unsigned sq_mask_ = 0;
+        io_uring_sqe *sqes_ = nullptr;
+        unsigned *cq_head_ = nullptr;
+        unsigned *cq_tail_ = nullptr;
+        unsigned cq_mask_ = 0;
+        io_uring_cqe *cqes_ = nullptr;
+
+        std::mutex mtx_;
+        // queued, not yet in the submission queue
+        std::deque<Op *> waiting_;
+        // in the submission queue or the kernel
+        unsigned in_flight_ = 0;
+        // in the submission queue, not yet handed to the kernel
+        unsigned unsent_ = 0;
+        bool flush_posted_ = false;
+        bool armed_ = false;
+    };
+
+} // namespace FileIo
+
+// The I/O context `exor` runs on, possibly through strands; null if it is not
+// an `asio::io_context`.
+static asio::io_context *io_context_of(const asio::any_io_executor &exor) {
+    using Executor = asio::io_context::executor_type;
+    if (const auto *e = exor.target<Executor>()) {
+        return &e->context();
+    }
+    if (const auto *s = exor.target<asio::strand<Executor>>()) {
+        return &s->get_inner_executor().context();
+    }
+    if (const auto *s = exor.target<asio::strand<asio::any_io_executor>>()) {
+        return io_context_of(s->get_inner_executor());
+    }
+    return nullptr;
+}
+#endif
+
+bool FileIo::Uring() {
+#if defined(FASTERAPI_IO_URING)
+    static const bool uring = probe();
+    return uring;
+#else
+    return false;
+#endif
+}
+
+std::string_view FileIo::Backend() {
+    return Uring() ? "epoll + io_uring file reads" : "epoll";
+}
+
+asio::awaitable<std::string> FileIo::Read(int fd, size_t size) {
+#if defined(FASTERAPI_IO_URING)
+    Ring *ring = nullptr;
+    if (Uring()) {
+        const auto exor = co_await asio::this_coro::executor;
+        if (asio::io_context *io = io_context_of(exor)) {
+            ring = &asio::use_service<Ring>(*io);
+        }
+    }
+    if (ring && ring->ok()) {
+        std::string content(size, '\0');
+        for (size_t pos = 0; pos < size;) {
+            const int n = co_await ring->Read(
+                fd, &content[pos],
+                static_cast<unsigned>(std::min(size - pos, kMaxRead)), pos,
+                asio::use_awaitable);
+            if (n <= 0) {
+                if (n == -EINTR || n == -EAGAIN) {
+                    continue;
+                }
+                co_return std::string();
+            }
+            pos += static_cast<size_t>(n);
+        }
+        co_return content;
+    }
+#endif
+    co_return Utils::read_fd(fd, size);
+}
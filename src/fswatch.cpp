@@ -0,0 +1,117 @@
+#include "fswatch.hpp"
+#include <array>
+#include <cerrno>
+#include <filesystem>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// Events that may change what a request path resolves to.
+static constexpr uint32_t kMask = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+                                  IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                  IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF |
+                                  IN_ONLYDIR;
+
+bool FsWatch::Watcher::Open() {
+    const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    desc_.assign(fd);
+    add_tree("");
+    // the root itself must be watched
+    return !dirs_.empty();
+}
+
+void FsWatch::Watcher::add_tree(const std::string &rel) {
+    const std::string dir = root_ + rel;
+    const int wd = inotify_add_watch(desc_.native_handle(), dir.c_str(), kMask);
+    if (wd < 0) {
+        // e.g. ENOSPC when fs.inotify.max_user_watches is exhausted
+        const asio::error_code ec(errno, asio::error::get_system_category());
+        log_.Error("inotify_add_watch failed for " + dir, ec);
+        lose();
+        return;
+    }
+    dirs_[wd] = rel;
+
+    std::error_code ec;
+    for (const auto &it : std::filesystem::directory_iterator(dir, ec)) {
+        if (it.is_directory(ec) && !it.is_symlink(ec)) {
+            add_tree(rel + "/" + it.path().filename().string());
+        }
+    }
+}
+
+void FsWatch::Watcher::notify(std::string_view path, bool is_dir) const {
+    for (const Callback &cb : subs_) {
+        cb(path, is_dir);
+    }
+}
+
+void FsWatch::Watcher::lose() {
+    if (!complete_) {
+        return;
+    }
+    complete_ = false;
+    for (const auto &cb : lost_subs_) {
+        cb();
+    }
+}
+
+asio::awaitable<void> FsWatch::Watcher::Run() {
+    // large enough for many events; an event is at most
+    // sizeof(inotify_event) + NAME_MAX + 1 bytes
+    alignas(inotify_event) std::array<char, 16 * 1024> buf;
+    std::string path;
+
+    for (;;) {
+        asio::error_code ec;
+        const size_t n = co_await desc_.async_read_some(
+            asio::buffer(buf), asio::redirect_error(asio::use_awaitable, ec));
+        if (ec) {
+            if (ec != asio::error::operation_aborted) {
+                log_.Error("inotify read failed", ec);
+            }
+            // nothing can be trusted anymore, nor will be
+            notify("", true);
+            lose();
+            co_return;
+        }
+
+        for (size_t pos = 0; pos < n;) {
+            const auto *ev = reinterpret_cast<const inotify_event *>(&buf[pos]);
+            pos += sizeof(inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                notify("", true);
+                continue;
+            }
+            const auto it = dirs_.find(ev->wd);
+            if (it == dirs_.end()) {
+                continue;
+            }
+            if (ev->mask & IN_IGNORED) {
+                // the watch is gone (directory deleted or unmounted)
+                dirs_.erase(it);
+                continue;
+            }
+            if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                // the parent reports the deletion of a subdirectory; only
+                // the root has no parent to do so
+                if (it->second.empty()) {
+                    notify("", true);
+                }
+                continue;
+            }
+
+            const bool is_dir = ev->mask & IN_ISDIR;
+            path = it->second;
+            path += '/';
+            path += ev->len > 0 ? ev->name : "";
+            if (is_dir && (ev->mask & (IN_CREATE | IN_MOVED_TO))) {
+                add_tree(path);
+            }
+            notify(path, is_dir);
+        }
+    }
+}
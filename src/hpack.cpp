@@ -0,0 +1,437 @@
+#include "hpack.hpp"
+#include <algorithm>
+#include <array>
+#include <utility>
+
+using Field = std::pair<std::string_view, std::string_view>;
+
+// RFC 7541, appendix A
+static constexpr std::array<Field, Hpack::kNStatic> kStatic = {{
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+}};
+
+// Lengths of the codes of the 256 octets and of EOS (RFC 7541, appendix
+// B). The code is canonical: codes of a length follow the symbols in
+// order, after the shorter codes, so the lengths make the whole code.
+static constexpr unsigned kEos = 256;
+static constexpr unsigned kMaxLen = 30;
+static constexpr std::array<uint8_t, kEos + 1> kLens = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28, //
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28, //
+    6,  10, 10, 12, 13, 6,  8,  11, 10, 10, 8,  11, 8,  6,  6,  6,  //
+    5,  5,  5,  6,  6,  6,  6,  6,  6,  6,  7,  8,  15, 6,  12, 10, //
+    13, 6,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  //
+    7,  7,  7,  7,  7,  7,  7,  7,  8,  7,  8,  13, 19, 13, 14, 6,  //
+    15, 5,  6,  5,  6,  5,  6,  6,  6,  5,  7,  7,  6,  6,  6,  5,  //
+    6,  7,  6,  5,  5,  6,  7,  7,  7,  7,  7,  15, 11, 14, 13, 28, //
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23, //
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24, //
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23, //
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23, //
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25, //
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27, //
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23, //
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26, //
+    30,
+};
+
+// The code in the form canonical decoding takes.
+struct Huffman {
+    std::array<uint32_t, kEos + 1> codes{};   // by symbol
+    std::array<uint16_t, kEos + 1> symbols{}; // by code
+    std::array<uint32_t, kMaxLen + 1> first{}; // first code of a length
+    std::array<uint16_t, kMaxLen + 1> start{}; // its index in `symbols`
+    std::array<uint16_t, kMaxLen + 1> count{}; // codes of a length
+};
+
+static constexpr Huffman make_huffman() {
+    Huffman h;
+    for (const uint8_t len : kLens) {
+        ++h.count[len];
+    }
+    uint32_t code = 0;
+    uint16_t index = 0;
+    for (unsigned len = 1; len <= kMaxLen; ++len) {
+        h.first[len] = code;
+        h.start[len] = index;
+        code = (code + h.count[len]) << 1;
+        index = static_cast<uint16_t>(index + h.count[len]);
+    }
+    std::array<uint16_t, kMaxLen + 1> next = h.start;
+    for (unsigned sym = 0; sym <= kEos; ++sym) {
+        const uint8_t len = kLens[sym];
+        const uint16_t at = next[len]++;
+        h.symbols[at] = static_cast<uint16_t>(sym);
+        h.codes[sym] = h.first[len] + (at - h.start[len]);
+    }
+    return h;
+}
+
+static constexpr Huffman kHuffman = make_huffman();
+// RFC 7541, appendix B: '0' is 00000, 'a' 00011, EOS 30 ones
+static_assert(kHuffman.codes['0'] == 0 && kHuffman.codes['a'] == 0x3 &&
+              kHuffman.codes[kEos] == 0x3fffffff);
+
+// Append `value` with a `prefix`-bit prefix, the bits above it in the
+// first byte being `flags` (section 5.1).
+static void append_int(std::string &out, uint8_t flags, unsigned prefix,
+                       size_t value) {
+    const size_t max = (size_t{1} << prefix) - 1;
+    if (value < max) {
+        out += static_cast<char>(flags | value);
+        return;
+    }
+    out += static_cast<char>(flags | max);
+    value -= max;
+    while (value >= 128) {
+        out += static_cast<char>(value % 128 + 128);
+        value /= 128;
+    }
+    out += static_cast<char>(value);
+}
+
+// Decode an integer with a `prefix`-bit prefix from the front of
+// `block`; false if it is cut short or takes more than 32 bits.
+static bool read_int(std::string_view &block, unsigned prefix,
+                     size_t &value) {
+    if (block.empty()) {
+        return false;
+    }
+    const size_t max = (size_t{1} << prefix) - 1;
+    value = static_cast<uint8_t>(block.front()) & max;
+    block.remove_prefix(1);
+    if (value < max) {
+        return true;
+    }
+    for (unsigned shift = 0; shift < 32; shift += 7) {
+        if (block.empty()) {
+            return false;
+        }
+        const uint8_t byte = static_cast<uint8_t>(block.front());
+        block.remove_prefix(1);
+        value += static_cast<size_t>(byte & 127) << shift;
+        if ((byte & 128) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Append the string literal `str`, Huffman coded if that is shorter
+// (section 5.2).
+static void append_string(std::string &out, std::string_view str) {
+    const size_t huffman = Hpack::HuffmanSize(str);
+    if (huffman < str.size()) {
+        append_int(out, 0x80, 7, huffman);
+        Hpack::HuffmanEncode(out, str);
+    } else {
+        append_int(out, 0x00, 7, str.size());
+        out += str;
+    }
+}
+
+void Hpack::HuffmanEncode(std::string &out, std::string_view str) {
+    uint64_t bits = 0; // pending in the low `n` bits
+    unsigned n = 0;
+    for (const char c : str) {
+        const uint8_t sym = static_cast<uint8_t>(c);
+        bits = (bits << kLens[sym]) | kHuffman.codes[sym];
+        n += kLens[sym];
+        while (n >= 8) {
+            n -= 8;
+            out += static_cast<char>(bits >> n);
+        }
+    }
+    if (n > 0) {
+        // padded with the most significant bits of EOS, all ones
+        out += static_cast<char>((bits << (8 - n)) | (0xffu >> n));
+    }
+}
+
+size_t Hpack::HuffmanSize(std::string_view str) {
+    size_t bits = 0;
+    for (const char c : str) {
+        bits += kLens[static_cast<uint8_t>(c)];
+    }
+    return (bits + 7) / 8;
+}
+
+bool Hpack::HuffmanDecode(std::string_view in, std::string &out) {
+    uint32_t code = 0;
+    unsigned len = 0;
+    for (const char c : in) {
+        const uint8_t byte = static_cast<uint8_t>(c);
+        for (int bit = 7; bit >= 0; --bit) {
+            code = (code << 1) | ((byte >> bit) & 1);
+            ++len;
+            const uint32_t k = code - kHuffman.first[len];
+            if (code < kHuffman.first[len] || k >= kHuffman.count[len]) {
+                continue;
+            }
+            const uint16_t sym = kHuffman.symbols[kHuffman.start[len] + k];
+            if (sym == kEos) {
+                return false;
+            }
+            out += static_cast<char>(sym);
+            code = 0;
+            len = 0;
+        }
+    }
+    // the padding is shorter than a byte and a prefix of EOS
+    return len < 8 && code == (1u << len) - 1;
+}
+
+void Hpack::Table::evict(size_t max_size) {
+    while (size_ > max_size) {
+        const Entry &oldest = entries_.back();
+        size_ -= entry_size(oldest.name, oldest.value);
+        entries_.pop_back();
+    }
+}
+
+void Hpack::Table::SetMaxSize(size_t max_size) {
+    max_size_ = max_size;
+    evict(max_size);
+}
+
+void Hpack::Table::Add(std::string_view name, std::string_view value) {
+    const size_t size = entry_size(name, value);
+    if (size > max_size_) {
+        evict(0);
+        return;
+    }
+    // copied before evicting, for they may view an entry evicted
+    Entry entry{std::string(name), std::string(value)};
+    evict(max_size_ - size);
+    entries_.push_front(std::move(entry));
+    size_ += size;
+}
+
+bool Hpack::Table::Get(size_t index, std::string_view &name,
+                       std::string_view &value) const {
+    if (index == 0) {
+        return false;
+    }
+    if (index <= kNStatic) {
+        name = kStatic[index - 1].first;
+        value = kStatic[index - 1].second;
+        return true;
+    }
+    index -= kNStatic + 1;
+    if (index >= entries_.size()) {
+        return false;
+    }
+    name = entries_[index].name;
+    value = entries_[index].value;
+    return true;
+}
+
+size_t Hpack::Table::Find(std::string_view name, std::string_view value,
+                          bool &exact) const {
+    size_t by_name = 0;
+    for (size_t i = 0; i < kNStatic; ++i) {
+        if (kStatic[i].first != name) {
+            continue;
+        }
+        if (kStatic[i].second == value) {
+            exact = true;
+            return i + 1;
+        }
+        if (by_name == 0) {
+            by_name = i + 1;
+        }
+    }
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        if (entries_[i].name != name) {
+            continue;
+        }
+        if (entries_[i].value == value) {
+            exact = true;
+            return kNStatic + 1 + i;
+        }
+        if (by_name == 0) {
+            by_name = kNStatic + 1 + i;
+        }
+    }
+    exact = false;
+    return by_name;
+}
+
+Hpack::Decoder::Step Hpack::Decoder::next(std::string_view &block,
+                                          std::string_view &name,
+                                          std::string_view &value) {
+    const uint8_t first = static_cast<uint8_t>(block.front());
+    size_t index = 0;
+    if (first & 0x80) {
+        // indexed field (section 6.1)
+        if (!read_int(block, 7, index) || !table_.Get(index, name, value)) {
+            return Step::Error;
+        }
+        return Step::Field;
+    }
+    if ((first & 0xe0) == 0x20) {
+        // dynamic table size update (section 6.3)
+        if (!read_int(block, 5, index) || index > max_table_) {
+            return Step::Error;
+        }
+        table_.SetMaxSize(index);
+        return Step::Update;
+    }
+    // literal with incremental indexing, 01, or without indexing, 0000, or
+    // never indexed, 0001 (section 6.2)
+    const bool add = first & 0x40;
+    if (!read_int(block, add ? 6 : 4, index)) {
+        return Step::Error;
+    }
+    if (index == 0) {
+        if (!string(block, name_buf_, name)) {
+            return Step::Error;
+        }
+    } else {
+        std::string_view unused;
+        if (!table_.Get(index, name, unused)) {
+            return Step::Error;
+        }
+        if (add) {
+            // copied, as adding may evict the entry named
+            name_buf_.assign(name);
+            name = name_buf_;
+        }
+    }
+    if (!string(block, value_buf_, value)) {
+        return Step::Error;
+    }
+    if (add) {
+        table_.Add(name, value);
+    }
+    return Step::Field;
+}
+
+bool Hpack::Decoder::string(std::string_view &block, std::string &buf,
+                            std::string_view &out) {
+    if (block.empty()) {
+        return false;
+    }
+    const bool huffman = block.front() & 0x80;
+    size_t len = 0;
+    if (!read_int(block, 7, len) || len > block.size()) {
+        return false;
+    }
+    const std::string_view raw = block.substr(0, len);
+    block.remove_prefix(len);
+    if (!huffman) {
+        out = raw;
+        return true;
+    }
+    buf.clear();
+    if (!HuffmanDecode(raw, buf)) {
+        return false;
+    }
+    out = buf;
+    return true;
+}
+
+void Hpack::Encoder::SetMaxTableSize(size_t size) {
+    size = std::min(size, kDefaultTableSize);
+    if (size == table_.max_size() && update_ == SIZE_MAX) {
+        return;
+    }
+    table_.SetMaxSize(size);
+    min_update_ = std::min(min_update_, size);
+    update_ = size;
+}
+
+void Hpack::Encoder::Begin(std::string &out) {
+    if (update_ == SIZE_MAX) {
+        return;
+    }
+    // the smallest size first, so that the peer evicts as we did
+    if (min_update_ < update_) {
+        append_int(out, 0x20, 5, min_update_);
+    }
+    append_int(out, 0x20, 5, update_);
+    min_update_ = SIZE_MAX;
+    update_ = SIZE_MAX;
+}
+
+void Hpack::Encoder::Encode(std::string &out, std::string_view name,
+                            std::string_view value, bool indexed) {
+    bool exact = false;
+    const size_t index = table_.Find(name, value, exact);
+    if (exact) {
+        append_int(out, 0x80, 7, index);
+        return;
+    }
+    if (indexed) {
+        append_int(out, 0x40, 6, index);
+    } else {
+        append_int(out, 0x00, 4, index);
+    }
+    if (index == 0) {
+        append_string(out, name);
+    }
+    append_string(out, value);
+    if (indexed) {
+        table_.Add(name, value);
+    }
+}
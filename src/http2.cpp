@@ -0,0 +1,1045 @@
+#include "http2.hpp"
+#include "common.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <charconv>
+
+// Number of bytes requested from the socket per read.
+static constexpr size_t kReadSize = 16 * 1024;
+
+// Frames queued past which streams wait for the writer before queuing more.
+static constexpr size_t kMaxPending = 256 * 1024;
+
+// Bytes of a large file read per job of the file pool.
+static constexpr size_t kFileChunk = 64 * 1024;
+
+// Largest header block taken, CONTINUATION frames included.
+static constexpr size_t kMaxBlock = 64 * 1024;
+
+// Receive window of the connection, raised from the default at once so
+// that uploads on several streams do not stall each other; stream windows
+// stay at the default and are replenished as DATA arrives.
+static constexpr uint32_t kRecvWindow = 1 << 20;
+
+// Answer to a request upgrading its connection.
+static constexpr std::string_view kSwitching =
+    "HTTP/1.1 101 Switching Protocols" CRLF "Connection: Upgrade" CRLF
+    "Upgrade: h2c" CRLF CRLF;
+
+// Fields of HTTP/1 connections, which HTTP/2 has none of (section 8.2.2).
+static constexpr std::string_view kConnFields[] = {
+    "connection", "keep-alive", "proxy-connection", "transfer-encoding",
+    "upgrade"};
+
+static uint32_t get_u32(const char *p) {
+    const auto *u = reinterpret_cast<const uint8_t *>(p);
+    return (uint32_t{u[0]} << 24) | (uint32_t{u[1]} << 16) |
+           (uint32_t{u[2]} << 8) | u[3];
+}
+
+static void append_u32(std::string &out, uint32_t n) {
+    const char bytes[4] = {static_cast<char>(n >> 24),
+                           static_cast<char>(n >> 16),
+                           static_cast<char>(n >> 8), static_cast<char>(n)};
+    out.append(bytes, sizeof(bytes));
+}
+
+// Strip the padding of a DATA or HEADERS payload; false if it is longer
+// than the payload.
+static bool unpad(const Http2::FrameHeader &fh, std::string_view &payload) {
+    if ((fh.flags & Http2::kPadded) == 0) {
+        return true;
+    }
+    if (payload.empty()) {
+        return false;
+    }
+    const size_t pad = static_cast<uint8_t>(payload.front());
+    payload.remove_prefix(1);
+    if (pad > payload.size()) {
+        return false;
+    }
+    payload.remove_suffix(pad);
+    return true;
+}
+
+// A field name as HTTP/2 has them: lower case tokens, a pseudo-field
+// beginning with ':'.
+static bool valid_name(std::string_view name) {
+    if (name.empty()) {
+        return false;
+    }
+    for (size_t i = 0; i < name.size(); ++i) {
+        const char c = name[i];
+        if (c <= ' ' || c >= 0x7f || (c >= 'A' && c <= 'Z') ||
+            (c == ':' && i > 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool valid_value(std::string_view value) {
+    return value.find_first_of(std::string_view("\0\r\n", 3)) ==
+           std::string_view::npos;
+}
+
+Http2::FrameHeader Http2::ParseFrameHeader(const char *p) {
+    const auto *u = reinterpret_cast<const uint8_t *>(p);
+    return {(uint32_t{u[0]} << 16) | (uint32_t{u[1]} << 8) | u[2],
+            static_cast<Type>(u[3]), u[4], get_u32(p + 5) & kMaxWindow};
+}
+
+void Http2::AppendFrameHeader(std::string &out, size_t length, Type type,
+                              uint8_t flags, uint32_t stream) {
+    const char bytes[5] = {
+        static_cast<char>(length >> 16), static_cast<char>(length >> 8),
+        static_cast<char>(length), static_cast<char>(type),
+        static_cast<char>(flags)};
+    out.append(bytes, sizeof(bytes));
+    append_u32(out, stream);
+}
+
+Http2::ErrorCode Http2::ApplySettings(std::string_view payload,
+                                      Settings &settings) {
+    if (payload.size() % 6 != 0) {
+        return ErrorCode::FrameSizeError;
+    }
+    for (; !payload.empty(); payload.remove_prefix(6)) {
+        const auto id = static_cast<Setting>(
+            (uint16_t{static_cast<uint8_t>(payload[0])} << 8) |
+            static_cast<uint8_t>(payload[1]));
+        const uint32_t value = get_u32(payload.data() + 2);
+        switch (id) {
+        case Setting::HeaderTableSize:
+            settings.header_table_size = value;
+            break;
+        case Setting::EnablePush:
+            if (value > 1) {
+                return ErrorCode::ProtocolError;
+            }
+            break;
+        case Setting::InitialWindowSize:
+            if (value > kMaxWindow) {
+                return ErrorCode::FlowControlError;
+            }
+            settings.initial_window = value;
+            break;
+        case Setting::MaxFrameSize:
+            if (value < kDefaultFrameSize || value > kMaxFrameSize) {
+                return ErrorCode::ProtocolError;
+            }
+            settings.max_frame_size = value;
+            break;
+        default:
+            // the server pushes nothing and sends no field list worth a
+            // limit; unknown settings are ignored
+            break;
+        }
+    }
+    return ErrorCode::NoError;
+}
+
+bool Http2::Upgrades(const HttpReq::Message &req) {
+    if (req.version != HttpHdr::Version::HTTP_1_1 || req.length != 0 ||
+        req.chunked || req.get("HTTP2-Settings").empty()) {
+        return false;
+    }
+    std::string_view tokens = req.get(HttpHdr::Field::UPGRADE);
+    while (!tokens.empty()) {
+        const size_t comma = tokens.find(',');
+        std::string_view token = tokens.substr(0, comma);
+        tokens = comma == std::string_view::npos ? std::string_view()
+                                                 : tokens.substr(comma + 1);
+        while (!token.empty() && token.front() == ' ') {
+            token.remove_prefix(1);
+        }
+        while (!token.empty() && token.back() == ' ') {
+            token.remove_suffix(1);
+        }
+        if (iequals_ascii(token, "h2c")) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Http2::DecodeBase64Url(std::string_view in, std::string &out) {
+    while (!in.empty() && in.back() == '=') {
+        in.remove_suffix(1);
+    }
+    uint32_t bits = 0;
+    unsigned n = 0;
+    for (const char c : in) {
+        uint32_t v;
+        if (c >= 'A' && c <= 'Z') {
+            v = static_cast<uint32_t>(c - 'A');
+        } else if (c >= 'a' && c <= 'z') {
+            v = static_cast<uint32_t>(c - 'a' + 26);
+        } else if (c >= '0' && c <= '9') {
+            v = static_cast<uint32_t>(c - '0' + 52);
+        } else if (c == '-') {
+            v = 62;
+        } else if (c == '_') {
+            v = 63;
+        } else {
+            return false;
+        }
+        bits = (bits << 6) | v;
+        n += 6;
+        if (n >= 8) {
+            n -= 8;
+            out += static_cast<char>(bits >> n);
+        }
+    }
+    // a lone character makes no byte
+    return n < 6;
+}
+
+// A request and its response.
+struct Http2::Session::Stream {
+    uint32_t id = 0;
+    // the request head, rebuilt for HTTP/1, then the body
+    std::string buf;
+    size_t head_size = 0;
+    HttpReq::Message req;
+    HttpRsp::Message rsp;
+    // the response head serialized for HTTP/1, and a piece of a large file
+    std::string head;
+    std::string chunk;
+    int64_t send_window = kDefaultWindow;
+    int64_t recv_window = kDefaultWindow;
+    size_t held = 0; // bytes of the body counted in `buffered_`
+    Metrics::Clock::time_point start;
+    bool remote_closed = false; // END_STREAM received
+    bool local_closed = false;  // END_STREAM sent
+    bool reset = false;         // RST_STREAM sent or received
+    bool started = false;       // being answered
+    bool bad = false;           // head rejected, answered 400
+    bool too_large = false;     // body over the limit, answered 413
+};
+
+Http2::Session::Session(asio::ip::tcp::socket &socket, TimeWheel::Wheel &wheel,
+                        TimeWheel::Timer &timer, FileIo::Pool &pool,
+                        Metrics::Registry &metrics, const Options &opts,
+                        Hooks hooks)
+    : socket_(socket), wheel_(wheel), timer_(timer), pool_(pool),
+      metrics_(metrics), opts_(opts), hooks_(std::move(hooks)),
+      recv_window_(kDefaultWindow), wake_writer_(socket.get_executor()),
+      drained_(socket.get_executor()), window_(socket.get_executor()),
+      tasks_(socket.get_executor()) {
+    for (asio::steady_timer *signal : {&wake_writer_, &drained_, &window_,
+                                       &tasks_}) {
+        signal->expires_at(asio::steady_timer::time_point::max());
+    }
+}
+
+asio::awaitable<void> Http2::Session::wait(asio::steady_timer &signal) {
+    asio::error_code ec;
+    co_await signal.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+}
+
+// The reader runs in this coroutine; the writer and the streams in
+// coroutines of their own, all on the strand. When the connection ends,
+// streams stop sending, and the session waits for their handlers to return
+// and for the writer to flush what is queued, e.g. a GOAWAY.
+asio::awaitable<void> Http2::Session::Run(std::string_view buffered,
+                                          std::string_view upgrade) {
+    strand_ = co_await asio::this_coro::executor;
+    std::string in(buffered);
+    wheel_.Set(timer_, opts_.idle_timeout);
+    // frames are written as soon as the windows let them, which Nagle's
+    // algorithm would hold back until the peer acknowledges the last ones
+    asio::error_code ec;
+    socket_.set_option(asio::ip::tcp::no_delay(true), ec);
+
+    // the server preface: our settings, then a larger connection window
+    if (!upgrade.empty()) {
+        out_ = kSwitching;
+    }
+    AppendFrameHeader(out_, 12, Type::Settings, 0, 0);
+    for (const auto &[id, value] :
+         {std::pair{Setting::MaxConcurrentStreams, opts_.max_streams},
+          std::pair{Setting::MaxHeaderListSize,
+                    static_cast<uint32_t>(HttpReq::Parser::kMaxHeadSize)}}) {
+        out_ += static_cast<char>(static_cast<uint16_t>(id) >> 8);
+        out_ += static_cast<char>(id);
+        append_u32(out_, value);
+    }
+    queue_window_update(0, kRecvWindow - kDefaultWindow);
+    recv_window_ = kRecvWindow;
+    asio::co_spawn(strand_, writer(), [this](std::exception_ptr) {
+        writer_done_ = true;
+        notify(tasks_);
+    });
+
+    ErrorCode err = ErrorCode::NoError;
+    if (!upgrade.empty()) {
+        // its HTTP2-Settings count as the client's first SETTINGS
+        const StreamPtr s = open(1, upgrade);
+        buf_.clear();
+        if (!DecodeBase64Url(s->req.get("HTTP2-Settings"), buf_) ||
+            (err = ApplySettings(buf_, peer_)) != ErrorCode::NoError) {
+            err = ErrorCode::ProtocolError;
+        } else {
+            encoder_.SetMaxTableSize(peer_.header_table_size);
+            s->send_window = peer_.initial_window;
+            end_request(s);
+        }
+    }
+
+    bool preface = false;
+    bool settings = false;
+    Metrics::Recorder *rec = &metrics_.local();
+    while (err == ErrorCode::NoError) {
+        size_t pos = 0;
+        if (!preface && in.size() >= kPreface.size()) {
+            if (!in.starts_with(kPreface)) {
+                err = ErrorCode::ProtocolError;
+                break;
+            }
+            preface = true;
+            pos = kPreface.size();
+        } else if (!preface && !kPreface.starts_with(in)) {
+            err = ErrorCode::ProtocolError;
+            break;
+        }
+        while (preface && in.size() - pos >= kFrameHeaderSize) {
+            const FrameHeader fh = ParseFrameHeader(in.data() + pos);
+            if (fh.length > kDefaultFrameSize) {
+                err = ErrorCode::FrameSizeError;
+                break;
+            }
+            if (in.size() - pos - kFrameHeaderSize < fh.length) {
+                break;
+            }
+            // the preface ends with SETTINGS
+            if (!settings && fh.type != Type::Settings) {
+                err = ErrorCode::ProtocolError;
+                break;
+            }
+            settings = true;
+            err = frame(fh, std::string_view(in).substr(
+                                pos + kFrameHeaderSize, fh.length));
+            pos += kFrameHeaderSize + fh.length;
+            if (err != ErrorCode::NoError) {
+                break;
+            }
+        }
+        in.erase(0, pos);
+        if (err != ErrorCode::NoError) {
+            break;
+        }
+        // the client reads too slowly for what it asks: wait for the writer
+        while (out_.size() >= kMaxPending && !closing_) {
+            co_await wait(drained_);
+        }
+        if (closing_) {
+            break;
+        }
+
+        const size_t old = in.size();
+        in.resize(old + kReadSize);
+        asio::error_code ec;
+        const size_t n_read = co_await socket_.async_read_some(
+            asio::buffer(in.data() + old, kReadSize),
+            asio::redirect_error(asio::use_awaitable, ec));
+        in.resize(old + n_read);
+        rec = &metrics_.local();
+        if (ec) {
+            if (ec != asio::error::eof && !closing_) {
+                rec->Fail(Metrics::Error::Read);
+            }
+            break;
+        }
+        rec->Add(Metrics::Count::BytesIn, n_read);
+        // a write under way has a deadline of its own
+        if (!writing_) {
+            wheel_.Set(timer_, opts_.idle_timeout);
+        }
+    }
+
+    if (err != ErrorCode::NoError) {
+        queue_goaway(err);
+        rec->Fail(Metrics::Error::Malformed);
+    }
+    closing_ = true;
+    notify(window_);
+    notify(drained_);
+    while (n_tasks_ > 0) {
+        co_await wait(tasks_);
+    }
+    notify(wake_writer_);
+    while (!writer_done_) {
+        co_await wait(tasks_);
+    }
+}
+
+Http2::ErrorCode Http2::Session::frame(const FrameHeader &fh,
+                                       std::string_view payload) {
+    // a header block is sent in frames of its own
+    if (block_stream_ != 0 &&
+        (fh.type != Type::Continuation || fh.stream != block_stream_)) {
+        return ErrorCode::ProtocolError;
+    }
+    switch (fh.type) {
+    case Type::Data:
+        return on_data(fh, payload);
+    case Type::Headers:
+        return on_headers(fh, payload);
+    case Type::Priority:
+        // deprecated, and ignored
+        if (fh.stream == 0) {
+            return ErrorCode::ProtocolError;
+        }
+        if (fh.length != 5) {
+            reset(fh.stream, ErrorCode::FrameSizeError);
+        }
+        return ErrorCode::NoError;
+    case Type::RstStream: {
+        if (fh.stream == 0 || fh.stream > last_stream_) {
+            return ErrorCode::ProtocolError;
+        }
+        if (fh.length != 4) {
+            return ErrorCode::FrameSizeError;
+        }
+        const auto it = streams_.find(fh.stream);
+        if (it != streams_.end()) {
+            it->second->reset = true;
+            streams_.erase(it);
+            notify(window_);
+        }
+        return ErrorCode::NoError;
+    }
+    case Type::Settings:
+        return on_settings(fh, payload);
+    case Type::PushPromise:
+        // clients do not push
+        return ErrorCode::ProtocolError;
+    case Type::Ping:
+        if (fh.stream != 0) {
+            return ErrorCode::ProtocolError;
+        }
+        if (fh.length != 8) {
+            return ErrorCode::FrameSizeError;
+        }
+        if ((fh.flags & kAck) == 0) {
+            AppendFrameHeader(out_, 8, Type::Ping, kAck, 0);
+            out_ += payload;
+            notify(wake_writer_);
+        }
+        return ErrorCode::NoError;
+    case Type::GoAway:
+        // the client opens no more streams; those open are answered
+        return fh.stream == 0 ? ErrorCode::NoError : ErrorCode::ProtocolError;
+    case Type::WindowUpdate:
+        return on_window_update(fh, payload);
+    case Type::Continuation:
+        if (block_stream_ == 0) {
+            return ErrorCode::ProtocolError;
+        }
+        if (block_.size() + payload.size() > kMaxBlock) {
+            return ErrorCode::EnhanceYourCalm;
+        }
+        block_ += payload;
+        return (fh.flags & kEndHeaders) != 0 ? end_headers()
+                                             : ErrorCode::NoError;
+    }
+    // frames of unknown types are ignored
+    return ErrorCode::NoError;
+}
+
+Http2::ErrorCode Http2::Session::on_headers(const FrameHeader &fh,
+                                            std::string_view payload) {
+    if (fh.stream == 0 || fh.stream % 2 == 0 || !unpad(fh, payload)) {
+        return ErrorCode::ProtocolError;
+    }
+    if ((fh.flags & kPriority) != 0) {
+        if (payload.size() < 5) {
+            return ErrorCode::ProtocolError;
+        }
+        payload.remove_prefix(5);
+    }
+    if (payload.size() > kMaxBlock) {
+        return ErrorCode::EnhanceYourCalm;
+    }
+    block_.assign(payload);
+    block_stream_ = fh.stream;
+    block_flags_ = fh.flags;
+    return (fh.flags & kEndHeaders) != 0 ? end_headers() : ErrorCode::NoError;
+}
+
+// A new stream's head is rebuilt as an HTTP/1 head, "METHOD PATH
+// HTTP/2\r\n" and the fields, `:authority` as Host, then parsed as one.
+// Malformed requests (section 8.1.1) are reset rather than answered; a head
+// that is well-formed HTTP/2 but too large for the parser is answered 400.
+Http2::ErrorCode Http2::Session::end_headers() {
+    const uint32_t id = block_stream_;
+    block_stream_ = 0;
+    const bool end_stream = (block_flags_ & kEndStream) != 0;
+
+    const auto it = streams_.find(id);
+    if (it != streams_.end()) {
+        // trailers, which are decoded for the sake of the table and dropped
+        const StreamPtr s = it->second;
+        if (!decoder_.Decode(block_, [](std::string_view, std::string_view) {
+            })) {
+            return ErrorCode::CompressionError;
+        }
+        if (s->remote_closed) {
+            reset(*s, ErrorCode::StreamClosed);
+        } else if (!end_stream) {
+            reset(*s, ErrorCode::ProtocolError);
+        } else {
+            end_request(s);
+        }
+        return ErrorCode::NoError;
+    }
+    if (id <= last_stream_) {
+        return ErrorCode::StreamClosed;
+    }
+    last_stream_ = id;
+
+    bool regular = false;
+    bool host = false;
+    bool malformed = false;
+    // pseudo-fields are kept in `buf_`, `:method`, `:path`, `:authority`
+    // and `:scheme` in turn, each once; cookies are joined into one field
+    std::array<std::pair<std::string_view, size_t>, 4> pseudo = {{
+        {":method", SIZE_MAX},
+        {":path", SIZE_MAX},
+        {":authority", SIZE_MAX},
+        {":scheme", SIZE_MAX},
+    }};
+    std::string cookie;
+    buf_.clear();
+    fields_.clear();
+    const bool decoded = decoder_.Decode(
+        block_, [&](std::string_view name, std::string_view value) {
+            if (malformed || !valid_name(name) || !valid_value(value)) {
+                malformed = true;
+                return;
+            }
+            if (name.front() == ':') {
+                auto p = std::find_if(
+                    pseudo.begin(), pseudo.end(),
+                    [name](const auto &slot) { return slot.first == name; });
+                malformed = regular || p == pseudo.end() ||
+                            p->second != SIZE_MAX || value.empty();
+                if (!malformed) {
+                    p->second = buf_.size();
+                    buf_ += value;
+                    buf_ += '\0';
+                }
+                return;
+            }
+            regular = true;
+            if (std::find(std::begin(kConnFields), std::end(kConnFields),
+                          name) != std::end(kConnFields) ||
+                (name == "te" && value != "trailers")) {
+                malformed = true;
+                return;
+            }
+            if (name == "cookie") {
+                cookie += cookie.empty() ? "" : "; ";
+                cookie += value;
+                return;
+            }
+            host = host || name == "host";
+            fields_ += name;
+            fields_ += ": ";
+            fields_ += value;
+            fields_ += CRLF;
+        });
+    if (!decoded) {
+        return ErrorCode::CompressionError;
+    }
+    const auto pseudo_value = [this, &pseudo](size_t i) {
+        const size_t at = pseudo[i].second;
+        return at == SIZE_MAX ? std::string_view()
+                              : std::string_view(buf_.data() + at,
+                                                 buf_.find('\0', at) - at);
+    };
+    const std::string_view method = pseudo_value(0);
+    const std::string_view path = pseudo_value(1);
+    if (malformed || method.empty() || path.empty() ||
+        pseudo[3].second == SIZE_MAX ||
+        method.find(' ') != std::string_view::npos ||
+        path.find(' ') != std::string_view::npos) {
+        reset(id, ErrorCode::ProtocolError);
+        return ErrorCode::NoError;
+    }
+    // a stream reset by the client leaves `streams_`, its handler running
+    if (closing_ || streams_.size() >= opts_.max_streams ||
+        n_tasks_ >= opts_.max_streams) {
+        reset(id, ErrorCode::RefusedStream);
+        return ErrorCode::NoError;
+    }
+
+    std::string head;
+    head.reserve(method.size() + path.size() + fields_.size() + 64);
+    head += method;
+    head += ' ';
+    head += path;
+    head += " HTTP/2" CRLF;
+    if (!host && !pseudo_value(2).empty()) {
+        head += "host: ";
+        head += pseudo_value(2);
+        head += CRLF;
+    }
+    head += fields_;
+    if (!cookie.empty()) {
+        head += "cookie: ";
+        head += cookie;
+        head += CRLF;
+    }
+    head += CRLF;
+    const StreamPtr s = open(id, head);
+    if (s->too_large) {
+        start(s);
+    }
+    if (end_stream) {
+        end_request(s);
+    }
+    return ErrorCode::NoError;
+}
+
+Http2::ErrorCode Http2::Session::on_data(const FrameHeader &fh,
+                                         std::string_view payload) {
+    if (fh.stream == 0) {
+        return ErrorCode::ProtocolError;
+    }
+    // the connection window counts every DATA frame, padding included
+    recv_window_ -= fh.length;
+    if (recv_window_ < 0) {
+        return ErrorCode::FlowControlError;
+    }
+    if (fh.length > 0) {
+        queue_window_update(0, fh.length);
+        recv_window_ += fh.length;
+    }
+    if (!unpad(fh, payload)) {
+        return ErrorCode::ProtocolError;
+    }
+    const auto it = streams_.find(fh.stream);
+    if (it == streams_.end()) {
+        // idle, or closed, e.g. reset by the server: ignored
+        return fh.stream > last_stream_ ? ErrorCode::ProtocolError
+                                        : ErrorCode::NoError;
+    }
+    const StreamPtr s = it->second;
+    if (s->remote_closed) {
+        reset(*s, ErrorCode::StreamClosed);
+        return ErrorCode::NoError;
+    }
+    s->recv_window -= fh.length;
+    if (s->recv_window < 0) {
+        reset(*s, ErrorCode::FlowControlError);
+        return ErrorCode::NoError;
+    }
+    // a body answered 413 already is dropped
+    if (!s->started) {
+        if (s->buf.size() - s->head_size + payload.size() > opts_.max_body) {
+            s->too_large = true;
+            start(s);
+        } else if (buffered_ + payload.size() > opts_.max_body) {
+            // the streams hold too much already; nothing of this one
+            // was processed, so the client may send it again
+            reset(*s, ErrorCode::RefusedStream);
+            return ErrorCode::NoError;
+        } else {
+            s->buf += payload;
+            s->held += payload.size();
+            buffered_ += payload.size();
+        }
+    }
+    if ((fh.flags & kEndStream) != 0) {
+        end_request(s);
+    } else if (!s->started && fh.length > 0) {
+        queue_window_update(s->id, fh.length);
+        s->recv_window += fh.length;
+    }
+    return ErrorCode::NoError;
+}
+
+Http2::ErrorCode Http2::Session::on_window_update(const FrameHeader &fh,
+                                                  std::string_view payload) {
+    if (fh.length != 4) {
+        return ErrorCode::FrameSizeError;
+    }
+    const uint32_t increment = get_u32(payload.data()) & kMaxWindow;
+    if (fh.stream == 0) {
+        send_window_ += increment;
+        if (increment == 0) {
+            return ErrorCode::ProtocolError;
+        }
+        if (send_window_ > kMaxWindow) {
+            return ErrorCode::FlowControlError;
+        }
+        notify(window_);
+        return ErrorCode::NoError;
+    }
+    const auto it = streams_.find(fh.stream);
+    if (it == streams_.end()) {
+        return fh.stream > last_stream_ ? ErrorCode::ProtocolError
+                                        : ErrorCode::NoError;
+    }
+    const StreamPtr s = it->second;
+    s->send_window += increment;
+    if (increment == 0) {
+        reset(*s, ErrorCode::ProtocolError);
+    } else if (s->send_window > kMaxWindow) {
+        reset(*s, ErrorCode::FlowControlError);
+    }
+    notify(window_);
+    return ErrorCode::NoError;
+}
+
+Http2::ErrorCode Http2::Session::on_settings(const FrameHeader &fh,
+                                             std::string_view payload) {
+    if (fh.stream != 0) {
+        return ErrorCode::ProtocolError;
+    }
+    if ((fh.flags & kAck) != 0) {
+        return fh.length == 0 ? ErrorCode::NoError
+                              : ErrorCode::FrameSizeError;
+    }
+    const uint32_t old_window = peer_.initial_window;
+    const ErrorCode err = ApplySettings(payload, peer_);
+    if (err != ErrorCode::NoError) {
+        return err;
+    }
+    encoder_.SetMaxTableSize(peer_.header_table_size);
+    // a new initial window moves the windows of the open streams with it
+    const int64_t delta =
+        static_cast<int64_t>(peer_.initial_window) - old_window;
+    for (const auto &[id, s] : streams_) {
+        s->send_window += delta;
+        if (s->send_window > kMaxWindow) {
+            return ErrorCode::FlowControlError;
+        }
+    }
+    AppendFrameHeader(out_, 0, Type::Settings, kAck, 0);
+    notify(wake_writer_);
+    notify(window_);
+    return ErrorCode::NoError;
+}
+
+Http2::Session::StreamPtr Http2::Session::open(uint32_t id,
+                                               std::string_view head) {
+    const StreamPtr s = std::make_shared<Stream>();
+    s->id = id;
+    s->start = Metrics::Clock::now();
+    s->send_window = peer_.initial_window;
+    s->buf.assign(head);
+    s->head_size = head.size();
+    s->bad = s->req.Feed(s->buf) != HttpReq::Parser::Result::Complete ||
+             !s->req.Update();
+    s->too_large = !s->bad && s->req.length > opts_.max_body;
+    streams_.emplace(id, s);
+    last_stream_ = std::max(last_stream_, id);
+    return s;
+}
+
+void Http2::Session::end_request(const StreamPtr &s) {
+    s->remote_closed = true;
+    if (s->started) {
+        return;
+    }
+    if (!s->bad && s->req.has(HttpHdr::Field::CONTENT_LENGTH) &&
+        s->buf.size() - s->head_size != s->req.length) {
+        reset(*s, ErrorCode::ProtocolError);
+        return;
+    }
+    start(s);
+}
+
+void Http2::Session::start(const StreamPtr &s) {
+    s->started = true;
+    ++n_tasks_;
+    asio::co_spawn(strand_, respond(s), [this](std::exception_ptr) {
+        --n_tasks_;
+        notify(tasks_);
+    });
+}
+
+asio::awaitable<void> Http2::Session::respond(StreamPtr s) {
+    HttpRsp::Message &rsp = s->rsp;
+    // the buffer may have moved since the head was parsed
+    s->req.Feed(s->buf);
+    s->req.set_body(std::string_view(s->buf).substr(s->head_size));
+    rsp.Reset(HttpHdr::Conn::KEEP_ALIVE);
+    if (s->too_large) {
+        rsp.Error(HttpHdr::Status::PayloadTooLarge);
+        metrics_.local().Fail(Metrics::Error::TooLarge);
+    } else if (s->bad) {
+        rsp.Error(HttpHdr::Status::BadRequest);
+        metrics_.local().Fail(Metrics::Error::Malformed);
+    } else {
+        co_await hooks_.serve(s->req, rsp);
+    }
+    uint64_t bytes = 0;
+    if (!s->reset && !closing_) {
+        bytes = co_await send(*s);
+    }
+    hooks_.done(s->req, rsp, bytes, s->start);
+    release(*s);
+    rsp.file.reset();
+    rsp.fd.reset();
+    rsp.relay.reset();
+}
+
+// Fields of the response that vary from one response to the next, kept out
+// of the dynamic table so that they do not evict those that repeat.
+static bool worth_indexing(std::string_view name) {
+    return name != "content-length" && name != "content-range" &&
+           name != "etag" && name != "last-modified";
+}
+
+// The head is the HTTP/1 head of the response, converted: the status line
+// becomes `:status`, names are lowered, fields of the connection dropped.
+// Its frames are queued at once, as the encoder's table must see blocks in
+// the order they go out. The body follows in DATA frames as large as the
+// windows and the peer's frame size allow; a large file is read on the file
+// pool a piece at a time.
+asio::awaitable<uint64_t> Http2::Session::send(Stream &s) {
+    HttpRsp::Message &rsp = s.rsp;
+    const std::array<asio::const_buffer, 2> bufs = rsp.ToBuffers(s.head);
+    const bool bodiless = rsp.code == HttpHdr::Status::NotModified ||
+                          s.req.method == HttpHdr::Method::HEAD;
+    // a relayed body is of unknown size until its end
+    const bool relay = rsp.relay && !rsp.relay->done();
+    const size_t size = bodiless || rsp.relay ? 0
+                        : rsp.fd              ? rsp.fd_size
+                                              : bufs[1].size();
+    const std::string_view body(static_cast<const char *>(bufs[1].data()),
+                                bufs[1].size());
+
+    while (out_.size() >= kMaxPending && !closing_ && !s.reset) {
+        co_await wait(drained_);
+    }
+    if (closing_ || s.reset) {
+        co_return 0;
+    }
+    std::string &block = out_block_;
+    block.clear();
+    encoder_.Begin(block);
+    char status[4];
+    const char *end = std::to_chars(
+        status, status + sizeof(status),
+        rsp.relay ? rsp.relay->status
+                  : HttpHdr::kArrStatusCode[static_cast<uint8_t>(rsp.code)])
+        .ptr;
+    encoder_.Encode(
+        block, ":status",
+        std::string_view(status, static_cast<size_t>(end - status)));
+    const std::string_view head = s.head;
+    for (size_t pos = head.find('\n') + 1; pos < head.size();) {
+        size_t eol = head.find('\n', pos);
+        eol = eol == std::string_view::npos ? head.size() : eol;
+        std::string_view line = head.substr(pos, eol - pos);
+        pos = eol + 1;
+        if (line.ends_with('\r')) {
+            line.remove_suffix(1);
+        }
+        const size_t colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            continue;
+        }
+        name_.assign(line.substr(0, colon));
+        std::transform(
+            name_.begin(), name_.end(), name_.begin(),
+            [](char c) { return c >= 'A' && c <= 'Z' ? c + 32 : c; });
+        std::string_view value = line.substr(colon + 1);
+        while (!value.empty() && value.front() == ' ') {
+            value.remove_prefix(1);
+        }
+        if (std::find(std::begin(kConnFields), std::end(kConnFields), name_) ==
+            std::end(kConnFields)) {
+            encoder_.Encode(block, name_, value, worth_indexing(name_));
+        }
+    }
+    for (size_t off = 0; off == 0 || off < block.size();) {
+        const size_t n = std::min<size_t>(block.size() - off,
+                                          peer_.max_frame_size);
+        const uint8_t flags = (off + n == block.size() ? kEndHeaders : 0) |
+                              (off == 0 && size == 0 && !relay ? kEndStream
+                                                               : 0);
+        AppendFrameHeader(out_, n,
+                          off == 0 ? Type::Headers : Type::Continuation, flags,
+                          s.id);
+        out_.append(block, off, n);
+        off += n;
+    }
+    uint64_t bytes = block.size();
+    notify(wake_writer_);
+
+    size_t sent = 0;
+    size_t chunk_pos = 0;
+    s.chunk.clear();
+    std::string_view piece; // of the relay, not sent yet
+    while (relay || sent < size) {
+        if (closing_ || s.reset) {
+            co_return bytes;
+        }
+        if (out_.size() >= kMaxPending) {
+            co_await wait(drained_);
+            continue;
+        }
+        const int64_t window = std::min(send_window_, s.send_window);
+        if (window <= 0) {
+            co_await wait(window_);
+            continue;
+        }
+        if (relay && piece.empty()) {
+            piece = co_await rsp.relay->Read();
+            if (closing_ || s.reset) {
+                co_return bytes;
+            }
+            if (!piece.empty()) {
+                continue;
+            }
+            if (!rsp.relay->done()) {
+                // the server failed: the stream is cut short
+                reset(s, ErrorCode::InternalError);
+                co_return bytes;
+            }
+            AppendFrameHeader(out_, 0, Type::Data, kEndStream, s.id);
+            notify(wake_writer_);
+            break;
+        }
+        if (rsp.fd && chunk_pos == s.chunk.size()) {
+            const size_t n = std::min(kFileChunk, size - sent);
+            const int fd = rsp.fd->get();
+            const auto offset = static_cast<off_t>(rsp.fd_offset + sent);
+            const Metrics::Clock::time_point t0 = Metrics::Clock::now();
+            const bool ran = co_await pool_.Run([&s, fd, n, offset] {
+                s.chunk = Utils::read_fd(fd, n, offset);
+            });
+            metrics_.local().Time(Metrics::Phase::File, t0,
+                                  Metrics::Clock::now());
+            if (!ran || s.chunk.size() != n) {
+                // the pool full, or the file shrank: the stream is cut short
+                if (!s.reset && !closing_) {
+                    reset(s, ErrorCode::InternalError);
+                }
+                co_return bytes;
+            }
+            chunk_pos = 0;
+            continue;
+        }
+        const std::string_view src =
+            relay    ? piece
+            : rsp.fd ? std::string_view(s.chunk).substr(chunk_pos)
+                     : body.substr(sent);
+        const size_t n = std::min({src.size(), static_cast<size_t>(window),
+                                   static_cast<size_t>(peer_.max_frame_size)});
+        AppendFrameHeader(out_, n, Type::Data,
+                          !relay && sent + n == size ? kEndStream : 0, s.id);
+        out_.append(src.data(), n);
+        if (relay) {
+            piece.remove_prefix(n);
+        }
+        send_window_ -= static_cast<int64_t>(n);
+        s.send_window -= static_cast<int64_t>(n);
+        sent += n;
+        chunk_pos += n;
+        bytes += n;
+        notify(wake_writer_);
+    }
+    close_local(s);
+    co_return bytes;
+}
+
+void Http2::Session::reset(uint32_t id, ErrorCode code) {
+    AppendFrameHeader(out_, 4, Type::RstStream, 0, id);
+    append_u32(out_, static_cast<uint32_t>(code));
+    notify(wake_writer_);
+}
+
+void Http2::Session::reset(Stream &s, ErrorCode code) {
+    const uint32_t id = s.id;
+    reset(id, code);
+    s.reset = true;
+    // the handler of a stream answered holds the body until it returns
+    if (!s.started) {
+        release(s);
+    }
+    const auto it = streams_.find(id);
+    if (it != streams_.end() && it->second.get() == &s) {
+        streams_.erase(it);
+    }
+    notify(window_);
+}
+
+// A response sent before its request was received in full, e.g. a 413, ends
+// the stream: the client is told to send no more of it (section 8.1).
+void Http2::Session::close_local(Stream &s) {
+    s.local_closed = true;
+    if (!s.remote_closed) {
+        reset(s, ErrorCode::NoError);
+        return;
+    }
+    const auto it = streams_.find(s.id);
+    if (it != streams_.end() && it->second.get() == &s) {
+        streams_.erase(it);
+    }
+}
+
+void Http2::Session::release(Stream &s) {
+    buffered_ -= s.held;
+    s.held = 0;
+}
+
+void Http2::Session::queue_window_update(uint32_t id, uint32_t increment) {
+    AppendFrameHeader(out_, 4, Type::WindowUpdate, 0, id);
+    append_u32(out_, increment);
+    notify(wake_writer_);
+}
+
+void Http2::Session::queue_goaway(ErrorCode code) {
+    AppendFrameHeader(out_, 8, Type::GoAway, 0, 0);
+    append_u32(out_, last_stream_);
+    append_u32(out_, static_cast<uint32_t>(code));
+    notify(wake_writer_);
+}
+
+// Frames are queued by the reader and the streams as they go; each write
+// takes all of them, so that the responses of streams answered together,
+// and the control frames between, share a system call.
+asio::awaitable<void> Http2::Session::writer() {
+    for (;;) {
+        if (out_.empty()) {
+            if (closing_ && n_tasks_ == 0) {
+                break;
+            }
+            co_await wait(wake_writer_);
+            continue;
+        }
+        std::swap(out_, writing_buf_);
+        out_.clear();
+        writing_ = true;
+        wheel_.Set(timer_, opts_.write_timeout);
+        const Metrics::Clock::time_point t0 = Metrics::Clock::now();
+        asio::error_code ec;
+        const size_t n_written = co_await asio::async_write(
+            socket_, asio::buffer(writing_buf_),
+            asio::redirect_error(asio::use_awaitable, ec));
+        writing_ = false;
+        Metrics::Recorder &rec = metrics_.local();
+        rec.Time(Metrics::Phase::Write, t0, Metrics::Clock::now());
+        rec.Add(Metrics::Count::BytesOut, n_written);
+        notify(drained_);
+        if (ec) {
+            if (!closing_) {
+                rec.Fail(Metrics::Error::Write);
+            }
+            // the reader stops too
+            closing_ = true;
+            out_.clear();
+            socket_.shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+            notify(window_);
+            break;
+        }
+        wheel_.Set(timer_, opts_.idle_timeout);
+    }
+}
@@ -0,0 +1,229 @@
+#include "httpcond.hpp"
+#include "httpdate.hpp"
+#include <algorithm>
+#include <charconv>
+#include <limits>
+
+static std::string_view trim(std::string_view str) {
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) {
+        str.remove_prefix(1);
+    }
+    while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) {
+        str.remove_suffix(1);
+    }
+    return str;
+}
+
+static void append_hex(std::string &out, uint64_t n) {
+    char digits[16];
+    const char *end = std::to_chars(digits, digits + sizeof(digits), n, 16).ptr;
+    out.append(digits, static_cast<size_t>(end - digits));
+}
+
+static void append_dec(std::string &out, size_t n) {
+    char digits[20];
+    const char *end = std::to_chars(digits, digits + sizeof(digits), n).ptr;
+    out.append(digits, static_cast<size_t>(end - digits));
+}
+
+// Parse a non-empty run of digits, saturating: a position too large for
+// `size_t` is past the end of any file all the same.
+static bool parse_pos(std::string_view str, size_t &n) {
+    if (str.empty() || str.find_first_not_of("0123456789") !=
+                           std::string_view::npos) {
+        return false;
+    }
+    if (std::from_chars(str.data(), str.data() + str.size(), n).ec !=
+        std::errc()) {
+        n = std::numeric_limits<size_t>::max();
+    }
+    return true;
+}
+
+static std::string lines(std::string_view etag, std::time_t mtime) {
+    char date[HttpDate::kLen];
+    HttpDate::Format(mtime, date);
+    std::string out = "ETag: ";
+    out += etag;
+    out += CRLF "Last-Modified: ";
+    out.append(date, sizeof(date));
+    out += CRLF;
+    return out;
+}
+
+HttpCond::Validators HttpCond::Make(const timespec &mtime, size_t size) {
+    Validators v;
+    // quotes, separators, and three numbers of 16 hex digits at most
+    v.etag.reserve(4 + 3 * 16);
+    v.etag += '"';
+    append_hex(v.etag, static_cast<uint64_t>(mtime.tv_sec));
+    v.etag += '.';
+    append_hex(v.etag, static_cast<uint64_t>(mtime.tv_nsec));
+    v.etag += '-';
+    append_hex(v.etag, size);
+    v.etag += '"';
+    v.mtime = mtime.tv_sec;
+    v.lines = lines(v.etag, v.mtime);
+    return v;
+}
+
+HttpCond::Validators HttpCond::Variant(const Validators &file,
+                                       std::string_view coding) {
+    Validators v;
+    v.etag = file.etag;
+    v.etag.pop_back();
+    v.etag += '-';
+    v.etag += coding;
+    v.etag += '"';
+    v.mtime = file.mtime;
+    v.lines = lines(v.etag, v.mtime);
+    return v;
+}
+
+bool HttpCond::NoneMatch(std::string_view tags, std::string_view etag) {
+    if (trim(tags) == "*") {
+        return true;
+    }
+    while (!tags.empty()) {
+        const size_t comma = tags.find(',');
+        std::string_view tag = trim(tags.substr(0, comma));
+        tags = comma == std::string_view::npos ? std::string_view()
+                                               : tags.substr(comma + 1);
+        if (tag.starts_with("W/")) {
+            tag.remove_prefix(2);
+        }
+        if (tag == etag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HttpCond::IfRange(std::string_view cond, const Validators &v) {
+    cond = trim(cond);
+    if (cond.starts_with('"')) {
+        return cond == v.etag;
+    }
+    // a weak tag, "W/...", is no date either: it never matches
+    std::time_t t;
+    return HttpDate::Parse(cond, t) && t == v.mtime;
+}
+
+HttpCond::Outcome HttpCond::ParseRanges(std::string_view spec, size_t size,
+                                        Ranges &ranges) {
+    ranges.n = 0;
+    if (spec.size() < 6 || !iequals_ascii(spec.substr(0, 6), "bytes=")) {
+        return Outcome::Full;
+    }
+    spec.remove_prefix(6);
+    bool any = false;
+    while (!spec.empty()) {
+        const size_t comma = spec.find(',');
+        const std::string_view item = trim(spec.substr(0, comma));
+        spec = comma == std::string_view::npos ? std::string_view()
+                                               : spec.substr(comma + 1);
+        if (item.empty()) {
+            continue;
+        }
+        const size_t dash = item.find('-');
+        if (dash == std::string_view::npos) {
+            return Outcome::Full;
+        }
+        const std::string_view first_str = item.substr(0, dash);
+        const std::string_view last_str = item.substr(dash + 1);
+        size_t first = 0;
+        size_t last = 0;
+        if (first_str.empty()) {
+            // the last `last` bytes
+            if (!parse_pos(last_str, last)) {
+                return Outcome::Full;
+            }
+            any = true;
+            if (last == 0 || size == 0) {
+                continue;
+            }
+            first = size - std::min(last, size);
+            last = size - 1;
+        } else {
+            if (!parse_pos(first_str, first) ||
+                (!last_str.empty() && !parse_pos(last_str, last))) {
+                return Outcome::Full;
+            }
+            if (last_str.empty()) {
+                last = std::numeric_limits<size_t>::max();
+            } else if (last < first) {
+                return Outcome::Full;
+            }
+            any = true;
+            if (first >= size) {
+                continue;
+            }
+            last = std::min(last, size - 1);
+        }
+        if (ranges.n == kMaxRanges) {
+            return Outcome::Full;
+        }
+        ranges.parts[ranges.n++] = {first, last - first + 1};
+    }
+    if (!any) {
+        return Outcome::Full;
+    }
+    return ranges.n == 0 ? Outcome::Unsatisfiable : Outcome::Partial;
+}
+
+HttpCond::Outcome
+HttpCond::Evaluate(const Validators &v, size_t size,
+                   std::string_view if_none_match,
+                   std::string_view if_modified_since, std::string_view range,
+                   std::string_view if_range, Ranges &ranges) {
+    // If-Modified-Since counts only without If-None-Match, which is exact
+    bool current = false;
+    std::time_t since;
+    if (!if_none_match.empty()) {
+        current = NoneMatch(if_none_match, v.etag);
+    } else if (HttpDate::Parse(trim(if_modified_since), since)) {
+        current = v.mtime <= since;
+    }
+    if (current) {
+        return Outcome::NotModified;
+    }
+    if (range.empty() || (!if_range.empty() && !IfRange(if_range, v))) {
+        return Outcome::Full;
+    }
+    return ParseRanges(range, size, ranges);
+}
+
+void HttpCond::AppendContentRange(std::string &out, Range range,
+                                  size_t size) {
+    out += "Content-Range: bytes ";
+    append_dec(out, range.offset);
+    out += '-';
+    append_dec(out, range.offset + range.length - 1);
+    out += '/';
+    append_dec(out, size);
+    out += CRLF;
+}
+
+void HttpCond::AppendUnsatisfied(std::string &out, size_t size) {
+    out += "Content-Range: bytes */";
+    append_dec(out, size);
+    out += CRLF;
+}
+
+void HttpCond::AppendPart(std::string &out, std::string_view type_line,
+                          Range range, size_t size, std::string_view data) {
+    out += "--";
+    out += kBoundary;
+    out += CRLF;
+    out += type_line;
+    AppendContentRange(out, range, size);
+    out += CRLF;
+    out += data;
+    out += CRLF;
+}
+
+void HttpCond::AppendClose(std::string &out) {
+    out += "--";
+    out += kBoundary;
+    out += "--" CRLF;
+}
@@ -0,0 +1,123 @@
+#include "httpdate.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+static constexpr char kPrefix[] = "Date: ";
+static constexpr size_t kLenPrefix = sizeof(kPrefix) - 1;
+static constexpr size_t kLenLine = kLenPrefix + HttpDate::kLen + 2;
+
+static constexpr char kDays[7][4] = {"Sun", "Mon", "Tue", "Wed",
+                                     "Thu", "Fri", "Sat"};
+static constexpr char kMonths[12][4] = {"Jan", "Feb", "Mar", "Apr",
+                                        "May", "Jun", "Jul", "Aug",
+                                        "Sep", "Oct", "Nov", "Dec"};
+
+// Header lines; only the refreshing coroutine writes them.
+static std::array<std::array<char, kLenLine>, HttpDate::kNSlot> slots;
+// Slot published to readers.
+static std::atomic<size_t> current{0};
+
+// Write `n` as exactly `width` decimal digits.
+static inline char *put_digits(char *out, unsigned n, int width) {
+    for (int i = width - 1; i >= 0; --i) {
+        out[i] = static_cast<char>('0' + n % 10);
+        n /= 10;
+    }
+    return out + width;
+}
+
+void HttpDate::Format(std::time_t t, char *out) {
+    std::tm tm;
+    gmtime_r(&t, &tm);
+    std::memcpy(out, kDays[tm.tm_wday], 3);
+    out[3] = ',';
+    out[4] = ' ';
+    char *p = put_digits(out + 5, static_cast<unsigned>(tm.tm_mday), 2);
+    *p++ = ' ';
+    std::memcpy(p, kMonths[tm.tm_mon], 3);
+    p[3] = ' ';
+    p = put_digits(p + 4, static_cast<unsigned>(tm.tm_year + 1900), 4);
+    *p++ = ' ';
+    p = put_digits(p, static_cast<unsigned>(tm.tm_hour), 2);
+    *p++ = ':';
+    p = put_digits(p, static_cast<unsigned>(tm.tm_min), 2);
+    *p++ = ':';
+    p = put_digits(p, static_cast<unsigned>(tm.tm_sec), 2);
+    std::memcpy(p, " GMT", 4);
+}
+
+// Read exactly `width` decimal digits; false if there are not.
+static inline bool get_digits(const char *in, int width, int &n) {
+    n = 0;
+    for (int i = 0; i < width; ++i) {
+        if (in[i] < '0' || in[i] > '9') {
+            return false;
+        }
+        n = n * 10 + (in[i] - '0');
+    }
+    return true;
+}
+
+bool HttpDate::Parse(std::string_view date, std::time_t &t) {
+    // "Sun, 06 Nov 1994 08:49:37 GMT"
+    if (date.size() != kLen || date.substr(3, 2) != ", " || date[7] != ' ' ||
+        date[11] != ' ' || date[16] != ' ' || date[19] != ':' ||
+        date[22] != ':' || date.substr(25) != " GMT") {
+        return false;
+    }
+    std::tm tm{};
+    tm.tm_mon = -1;
+    for (int i = 0; i < 12; ++i) {
+        if (date.substr(8, 3) == kMonths[i]) {
+            tm.tm_mon = i;
+        }
+    }
+    const char *p = date.data();
+    if (tm.tm_mon < 0 || !get_digits(p + 5, 2, tm.tm_mday) ||
+        !get_digits(p + 12, 4, tm.tm_year) ||
+        !get_digits(p + 17, 2, tm.tm_hour) ||
+        !get_digits(p + 20, 2, tm.tm_min) ||
+        !get_digits(p + 23, 2, tm.tm_sec)) {
+        return false;
+    }
+    tm.tm_year -= 1900;
+    t = timegm(&tm);
+    return true;
+}
+
+void HttpDate::Refresh() {
+    const size_t next = (current.load(std::memory_order_relaxed) + 1) % kNSlot;
+    char *line = slots[next].data();
+    std::memcpy(line, kPrefix, kLenPrefix);
+    Format(std::time(nullptr), line + kLenPrefix);
+    std::memcpy(line + kLenPrefix + kLen, "\r\n", 2);
+    current.store(next, std::memory_order_release);
+}
+
+std::string_view HttpDate::Line() {
+    return {slots[current.load(std::memory_order_acquire)].data(), kLenLine};
+}
+
+asio::awaitable<void> HttpDate::Run() {
+    using namespace std::chrono;
+    asio::steady_timer timer(co_await asio::this_coro::executor);
+    for (;;) {
+        Refresh();
+        // wake up right after the second turns, so the date is never late
+        // by more than the timer's slack
+        const auto now = system_clock::now().time_since_epoch();
+        timer.expires_after(seconds(1) - (now - floor<seconds>(now)) +
+                            milliseconds(1));
+        asio::error_code ec;
+        co_await timer.async_wait(
+            asio::redirect_error(asio::use_awaitable, ec));
+        if (ec) {
+            co_return;
+        }
+    }
+}
+
+// Valid from the start, before `Run` is spawned.
+static const bool kInitialized = (HttpDate::Refresh(), true);
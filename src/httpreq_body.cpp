@@ -0,0 +1,64 @@
+#include "httpreq_body.hpp"
+
+// The read from the connection is inline rather than a nested coroutine, so
+// that a call needs one coroutine frame, recycled from call to call.
+asio::awaitable<std::string_view> HttpReq::BodyReader::Read() {
+    for (;;) {
+        if (done_ || malformed_) {
+            co_return std::string_view();
+        }
+
+        // 1. Return the next piece of the input, if any.
+        std::string_view out;
+        if (!chunked_) {
+            if (remaining_ == 0) {
+                done_ = true;
+                continue;
+            }
+            if (!in_.empty()) {
+                const size_t n = static_cast<size_t>(
+                    std::min<uint64_t>(remaining_, in_.size()));
+                out = in_.substr(0, n);
+                in_.remove_prefix(n);
+                remaining_ -= n;
+                size_ += n;
+                co_return out;
+            }
+        } else {
+            switch (decoder_.Decode(in_, out)) {
+            case ChunkedDecoder::Result::Data:
+                size_ += out.size();
+                co_return out;
+            case ChunkedDecoder::Result::Done:
+                done_ = true;
+                continue;
+            case ChunkedDecoder::Result::Error:
+                malformed_ = true;
+                continue;
+            case ChunkedDecoder::Result::Partial:
+                break;
+            }
+        }
+
+        // 2. Read more of the body from the connection into `buf_`; a body
+        // of known length up to its end, not into the next request. The
+        // timer covers this wait only: the caller may take longer between
+        // reads, waiting on something of its own.
+        wheel_.Set(timer_, timeout_);
+        if (continue_) {
+            continue_ = false;
+            co_await asio::async_write(socket_, asio::buffer(kContinue),
+                                       asio::use_awaitable);
+        }
+        const size_t max =
+            chunked_ ? buf_.size()
+                     : static_cast<size_t>(
+                           std::min<uint64_t>(buf_.size(), remaining_));
+        const size_t n = co_await socket_.async_read_some(
+            asio::buffer(buf_.data(), max), asio::use_awaitable);
+        wheel_.Cancel(timer_);
+        in_ = {buf_.data(), n};
+        n_read_ += n;
+        in_buffered_ = false;
+    }
+}
@@ -0,0 +1,299 @@
+#include "httproute.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+// Split `rest`, beginning with '/', into its first segment and what follows
+// it, beginning with '/' or empty.
+static inline std::string_view next_segment(std::string_view rest,
+                                            std::string_view &after) {
+    const size_t end = rest.find('/', 1);
+    if (end == std::string_view::npos) {
+        after = {};
+        return rest.substr(1);
+    }
+    after = rest.substr(end);
+    return rest.substr(1, end - 1);
+}
+
+// FNV-1a hash of a path segment.
+static inline uint32_t hash_segment(std::string_view seg) {
+    uint32_t h = 2166136261u;
+    for (const char c : seg) {
+        h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    return h;
+}
+
+void HttpRoute::Router::Add(HttpHdr::Method method, std::string_view pattern,
+                            Handler handler) {
+    add(method, pattern, Route{std::move(handler), nullptr, nullptr, {}});
+}
+
+void HttpRoute::Router::Stream(HttpHdr::Method method,
+                               std::string_view pattern,
+                               StreamHandler handler) {
+    add(method, pattern, Route{nullptr, std::move(handler), nullptr, {}});
+}
+
+void HttpRoute::Router::Async(HttpHdr::Method method, std::string_view pattern,
+                              AsyncHandler handler) {
+    add(method, pattern, Route{nullptr, nullptr, std::move(handler), {}});
+}
+
+void HttpRoute::Router::add(HttpHdr::Method method, std::string_view pattern,
+                            Route route) {
+    const auto invalid = [pattern](const char *why) {
+        return std::invalid_argument("Invalid route " + std::string(pattern) +
+                                     ": " + why);
+    };
+    if (method == HttpHdr::Method::UNKNOWN) {
+        throw invalid("unknown method");
+    }
+    if (!pattern.starts_with('/')) {
+        throw invalid("pattern must begin with '/'");
+    }
+    if (!route.handler && !route.stream && !route.async) {
+        throw invalid("no handler");
+    }
+    if (!draft_) {
+        draft_ = std::make_unique<Draft>();
+    }
+
+    Draft *node = draft_.get();
+    std::vector<std::string> &names = route.names;
+    for (std::string_view rest = pattern, after; !rest.empty(); rest = after) {
+        const std::string_view seg = next_segment(rest, after);
+        std::unique_ptr<Draft> *child;
+        if (seg.starts_with(':') || seg.starts_with('*')) {
+            if (seg.size() == 1) {
+                throw invalid("parameter without a name");
+            }
+            if (names.size() == kMaxParams) {
+                throw invalid("too many parameters");
+            }
+            if (seg[0] == '*' && !after.empty()) {
+                throw invalid("wildcard before the last segment");
+            }
+            names.emplace_back(seg.substr(1));
+            child = seg[0] == ':' ? &node->param : &node->wild;
+        } else {
+            auto it = node->statics.find(seg);
+            if (it == node->statics.end()) {
+                it = node->statics.emplace(std::string(seg), nullptr).first;
+            }
+            child = &it->second;
+        }
+        if (!*child) {
+            *child = std::make_unique<Draft>();
+        }
+        node = child->get();
+    }
+
+    if (!node->routes) {
+        node->routes = std::make_unique<MethodRoutes>();
+        node->routes->fill(kNone);
+    }
+    uint32_t &i = (*node->routes)[static_cast<uint8_t>(method)];
+    if (i != kNone) {
+        throw invalid("route already exists");
+    }
+    i = static_cast<uint32_t>(routes_.size());
+    routes_.push_back(std::move(route));
+}
+
+void HttpRoute::Router::Compile() {
+    nodes_.clear();
+    labels_.clear();
+    ends_.clear();
+    if (!draft_) {
+        return;
+    }
+
+    // Breadth first, so that the children of a node are laid out next to
+    // each other; `drafts[i]` is the draft of `nodes_[i]`.
+    std::vector<const Draft *> drafts{draft_.get()};
+    nodes_.emplace_back();
+    for (size_t i = 0; i < drafts.size(); ++i) {
+        const Draft &draft = *drafts[i];
+        const auto add_child = [&](const Draft &child) {
+            drafts.push_back(&child);
+            nodes_.emplace_back();
+            return static_cast<uint32_t>(nodes_.size() - 1);
+        };
+
+        // static children in the order of their hash, for binary search
+        std::vector<std::pair<uint32_t, const std::string *>> statics;
+        for (const auto &[label, child] : draft.statics) {
+            statics.emplace_back(hash_segment(label), &label);
+        }
+        std::sort(statics.begin(), statics.end());
+        nodes_[i].first = static_cast<uint32_t>(nodes_.size());
+        nodes_[i].n_static = static_cast<uint32_t>(statics.size());
+        for (const auto &[hash, label] : statics) {
+            const uint32_t j = add_child(*draft.statics.find(*label)->second);
+            nodes_[j].hash = hash;
+            nodes_[j].label = static_cast<uint32_t>(labels_.size());
+            nodes_[j].label_len = static_cast<uint32_t>(label->size());
+            labels_ += *label;
+        }
+        if (draft.param) {
+            nodes_[i].param = add_child(*draft.param);
+        }
+        if (draft.wild) {
+            nodes_[i].wild = add_child(*draft.wild);
+        }
+
+        if (draft.routes) {
+            End end{*draft.routes, "Allow:"};
+            // HEAD is answered wherever GET is, by the GET handler; the
+            // listener leaves the body out
+            uint32_t &head = end.routes[static_cast<uint8_t>(
+                HttpHdr::Method::HEAD)];
+            if (head == kNone) {
+                head = end.routes[static_cast<uint8_t>(HttpHdr::Method::GET)];
+            }
+            const char *sep = " ";
+            for (uint8_t m = 0; m < HttpHdr::kNMethod; ++m) {
+                if (end.routes[m] != kNone) {
+                    end.allow += sep;
+                    end.allow += HttpHdr::kArrMethodStr[m];
+                    sep = ", ";
+                }
+            }
+            end.allow += CRLF;
+            nodes_[i].end = static_cast<uint32_t>(ends_.size());
+            ends_.push_back(std::move(end));
+        }
+    }
+}
+
+uint32_t HttpRoute::Router::find(uint32_t i, std::string_view rest,
+                                 uint8_t method, Params &params,
+                                 uint32_t &other) const {
+    const Node &node = nodes_[i];
+    // an end without a route of the method gives way to the next match
+    const auto accept = [this, method, &other](uint32_t end) {
+        if (end == kNone || ends_[end].routes[method] != kNone) {
+            return end;
+        }
+        if (other == kNone) {
+            other = end;
+        }
+        return kNone;
+    };
+    if (rest.empty()) {
+        return accept(node.end);
+    }
+    std::string_view after;
+    const std::string_view seg = next_segment(rest, after);
+
+    if (node.n_static > 0) {
+        const uint32_t hash = hash_segment(seg);
+        const Node *const last = nodes_.data() + node.first + node.n_static;
+        for (const Node *it = std::lower_bound(
+                 nodes_.data() + node.first, last, hash,
+                 [](const Node &n, uint32_t h) { return n.hash < h; });
+             it != last && it->hash == hash; ++it) {
+            if (std::string_view(labels_.data() + it->label, it->label_len) !=
+                seg) {
+                continue;
+            }
+            const uint32_t end = find(static_cast<uint32_t>(it - nodes_.data()),
+                                      after, method, params, other);
+            if (end != kNone) {
+                return end;
+            }
+            break;
+        }
+    }
+
+    if (node.param != kNone && !seg.empty()) {
+        params.values_[params.n_++] = seg;
+        const uint32_t end = find(node.param, after, method, params, other);
+        if (end != kNone) {
+            return end;
+        }
+        --params.n_;
+    }
+
+    if (node.wild != kNone) {
+        const uint32_t end = accept(nodes_[node.wild].end);
+        if (end != kNone) {
+            params.values_[params.n_++] = rest;
+        }
+        return end;
+    }
+    return kNone;
+}
+
+uint32_t HttpRoute::Router::lookup(std::string_view path,
+                                   HttpHdr::Method method,
+                                   Params &params) const {
+    params.n_ = 0;
+    if (nodes_.empty() || !path.starts_with('/')) {
+        return kNone;
+    }
+    uint32_t other = kNone;
+    const uint32_t end = find(0, path.substr(0, path.find('?')),
+                              static_cast<uint8_t>(method), params, other);
+    if (end == kNone) {
+        params.n_ = 0;
+        return other;
+    }
+    return end;
+}
+
+const HttpRoute::Route *
+HttpRoute::Router::route(uint32_t end, HttpHdr::Method method,
+                         Params &params) const {
+    const uint32_t i = ends_[end].routes[static_cast<uint8_t>(method)];
+    if (i == kNone) {
+        return nullptr;
+    }
+    const Route &route = routes_[i];
+    for (size_t k = 0; k < params.n_; ++k) {
+        params.names_[k] = route.names[k];
+    }
+    return &route;
+}
+
+const HttpRoute::Handler *
+HttpRoute::Router::Match(HttpHdr::Method method, std::string_view path,
+                         Params &params) const {
+    const uint32_t end = lookup(path, method, params);
+    if (end == kNone) {
+        return nullptr;
+    }
+    const Route *route = this->route(end, method, params);
+    return route != nullptr && route->handler ? &route->handler : nullptr;
+}
+
+const HttpRoute::Route *
+HttpRoute::Router::Find(const HttpReq::Message &req, Params &params,
+                        HttpRsp::Message &rsp) const {
+    const uint32_t end = lookup(req.path(), req.method, params);
+    if (end == kNone) {
+        rsp.Error(HttpHdr::Status::NotFound);
+        return nullptr;
+    }
+    const Route *route = this->route(end, req.method, params);
+    if (route == nullptr) {
+        rsp.Error(HttpHdr::Status::MethodNotAllowed);
+        rsp.headers = ends_[end].allow;
+    }
+    return route;
+}
+
+void HttpRoute::Router::Serve(const HttpReq::Message &req,
+                              HttpRsp::Message &rsp) const {
+    Params params;
+    const Route *route = Find(req, params, rsp);
+    if (route == nullptr) {
+        return;
+    }
+    if (!route->handler) {
+        rsp.Error(HttpHdr::Status::InternalServerError);
+        return;
+    }
+    route->handler(req, params, rsp);
+}
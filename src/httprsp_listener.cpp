@@ -1,123 +1,1171 @@
 #include "httprsp_listener.hpp"
 #include "common.hpp"
+#include "fileio.hpp"
+#include "http2.hpp"
+#include "httpdate.hpp"
+#include "httpreq_body.hpp"
 #include "httpreq_message.hpp"
 #include "httprsp_message.hpp"
-#include <iostream>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <memory>
+#include <string_view>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
 
-// Convert `asio::streambuf` to `std::string`
-// Note: This function consumes the buffer.
-static inline const std::string streambuf2string(asio::streambuf &buffer) {
-    std::istream is(&buffer);
-    std::string data((std::istreambuf_iterator<char>(is)),
-                     std::istreambuf_iterator<char>());
-    return data;
+// Number of bytes requested from the socket per read.
+static constexpr size_t kReadSize = 4096;
+
+// Most pipelined requests answered with one write.
+static constexpr size_t kMaxBatch = 16;
+
+// Pause of the accept loop when out of descriptors, doubled every time it
+// fails again.
+static constexpr std::chrono::milliseconds kMinBackoff(10);
+static constexpr std::chrono::milliseconds kMaxBackoff(1000);
+
+// Most pending clients turned away at once when out of descriptors.
+static constexpr size_t kMaxShed = 64;
+
+// Largest buffer kept when a connection state is returned to the pool.
+static constexpr size_t kMaxPooledBuf = 64 * 1024;
+
+// Number of connection states pooled per thread.
+static constexpr size_t kPoolSize = 32;
+
+// State of a connection: the read buffer, the request, and a batch of
+// responses with their serialized heads; the buffer of a body read piece by
+// piece, and a chunked body decoded whole.
+// Everything keeps its capacity from request to request, and from
+// connection to connection through a per-thread pool, so that serving
+// keep-alive traffic in steady state allocates nothing.
+struct Conn {
+    asio::streambuf req_buf;
+    HttpReq::Message req;
+    std::array<HttpRsp::Message, kMaxBatch> rsps;
+    std::array<std::string, kMaxBatch> rsp_heads;
+    std::vector<asio::const_buffer> rsp_bufs;
+    std::vector<char> body_buf;
+    std::string body;
+    // access records of the batch, filled if the access log is on, and when
+    // their requests began
+    std::array<Log::Record, kMaxBatch> logs;
+    std::array<Metrics::Clock::time_point, kMaxBatch> log_starts;
+    // deadline of the current step of the session
+    TimeWheel::Timer timer;
+
+    Conn() { rsp_bufs.reserve(2 * kMaxBatch); }
+
+    // Prepare the state for another connection. Return false if it holds
+    // too much memory to be worth keeping.
+    bool Recycle() {
+        req_buf.consume(req_buf.size());
+        bool small = req_buf.capacity() <= kMaxPooledBuf &&
+                     body.capacity() <= kMaxPooledBuf;
+        for (HttpRsp::Message &rsp : rsps) {
+            // do not pin cache entries or files
+            rsp.file.reset();
+            rsp.fd.reset();
+            rsp.relay.reset();
+            small = small && rsp.body.capacity() <= kMaxPooledBuf;
+        }
+        return small;
+    }
+};
+
+// Free connection states of the calling thread.
+// In shared mode a state may be released on another thread than the one it
+// was taken on; it then joins that thread's pool.
+struct ConnPool {
+    std::array<Conn *, kPoolSize> free;
+    size_t n_free = 0;
+
+    ~ConnPool() {
+        while (n_free > 0) {
+            delete free[--n_free];
+        }
+    }
+
+    static ConnPool &local() {
+        thread_local ConnPool pool;
+        return pool;
+    }
+};
+
+struct ConnRelease {
+    void operator()(Conn *conn) const {
+        ConnPool &pool = ConnPool::local();
+        if (pool.n_free < kPoolSize && conn->Recycle()) {
+            pool.free[pool.n_free++] = conn;
+        } else {
+            delete conn;
+        }
+    }
+};
+
+using ConnPtr = std::unique_ptr<Conn, ConnRelease>;
+
+static ConnPtr acquire_conn() {
+    ConnPool &pool = ConnPool::local();
+    return ConnPtr(pool.n_free > 0 ? pool.free[--pool.n_free] : new Conn);
+}
+
+// Disarms the deadline of a connection when its session ends.
+struct TimerGuard {
+    TimeWheel::Wheel &wheel;
+    TimeWheel::Timer &timer;
+    ~TimerGuard() { wheel.Cancel(timer); }
+};
+
+// A deadline of a connection passed: shut its socket down, given as the
+// argument. Pending and later operations on the socket fail, which ends the
+// session. Only the descriptor is used, as the session may be running on
+// another thread.
+static void expire(void *arg) {
+    ::shutdown(static_cast<int>(reinterpret_cast<intptr_t>(arg)), SHUT_RDWR);
+}
+
+// Releases the place of a connection in the count of connections served.
+struct ConnSlot {
+    std::atomic<size_t> &n_conns;
+    ~ConnSlot() { n_conns.fetch_sub(1, std::memory_order_relaxed); }
+};
+
+// Buffer sequence referring to buffers it does not own.
+// Write operations keep a copy of their buffer sequence; copying a
+// `std::vector` would allocate on every write, copying this view does not.
+struct BufferView {
+    using value_type = asio::const_buffer;
+    using const_iterator = const asio::const_buffer *;
+
+    const_iterator begin() const { return data; }
+    const_iterator end() const { return data + size; }
+
+    const asio::const_buffer *data;
+    size_t size;
+};
+
+// Count a response in the metrics of the calling thread; `n_served` is the
+// number of requests answered on the connection so far. A relayed response
+// of a status we have none of is counted in no status.
+static void count_response(Metrics::Recorder &rec, const HttpRsp::Message &rsp,
+                           uint64_t &n_served) {
+    rec.Add(Metrics::Count::Requests);
+    if (!rsp.relay ||
+        rsp.relay->status ==
+            HttpHdr::kArrStatusCode[static_cast<uint8_t>(rsp.code)]) {
+        rec.Respond(rsp.code);
+    }
+    if (n_served++ > 0) {
+        rec.Add(Metrics::Count::Reused);
+    }
+}
+
+// Fill `rec` with what the access log keeps of the response `rsp` to `req`,
+// `bytes` long, but the latency, known once it is written.
+static void log_response(Log::Record &rec, const HttpReq::Message &req,
+                         const HttpRsp::Message &rsp, uint64_t bytes) {
+    rec.kind = Log::Kind::Access;
+    rec.method = req.method;
+    rec.set_text(req.path());
+    rec.status = rsp.relay
+                     ? rsp.relay->status
+                     : HttpHdr::kArrStatusCode[static_cast<uint8_t>(rsp.code)];
+    rec.bytes = bytes;
+}
+
+// Bytes of the response `rsp` serialized into `bufs`; a relayed body is
+// counted as it is sent.
+static uint64_t wire_size(const HttpRsp::Message &rsp,
+                          const std::array<asio::const_buffer, 2> &bufs) {
+    return bufs[0].size() + bufs[1].size() + (rsp.fd ? rsp.fd_size : 0);
+}
+
+// Log the access records of the responses [begin, end) of the batch of
+// `conn`, written at `t`.
+static void push_logs(Log::Logger &log, Conn &conn, size_t begin, size_t end,
+                      Metrics::Clock::time_point t) {
+    for (size_t i = begin; i < end; ++i) {
+        Log::Record &rec = conn.logs[i];
+        rec.latency_ns = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                t - conn.log_starts[i])
+                .count());
+        log.Push(rec);
+    }
+}
+
+// View the readable bytes of `asio::streambuf` without consuming them.
+// Note: the view is invalidated by the next `prepare` or `consume`.
+static inline std::string_view streambuf2view(const asio::streambuf &buffer) {
+    const auto data = buffer.data();
+    return {static_cast<const char *>(data.data()), data.size()};
+}
+
+HttpRsp::Listener::Listener(const Config &cfg, HttpRoute::Router router)
+    : port_(cfg.port), reuse_port_(cfg.mode == Mode::Sharded),
+      root_(Utils::canonical_dir(cfg.root)), sendfile_min_(cfg.sendfile_min),
+      compress_min_(cfg.compress_min), gzip_level_(cfg.gzip_level),
+      max_body_(cfg.max_body), body_buffer_(cfg.body_buffer),
+      max_conns_(cfg.max_conns), h2_max_streams_(cfg.h2_max_streams),
+      n_conns_(0), idle_timeout_(cfg.idle_timeout),
+      head_timeout_(cfg.head_timeout), body_timeout_(cfg.body_timeout),
+      write_timeout_(cfg.write_timeout),
+      log_(cfg.access_log, STDERR_FILENO, cfg.log_ring),
+      cache_(cfg.cache_bytes, cfg.cache_max_file),
+      zcache_(cfg.compress_cache_bytes, cfg.cache_max_file),
+      open_cache_(cfg.open_cache_entries, cfg.open_cache_ttl),
+      file_pool_(cfg.file_threads, cfg.file_queue),
+      proxy_({cfg.upstream_connect_timeout, cfg.upstream_read_timeout,
+              cfg.upstream_idle_timeout, cfg.upstream_max_idle,
+              body_buffer_}),
+      router_(std::move(router)) {
+    if (!cfg.metrics_path.empty()) {
+        router_.Get(cfg.metrics_path,
+                    [this](const HttpReq::Message &, const HttpRoute::Params &,
+                           HttpRsp::Message &rsp) { RenderMetrics(rsp.body); });
+    }
+    for (const ProxyRoute &proxy : cfg.proxies) {
+        std::string_view prefix = proxy.prefix;
+        if (prefix.ends_with('/')) {
+            prefix.remove_suffix(1);
+        }
+        const size_t route = proxy_.Add(proxy.upstreams, proxy.balance);
+        for (uint8_t m = 1; m < HttpHdr::kNMethod; ++m) {
+            router_.Stream(static_cast<HttpHdr::Method>(m),
+                           std::string(prefix) + "/*path",
+                           [this, route](const HttpReq::Message &req,
+                                         const HttpRoute::Params &,
+                                         HttpReq::BodyReader &body,
+                                         HttpRsp::Message &rsp) {
+                               return proxy_.Forward(route, req, body, rsp);
+                           });
+        }
+    }
+    if (!cfg.files_prefix.empty()) {
+        std::string_view prefix = cfg.files_prefix;
+        if (prefix.ends_with('/')) {
+            prefix.remove_suffix(1);
+        }
+        router_.Async(HttpHdr::Method::GET, std::string(prefix) + "/*path",
+                      [this](const HttpReq::Message &req,
+                             const HttpRoute::Params &params,
+                             HttpRsp::Message &rsp) {
+                          return serve_file(
+                              req, params.value(params.size() - 1), rsp);
+                      });
+    }
+    router_.Compile();
+}
+
+void HttpRsp::Listener::RenderMetrics(std::string &out) const {
+    metrics_.Render(out);
+    proxy_.Render(out);
+    Metrics::Append(out, "fasterapi_connections", "gauge",
+                    "Connections being served.", n_conns());
+    Metrics::Append(out, "fasterapi_connections_accepted_total", "counter",
+                    "Connections accepted.",
+                    stats_.accepted.load(std::memory_order_relaxed));
+    Metrics::Append(out, "fasterapi_connections_rejected_total", "counter",
+                    "Clients answered 503: over the connection limit or out "
+                    "of descriptors.",
+                    stats_.rejected.load(std::memory_order_relaxed));
+    Metrics::Append(out, "fasterapi_accept_pauses_total", "counter",
+                    "Pauses of the accept loop, out of descriptors.",
+                    stats_.paused.load(std::memory_order_relaxed));
+    Metrics::Append(out, "fasterapi_file_pool_queued", "gauge",
+                    "Files not in the cache being served by the file pool.",
+                    file_pool_.n_queued());
+    Metrics::Append(out, "fasterapi_file_pool_jobs_total", "counter",
+                    "Jobs of the file pool: files opened, read or "
+                    "compressed.",
+                    file_pool_.n_done());
+    Metrics::Append(out, "fasterapi_file_pool_rejected_total", "counter",
+                    "Requests answered 503, the file pool full.",
+                    file_pool_.n_rejected());
+    Metrics::Append(out, "fasterapi_log_dropped_total", "counter",
+                    "Log records dropped, the ring of their thread full.",
+                    log_.dropped());
+}
+
+void HttpRsp::Listener::Watch(FsWatch::Watcher &watcher) {
+    watcher.Subscribe([this](std::string_view path, bool is_dir) {
+        open_cache_.Invalidate(path, is_dir);
+        cache_.Invalidate(path, is_dir);
+        zcache_.Invalidate(path, is_dir);
+        // variants are filed under the file they encode, not the
+        // precompressed sibling they were read from
+        for (const Compress::Coding coding :
+             {Compress::Coding::Br, Compress::Coding::Gzip}) {
+            const std::string_view suffix = Compress::suffix(coding);
+            if (!is_dir && path.size() > suffix.size() &&
+                path.ends_with(suffix)) {
+                zcache_.Invalidate(path.substr(0, path.size() - suffix.size()),
+                                   false);
+            }
+        }
+    });
+    // a change in a directory that is not watched would go unnoticed
+    watcher.SubscribeLost([this] {
+        log_.Error("File caches disabled: the root is not watched whole");
+        open_cache_.Disable();
+        cache_.Disable();
+        zcache_.Disable();
+    });
+    if (!watcher.complete()) {
+        log_.Error("File caches left off: the root is not watched whole");
+        return;
+    }
+    open_cache_.Enable();
+    cache_.Enable();
+    zcache_.Enable();
+}
+
+// Key of the variant of the file at the request path `path` for the clients
+// accepting `accepted`; valid until the next call on the thread.
+static std::string_view variant_key(std::string_view path,
+                                    Compress::Codings accepted) {
+    thread_local std::string key;
+    key.assign(1, static_cast<char>('0' + accepted));
+    key += path;
+    return key;
+}
+
+// The file is answered as it is, then replaced with a variant in a content
+// coding the client accepts, if one is worth it. Variants are cached by the
+// set of codings accepted, which browsers keep to a few, so that a hit is one
+// lookup; the blocking work of a miss (opening a precompressed sibling,
+// compressing) is done on the file pool. On a miss, for clients accepting
+// no coding, or if the pool is full, the file goes out as it is.
+// Last, the answer is made conditional or partial from the validators of
+// what was found; ranges are only served of the file as it is.
+asio::awaitable<void>
+HttpRsp::Listener::serve_file(const HttpReq::Message &req,
+                              std::string_view path, HttpRsp::Message &rsp) {
+    const uint64_t gen = zcache_.generation();
+    const Compress::Codings accepted =
+        zcache_.enabled() && req.range().empty()
+            ? Compress::Accepted(req.get(HttpHdr::Field::ACCEPT_ENCODING))
+            : 0;
+    if (accepted == 0 ||
+        !rsp.CachedFile(variant_key(path, accepted), zcache_)) {
+        if (!rsp.CachedFile(path, cache_) && !co_await open_file(path, rsp)) {
+            co_return;
+        }
+        const size_t size = rsp.file ? rsp.file->body.size()
+                            : rsp.fd ? rsp.fd_size
+                                     : rsp.body.size();
+        if (accepted != 0 && rsp.code == HttpHdr::Status::OK &&
+            Compress::Compressible(rsp.cont_type) && size >= compress_min_ &&
+            (rsp.file || may_have_sibling(path, accepted))) {
+            const Metrics::Clock::time_point t0 = Metrics::Clock::now();
+            co_await file_pool_.Run(
+                [&] { encode_file(path, accepted, gen, rsp); });
+            metrics_.local().Time(Metrics::Phase::File, t0,
+                                  Metrics::Clock::now());
+        }
+    }
+
+    HttpCond::Ranges ranges;
+    if (rsp.Conditional(req, ranges)) {
+        co_return;
+    }
+    const Metrics::Clock::time_point t0 = Metrics::Clock::now();
+    const bool ran = co_await file_pool_.Run([&] { rsp.FillParts(ranges); });
+    metrics_.local().Time(Metrics::Phase::File, t0, Metrics::Clock::now());
+    if (!ran) {
+        rsp.Error(HttpHdr::Status::ServiceUnavailable);
+        rsp.headers = "Retry-After: 1" CRLF;
+    }
+}
+
+// Steps of `Message::ServFile`: a file found in the open file cache is served
+// at once unless it must be read. Otherwise, the file is opened and read on
+// the file pool; with io_uring, the pool only opens it, and the ring of the
+// I/O context reads it.
+asio::awaitable<bool> HttpRsp::Listener::open_file(std::string_view path,
+                                                   HttpRsp::Message &rsp) {
+    HttpRsp::PendingFile pending;
+    pending.gen = cache_.generation();
+    pending.open = open_cache_.Get(path);
+    if (pending.open && rsp.OpenFile(pending, sendfile_min_)) {
+        co_return true;
+    }
+
+    const Metrics::Clock::time_point t0 = Metrics::Clock::now();
+    const bool uring = FileIo::Uring();
+    bool served = false;
+    bool ran = true;
+    std::string cont;
+    if (!pending.open || !uring) {
+        ran = co_await file_pool_.Run([&] {
+            if (!pending.open) {
+                pending.open = open_cache_.Open(path, root_);
+                if ((served = rsp.OpenFile(pending, sendfile_min_))) {
+                    return;
+                }
+            }
+            if (!uring) {
+                cont = Utils::read_fd(pending.open->fd.get(),
+                                      pending.open->size);
+            }
+        });
+    }
+    if (ran && !served && uring) {
+        cont = co_await FileIo::Read(pending.open->fd.get(),
+                                     pending.open->size);
+    }
+    metrics_.local().Time(Metrics::Phase::File, t0, Metrics::Clock::now());
+    if (!ran) {
+        rsp.Error(HttpHdr::Status::ServiceUnavailable);
+        rsp.headers = "Retry-After: 1" CRLF;
+        co_return false;
+    }
+    if (!served) {
+        rsp.FillFile(path, cache_, pending, std::move(cont));
+    }
+    co_return true;
+}
+
+// Siblings known to be missing are found so in the open file cache, which
+// keeps such negative entries, without blocking.
+bool HttpRsp::Listener::may_have_sibling(std::string_view path,
+                                         Compress::Codings accepted) {
+    const OpenCache::EntryPtr open = open_cache_.Get(path);
+    if (!open) {
+        return true;
+    }
+    for (const Compress::Coding coding :
+         {Compress::Coding::Br, Compress::Coding::Gzip}) {
+        if ((accepted & Compress::bit(coding)) == 0) {
+            continue;
+        }
+        const OpenCache::EntryPtr sibling = open_cache_.Get(
+            open->file + std::string(Compress::suffix(coding)));
+        if (!sibling || sibling->found()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Preference: a precompressed sibling, brotli first, then a file compressed
+// with zlib, gzip rather than deflate. When no variant is worth it (the
+// client accepts only brotli, the file does not shrink), the file itself is
+// cached as the variant, so that it is not tried again.
+void HttpRsp::Listener::encode_file(std::string_view path,
+                                    Compress::Codings accepted, uint64_t gen,
+                                    HttpRsp::Message &rsp) {
+    OpenCache::EntryPtr open = open_cache_.Get(path);
+    if (!open) {
+        open = open_cache_.Open(path, root_);
+    }
+    if (!open->found()) {
+        return;
+    }
+
+    for (const Compress::Coding coding :
+         {Compress::Coding::Br, Compress::Coding::Gzip}) {
+        if ((accepted & Compress::bit(coding)) == 0) {
+            continue;
+        }
+        const std::string name =
+            open->file + std::string(Compress::suffix(coding));
+        OpenCache::EntryPtr sibling = open_cache_.Get(name);
+        if (!sibling) {
+            sibling = open_cache_.Open(name, root_);
+        }
+        if (!sibling->found() || sibling->size == 0) {
+            continue;
+        }
+        if (sibling->size >= sendfile_min_ ||
+            sibling->size > zcache_.max_entry()) {
+            rsp.SiblingFile(sibling, coding);
+            return;
+        }
+        std::string cont =
+            Utils::read_fd(sibling->fd.get(), sibling->size);
+        if (!cont.empty()) {
+            rsp.FillEncoded(variant_key(path, accepted), zcache_, gen, coding,
+                            open->file, std::move(cont));
+            return;
+        }
+    }
+
+    // only a file small enough to be cached is compressed
+    if (!rsp.file) {
+        return;
+    }
+    const Compress::Coding coding =
+        (accepted & Compress::bit(Compress::Coding::Gzip)) != 0
+            ? Compress::Coding::Gzip
+        : (accepted & Compress::bit(Compress::Coding::Deflate)) != 0
+            ? Compress::Coding::Deflate
+            : Compress::Coding::Identity;
+    std::string cont;
+    if (coding != Compress::Coding::Identity && gzip_level_ > 0) {
+        cont = Compress::Encode(rsp.file->body, coding, gzip_level_);
+    }
+    if (!cont.empty() && cont.size() < rsp.file->body.size()) {
+        rsp.FillEncoded(variant_key(path, accepted), zcache_, gen, coding,
+                        rsp.file->file, std::move(cont));
+    } else {
+        zcache_.Put(variant_key(path, accepted), rsp.file, gen);
+    }
+}
+
+// Stream `size` bytes of a file from `offset` to the socket with sendfile(2).
+// The kernel copies straight from the page cache to the socket, so memory use
+// does not depend on the file size. Whenever the socket buffer is full, the
+// coroutine waits for writability instead of blocking the thread.
+// The deadline `timer` is pushed back by `timeout` on every progress.
+static asio::awaitable<void>
+send_file(asio::ip::tcp::socket &socket, int fd, size_t offset, size_t size,
+          TimeWheel::Wheel &wheel, TimeWheel::Timer &timer,
+          TimeWheel::Clock::duration timeout, asio::error_code &ec) {
+    socket.native_non_blocking(true, ec);
+    off_t pos = static_cast<off_t>(offset);
+    const off_t end = static_cast<off_t>(offset + size);
+    while (!ec && pos < end) {
+        const ssize_t n = ::sendfile(socket.native_handle(), fd, &pos,
+                                     static_cast<size_t>(end - pos));
+        if (n > 0) {
+            wheel.Set(timer, timeout);
+            continue;
+        }
+        if (n == 0) {
+            // the file shrank after the head announced its length
+            ec = asio::error::eof;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            co_await socket.async_wait(
+                asio::ip::tcp::socket::wait_write,
+                asio::redirect_error(asio::use_awaitable, ec));
+        } else if (errno != EINTR) {
+            ec = asio::error_code(errno, asio::error::get_system_category());
+        }
+    }
+}
+
+// Send the body of `relay` as it is read, in chunks if it is to be; return
+// the bytes written. The deadline `timer` is set by `timeout` for each
+// write, and off while waiting for the relay, which has deadlines of its
+// own. A body cut short is sent without its last chunk.
+static asio::awaitable<uint64_t>
+send_relay(asio::ip::tcp::socket &socket, HttpRsp::Relay &relay,
+           TimeWheel::Wheel &wheel, TimeWheel::Timer &timer,
+           TimeWheel::Clock::duration timeout, asio::error_code &ec) {
+    uint64_t n_written = 0;
+    char size_line[24];
+    for (;;) {
+        wheel.Cancel(timer);
+        const std::string_view piece = co_await relay.Read();
+        if (piece.empty() && (!relay.chunked || !relay.done())) {
+            co_return n_written;
+        }
+        std::string_view prefix;
+        std::string_view suffix;
+        if (relay.chunked && piece.empty()) {
+            prefix = "0" CRLF2;
+        } else if (relay.chunked) {
+            char *end = std::to_chars(size_line, size_line + 16, piece.size(),
+                                      16)
+                            .ptr;
+            *end++ = '\r';
+            *end++ = '\n';
+            prefix = {size_line, static_cast<size_t>(end - size_line)};
+            suffix = CRLF;
+        }
+        wheel.Set(timer, timeout);
+        n_written += co_await asio::async_write(
+            socket,
+            std::array{asio::buffer(prefix), asio::buffer(piece),
+                       asio::buffer(suffix)},
+            asio::redirect_error(asio::use_awaitable, ec));
+        if (ec || piece.empty()) {
+            co_return n_written;
+        }
+    }
+}
+
+// SO_REUSEPORT, which asio does not provide.
+using ReusePort =
+    asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+asio::ip::tcp::acceptor
+HttpRsp::Listener::Open(const asio::any_io_executor &exor) const {
+    const asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), port_);
+    asio::ip::tcp::acceptor acceptor(exor);
+    acceptor.open(endpoint.protocol());
+    acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+    if (reuse_port_) {
+        acceptor.set_option(ReusePort(true));
+    }
+    acceptor.bind(endpoint);
+    acceptor.listen();
+    return acceptor;
+}
+
+// Answer a client that will not be served with 503, without waiting: the
+// response fits in the empty send buffer of a new connection. The caller
+// closes the connection.
+static void reject(int fd) {
+    static constexpr std::string_view kRetry =
+        "Content-Length: 0" CRLF "Retry-After: 1" CRLF;
+    const std::string_view parts[] = {
+        HttpHdr::status_line(HttpHdr::Status::ServiceUnavailable), kRetry,
+        HttpDate::Line(), HttpHdr::conn_line(HttpHdr::Conn::CLOSE)};
+    std::array<iovec, std::size(parts)> iov;
+    for (size_t i = 0; i < iov.size(); ++i) {
+        iov[i] = {const_cast<char *>(parts[i].data()), parts[i].size()};
+    }
+    msghdr msg{};
+    msg.msg_iov = iov.data();
+    msg.msg_iovlen = iov.size();
+    ::sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+static inline bool out_of_fds(const asio::error_code &ec) {
+    return ec == asio::error::no_descriptors ||
+           ec == asio::error_code(ENFILE, asio::error::get_system_category());
 }
 
-// Coroutine that continuously listens for incoming TCP connections on a
-// specified port. This function sets up an acceptor, listens on port 8080, and
-// spawns a new coroutine for each client connection using the handle_client
+void HttpRsp::Listener::shed(asio::ip::tcp::acceptor &acceptor,
+                             Utils::Fd &spare) {
+    for (size_t i = 0; i < kMaxShed; ++i) {
+        if (!spare) {
+            spare = Utils::open_file("/dev/null");
+            if (!spare) {
+                return;
+            }
+        }
+        spare.reset();
+        // the acceptor is non-blocking: fails at once if no client is left
+        const int fd = ::accept4(acceptor.native_handle(), nullptr, nullptr,
+                                 SOCK_CLOEXEC);
+        if (fd >= 0) {
+            reject(fd);
+            ::close(fd);
+            stats_.rejected.fetch_add(1, std::memory_order_relaxed);
+        }
+        spare = Utils::open_file("/dev/null");
+        if (fd < 0) {
+            return;
+        }
+    }
+}
+
+// Coroutine that continuously listens for incoming TCP connections and
+// spawns a new coroutine for each client connection using the session
 // coroutine.
-asio::awaitable<void> HttpRsp::Listener::Start() {
+asio::awaitable<void>
+HttpRsp::Listener::Start(asio::ip::tcp::acceptor acceptor,
+                         TimeWheel::Wheel &wheel) {
     // Get the executor associated with the current coroutine.
     auto exor = co_await asio::this_coro::executor;
 
-    // Set up the TCP acceptor to listen on port 8080 using IPv4.
-    asio::ip::tcp::acceptor acceptor(exor, {asio::ip::tcp::v4(), port_});
-    std::cout << "Server listening on port " << port_ << std::endl;
+    // Descriptor held in reserve for `shed`.
+    Utils::Fd spare = Utils::open_file("/dev/null");
+    asio::steady_timer timer(exor);
+    auto backoff = kMinBackoff;
+    bool paused = false;
 
-    for (;;)
-        try {
-            // Asynchronously accept a new connection.
-            asio::ip::tcp::socket socket =
-                co_await acceptor.async_accept(asio::use_awaitable);
+    for (;;) {
+        // Asynchronously accept a new connection.
+        asio::error_code ec;
+        asio::ip::tcp::endpoint peer;
+        asio::ip::tcp::socket socket = co_await acceptor.async_accept(
+            peer, asio::redirect_error(asio::use_awaitable, ec));
 
-            // Spawn a new coroutine to handle the client using a strand for
-            // safe concurrent access.
-            asio::co_spawn(exor, session(std::move(socket)), asio::detached);
+        // Out of descriptors: retrying at once would spin, as the pending
+        // connection stays in the backlog. Turn the waiting clients away,
+        // then pause until descriptors may have been released.
+        if (out_of_fds(ec)) {
+            stats_.paused.fetch_add(1, std::memory_order_relaxed);
+            if (!paused) {
+                log_.Error("Accept paused", ec);
+                paused = true;
+            }
+            shed(acceptor, spare);
+            timer.expires_after(backoff);
+            co_await timer.async_wait(
+                asio::redirect_error(asio::use_awaitable, ec));
+            backoff = std::min(backoff * 2, kMaxBackoff);
+            continue;
         }
-        // Handle exceptions thrown by the acceptor.
-        // TODO: [asio.system:24] Too many open files
-        catch (std::system_error &e) {
-            std::cerr << "Acceptor Exception: "
-                      << "[" << e.code() << "] meaning [" << e.what() << "]"
-                      << std::endl;
+        if (ec == asio::error::operation_aborted) {
+            co_return;
         }
+        if (ec) {
+            // e.g. the client reset the connection before it was accepted
+            log_.Error("Acceptor error", ec);
+            continue;
+        }
+        if (paused) {
+            log_.Error("Accept resumed");
+            paused = false;
+            backoff = kMinBackoff;
+        }
+
+        // Over the limit: answer 503 and close.
+        if (n_conns_.fetch_add(1, std::memory_order_relaxed) >= max_conns_) {
+            n_conns_.fetch_sub(1, std::memory_order_relaxed);
+            stats_.rejected.fetch_add(1, std::memory_order_relaxed);
+            reject(socket.native_handle());
+            continue;
+        }
+        stats_.accepted.fetch_add(1, std::memory_order_relaxed);
+
+        // Spawn a new coroutine to handle the client.
+        asio::co_spawn(exor, session(std::move(socket), peer, wheel),
+                       asio::detached);
+    }
 }
 
 // Coroutine to handle an individual client connection, now with Keep-Alive
-// support.
-asio::awaitable<void> HttpRsp::Listener::session(asio::ip::tcp::socket socket) {
-    asio::streambuf req_buf;
-    HttpReq::Message req;
-    HttpRsp::Message rsp;
+// and pipelining support.
+//
+// Pipelined requests are served in batches: every request already complete
+// in the read buffer is answered, and all the responses of the batch go out
+// in order with one gathered write. A partial request at the end of the
+// buffer is kept for the next read.
+//
+// Every step runs against a deadline in the timing wheel: waiting for a
+// request, reading its head, its body, and writing the responses. Since the
+// head deadline is set when its first bytes arrive, not at every read, a
+// client trickling a head byte by byte is disconnected all the same.
+//
+// The phases of each request are timed into the metrics of the thread
+// running the session at the time, see `Metrics::Phase`. With the access
+// log on, each response is logged once written, its latency running from
+// the first byte of its request, or for a pipelined one, from the end of
+// the previous.
+asio::awaitable<void>
+HttpRsp::Listener::session(asio::ip::tcp::socket socket,
+                           asio::ip::tcp::endpoint peer,
+                           TimeWheel::Wheel &wheel) {
+    // buffers of the connection, taken from the thread's pool; keeping
+    // them out of the coroutine frame also keeps the frame small enough for
+    // asio to recycle it
+    const ConnPtr conn = acquire_conn();
+    asio::streambuf &req_buf = conn->req_buf;
+    HttpReq::Message &req = conn->req;
+    std::array<HttpRsp::Message, kMaxBatch> &rsps = conn->rsps;
+    std::array<std::string, kMaxBatch> &rsp_heads = conn->rsp_heads;
+    std::vector<asio::const_buffer> &rsp_bufs = conn->rsp_bufs;
+    const bool log_access = log_.access();
+    if (log_access) {
+        for (Log::Record &rec : conn->logs) {
+            rec.set_peer(peer);
+        }
+    }
+    bool keep_alive = true;
+    uint64_t n_served = 0;
+    // the connection was counted when accepted
+    const ConnSlot slot{n_conns_};
+    TimeWheel::Timer &timer = conn->timer;
+    timer.fn = expire;
+    timer.arg = reinterpret_cast<void *>(
+        static_cast<intptr_t>(socket.native_handle()));
+    const TimerGuard timer_guard{wheel, timer};
 
-    for (;;)
+    while (keep_alive)
         try {
-            // 1. Asynchronously read until the HTTP header delimiter.
-            // NOTE: the function does not stop reading once the delimiter is
-            // found; it reads until the buffer is full or the delimiter is
-            co_await asio::async_read_until(socket, req_buf, CRLF2,
-                                            asio::use_awaitable);
-
-            // 2. Parse the request header and perhaps body.
-            req.Update(streambuf2string(req_buf));
-
-            // 3. Read the remaining body if it exists.
-            if (req.unread() > 0) {
-                asio::streambuf reqbody_buf;
-                asio::error_code ec_read_body;
-                co_await asio::async_read(
-                    socket, reqbody_buf, asio::transfer_exactly(req.unread()),
-                    asio::redirect_error(asio::use_awaitable, ec_read_body));
-                if (ec_read_body) {
-                    std::cerr
-                        << "Error reading body: " << ec_read_body.message()
-                        << std::endl;
-                    break;
+            // 1. Read until the first request head is complete.
+            // The parser works on the read buffer in place and resumes where
+            // it stopped, so a head split across reads is scanned only once.
+            req.Reset();
+            bool idle = req_buf.size() == 0;
+            wheel.Set(timer, idle ? idle_timeout_ : head_timeout_);
+            // when the first bytes of the head were there, and the last
+            Metrics::Clock::time_point t_read =
+                idle ? Metrics::Clock::time_point() : Metrics::Clock::now();
+            Metrics::Clock::time_point t = t_read;
+            HttpReq::Parser::Result res;
+            while ((res = req.Feed(streambuf2view(req_buf))) ==
+                   HttpReq::Parser::Result::Partial) {
+                const size_t n_read = co_await socket.async_read_some(
+                    req_buf.prepare(kReadSize), asio::use_awaitable);
+                req_buf.commit(n_read);
+                t = Metrics::Clock::now();
+                metrics_.local().Add(Metrics::Count::BytesIn, n_read);
+                if (idle) {
+                    idle = false;
+                    wheel.Set(timer, head_timeout_);
+                    t_read = t;
                 }
-                req.set_body(req.body() + streambuf2string(reqbody_buf));
             }
+            metrics_.local().Time(Metrics::Phase::Read, t_read, t);
+
+            // 2. Answer the requests of the buffer one after another; the
+            // request at offset `n_done` has just been fed to the parser,
+            // which began at `t`.
+            size_t n_rsp = 0;
+            size_t n_done = 0;
+            rsp_bufs.clear();
+            for (;;) {
+                HttpRsp::Message &rsp = rsps[n_rsp];
+                conn->log_starts[n_rsp] = n_rsp == 0 ? t_read : t;
+
+                // 2.1. A client speaking HTTP/2 from its first bytes, the
+                // preface read as a request head: hand the connection over.
+                if (n_served == 0 && res == HttpReq::Parser::Result::Complete &&
+                    streambuf2view(req_buf).starts_with(
+                        Http2::kPreface.substr(0, Http2::kPrefaceHead))) {
+                    co_await session_h2(socket, peer, wheel, timer,
+                                        streambuf2view(req_buf), {});
+                    break;
+                }
+
+                // 2.2. Reject malformed requests and close.
+                if (res == HttpReq::Parser::Result::Error || !req.Update()) {
+                    rsp.Error(HttpHdr::Status::BadRequest);
+                    rsp.conn = HttpHdr::Conn::CLOSE;
+                    const auto bufs = rsp.ToBuffers(rsp_heads[n_rsp]);
+                    rsp_bufs.insert(rsp_bufs.end(), bufs.begin(), bufs.end());
+                    if (log_access) {
+                        log_response(conn->logs[n_rsp], req, rsp,
+                                     wire_size(rsp, bufs));
+                    }
+                    metrics_.local().Fail(Metrics::Error::Malformed);
+                    count_response(metrics_.local(), rsp, n_served);
+                    ++n_rsp;
+                    keep_alive = false;
+                    break;
+                }
 
-            // 4. Update response message.
-            rsp.ServFile(req, root_);
+                // 2.3. A request upgrading to h2c, once the requests before
+                // it are answered, is answered over HTTP/2 as stream 1, and
+                // so is the rest of the connection.
+                if (Http2::Upgrades(req)) {
+                    if (n_rsp == 0) {
+                        const std::string_view buffered =
+                            streambuf2view(req_buf);
+                        co_await session_h2(
+                            socket, peer, wheel, timer,
+                            buffered.substr(req.size()),
+                            buffered.substr(0, req.head.size()));
+                    }
+                    break;
+                }
 
-            // 4. Asynchronously write the response back to the client.
+                // 2.4. Find the route of the request; if there is none, the
+                // response is set to 404 or 405.
+                rsp.Reset(req.conn);
+                HttpRoute::Params params;
+                const HttpRoute::Route *route =
+                    router_.Find(req, params, rsp);
+                Metrics::Clock::time_point t_parsed = Metrics::Clock::now();
+                metrics_.local().Time(Metrics::Phase::Parse, t, t_parsed);
+                t = t_parsed;
+                const bool whole = !req.chunked && req.length <= max_body_ &&
+                                   n_done + req.size() <= req_buf.size();
+
+                if (whole && (route == nullptr || !route->stream)) {
+                    // 2.5. The whole request is in the buffer: answer it.
+                    if (route != nullptr) {
+                        req.set_body(streambuf2view(req_buf).substr(
+                            n_done + req.head.size(), req.length));
+                        if (route->async) {
+                            co_await route->async(req, params, rsp);
+                        } else {
+                            route->handler(req, params, rsp);
+                        }
+                        t = Metrics::Clock::now();
+                        metrics_.local().Time(Metrics::Phase::Handle, t_parsed,
+                                              t);
+                    }
+                    n_done += req.size();
+                } else if (n_rsp > 0) {
+                    // The body is to be read from the connection: answer the
+                    // requests before first, as reading may move the buffer
+                    // they refer to.
+                    break;
+                } else if (route == nullptr) {
+                    // 2.6. Nobody reads the body: answer and close.
+                    rsp.conn = HttpHdr::Conn::CLOSE;
+                } else if (route->stream || req.chunked) {
+                    // 2.7. Read the body piece by piece through the
+                    // connection's body buffer: streamed to the handler, or
+                    // decoded whole for it up to `max_body_`.
+                    conn->body_buf.resize(body_buffer_);
+                    HttpReq::BodyReader body(
+                        socket, req,
+                        streambuf2view(req_buf).substr(req.head.size()),
+                        conn->body_buf, wheel, timer, body_timeout_);
+                    if (route->stream) {
+                        // the handler may wait on more than the client,
+                        // e.g. a proxy on its upstream under deadlines of
+                        // its own: stop the head timeout here, reads of the
+                        // body arm the timer for themselves.
+                        wheel.Cancel(timer);
+                        co_await route->stream(req, params, body, rsp);
+                    } else {
+                        std::string &whole_body = conn->body;
+                        whole_body.clear();
+                        for (std::string_view piece;
+                             !(piece = co_await body.Read()).empty();) {
+                            if (whole_body.size() + piece.size() > max_body_) {
+                                rsp.Error(HttpHdr::Status::PayloadTooLarge);
+                                metrics_.local().Fail(
+                                    Metrics::Error::TooLarge);
+                                break;
+                            }
+                            whole_body += piece;
+                        }
+                        t_parsed = Metrics::Clock::now();
+                        metrics_.local().Time(Metrics::Phase::Read, t,
+                                              t_parsed);
+                        if (body.done() && route->async) {
+                            req.set_body(whole_body);
+                            co_await route->async(req, params, rsp);
+                        } else if (body.done()) {
+                            req.set_body(whole_body);
+                            route->handler(req, params, rsp);
+                        }
+                    }
+                    t = Metrics::Clock::now();
+                    metrics_.local().Time(Metrics::Phase::Handle, t_parsed, t);
+                    metrics_.local().Add(Metrics::Count::BytesIn,
+                                         body.n_read());
+                    if (body.malformed()) {
+                        rsp.Error(HttpHdr::Status::BadRequest);
+                    }
+                    if (!body.done()) {
+                        rsp.conn = HttpHdr::Conn::CLOSE;
+                    }
+                    // drop the request, and put back the bytes of the next
+                    // one read with the body
+                    const std::string_view leftover = body.leftover();
+                    req_buf.consume(req.head.size() + body.n_buffered());
+                    req_buf.commit(asio::buffer_copy(
+                        req_buf.prepare(leftover.size()),
+                        asio::buffer(leftover)));
+                    n_done = 0;
+                } else if (req.length > max_body_) {
+                    rsp.Error(HttpHdr::Status::PayloadTooLarge);
+                    rsp.conn = HttpHdr::Conn::CLOSE;
+                    metrics_.local().Fail(Metrics::Error::TooLarge);
+                } else {
+                    // 2.8. Read the rest of a body of known length into the
+                    // buffer, right after the head, and answer.
+                    if (HttpReq::expects_continue(req)) {
+                        co_await asio::async_write(
+                            socket, asio::buffer(HttpReq::kContinue),
+                            asio::use_awaitable);
+                    }
+                    wheel.Set(timer, body_timeout_);
+                    asio::error_code ec_read_body;
+                    const size_t n_read = co_await asio::async_read(
+                        socket, req_buf,
+                        asio::transfer_exactly(req.size() - req_buf.size()),
+                        asio::redirect_error(asio::use_awaitable,
+                                             ec_read_body));
+                    t_parsed = Metrics::Clock::now();
+                    Metrics::Recorder &rec = metrics_.local();
+                    rec.Add(Metrics::Count::BytesIn, n_read);
+                    rec.Time(Metrics::Phase::Read, t, t_parsed);
+                    if (ec_read_body) {
+                        rec.Fail(Metrics::Error::Read);
+                        log_.Error("Error reading body", ec_read_body, &peer);
+                        keep_alive = false;
+                        break;
+                    }
+                    // reading may have moved the buffer; refresh the views
+                    req.Feed(streambuf2view(req_buf));
+                    req.set_body(streambuf2view(req_buf).substr(
+                        req.head.size(), req.length));
+                    router_.Find(req, params, rsp);
+                    if (route->async) {
+                        co_await route->async(req, params, rsp);
+                    } else {
+                        route->handler(req, params, rsp);
+                    }
+                    t = Metrics::Clock::now();
+                    rec.Time(Metrics::Phase::Handle, t_parsed, t);
+                    n_done = req.size();
+                }
+
+                // Serialize the response head; the response to a HEAD
+                // request describes the body without sending it.
+                auto bufs = rsp.ToBuffers(rsp_heads[n_rsp]);
+                if (req.method == HttpHdr::Method::HEAD) {
+                    bufs[1] = asio::const_buffer();
+                    rsp.fd.reset();
+                }
+                rsp_bufs.insert(rsp_bufs.end(), bufs.begin(), bufs.end());
+                if (log_access) {
+                    log_response(conn->logs[n_rsp], req, rsp,
+                                 wire_size(rsp, bufs));
+                }
+                ++n_rsp;
+                count_response(metrics_.local(), rsp, n_served);
+
+                // 2.9. Close the connection if not Keep-Alive; end the batch
+                // at a file to stream or a response to relay, when full, or
+                // when no complete request head is left.
+                if (rsp.conn != HttpHdr::Conn::KEEP_ALIVE) {
+                    keep_alive = false;
+                    break;
+                }
+                if (rsp.fd || rsp.relay || n_rsp == kMaxBatch) {
+                    break;
+                }
+                req.Reset();
+                res = req.Feed(streambuf2view(req_buf).substr(n_done));
+                if (res == HttpReq::Parser::Result::Partial) {
+                    break;
+                }
+            }
+            if (n_rsp == 0) {
+                break;
+            }
+
+            // 3. Asynchronously write the responses back to the client.
+            // Heads and bodies go out in one gathered write; a cached body is
+            // sent straight from the cache entry, a large file is streamed
+            // from the page cache after the head, and a relayed body as it
+            // is read.
+            wheel.Set(timer, write_timeout_);
+            const Metrics::Clock::time_point t_write = Metrics::Clock::now();
             asio::error_code ec_write;
-            co_await asio::async_write(
-                socket, asio::buffer(rsp.ToStr()),
+            uint64_t n_written = co_await asio::async_write(
+                socket, BufferView{rsp_bufs.data(), rsp_bufs.size()},
                 asio::redirect_error(asio::use_awaitable, ec_write));
+            HttpRsp::Message &last = rsps[n_rsp - 1];
+            // a streamed file or relayed body is logged once sent, the
+            // responses before it now
+            const size_t n_logged = last.fd || last.relay ? n_rsp - 1 : n_rsp;
+            if (log_access) {
+                push_logs(log_, *conn, 0, n_logged, Metrics::Clock::now());
+            }
+            if (!ec_write && last.fd) {
+                co_await send_file(socket, last.fd->get(), last.fd_offset,
+                                   last.fd_size, wheel, timer, write_timeout_,
+                                   ec_write);
+                n_written += ec_write ? 0 : last.fd_size;
+                last.fd.reset();
+            }
+            if (!ec_write && last.relay) {
+                const uint64_t n_relayed =
+                    co_await send_relay(socket, *last.relay, wheel, timer,
+                                        write_timeout_, ec_write);
+                n_written += n_relayed;
+                conn->logs[n_rsp - 1].bytes += n_relayed;
+                // a body cut short ends the response with the connection
+                keep_alive = keep_alive && last.relay->done();
+            }
+            last.relay.reset();
+            const Metrics::Clock::time_point t_written = Metrics::Clock::now();
+            Metrics::Recorder &rec = metrics_.local();
+            rec.Time(Metrics::Phase::Write, t_write, t_written);
+            rec.Add(Metrics::Count::BytesOut, n_written);
+            if (log_access) {
+                push_logs(log_, *conn, n_logged, n_rsp, t_written);
+            }
             if (ec_write) {
-                std::cerr << "Client closed connection: [" << ec_write.message()
-                          << "]" << std::endl;
+                rec.Fail(Metrics::Error::Write);
+                log_.Error("Client closed connection", ec_write, &peer);
                 break;
             }
 
-            // 5. Close the connection if not Keep-Alive by exiting loop
-            if (rsp.conn != HttpHdr::Conn::KEEP_ALIVE) {
-                break;
-            }
+            // 4. Drop the answered requests from the buffer; bytes of a
+            // following request, if any, are kept for the next batch.
+            req_buf.consume(n_done);
 
         } catch (std::system_error &e) {
+            if (e.code() != asio::error::eof) {
+                metrics_.local().Fail(Metrics::Error::Read);
+            }
             // Ignore EOF and connection reset errors.
             if (e.code() != asio::error::eof &&
                 e.code() != asio::error::connection_reset) {
-                std::cerr << "Client Handling Exception: "
-                          << "[" << e.code()
-                          << "] meaning "
-                             "["
-                          << e.what() << "]" << std::endl;
+                log_.Error("Client handling exception", e.code(), &peer);
             }
+            // The connection is unusable after a failed read.
+            break;
         }
 
-    // Attempt graceful closure of the connection
-    // TODO:
-    // - [asio.system:107]: Transport endpoint is not connected
+    // The descriptor must not be shut down by the deadline once closed, as
+    // its number may be reused by then.
+    wheel.Cancel(timer);
+
+    // Attempt graceful closure of the connection; a peer that reset it
+    // already, as clients may once they have their responses, leaves it not
+    // connected.
     try {
         socket.shutdown(asio::ip::tcp::socket::shutdown_send);
         socket.close();
     } catch (std::system_error &e) {
-        std::cerr << "Closing Exception: "
-                  << "[" << e.code() << "] meaning [" << e.what() << "]"
-                  << std::endl;
+        if (e.code() != asio::error::not_connected) {
+            log_.Error("Closing exception", e.code(), &peer);
+        }
+    }
+}
+
+// The strand keeps the coroutines of the session, its reader, writer and
+// streams, from running at once on the threads of a shared context. Each
+// stream is counted and logged as a request of the connection.
+asio::awaitable<void>
+HttpRsp::Listener::session_h2(asio::ip::tcp::socket &socket,
+                              const asio::ip::tcp::endpoint &peer,
+                              TimeWheel::Wheel &wheel, TimeWheel::Timer &timer,
+                              std::string_view buffered,
+                              std::string_view upgrade) {
+    metrics_.local().Add(Metrics::Count::Http2);
+    uint64_t n_served = 0;
+    const bool log_access = log_.access();
+    Http2::Hooks hooks{
+        [&](const HttpReq::Message &req, HttpRsp::Message &rsp) {
+            return serve_h2(req, rsp, socket, wheel, timer);
+        },
+        [&](const HttpReq::Message &req, const HttpRsp::Message &rsp,
+            uint64_t bytes, Metrics::Clock::time_point start) {
+            count_response(metrics_.local(), rsp, n_served);
+            if (!log_access) {
+                return;
+            }
+            Log::Record rec;
+            rec.set_peer(peer);
+            log_response(rec, req, rsp, bytes);
+            rec.latency_ns = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    Metrics::Clock::now() - start)
+                    .count());
+            log_.Push(rec);
+        }};
+    Http2::Session h2(socket, wheel, timer, file_pool_, metrics_,
+                      {max_body_, h2_max_streams_, idle_timeout_,
+                       write_timeout_},
+                      std::move(hooks));
+    co_await asio::co_spawn(asio::make_strand(socket.get_executor()),
+                            h2.Run(buffered, upgrade), asio::use_awaitable);
+}
+
+// Answer a request of an HTTP/2 stream, its body read whole, as step 2.5 of
+// `session` does. A streaming route reads that body in one piece.
+asio::awaitable<void>
+HttpRsp::Listener::serve_h2(const HttpReq::Message &req, HttpRsp::Message &rsp,
+                            asio::ip::tcp::socket &socket,
+                            TimeWheel::Wheel &wheel, TimeWheel::Timer &timer) {
+    const Metrics::Clock::time_point t0 = Metrics::Clock::now();
+    HttpRoute::Params params;
+    const HttpRoute::Route *route = router_.Find(req, params, rsp);
+    const Metrics::Clock::time_point t1 = Metrics::Clock::now();
+    metrics_.local().Time(Metrics::Phase::Parse, t0, t1);
+    if (route == nullptr) {
+        co_return;
+    }
+    if (route->async) {
+        co_await route->async(req, params, rsp);
+    } else if (route->handler) {
+        route->handler(req, params, rsp);
+    } else {
+        HttpReq::BodyReader body(socket, req.body(), wheel, timer);
+        co_await route->stream(req, params, body, rsp);
     }
+    metrics_.local().Time(Metrics::Phase::Handle, t1, Metrics::Clock::now());
 }
@@ -0,0 +1,205 @@
+#include "log.hpp"
+#include <bit>
+#include <cerrno>
+#include <charconv>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+// Pause of the writer thread when the rings are empty.
+static constexpr std::chrono::milliseconds kIdle(10);
+
+// Bytes formatted before they are written out.
+static constexpr size_t kBatch = 64 * 1024;
+
+static std::atomic<uint64_t> next_id{1};
+
+void Log::Record::set_peer(const asio::ip::tcp::endpoint &peer) {
+    const asio::ip::address address = peer.address();
+    if (address.is_v4()) {
+        const asio::ip::address_v4::bytes_type v4 = address.to_v4().to_bytes();
+        addr = {};
+        addr[10] = addr[11] = 0xff;
+        std::copy(v4.begin(), v4.end(), addr.begin() + 12);
+    } else {
+        const asio::ip::address_v6::bytes_type v6 = address.to_v6().to_bytes();
+        std::copy(v6.begin(), v6.end(), addr.begin());
+    }
+    port = peer.port();
+}
+
+Log::Logger::Logger(const std::string &access_path, int error_fd,
+                    size_t ring_size)
+    : id_(next_id.fetch_add(1, std::memory_order_relaxed)),
+      ring_size_(std::bit_ceil(std::max<size_t>(ring_size, 2))),
+      error_fd_(error_fd) {
+    if (!access_path.empty()) {
+        access_fd_.reset(::open(access_path.c_str(),
+                                O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                                0644));
+        if (!access_fd_) {
+            std::cerr << "Cannot open the access log " << access_path
+                      << std::endl;
+        }
+    }
+    writer_ = std::thread(&Logger::run, this);
+}
+
+Log::Logger::~Logger() {
+    stop_.store(true, std::memory_order_release);
+    writer_.join();
+}
+
+void Log::Logger::Error(std::string_view what, const asio::error_code &ec,
+                        const asio::ip::tcp::endpoint *peer) {
+    Record rec;
+    rec.kind = Kind::Error;
+    if (ec) {
+        rec.category = &ec.category();
+        rec.code = ec.value();
+    }
+    if (peer != nullptr) {
+        rec.set_peer(*peer);
+    }
+    rec.set_text(what);
+    Push(rec);
+}
+
+uint64_t Log::Logger::dropped() const {
+    uint64_t n = 0;
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (const auto &ring : rings_) {
+        n += ring->dropped();
+    }
+    return n;
+}
+
+Log::Ring &Log::Logger::attach() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    rings_.push_back(std::make_unique<Ring>(ring_size_));
+    return *rings_.back();
+}
+
+// Write all of `buf` to `fd`, then empty it; what cannot be written is
+// lost.
+static void write_out(int fd, std::string &buf) {
+    for (size_t pos = 0; fd >= 0 && pos < buf.size();) {
+        const ssize_t n = ::write(fd, buf.data() + pos, buf.size() - pos);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        pos += static_cast<size_t>(n);
+    }
+    buf.clear();
+}
+
+void Log::Logger::run() {
+    std::string access;
+    std::string errors;
+    access.reserve(kBatch + 1024);
+    Record rec;
+    for (;;) {
+        // the rings are drained once more after the stop is seen
+        const bool stop = stop_.load(std::memory_order_acquire);
+        bool idle = true;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            for (const auto &ring : rings_) {
+                while (ring->Pop(rec)) {
+                    idle = false;
+                    std::string &out = rec.kind == Kind::Access ? access
+                                                                : errors;
+                    format(rec, out);
+                    if (out.size() >= kBatch) {
+                        write_out(&out == &access ? access_fd_.get()
+                                                  : error_fd_,
+                                  out);
+                    }
+                }
+            }
+        }
+        write_out(access_fd_.get(), access);
+        write_out(error_fd_, errors);
+        if (stop) {
+            return;
+        }
+        if (idle) {
+            std::this_thread::sleep_for(kIdle);
+        }
+    }
+}
+
+static void append_num(std::string &out, uint64_t value) {
+    char digits[20];
+    out.append(digits,
+               std::to_chars(digits, digits + sizeof(digits), value).ptr);
+}
+
+// `2026-01-02T03:04:05.678Z`
+static void append_time(std::string &out, int64_t time_ns) {
+    const time_t secs = static_cast<time_t>(time_ns / 1'000'000'000);
+    tm utc;
+    gmtime_r(&secs, &utc);
+    char buf[32];
+    const size_t n = std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &utc);
+    out.append(buf, n);
+    const unsigned ms =
+        static_cast<unsigned>(time_ns / 1'000'000 % 1000);
+    out += '.';
+    out += static_cast<char>('0' + ms / 100);
+    out += static_cast<char>('0' + ms / 10 % 10);
+    out += static_cast<char>('0' + ms % 10);
+    out += 'Z';
+}
+
+// `127.0.0.1:8080`, `[::1]:8080`, or `-` if unknown.
+static void append_peer(std::string &out, const Log::Record &rec) {
+    if (rec.port == 0) {
+        out += '-';
+        return;
+    }
+    const asio::ip::address_v6 v6(rec.addr);
+    if (v6.is_v4_mapped()) {
+        out += asio::ip::make_address_v4(asio::ip::v4_mapped, v6).to_string();
+    } else {
+        out += '[';
+        out += v6.to_string();
+        out += ']';
+    }
+    out += ':';
+    append_num(out, rec.port);
+}
+
+// Access: `TIME PEER "METHOD PATH" STATUS BYTES LATENCY_US`
+// Error: `TIME error PEER WHAT: MESSAGE`
+void Log::Logger::format(const Record &rec, std::string &out) {
+    append_time(out, rec.time_ns);
+    out += ' ';
+    if (rec.kind == Kind::Access) {
+        append_peer(out, rec);
+        out += " \"";
+        out += HttpHdr::method2str(rec.method);
+        out += ' ';
+        out.append(rec.text, rec.n_text);
+        out += "\" ";
+        append_num(out, rec.status);
+        out += ' ';
+        append_num(out, rec.bytes);
+        out += ' ';
+        append_num(out, rec.latency_ns / 1000);
+    } else {
+        out += "error ";
+        append_peer(out, rec);
+        out += ' ';
+        out.append(rec.text, rec.n_text);
+        if (rec.category != nullptr) {
+            out += ": ";
+            out += rec.category->message(rec.code);
+        }
+    }
+    out += '\n';
+}
@@ -1,7 +1,111 @@
 #include "httprsp_run.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+#include <utility>
+
+static void usage(const char *prog) {
+    std::cerr << "Usage: " << prog
+              << " [-p PORT] [-t THREADS] [-c CONNS] [--sharded] [--pin] "
+                 "[--access-log FILE]\n"
+                 "       [--proxy PREFIX=HOST:PORT[,HOST:PORT...]]... "
+                 "[--balance rr|least] [ROOT]\n"
+                 "  -p PORT      port to listen on (default 8080)\n"
+                 "  -t THREADS   number of worker threads (default 4)\n"
+                 "  -c CONNS     most connections served at once (default "
+                 "10000)\n"
+                 "  --sharded    one I/O context and SO_REUSEPORT acceptor "
+                 "per thread\n"
+                 "  --pin        pin each worker thread to its own CPU\n"
+                 "  --access-log FILE\n"
+                 "               append a line per response to FILE\n"
+                 "  --proxy PREFIX=HOST:PORT[,HOST:PORT...]\n"
+                 "               forward requests under PREFIX to the upstream "
+                 "servers\n"
+                 "  --balance rr|least\n"
+                 "               spread them in turn (default), or to the "
+                 "least busy\n"
+                 "  ROOT         directory of the files served (default .)\n";
+}
+
+// Parse "PREFIX=HOST:PORT[,HOST:PORT...]" into `out`; false if malformed.
+static bool parse_proxy(std::string_view str, HttpRsp::ProxyRoute &out) {
+    const size_t eq = str.find('=');
+    if (eq == std::string_view::npos || !str.starts_with('/')) {
+        return false;
+    }
+    out.prefix = str.substr(0, eq);
+    for (std::string_view rest = str.substr(eq + 1); !rest.empty();) {
+        const size_t comma = std::min(rest.find(','), rest.size());
+        if (comma == 0) {
+            return false;
+        }
+        out.upstreams.emplace_back(rest.substr(0, comma));
+        rest.remove_prefix(std::min(comma + 1, rest.size()));
+    }
+    return !out.upstreams.empty();
+}
+
+// Parse a positive decimal number into `out`; false if malformed.
+template <typename T> static bool parse_num(const char *str, T &out) {
+    const char *end = str + std::strlen(str);
+    const auto [ptr, ec] = std::from_chars(str, end, out);
+    return ec == std::errc() && ptr == end && out > 0;
+}
 
 int main(int argc, char *argv[]) {
-    const std::string root = (argc > 1) ? argv[1] : ".";
-    HttpRsp::Run(8080, 4, root);
+    HttpRsp::Config cfg;
+    HttpRsp::Balance balance = HttpRsp::Balance::RoundRobin;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (arg == "-p" && i + 1 < argc) {
+            if (!parse_num(argv[++i], cfg.port)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "-t" && i + 1 < argc) {
+            if (!parse_num(argv[++i], cfg.n_thread)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "-c" && i + 1 < argc) {
+            if (!parse_num(argv[++i], cfg.max_conns)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--sharded") {
+            cfg.mode = HttpRsp::Mode::Sharded;
+        } else if (arg == "--pin") {
+            cfg.pin_cpu = true;
+        } else if (arg == "--access-log" && i + 1 < argc) {
+            cfg.access_log = argv[++i];
+        } else if (arg == "--proxy" && i + 1 < argc) {
+            HttpRsp::ProxyRoute proxy;
+            if (!parse_proxy(argv[++i], proxy)) {
+                usage(argv[0]);
+                return 1;
+            }
+            cfg.proxies.push_back(std::move(proxy));
+        } else if (arg == "--balance" && i + 1 < argc) {
+            const std::string_view name = argv[++i];
+            if (name != "rr" && name != "least") {
+                usage(argv[0]);
+                return 1;
+            }
+            balance = name == "rr" ? HttpRsp::Balance::RoundRobin
+                                   : HttpRsp::Balance::LeastOutstanding;
+        } else if (arg.starts_with('-')) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            cfg.root = arg;
+        }
+    }
+    for (HttpRsp::ProxyRoute &proxy : cfg.proxies) {
+        proxy.balance = balance;
+    }
+    HttpRsp::Run(cfg);
     return 0;
 }
@@ -0,0 +1,227 @@
+#include "metrics.hpp"
+#include <charconv>
+
+// Upper bounds of the buckets of the exported histograms, in seconds and in
+// nanoseconds. A bucket of `Histogram` straddling a bound is counted in the
+// next one up.
+static constexpr std::pair<std::string_view, uint64_t> kBounds[] = {
+    {"1e-05", 10'000},          {"2.5e-05", 25'000},
+    {"5e-05", 50'000},          {"0.0001", 100'000},
+    {"0.00025", 250'000},       {"0.0005", 500'000},
+    {"0.001", 1'000'000},       {"0.0025", 2'500'000},
+    {"0.005", 5'000'000},       {"0.01", 10'000'000},
+    {"0.025", 25'000'000},      {"0.05", 50'000'000},
+    {"0.1", 100'000'000},       {"0.25", 250'000'000},
+    {"0.5", 500'000'000},       {"1", 1'000'000'000},
+    {"2.5", 2'500'000'000},     {"5", 5'000'000'000},
+    {"10", 10'000'000'000},
+};
+
+static constexpr std::string_view kPhaseStr[Metrics::kNPhase] = {
+    "read", "parse", "handle", "write", "file"};
+static constexpr std::string_view kErrorStr[Metrics::kNError] = {
+    "malformed", "too_large", "read", "write"};
+
+static std::atomic<uint64_t> next_id{1};
+
+void Metrics::Distribution::Add(const Histogram &hist) {
+    for (size_t i = 0; i < Histogram::kNBucket; ++i) {
+        const uint64_t n = hist.bucket(i);
+        buckets[i] += n;
+        count += n;
+    }
+    sum += hist.sum();
+}
+
+uint64_t Metrics::Distribution::Quantile(double q) const {
+    if (count == 0) {
+        return 0;
+    }
+    const double rank = q * static_cast<double>(count);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < Histogram::kNBucket; ++i) {
+        seen += buckets[i];
+        if (static_cast<double>(seen) >= rank && seen > 0) {
+            // the middle of the bucket
+            return (Histogram::lower(i) + Histogram::lower(i + 1) - 1) / 2;
+        }
+    }
+    return Histogram::kMax;
+}
+
+Metrics::Registry::Registry()
+    : id_(next_id.fetch_add(1, std::memory_order_relaxed)) {}
+
+Metrics::Recorder &Metrics::Registry::attach() {
+    const std::thread::id self = std::this_thread::get_id();
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (const auto &[id, recorder] : recorders_) {
+        if (id == self) {
+            return *recorder;
+        }
+    }
+    recorders_.emplace_back(self, std::make_unique<Recorder>());
+    return *recorders_.back().second;
+}
+
+Metrics::Snapshot Metrics::Registry::Collect() const {
+    Snapshot snap;
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (const auto &[id, recorder] : recorders_) {
+        for (size_t i = 0; i < kNPhase; ++i) {
+            snap.phases[i].Add(recorder->phases[i]);
+        }
+        for (size_t i = 0; i < kNCount; ++i) {
+            snap.counts[i] +=
+                recorder->counts[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < HttpHdr::kNStatus; ++i) {
+            snap.responses[i] +=
+                recorder->responses[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < kNError; ++i) {
+            snap.errors[i] +=
+                recorder->errors[i].load(std::memory_order_relaxed);
+        }
+    }
+    snap.n_threads = recorders_.size();
+    return snap;
+}
+
+static void append_num(std::string &out, uint64_t value) {
+    char digits[20];
+    out.append(digits,
+               std::to_chars(digits, digits + sizeof(digits), value).ptr);
+}
+
+void Metrics::AppendSample(std::string &out, std::string_view name,
+                           std::string_view label, std::string_view value,
+                           uint64_t n) {
+    out += name;
+    out += '{';
+    out += label;
+    out += "=\"";
+    out += value;
+    out += "\"} ";
+    append_num(out, n);
+    out += '\n';
+}
+
+void Metrics::AppendHeader(std::string &out, std::string_view name,
+                           std::string_view type, std::string_view help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void Metrics::Append(std::string &out, std::string_view name,
+                     std::string_view type, std::string_view help,
+                     uint64_t value) {
+    AppendHeader(out, name, type, help);
+    out += name;
+    out += ' ';
+    append_num(out, value);
+    out += '\n';
+}
+
+void Metrics::AppendHistogram(std::string &out, std::string_view name,
+                              std::string_view label, std::string_view value,
+                              const Distribution &dist) {
+    // `name_suffix{label="value"`, the labels left open
+    const auto series = [&](std::string_view suffix) {
+        out += name;
+        out += suffix;
+        out += '{';
+        out += label;
+        out += "=\"";
+        out += value;
+        out += '"';
+    };
+    size_t i = 0;
+    uint64_t seen = 0;
+    for (const auto &[le, ns] : kBounds) {
+        for (; i < Histogram::kNBucket && Histogram::lower(i + 1) - 1 <= ns;
+             ++i) {
+            seen += dist.buckets[i];
+        }
+        series("_bucket");
+        out += ",le=\"";
+        out += le;
+        out += "\"} ";
+        append_num(out, seen);
+        out += '\n';
+    }
+    series("_bucket");
+    out += ",le=\"+Inf\"} ";
+    append_num(out, dist.count);
+    out += '\n';
+
+    char digits[32];
+    series("_sum");
+    out += "} ";
+    out.append(digits, std::to_chars(digits, digits + sizeof(digits),
+                                     static_cast<double>(dist.sum) / 1e9)
+                           .ptr);
+    out += '\n';
+    series("_count");
+    out += "} ";
+    append_num(out, dist.count);
+    out += '\n';
+}
+
+void Metrics::Registry::Render(std::string &out) const {
+    const std::unique_ptr<const Snapshot> snap =
+        std::make_unique<const Snapshot>(Collect());
+
+    static constexpr std::string_view kDuration =
+        "fasterapi_request_duration_seconds";
+    AppendHeader(out, kDuration, "histogram",
+                 "Time spent on requests, by phase.");
+    for (size_t p = 0; p < kNPhase; ++p) {
+        AppendHistogram(out, kDuration, "phase", kPhaseStr[p],
+                        snap->phases[p]);
+    }
+
+    const auto count = [&snap](Count c) {
+        return snap->counts[static_cast<uint8_t>(c)];
+    };
+    Append(out, "fasterapi_requests_total", "counter", "Requests answered.",
+           count(Count::Requests));
+    Append(out, "fasterapi_keepalive_reused_total", "counter",
+           "Requests after the first of their connection.",
+           count(Count::Reused));
+    Append(out, "fasterapi_received_bytes_total", "counter",
+           "Bytes read from clients.", count(Count::BytesIn));
+    Append(out, "fasterapi_sent_bytes_total", "counter",
+           "Bytes written to clients.", count(Count::BytesOut));
+    Append(out, "fasterapi_http2_connections_total", "counter",
+           "Connections turned to HTTP/2, by prior knowledge or upgrade.",
+           count(Count::Http2));
+
+    AppendHeader(out, "fasterapi_responses_total", "counter",
+                 "Responses, by status code.");
+    for (size_t i = 0; i < HttpHdr::kNStatus; ++i) {
+        char code[8];
+        const char *end =
+            std::to_chars(code, code + sizeof(code), HttpHdr::kArrStatusCode[i])
+                .ptr;
+        AppendSample(out, "fasterapi_responses_total", "code",
+                     std::string_view(code, static_cast<size_t>(end - code)),
+                     snap->responses[i]);
+    }
+
+    AppendHeader(out, "fasterapi_errors_total", "counter", "Errors, by kind.");
+    for (size_t i = 0; i < kNError; ++i) {
+        AppendSample(out, "fasterapi_errors_total", "kind", kErrorStr[i],
+                     snap->errors[i]);
+    }
+
+    Append(out, "fasterapi_threads", "gauge", "Threads that have recorded.",
+           snap->n_threads);
+}
@@ -0,0 +1,99 @@
+#include "opencache.hpp"
+#include <sys/stat.h>
+
+OpenCache::EntryPtr OpenCache::Cache::Get(std::string_view path) {
+    if (!enabled()) {
+        return nullptr;
+    }
+    Shard &sh = shard(path);
+    std::lock_guard<std::mutex> lock(sh.mtx);
+    const auto it = sh.map.find(path);
+    if (it == sh.map.end()) {
+        return nullptr;
+    }
+    if (it->second->entry->expires <= Clock::now()) {
+        sh.lru.erase(it->second);
+        sh.map.erase(it);
+        return nullptr;
+    }
+    sh.lru.splice(sh.lru.begin(), sh.lru, it->second);
+    return it->second->entry;
+}
+
+OpenCache::EntryPtr OpenCache::Cache::Open(std::string_view path,
+                                           const std::string &root) {
+    // taken before opening so a concurrent change is not cached
+    const uint64_t gen = gen_.load(std::memory_order_acquire);
+    auto entry = std::make_shared<Entry>();
+    entry->expires = Clock::now() + ttl_;
+
+    const std::filesystem::path full_path = Utils::resolve(path, root);
+    struct stat st;
+    if (!full_path.empty()) {
+        entry->fd = Utils::open_file(full_path);
+    }
+    if (entry->fd && ::fstat(entry->fd.get(), &st) == 0) {
+        entry->file = Utils::relative(full_path, root);
+        entry->size = static_cast<size_t>(st.st_size);
+        entry->mtime = st.st_mtim;
+        entry->inode = st.st_ino;
+        entry->cont_type = HttpHdr::ext2conttype(full_path.native());
+        entry->validators = HttpCond::Make(st.st_mtim, entry->size);
+    } else {
+        // resolved as a file would be, for `Invalidate` to find it under
+        // any spelling of the request path
+        entry->fd.reset();
+        entry->file = Utils::resolve_missing(path, root);
+    }
+    put(path, entry, gen);
+    return entry;
+}
+
+void OpenCache::Cache::put(std::string_view path, EntryPtr entry,
+                           uint64_t gen) {
+    if (!enabled()) {
+        return;
+    }
+    Shard &sh = shard(path);
+    std::lock_guard<std::mutex> lock(sh.mtx);
+    // the file was invalidated while being opened
+    if (gen != gen_.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    const auto it = sh.map.find(path);
+    if (it != sh.map.end()) {
+        it->second->entry = std::move(entry);
+        sh.lru.splice(sh.lru.begin(), sh.lru, it->second);
+        return;
+    }
+    sh.lru.push_front({std::string(path), std::move(entry)});
+    sh.map.emplace(sh.lru.front().key, sh.lru.begin());
+    if (sh.lru.size() > shard_cap_) {
+        sh.map.erase(sh.lru.back().key);
+        sh.lru.pop_back();
+    }
+}
+
+// As in `FileCache::Cache::Invalidate`, every shard is scanned, several
+// request paths resolving to the same file.
+void OpenCache::Cache::Invalidate(std::string_view file, bool is_dir) {
+    gen_.fetch_add(1, std::memory_order_acq_rel);
+
+    for (Shard &sh : shards_) {
+        std::lock_guard<std::mutex> lock(sh.mtx);
+        for (auto it = sh.lru.begin(); it != sh.lru.end();) {
+            const std::string_view f = it->entry->file;
+            const bool hit =
+                file.empty() || f == file ||
+                (is_dir && f.size() > file.size() && f.starts_with(file) &&
+                 f[file.size()] == '/');
+            if (hit) {
+                sh.map.erase(it->key);
+                it = sh.lru.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
@@ -0,0 +1,818 @@
+#include "proxy.hpp"
+#include "common.hpp"
+#include "httpdate.hpp"
+#include "timewheel.hpp"
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+#include <sys/socket.h>
+
+// Most bytes of a response head, and most of its fields.
+static constexpr size_t kMaxHead = 16 * 1024;
+static constexpr size_t kMaxFields = 64;
+
+static constexpr std::string_view kCountName[] = {
+    "fasterapi_upstream_requests_total", "fasterapi_upstream_reused_total",
+    "fasterapi_upstream_connects_total", "fasterapi_upstream_failures_total",
+    "fasterapi_upstream_timeouts_total"};
+static constexpr std::string_view kCountHelp[] = {
+    "Requests forwarded, by upstream server.",
+    "Requests sent on an idle pooled connection, by upstream server.",
+    "Connections opened, by upstream server.",
+    "Requests answered 502 or cut short, the connection failed or the "
+    "response malformed, by upstream server.",
+    "Requests answered 504 or cut short, the server too slow, by upstream "
+    "server."};
+
+static std::atomic<uint64_t> next_id{1};
+
+// Fields of a connection rather than of the message, never forwarded (RFC
+// 9110, 7.6.1), nor are those the Connection field names.
+static constexpr std::string_view kHopByHop[] = {
+    "connection", "keep-alive",          "proxy-connection",
+    "te",         "trailer",             "transfer-encoding",
+    "upgrade",    "proxy-authorization", "proxy-authenticate"};
+
+static std::string_view trim(std::string_view str) {
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) {
+        str.remove_prefix(1);
+    }
+    while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) {
+        str.remove_suffix(1);
+    }
+    return str;
+}
+
+// Whether the comma-separated `list` has `token`, in any case.
+static bool listed(std::string_view list, std::string_view token) {
+    while (!list.empty()) {
+        const size_t comma = std::min(list.find(','), list.size());
+        const std::string_view item = trim(list.substr(0, comma));
+        list.remove_prefix(std::min(comma + 1, list.size()));
+        if (iequals_ascii(item, token)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether the field `name` is not forwarded, `connection` being the value
+// of the Connection field of its message.
+static bool hop_by_hop(std::string_view name, std::string_view connection) {
+    for (const std::string_view hop : kHopByHop) {
+        if (iequals_ascii(name, hop)) {
+            return true;
+        }
+    }
+    return listed(connection, name);
+}
+
+// Our status of the code `code`, or OK if there is none.
+static HttpHdr::Status status_of(uint16_t code) {
+    for (uint8_t i = 0; i < HttpHdr::kNStatus; ++i) {
+        if (HttpHdr::kArrStatusCode[i] == code) {
+            return static_cast<HttpHdr::Status>(i);
+        }
+    }
+    return HttpHdr::Status::OK;
+}
+
+// Response head of a server, its values views into the read buffer.
+struct Head {
+    uint16_t status = 0;
+    bool http10 = false;
+    std::string_view reason;
+    size_t size = 0; // up to the empty line
+    size_t n_fields = 0;
+    std::array<std::pair<std::string_view, std::string_view>, kMaxFields>
+        fields;
+
+    bool has(std::string_view name) const {
+        return std::any_of(
+            fields.begin(), fields.begin() + n_fields,
+            [name](const auto &field) {
+                return iequals_ascii(field.first, name);
+            });
+    }
+
+    // Value of the field `name`, the first one if repeated.
+    std::string_view get(std::string_view name) const {
+        for (size_t i = 0; i < n_fields; ++i) {
+            if (iequals_ascii(fields[i].first, name)) {
+                return fields[i].second;
+            }
+        }
+        return {};
+    }
+};
+
+enum class Parsed : uint8_t { Complete = 0, Partial, Error };
+
+// Parse the response head at the front of `in`, the whole of it every call:
+// heads are small, and mostly arrive in one read. Lines may end with a bare
+// LF.
+static Parsed parse_head(std::string_view in, Head &head) {
+    head.n_fields = 0;
+    for (size_t pos = 0, i = 0;; ++i) {
+        const size_t eol = in.find('\n', pos);
+        if (eol == std::string_view::npos) {
+            return in.size() >= kMaxHead ? Parsed::Error : Parsed::Partial;
+        }
+        std::string_view line = in.substr(pos, eol - pos);
+        pos = eol + 1;
+        if (line.ends_with('\r')) {
+            line.remove_suffix(1);
+        }
+        if (i == 0) {
+            // "HTTP/1.1 200 OK", the reason phrase optional
+            if (line.size() < 12 || !line.starts_with("HTTP/1.") ||
+                line[8] != ' ' || (line.size() > 12 && line[12] != ' ')) {
+                return Parsed::Error;
+            }
+            const char *end = line.data() + 12;
+            const auto [ptr, ec] =
+                std::from_chars(line.data() + 9, end, head.status);
+            if (ec != std::errc() || ptr != end || head.status < 100) {
+                return Parsed::Error;
+            }
+            head.http10 = line[7] == '0';
+            head.reason = line.substr(std::min<size_t>(13, line.size()));
+            continue;
+        }
+        if (line.empty()) {
+            head.size = pos;
+            return pos > kMaxHead ? Parsed::Error : Parsed::Complete;
+        }
+        const size_t colon = line.find(':');
+        const std::string_view name = line.substr(0, colon);
+        if (colon == std::string_view::npos || name.empty() ||
+            name.find_first_of(" \t") != std::string_view::npos ||
+            head.n_fields == kMaxFields) {
+            return Parsed::Error;
+        }
+        head.fields[head.n_fields++] = {name, trim(line.substr(colon + 1))};
+    }
+}
+
+static void append_num(std::string &out, uint64_t value) {
+    char digits[20];
+    out.append(digits,
+               std::to_chars(digits, digits + sizeof(digits), value).ptr);
+}
+
+// An exchange with a server: the request, written on a connection of the
+// pool or a new one, then its response, relayed.
+class Proxy::Forwarder::Exchange : public HttpRsp::Relay {
+  public:
+    enum class Outcome : uint8_t {
+        Relayed = 0, // the response head is in, its body to relay
+        Failed,      // answer 502
+        TimedOut,    // answer 504
+        Aborted,     // the body of the client is malformed
+    };
+
+    Exchange(Forwarder &fwd, size_t upstream, const asio::any_io_executor &exor,
+             TimeWheel::Wheel &wheel)
+        : fwd_(fwd), upstream_(upstream), socket_(exor), wheel_(wheel),
+          buf_(std::max(fwd.opts_.buffer, kMaxHead)) {
+        timer_.fn = expire;
+        timer_.arg = this;
+        fwd_.upstreams_[upstream_]->outstanding.fetch_add(
+            1, std::memory_order_relaxed);
+    }
+
+    ~Exchange() override {
+        close();
+        fwd_.upstreams_[upstream_]->outstanding.fetch_sub(
+            1, std::memory_order_relaxed);
+    }
+
+    // Send `req`, its body read from `body`, and read the response head;
+    // frame the body for the client in `rsp`.
+    asio::awaitable<Outcome> Send(const HttpReq::Message &req,
+                                  HttpReq::BodyReader &body,
+                                  HttpRsp::Message &rsp);
+
+    asio::awaitable<std::string_view> Read() override;
+
+    bool done() const override { return done_; }
+
+  private:
+    // Framing of the response body (RFC 9112, 6.3).
+    enum class Framing : uint8_t {
+        None = 0, // no body
+        Length,   // Content-Length
+        Chunked,
+        Close, // up to the end of the connection
+    };
+
+    // The deadline passed: shut the socket down, so that the operation
+    // pending fails.
+    static void expire(void *arg) {
+        Exchange *ex = static_cast<Exchange *>(arg);
+        ex->expired_.store(true, std::memory_order_relaxed);
+        ::shutdown(ex->fd_, SHUT_RDWR);
+    }
+
+    // Open a new connection; false on failure.
+    asio::awaitable<bool> connect();
+    // Take the connection of `idle`.
+    void adopt(Idle idle);
+    // Write `bufs` whole within the deadline; false on failure.
+    template <typename Buffers>
+    asio::awaitable<bool> write(const Buffers &bufs);
+    // Read the final response head into `reply`, skipping interim ones;
+    // false if the connection failed, or the head is malformed.
+    asio::awaitable<bool> read_head(Head &reply);
+    // Build the head relayed to the client of `req` from `reply`.
+    void relay_head(const HttpReq::Message &req, const Head &reply,
+                    HttpRsp::Message &rsp);
+
+    // The body is read: return the connection to the pool if it may serve
+    // another request, or close it.
+    void finish();
+    // The body could not be read in full.
+    void fail();
+    void close();
+
+    Forwarder &fwd_;
+    const size_t upstream_;
+    asio::ip::tcp::socket socket_;
+    TimeWheel::Wheel &wheel_;
+    TimeWheel::Timer timer_;
+    // descriptor of the socket, for the deadline
+    int fd_ = -1;
+    bool v6_ = false;
+    std::atomic<bool> expired_{false};
+    // the request head, then the response is read into `buf_`
+    std::string out_;
+    std::vector<char> buf_;
+    std::string_view in_; // read, not relayed yet
+    uint64_t n_in_ = 0;   // bytes read on the connection
+    HttpReq::ChunkedDecoder decoder_;
+    uint64_t remaining_ = 0; // of a body of known length
+    Framing framing_ = Framing::None;
+    bool keep_alive_ = false;
+    bool done_ = false;
+    bool failed_ = false;
+};
+
+asio::awaitable<bool> Proxy::Forwarder::Exchange::connect() {
+    for (const asio::ip::tcp::endpoint &endpoint :
+         fwd_.upstreams_[upstream_]->endpoints) {
+        asio::error_code ec;
+        socket_.open(endpoint.protocol(), ec);
+        if (ec) {
+            co_return false;
+        }
+        fd_ = socket_.native_handle();
+        v6_ = endpoint.protocol() == asio::ip::tcp::v6();
+        wheel_.Set(timer_, fwd_.opts_.connect_timeout);
+        co_await socket_.async_connect(
+            endpoint, asio::redirect_error(asio::use_awaitable, ec));
+        wheel_.Cancel(timer_);
+        if (!ec) {
+            // the head and the body are written separately
+            socket_.set_option(asio::ip::tcp::no_delay(true), ec);
+            fwd_.local().stats[upstream_].Add(Count::Connects);
+            co_return true;
+        }
+        close();
+        if (expired_.load(std::memory_order_relaxed)) {
+            co_return false;
+        }
+    }
+    co_return false;
+}
+
+void Proxy::Forwarder::Exchange::adopt(Idle idle) {
+    asio::error_code ec;
+    socket_.assign(idle.v6 ? asio::ip::tcp::v6() : asio::ip::tcp::v4(),
+                   idle.fd.get(), ec);
+    if (!ec) {
+        fd_ = idle.fd.release();
+        v6_ = idle.v6;
+    }
+}
+
+template <typename Buffers>
+asio::awaitable<bool> Proxy::Forwarder::Exchange::write(const Buffers &bufs) {
+    asio::error_code ec;
+    wheel_.Set(timer_, fwd_.opts_.read_timeout);
+    co_await asio::async_write(socket_, bufs,
+                               asio::redirect_error(asio::use_awaitable, ec));
+    wheel_.Cancel(timer_);
+    co_return !ec;
+}
+
+// 1xx responses but 101 are interim, and dropped: the client did not ask
+// for them, as Expect is not forwarded. 101 is a protocol switch, which
+// was not asked for either.
+asio::awaitable<bool> Proxy::Forwarder::Exchange::read_head(Head &reply) {
+    size_t n = 0;
+    for (;;) {
+        const Parsed res = parse_head({buf_.data(), n}, reply);
+        if (res == Parsed::Complete && reply.status < 200 &&
+            reply.status != 101) {
+            std::copy(buf_.begin() + static_cast<ptrdiff_t>(reply.size),
+                      buf_.begin() + static_cast<ptrdiff_t>(n), buf_.begin());
+            n -= reply.size;
+            continue;
+        }
+        if (res == Parsed::Complete) {
+            in_ = {buf_.data() + reply.size, n - reply.size};
+            co_return reply.status != 101;
+        }
+        if (res == Parsed::Error || n == buf_.size()) {
+            co_return false;
+        }
+        asio::error_code ec;
+        wheel_.Set(timer_, fwd_.opts_.read_timeout);
+        const size_t n_read = co_await socket_.async_read_some(
+            asio::buffer(buf_.data() + n, buf_.size() - n),
+            asio::redirect_error(asio::use_awaitable, ec));
+        wheel_.Cancel(timer_);
+        if (ec) {
+            co_return false;
+        }
+        n += n_read;
+        n_in_ += n_read;
+    }
+}
+
+asio::awaitable<Proxy::Forwarder::Exchange::Outcome>
+Proxy::Forwarder::Exchange::Send(const HttpReq::Message &req,
+                                 HttpReq::BodyReader &body,
+                                 HttpRsp::Message &rsp) {
+    // 1. The request head: the fields of the client but those of its
+    // connection, with the framing of the body set anew. Over HTTP/2 the
+    // body is whole already.
+    const std::string_view connection =
+        req.get(HttpHdr::Field::CONNECTION);
+    const bool h2 = req.version == HttpHdr::Version::HTTP_2_0;
+    const bool chunked = req.chunked && !h2;
+    const uint64_t length = h2 ? req.body().size() : req.length;
+    out_.clear();
+    out_ += req.head.method();
+    out_ += ' ';
+    out_ += req.path();
+    out_ += " HTTP/1.1" CRLF;
+    for (size_t i = 0; i < req.head.n_fields(); ++i) {
+        const std::string_view name = req.head.name(i);
+        if (hop_by_hop(name, connection) ||
+            iequals_ascii(name, "content-length") ||
+            iequals_ascii(name, "expect") ||
+            iequals_ascii(name, "http2-settings")) {
+            continue;
+        }
+        out_ += name;
+        out_ += ": ";
+        out_ += req.head.value(i);
+        out_ += CRLF;
+    }
+    if (!req.has(HttpHdr::Field::HOST)) {
+        out_ += "Host: ";
+        out_ += fwd_.upstreams_[upstream_]->name;
+        out_ += CRLF;
+    }
+    if (chunked) {
+        out_ += "Transfer-Encoding: chunked" CRLF;
+    } else if (length > 0 || req.has(HttpHdr::Field::CONTENT_LENGTH)) {
+        out_ += "Content-Length: ";
+        append_num(out_, length);
+        out_ += CRLF;
+    }
+    out_ += CRLF;
+
+    // 2. Write it on an idle connection, or a new one, and stream the body
+    // after it; then read the response head.
+    Head reply;
+    for (bool first = true;; first = false) {
+        Idle idle;
+        bool reused = false;
+        if (first && fwd_.checkout(upstream_, fwd_.local(), idle)) {
+            adopt(std::move(idle));
+            reused = socket_.is_open();
+        }
+        if (reused) {
+            fwd_.local().stats[upstream_].Add(Count::Reused);
+        } else if (!co_await connect()) {
+            co_return expired_.load(std::memory_order_relaxed)
+                ? Outcome::TimedOut
+                : Outcome::Failed;
+        }
+        n_in_ = 0;
+        bool ok = co_await write(asio::buffer(out_));
+        // a body left unread, the server failing, closes the connection of
+        // the client
+        char size_line[24];
+        for (std::string_view piece;
+             ok && !(piece = co_await body.Read()).empty();) {
+            if (!chunked) {
+                ok = co_await write(asio::buffer(piece));
+                continue;
+            }
+            char *end = std::to_chars(size_line, size_line + 16,
+                                      piece.size(), 16)
+                            .ptr;
+            *end++ = '\r';
+            *end++ = '\n';
+            ok = co_await write(std::array<asio::const_buffer, 3>{
+                asio::buffer(size_line,
+                             static_cast<size_t>(end - size_line)),
+                asio::buffer(piece), asio::buffer(CRLF, 2)});
+        }
+        if (body.malformed()) {
+            co_return Outcome::Aborted;
+        }
+        if (ok && chunked) {
+            ok = co_await write(asio::buffer("0" CRLF2, 5));
+        }
+        if (ok && co_await read_head(reply)) {
+            break;
+        }
+        // a connection that was idle may have been closed by the server
+        // meanwhile: a request it did not answer at all is tried again, if
+        // it has no body to send again
+        const bool expired = expired_.load(std::memory_order_relaxed);
+        close();
+        if (!reused || expired || n_in_ > 0 || chunked || length > 0) {
+            co_return expired ? Outcome::TimedOut : Outcome::Failed;
+        }
+    }
+
+    // 3. Frame the body of the response.
+    const uint16_t code = reply.status;
+    const std::string_view te = reply.get("transfer-encoding");
+    if (req.method == HttpHdr::Method::HEAD || code == 204 || code == 304) {
+        framing_ = Framing::None;
+    } else if (!te.empty()) {
+        // chunked last, or the body runs to the end of the connection
+        const size_t comma = te.rfind(',');
+        framing_ = iequals_ascii(trim(comma == std::string_view::npos
+                                          ? te
+                                          : te.substr(comma + 1)),
+                                 "chunked")
+                       ? Framing::Chunked
+                       : Framing::Close;
+    } else if (reply.has("content-length")) {
+        const std::string_view cl = reply.get("content-length");
+        const auto [ptr, ec] =
+            std::from_chars(cl.data(), cl.data() + cl.size(), remaining_);
+        if (ec != std::errc() || ptr != cl.data() + cl.size()) {
+            close();
+            co_return Outcome::Failed;
+        }
+        framing_ = Framing::Length;
+    } else {
+        framing_ = Framing::Close;
+    }
+    const std::string_view conn = reply.get("connection");
+    keep_alive_ = framing_ != Framing::Close &&
+                  (reply.http10 ? listed(conn, "keep-alive")
+                                : !listed(conn, "close"));
+    relay_head(req, reply, rsp);
+    if (framing_ == Framing::None ||
+        (framing_ == Framing::Length && remaining_ == 0)) {
+        finish();
+    }
+    co_return Outcome::Relayed;
+}
+
+// The head is of HTTP/1.1, as ours are. A body of unknown length goes to
+// HTTP/1.1 clients chunked, and to HTTP/1.0 ones up to the end of their
+// connection; HTTP/2 frames it itself.
+void Proxy::Forwarder::Exchange::relay_head(const HttpReq::Message &req,
+                                            const Head &reply,
+                                            HttpRsp::Message &rsp) {
+    status = reply.status;
+    head.clear();
+    head += "HTTP/1.1 ";
+    append_num(head, status);
+    head += ' ';
+    head += reply.reason;
+    head += CRLF;
+    const std::string_view connection = reply.get("connection");
+    const bool known = framing_ == Framing::None || framing_ == Framing::Length;
+    for (size_t i = 0; i < reply.n_fields; ++i) {
+        const auto &[name, value] = reply.fields[i];
+        if (hop_by_hop(name, connection) ||
+            (!known && iequals_ascii(name, "content-length"))) {
+            continue;
+        }
+        head += name;
+        head += ": ";
+        head += value;
+        head += CRLF;
+    }
+    if (!reply.has("date")) {
+        head += HttpDate::Line();
+    }
+    chunked = !known && req.version == HttpHdr::Version::HTTP_1_1;
+    if (chunked) {
+        head += "Transfer-Encoding: chunked" CRLF;
+    } else if (!known && req.version == HttpHdr::Version::HTTP_1_0) {
+        rsp.conn = HttpHdr::Conn::CLOSE;
+    }
+}
+
+// The read from the connection is inline, as in `HttpReq::BodyReader::Read`.
+asio::awaitable<std::string_view> Proxy::Forwarder::Exchange::Read() {
+    for (;;) {
+        if (done_ || failed_) {
+            co_return std::string_view();
+        }
+
+        // 1. Return the next piece of the input, if any.
+        std::string_view out;
+        switch (framing_) {
+        case Framing::None:
+            finish();
+            continue;
+        case Framing::Length:
+            if (remaining_ == 0) {
+                finish();
+                continue;
+            }
+            if (!in_.empty()) {
+                const size_t n = static_cast<size_t>(
+                    std::min<uint64_t>(remaining_, in_.size()));
+                out = in_.substr(0, n);
+                in_.remove_prefix(n);
+                remaining_ -= n;
+                co_return out;
+            }
+            break;
+        case Framing::Chunked:
+            switch (decoder_.Decode(in_, out)) {
+            case HttpReq::ChunkedDecoder::Result::Data:
+                co_return out;
+            case HttpReq::ChunkedDecoder::Result::Done:
+                finish();
+                continue;
+            case HttpReq::ChunkedDecoder::Result::Error:
+                fail();
+                continue;
+            case HttpReq::ChunkedDecoder::Result::Partial:
+                break;
+            }
+            break;
+        case Framing::Close:
+            if (!in_.empty()) {
+                out = in_;
+                in_ = {};
+                co_return out;
+            }
+            break;
+        }
+
+        // 2. Read more; a body of known length up to its end.
+        const size_t max =
+            framing_ == Framing::Length
+                ? static_cast<size_t>(
+                      std::min<uint64_t>(buf_.size(), remaining_))
+                : buf_.size();
+        asio::error_code ec;
+        wheel_.Set(timer_, fwd_.opts_.read_timeout);
+        const size_t n = co_await socket_.async_read_some(
+            asio::buffer(buf_.data(), max),
+            asio::redirect_error(asio::use_awaitable, ec));
+        wheel_.Cancel(timer_);
+        if (ec == asio::error::eof && framing_ == Framing::Close) {
+            finish();
+        } else if (ec) {
+            fail();
+        }
+        in_ = {buf_.data(), n};
+    }
+}
+
+void Proxy::Forwarder::Exchange::finish() {
+    done_ = true;
+    if (!keep_alive_ || !in_.empty() || !socket_.is_open()) {
+        close();
+        return;
+    }
+    asio::error_code ec;
+    Idle idle{Utils::Fd(socket_.release(ec)), v6_, Metrics::Clock::now()};
+    fd_ = -1;
+    if (!ec) {
+        fwd_.checkin(upstream_, std::move(idle));
+    }
+}
+
+void Proxy::Forwarder::Exchange::fail() {
+    failed_ = true;
+    fwd_.local().stats[upstream_].Add(
+        expired_.load(std::memory_order_relaxed) ? Count::Timeouts
+                                                 : Count::Failures);
+    close();
+}
+
+void Proxy::Forwarder::Exchange::close() {
+    wheel_.Cancel(timer_);
+    asio::error_code ec;
+    socket_.close(ec);
+    fd_ = -1;
+}
+
+Proxy::Forwarder::Forwarder(const Options &opts)
+    : opts_(opts), id_(next_id.fetch_add(1, std::memory_order_relaxed)) {}
+
+Proxy::Forwarder::~Forwarder() = default;
+
+size_t Proxy::Forwarder::Add(const std::vector<std::string> &upstreams,
+                             HttpRsp::Balance balance) {
+    if (upstreams.empty()) {
+        throw std::invalid_argument("proxy route without upstream servers");
+    }
+    Route route{{}, balance};
+    for (const std::string &name : upstreams) {
+        size_t i = 0;
+        while (i < upstreams_.size() && upstreams_[i]->name != name) {
+            ++i;
+        }
+        if (i == upstreams_.size()) {
+            // "host:port", an IPv6 address in brackets
+            const size_t colon = name.rfind(':');
+            if (colon == std::string::npos || colon == 0 ||
+                colon + 1 == name.size()) {
+                throw std::invalid_argument("upstream server not host:port: " +
+                                            name);
+            }
+            std::string host = name.substr(0, colon);
+            if (host.size() > 2 && host.front() == '[' && host.back() == ']') {
+                host = host.substr(1, host.size() - 2);
+            }
+            auto up = std::make_unique<Upstream>();
+            up->name = name;
+            asio::io_context ctx;
+            asio::ip::tcp::resolver resolver(ctx);
+            for (const auto &entry :
+                 resolver.resolve(host, name.substr(colon + 1))) {
+                up->endpoints.push_back(entry.endpoint());
+            }
+            upstreams_.push_back(std::move(up));
+        }
+        route.upstreams.push_back(i);
+    }
+    routes_.push_back(std::move(route));
+    return routes_.size() - 1;
+}
+
+Proxy::Forwarder::Local &Proxy::Forwarder::attach() {
+    const std::thread::id self = std::this_thread::get_id();
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (const auto &[id, local] : locals_) {
+        if (id == self) {
+            return *local;
+        }
+    }
+    locals_.emplace_back(
+        self, std::make_unique<Local>(upstreams_.size(), routes_.size()));
+    return *locals_.back().second;
+}
+
+// Least outstanding counts the requests of all threads, and starts looking
+// where round robin is, so that ties are spread too.
+size_t Proxy::Forwarder::pick(size_t route, Local &local) {
+    const Route &r = routes_[route];
+    const size_t n = r.upstreams.size();
+    const size_t start = local.next[route]++ % n;
+    size_t best = r.upstreams[start];
+    if (r.balance == HttpRsp::Balance::RoundRobin) {
+        return best;
+    }
+    int64_t least =
+        upstreams_[best]->outstanding.load(std::memory_order_relaxed);
+    for (size_t k = 1; k < n && least > 0; ++k) {
+        const size_t i = r.upstreams[(start + k) % n];
+        const int64_t outstanding =
+            upstreams_[i]->outstanding.load(std::memory_order_relaxed);
+        if (outstanding < least) {
+            best = i;
+            least = outstanding;
+        }
+    }
+    return best;
+}
+
+// A connection is dropped if it was idle too long, when the server may be
+// about to close it, or if it is readable: the server closed it, or sent
+// what no request asked for. The stack is in the order the connections
+// were returned, so past one idle too long, all are.
+bool Proxy::Forwarder::checkout(size_t upstream, Local &local, Idle &idle) {
+    std::vector<Idle> &stack = local.idle[upstream];
+    const Metrics::Clock::time_point now = Metrics::Clock::now();
+    while (!stack.empty()) {
+        if (now - stack.back().since > opts_.idle_timeout) {
+            stack.clear();
+            return false;
+        }
+        Idle top = std::move(stack.back());
+        stack.pop_back();
+        char c;
+        if (::recv(top.fd.get(), &c, 1, MSG_PEEK | MSG_DONTWAIT) < 0 &&
+            (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            idle = std::move(top);
+            return true;
+        }
+    }
+    return false;
+}
+
+// A full stack gives up its oldest connection.
+void Proxy::Forwarder::checkin(size_t upstream, Idle idle) {
+    if (opts_.max_idle == 0) {
+        return;
+    }
+    std::vector<Idle> &stack = local().idle[upstream];
+    if (stack.size() >= opts_.max_idle) {
+        stack.erase(stack.begin());
+    }
+    stack.push_back(std::move(idle));
+}
+
+asio::awaitable<void> Proxy::Forwarder::Forward(size_t route,
+                                                const HttpReq::Message &req,
+                                                HttpReq::BodyReader &body,
+                                                HttpRsp::Message &rsp) {
+    const Metrics::Clock::time_point t0 = Metrics::Clock::now();
+    const size_t upstream = pick(route, local());
+    local().stats[upstream].Add(Count::Requests);
+    const auto ex = std::make_shared<Exchange>(
+        *this, upstream, co_await asio::this_coro::executor, body.wheel());
+    const Exchange::Outcome outcome = co_await ex->Send(req, body, rsp);
+    // the coroutine may have moved to another thread
+    Stats &stats = local().stats[upstream];
+    switch (outcome) {
+    case Exchange::Outcome::Relayed:
+        stats.latency.Record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                Metrics::Clock::now() - t0)
+                .count()));
+        rsp.code = status_of(ex->status);
+        rsp.relay = ex;
+        break;
+    case Exchange::Outcome::Failed:
+        stats.Add(Count::Failures);
+        rsp.Error(HttpHdr::Status::BadGateway);
+        break;
+    case Exchange::Outcome::TimedOut:
+        stats.Add(Count::Timeouts);
+        rsp.Error(HttpHdr::Status::GatewayTimeout);
+        break;
+    case Exchange::Outcome::Aborted:
+        break;
+    }
+}
+
+void Proxy::Forwarder::Render(std::string &out) const {
+    const size_t n = upstreams_.size();
+    if (n == 0) {
+        return;
+    }
+    std::vector<Metrics::Distribution> latency(n);
+    std::vector<std::array<uint64_t, kNCount>> counts(n);
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (const auto &[id, local] : locals_) {
+            for (size_t i = 0; i < n; ++i) {
+                latency[i].Add(local->stats[i].latency);
+                for (size_t c = 0; c < kNCount; ++c) {
+                    counts[i][c] += local->stats[i].counts[c].load(
+                        std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+
+    static constexpr std::string_view kDuration =
+        "fasterapi_upstream_duration_seconds";
+    Metrics::AppendHeader(out, kDuration, "histogram",
+                          "Time from picking an upstream server to its "
+                          "response head, by server.");
+    for (size_t i = 0; i < n; ++i) {
+        Metrics::AppendHistogram(out, kDuration, "upstream",
+                                 upstreams_[i]->name, latency[i]);
+    }
+    for (size_t c = 0; c < kNCount; ++c) {
+        Metrics::AppendHeader(out, kCountName[c], "counter", kCountHelp[c]);
+        for (size_t i = 0; i < n; ++i) {
+            Metrics::AppendSample(out, kCountName[c], "upstream",
+                                  upstreams_[i]->name, counts[i][c]);
+        }
+    }
+    static constexpr std::string_view kOutstanding =
+        "fasterapi_upstream_outstanding";
+    Metrics::AppendHeader(out, kOutstanding, "gauge",
+                          "Requests in flight, by upstream server.");
+    for (size_t i = 0; i < n; ++i) {
+        const int64_t outstanding =
+            upstreams_[i]->outstanding.load(std::memory_order_relaxed);
+        Metrics::AppendSample(out, kOutstanding, "upstream",
+                              upstreams_[i]->name,
+                              static_cast<uint64_t>(std::max<int64_t>(
+                                  outstanding, 0)));
+    }
+}
@@ -0,0 +1,106 @@
+#include "simd.hpp"
+#include "simd_impl.hpp"
+
+namespace Simd {
+
+    namespace {
+
+        // One byte per "vector": the reference implementation all the
+        // vectorized kernels must agree with.
+        struct Scalar {
+            using Vec = char;
+            static constexpr size_t kWidth = 1;
+            static constexpr unsigned kShift = 0;
+
+            static Vec load(const char *p) { return *p; }
+            static void store(char *p, Vec v) { *p = v; }
+            static uint64_t eq(Vec v, char c) { return v == c; }
+            static bool ieq(Vec a, Vec b) { return iequals_char(a, b); }
+            static Vec upper(Vec v) {
+                return is_lower(v) ? static_cast<char>(v - 0x20) : v;
+            }
+        };
+
+        // Whether the CPU supports the instruction set of `isa`.
+        bool supported(Isa isa) {
+            switch (isa) {
+            case Isa::Scalar:
+                return true;
+#if defined(__x86_64__)
+            case Isa::SSE42:
+                return __builtin_cpu_supports("sse4.2");
+            case Isa::AVX2:
+                return __builtin_cpu_supports("avx2");
+            case Isa::AVX512BW:
+                return __builtin_cpu_supports("avx512bw");
+#elif defined(__aarch64__)
+            case Isa::NEON:
+                return true; // mandatory on AArch64
+#endif
+            default:
+                return false;
+            }
+        }
+
+        const Kernels *table(Isa isa) {
+            switch (isa) {
+            case Isa::Scalar:
+                return &kScalarKernels;
+#if defined(__x86_64__)
+            case Isa::SSE42:
+                return &kSSE42Kernels;
+            case Isa::AVX2:
+                return &kAVX2Kernels;
+            case Isa::AVX512BW:
+                return &kAVX512BWKernels;
+#elif defined(__aarch64__)
+            case Isa::NEON:
+                return &kNEONKernels;
+#endif
+            default:
+                return nullptr;
+            }
+        }
+
+        // Pick the widest supported instruction set.
+        const Kernels *select() {
+            static constexpr Isa kPreferred[] = {Isa::AVX512BW, Isa::AVX2,
+                                                 Isa::SSE42, Isa::NEON};
+            for (Isa isa : kPreferred) {
+                if (const Kernels *k = kernels(isa)) {
+                    return k;
+                }
+            }
+            return &kScalarKernels;
+        }
+
+    } // namespace
+
+    const Kernels kScalarKernels = make_kernels<Scalar>(Isa::Scalar);
+
+    const Kernels &kernels() {
+        static const Kernels *const k = select();
+        return *k;
+    }
+
+    const Kernels *kernels(Isa isa) {
+        return supported(isa) ? table(isa) : nullptr;
+    }
+
+    const char *isa2str(Isa isa) {
+        switch (isa) {
+        case Isa::Scalar:
+            return "scalar";
+        case Isa::SSE42:
+            return "sse4.2";
+        case Isa::AVX2:
+            return "avx2";
+        case Isa::AVX512BW:
+            return "avx512bw";
+        case Isa::NEON:
+            return "neon";
+        }
+        return "unknown";
+    }
+
+} // namespace Simd
@@ -0,0 +1,50 @@
+// Compiled with `-mavx2`; only called when the CPU supports AVX2.
+#include "simd_impl.hpp"
+#include <immintrin.h>
+
+namespace Simd {
+
+    namespace {
+
+        struct AVX2 {
+            using Vec = __m256i;
+            static constexpr size_t kWidth = 32;
+            static constexpr unsigned kShift = 0;
+
+            static Vec load(const char *p) {
+                return _mm256_loadu_si256(reinterpret_cast<const Vec *>(p));
+            }
+            static void store(char *p, Vec v) {
+                _mm256_storeu_si256(reinterpret_cast<Vec *>(p), v);
+            }
+            static uint64_t eq(Vec v, char c) {
+                return static_cast<uint32_t>(_mm256_movemask_epi8(
+                    _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c))));
+            }
+            // 0xFF for the bytes in 'a'..'z': unsigned (v - 'a') <= 25
+            static Vec lower(Vec v) {
+                const Vec t = _mm256_sub_epi8(v, _mm256_set1_epi8('a'));
+                return _mm256_cmpeq_epi8(
+                    _mm256_min_epu8(t, _mm256_set1_epi8(25)), t);
+            }
+            // Bytes match if equal, or if they differ by the case bit only
+            // and are letters.
+            static bool ieq(Vec a, Vec b) {
+                const Vec x = _mm256_xor_si256(a, b);
+                const Vec same = _mm256_cmpeq_epi8(x, _mm256_setzero_si256());
+                const Vec fold = _mm256_and_si256(
+                    _mm256_cmpeq_epi8(x, _mm256_set1_epi8(0x20)),
+                    lower(_mm256_or_si256(a, _mm256_set1_epi8(0x20))));
+                return _mm256_movemask_epi8(_mm256_or_si256(same, fold)) == -1;
+            }
+            static Vec upper(Vec v) {
+                return _mm256_sub_epi8(
+                    v, _mm256_and_si256(lower(v), _mm256_set1_epi8(0x20)));
+            }
+        };
+
+    } // namespace
+
+    const Kernels kAVX2Kernels = make_kernels<AVX2>(Isa::AVX2);
+
+} // namespace Simd
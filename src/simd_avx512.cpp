@@ -0,0 +1,56 @@
+// Compiled with `-mavx512bw`; only called when the CPU supports AVX-512BW.
+#include "simd_impl.hpp"
+#include <immintrin.h>
+
+namespace Simd {
+
+    namespace {
+
+        struct AVX512BW {
+            using Vec = __m512i;
+            static constexpr size_t kWidth = 64;
+            static constexpr unsigned kShift = 0;
+
+            static Vec load(const char *p) { return _mm512_loadu_si512(p); }
+            static void store(char *p, Vec v) { _mm512_storeu_si512(p, v); }
+            // Masked loads and stores never touch the bytes past n, so short
+            // inputs and tails need no scalar loop.
+            static __mmask64 first(size_t n) {
+                return n >= 64 ? ~__mmask64{0} : (__mmask64{1} << n) - 1;
+            }
+            static Vec load_n(const char *p, size_t n) {
+                return _mm512_maskz_loadu_epi8(first(n), p);
+            }
+            static void store_n(char *p, Vec v, size_t n) {
+                _mm512_mask_storeu_epi8(p, first(n), v);
+            }
+            static uint64_t eq(Vec v, char c) {
+                return _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(c));
+            }
+            // Mask of the bytes in 'a'..'z': unsigned (v - 'a') <= 25
+            static __mmask64 lower(Vec v) {
+                return _mm512_cmple_epu8_mask(
+                    _mm512_sub_epi8(v, _mm512_set1_epi8('a')),
+                    _mm512_set1_epi8(25));
+            }
+            // Bytes match if equal, or if they differ by the case bit only
+            // and are letters.
+            static bool ieq(Vec a, Vec b) {
+                const Vec x = _mm512_xor_si512(a, b);
+                const __mmask64 same = _mm512_testn_epi8_mask(x, x);
+                const __mmask64 fold =
+                    _mm512_cmpeq_epi8_mask(x, _mm512_set1_epi8(0x20)) &
+                    lower(_mm512_or_si512(a, _mm512_set1_epi8(0x20)));
+                return (same | fold) == ~__mmask64{0};
+            }
+            static Vec upper(Vec v) {
+                return _mm512_mask_sub_epi8(v, lower(v), v,
+                                            _mm512_set1_epi8(0x20));
+            }
+        };
+
+    } // namespace
+
+    const Kernels kAVX512BWKernels = make_kernels<AVX512BW>(Isa::AVX512BW);
+
+} // namespace Simd
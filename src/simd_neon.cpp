@@ -0,0 +1,51 @@
+// NEON is mandatory on AArch64, so no extra compile flags are needed.
+#include "simd_impl.hpp"
+#include <arm_neon.h>
+
+namespace Simd {
+
+    namespace {
+
+        struct NEON {
+            using Vec = uint8x16_t;
+            static constexpr size_t kWidth = 16;
+            // Masks are narrowed to 4 bits per byte, see `eq`.
+            static constexpr unsigned kShift = 2;
+
+            static Vec load(const char *p) {
+                return vld1q_u8(reinterpret_cast<const uint8_t *>(p));
+            }
+            static void store(char *p, Vec v) {
+                vst1q_u8(reinterpret_cast<uint8_t *>(p), v);
+            }
+            // NEON has no movemask: shift-narrow the 0x00/0xFF comparison
+            // result into a 64-bit mask holding one nibble per byte.
+            static uint64_t eq(Vec v, char c) {
+                const Vec m = vceqq_u8(v, vdupq_n_u8(static_cast<uint8_t>(c)));
+                const uint8x8_t nibbles =
+                    vshrn_n_u16(vreinterpretq_u16_u8(m), 4);
+                return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+            }
+            // 0xFF for the bytes in 'a'..'z': unsigned (v - 'a') <= 25
+            static Vec lower(Vec v) {
+                return vcleq_u8(vsubq_u8(v, vdupq_n_u8('a')), vdupq_n_u8(25));
+            }
+            // Bytes match if equal, or if they differ by the case bit only
+            // and are letters.
+            static bool ieq(Vec a, Vec b) {
+                const Vec x = veorq_u8(a, b);
+                const Vec same = vceqq_u8(x, vdupq_n_u8(0));
+                const Vec fold = vandq_u8(vceqq_u8(x, vdupq_n_u8(0x20)),
+                                          lower(vorrq_u8(a, vdupq_n_u8(0x20))));
+                return vminvq_u8(vorrq_u8(same, fold)) == 0xFF;
+            }
+            static Vec upper(Vec v) {
+                return vsubq_u8(v, vandq_u8(lower(v), vdupq_n_u8(0x20)));
+            }
+        };
+
+    } // namespace
+
+    const Kernels kNEONKernels = make_kernels<NEON>(Isa::NEON);
+
+} // namespace Simd
@@ -0,0 +1,49 @@
+// Compiled with `-msse4.2`; only called when the CPU supports SSE4.2.
+#include "simd_impl.hpp"
+#include <immintrin.h>
+
+namespace Simd {
+
+    namespace {
+
+        struct SSE42 {
+            using Vec = __m128i;
+            static constexpr size_t kWidth = 16;
+            static constexpr unsigned kShift = 0;
+
+            static Vec load(const char *p) {
+                return _mm_loadu_si128(reinterpret_cast<const Vec *>(p));
+            }
+            static void store(char *p, Vec v) {
+                _mm_storeu_si128(reinterpret_cast<Vec *>(p), v);
+            }
+            static uint64_t eq(Vec v, char c) {
+                return static_cast<uint32_t>(
+                    _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c))));
+            }
+            // 0xFF for the bytes in 'a'..'z': unsigned (v - 'a') <= 25
+            static Vec lower(Vec v) {
+                const Vec t = _mm_sub_epi8(v, _mm_set1_epi8('a'));
+                return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(25)), t);
+            }
+            // Bytes match if equal, or if they differ by the case bit only
+            // and are letters.
+            static bool ieq(Vec a, Vec b) {
+                const Vec x = _mm_xor_si128(a, b);
+                const Vec same = _mm_cmpeq_epi8(x, _mm_setzero_si128());
+                const Vec fold =
+                    _mm_and_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(0x20)),
+                                  lower(_mm_or_si128(a, _mm_set1_epi8(0x20))));
+                return _mm_movemask_epi8(_mm_or_si128(same, fold)) == 0xFFFF;
+            }
+            static Vec upper(Vec v) {
+                return _mm_sub_epi8(
+                    v, _mm_and_si128(lower(v), _mm_set1_epi8(0x20)));
+            }
+        };
+
+    } // namespace
+
+    const Kernels kSSE42Kernels = make_kernels<SSE42>(Isa::SSE42);
+
+} // namespace Simd
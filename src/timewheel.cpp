@@ -0,0 +1,94 @@
+#include "timewheel.hpp"
+#include <algorithm>
+
+void TimeWheel::Wheel::link(Timer &timer) {
+    // a level 1 slot must not hold a timer due in more than `kNSlot1`
+    // turns of level 0, or its cascade would come too early
+    const uint64_t last = ((now_ / kNSlot0) + kNSlot1) * kNSlot0 - 1;
+    timer.expiry = std::min(timer.expiry, last);
+
+    Timer **slot = timer.expiry - now_ < kNSlot0
+                       ? &level0_[timer.expiry % kNSlot0]
+                       : &level1_[(timer.expiry / kNSlot0) % kNSlot1];
+    timer.next = *slot;
+    timer.pprev = slot;
+    if (*slot != nullptr) {
+        (*slot)->pprev = &timer.next;
+    }
+    *slot = &timer;
+}
+
+void TimeWheel::Wheel::unlink(Timer &timer) {
+    *timer.pprev = timer.next;
+    if (timer.next != nullptr) {
+        timer.next->pprev = timer.pprev;
+    }
+    timer.next = nullptr;
+    timer.pprev = nullptr;
+}
+
+void TimeWheel::Wheel::Set(Timer &timer, Clock::duration timeout) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (timer.armed()) {
+        unlink(timer);
+    } else {
+        ++size_;
+    }
+    // round up, plus the part of the current tick already gone: a deadline
+    // never fires early, and at most two ticks late
+    const auto ticks = (timeout + kTick - Clock::duration(1)) / kTick;
+    timer.expiry = now_ + 1 + static_cast<uint64_t>(ticks);
+    link(timer);
+}
+
+void TimeWheel::Wheel::Cancel(Timer &timer) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (timer.armed()) {
+        unlink(timer);
+        --size_;
+    }
+}
+
+void TimeWheel::Wheel::tick() {
+    ++now_;
+    if (now_ % kNSlot0 == 0) {
+        // level 0 wrapped: move the timers due in its next turn down
+        Timer *timer = level1_[(now_ / kNSlot0) % kNSlot1];
+        while (timer != nullptr) {
+            Timer *next = timer->next;
+            unlink(*timer);
+            link(*timer);
+            timer = next;
+        }
+    }
+    Timer *&slot = level0_[now_ % kNSlot0];
+    while (slot != nullptr) {
+        Timer &timer = *slot;
+        unlink(timer);
+        --size_;
+        timer.fn(timer.arg);
+    }
+}
+
+void TimeWheel::Wheel::Advance(Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    const uint64_t due = static_cast<uint64_t>((now - start_) / kTick);
+    // more than one tick if the thread was late
+    while (now_ < due) {
+        tick();
+    }
+}
+
+asio::awaitable<void> TimeWheel::Wheel::Run() {
+    asio::steady_timer timer(co_await asio::this_coro::executor);
+    for (;;) {
+        Advance(Clock::now());
+        timer.expires_at(start_ + (now_ + 1) * kTick);
+        asio::error_code ec;
+        co_await timer.async_wait(
+            asio::redirect_error(asio::use_awaitable, ec));
+        if (ec) {
+            co_return;
+        }
+    }
+}